@@ -6,6 +6,8 @@
 #import "AIQSession.h"
 #import "AIQSynchronization.h"
 #import "DeviceContextProvider.h"
+#import "DocumentCodec.h"
+#import "FMDatabase+Helpers.h"
 #import "FMDB.h"
 #import "common.h"
 
@@ -30,7 +32,7 @@ NSString *const AIQContextValueUserInfoKey = @"AIQContextValueUserInfoKey";
     
     self = [super init];
     if (self) {
-        _pool = [FMDatabasePool databasePoolWithPath:[session valueForKey:@"dbPath"]];
+        _pool = [FMDatabasePool documentPoolWithPath:[session valueForKey:@"dbPath"]];
         
         _standardContextProviders = [NSSet setWithObjects:[DeviceContextProvider new], [AIQLocationContextProvider new], nil];
         NSMutableDictionary *document = [self clientContextDocument:error];
@@ -202,6 +204,30 @@ NSString *const AIQContextValueUserInfoKey = @"AIQContextValueUserInfoKey";
     return YES;
 }
 
+- (NSDictionary *)snapshot:(NSError *__autoreleasing *)error {
+    if (error) {
+        *error = nil;
+    }
+    
+    NSDictionary *client = [self clientContextDocument:error];
+    if (! client) {
+        return nil;
+    }
+    
+    // values from the client context take precedence, same as in valueForName:error:
+    NSMutableDictionary *snapshot = [NSMutableDictionary dictionary];
+    NSDictionary *backend = [self backendContextDocument:nil];
+    for (NSDictionary *document in @[backend ?: @{}, client]) {
+        for (NSString *name in document) {
+            if ([name characterAtIndex:0] != '_') {
+                snapshot[name] = document[name];
+            }
+        }
+    }
+    
+    return [snapshot copy];
+}
+
 #pragma mark - Private API
 
 - (void)observeValueForKeyPath:(NSString *)keyPath
@@ -235,7 +261,7 @@ NSString *const AIQContextValueUserInfoKey = @"AIQContextValueUserInfoKey";
             fields[field] = context[field];
         }
     }
-    NSData *data = [NSJSONSerialization dataWithJSONObject:fields options:kNilOptions error:nil];
+    NSData *data = [DocumentCodec dataWithObject:fields];
     
     [_pool inDatabase:^(FMDatabase *db) {
         if (! [db executeUpdate:@"UPDATE documents SET status = ?, data = ?, rejectionReason = NULL WHERE solution = '_global' AND identifier = ?",
@@ -265,7 +291,7 @@ NSString *const AIQContextValueUserInfoKey = @"AIQContextValueUserInfoKey";
         }
         
         if ([rs next]) {
-            document = [NSJSONSerialization JSONObjectWithData:[rs dataForColumnIndex:0] options:NSJSONReadingMutableContainers error:nil];
+            document = [DocumentCodec objectWithData:[rs dataForColumnIndex:0] mutable:YES];
             document[kAIQDocumentId] = [rs stringForColumnIndex:1];
         } else {
             NSString *identifier = [[NSUUID UUID] UUIDString];
@@ -276,7 +302,7 @@ NSString *const AIQContextValueUserInfoKey = @"AIQContextValueUserInfoKey";
                     document[[contextProvider valueForKey:@"name"]] = value;
                 }
             }
-            NSData *data = [NSJSONSerialization dataWithJSONObject:document options:kNilOptions error:nil];
+            NSData *data = [DocumentCodec dataWithObject:document];
             
             if (! [db executeUpdate:@"INSERT INTO documents (solution, identifier, type, status, data) VALUES (?, ?, ?, ?, ?)",
                    @"_global", identifier, @"_clientcontext", @(AIQSynchronizationStatusCreated), data]) {
@@ -306,7 +332,7 @@ NSString *const AIQContextValueUserInfoKey = @"AIQContextValueUserInfoKey";
         }
         
         if ([rs next]) {
-            document = [NSJSONSerialization JSONObjectWithData:[rs dataForColumnIndex:1] options:NSJSONReadingMutableContainers error:nil];
+            document = [DocumentCodec objectWithData:[rs dataForColumnIndex:1] mutable:YES];
             document[kAIQDocumentId] = [rs stringForColumnIndex:0];
         }
         
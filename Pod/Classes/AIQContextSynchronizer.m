@@ -1,6 +1,8 @@
 #import "AIQContext.h"
 #import "AIQContextSynchronizer.h"
 #import "AIQSession.h"
+#import "DocumentCodec.h"
+#import "FMDatabase+Helpers.h"
 #import "FMDB.h"
 #import "common.h"
 
@@ -15,7 +17,7 @@
 - (instancetype)initForSession:(AIQSession *)session {
     self = [super init];
     if (self) {
-        _pool = [FMDatabasePool databasePoolWithPath:[session valueForKey:@"dbPath"]];
+        _pool = [FMDatabasePool documentPoolWithPath:[session valueForKey:@"dbPath"]];
     }
     return self;
 }
@@ -28,7 +30,7 @@
         }
         
         if ([rs next]) {
-            NSDictionary *context = [NSJSONSerialization JSONObjectWithData:[rs dataForColumnIndex:0] options:kNilOptions error:nil];
+            NSDictionary *context = [DocumentCodec objectWithData:[rs dataForColumnIndex:0] mutable:NO];
             for (NSString *key in context) {
                 NOTIFY(AIQDidChangeContextValue, self, (@{AIQContextNameUserInfoKey: key, AIQContextValueUserInfoKey: context[key]}));
             }
@@ -46,7 +48,7 @@
         }
         
         if ([rs next]) {
-            NSDictionary *context = [NSJSONSerialization JSONObjectWithData:[rs dataForColumnIndex:0] options:kNilOptions error:nil];
+            NSDictionary *context = [DocumentCodec objectWithData:[rs dataForColumnIndex:0] mutable:NO];
             for (NSString *key in context) {
                 NOTIFY(AIQDidChangeContextValue, self, (@{AIQContextNameUserInfoKey: key, AIQContextValueUserInfoKey: context[key]}));
             }
@@ -15,9 +15,11 @@
 #import <AIQCoreLib/AIQDirectCall.h>
 #import <AIQCoreLib/AIQError.h>
 #import <AIQCoreLib/AIQLaunchableStore.h>
+#import <AIQCoreLib/AIQLiveQuery.h>
 #import <AIQCoreLib/AIQLocalStorage.h>
 #import <AIQCoreLib/AIQLog.h>
 #import <AIQCoreLib/AIQMessaging.h>
+#import <AIQCoreLib/AIQPredicate.h>
 #import <AIQCoreLib/AIQScheduler.h>
 #import <AIQCoreLib/AIQSession.h>
 #import <AIQCoreLib/AIQSynchronization.h>
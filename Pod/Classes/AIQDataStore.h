@@ -13,6 +13,8 @@
  */
 
 @class AIQDataStore;
+@class AIQLiveQuery;
+@class AIQPredicate;
 @class AIQSession;
 
 /**
@@ -183,6 +185,26 @@ EXTERN_API(NSString *) const kAIQDocumentStatus;
  */
 EXTERN_API(NSString *) const kAIQDocumentRejectionReason;
 
+/** Search result key for match rank.
+ 
+ This key is used to store the relevance of a search result as a positive number. The higher the number, the better
+ the document matches the search text.
+ 
+ @since 1.6.0
+ @see searchDocumentsOfType:forText:limit:error:
+ */
+EXTERN_API(NSString *) const kAIQSearchResultRank;
+
+/** Search result key for match snippet.
+ 
+ This key is used to store a fragment of the indexed field which matches the search text best, with the matching
+ terms enclosed in &lt;b&gt; and &lt;/b&gt; tags. The key is missing if none of the indexed fields is defined.
+ 
+ @since 1.6.0
+ @see searchDocumentsOfType:forText:limit:error:
+ */
+EXTERN_API(NSString *) const kAIQSearchResultSnippet;
+
 /** User info key for attachment name.
  
  This key is used to store a name of an attachment. It can be used to retrieve the attachment from the
@@ -244,6 +266,46 @@ EXTERN_API(NSString *) const kAIQAttachmentState;
  */
 EXTERN_API(NSString *) const kAIQAttachmentRejectionReason;
 
+/** Documents changed event name.
+ 
+ This is the name of the event generated by NSNotificationCenter once after a bulk write performed by AIQDataStore or
+ AIQLocalStorage module. The user info contains the solution and identifiers of created, updated and deleted
+ documents. The object of the notification is the module which performed the write.
+ 
+ @since 1.6.0
+ @see AIQCreatedDocumentIdsUserInfoKey
+ @see AIQUpdatedDocumentIdsUserInfoKey
+ @see AIQDeletedDocumentIdsUserInfoKey
+ */
+EXTERN_API(NSString *) const AIQDidChangeDocumentsNotification;
+
+/** User info key for identifiers of created documents.
+ 
+ This key is used to store an array of identifiers of documents created by a bulk write.
+ 
+ @since 1.6.0
+ @see AIQDidChangeDocumentsNotification
+ */
+EXTERN_API(NSString *) const AIQCreatedDocumentIdsUserInfoKey;
+
+/** User info key for identifiers of updated documents.
+ 
+ This key is used to store an array of identifiers of documents updated by a bulk write.
+ 
+ @since 1.6.0
+ @see AIQDidChangeDocumentsNotification
+ */
+EXTERN_API(NSString *) const AIQUpdatedDocumentIdsUserInfoKey;
+
+/** User info key for identifiers of deleted documents.
+ 
+ This key is used to store an array of identifiers of documents deleted by a bulk write.
+ 
+ @since 1.6.0
+ @see AIQDidChangeDocumentsNotification
+ */
+EXTERN_API(NSString *) const AIQDeletedDocumentIdsUserInfoKey;
+
 /** AIQDataStore module.
  
  AIQDataStore module can be used to access documents synchronized by the AIQSynchronization part.
@@ -281,6 +343,22 @@ EXTERN_API(NSString *) const kAIQAttachmentRejectionReason;
  */
 - (NSDictionary *)documentForId:(NSString *)identifier error:(NSError **)error;
 
+/** Returns selected fields of a document for given identifier.
+ 
+ This method can be used to retrieve only some of the fields of a document, without decoding the whole document.
+ System fields are always included in the result. Fields which are not defined in the document, or which are null,
+ are omitted.
+ 
+ @param identifier Identifier of a document to retrieve. Must not be nil and must exist.
+ @param fields Array of field names to retrieve. Nested fields can be specified by separating the path components with
+ a dot. May be nil, in which case all fields are retrieved.
+ @param error If defined, will store an error in case of any failures. May be nil.
+ @return Document for given identifier containing the requested fields or nil if the document could not be found or if
+ retrieving failed, in which case the error parameter will contain the reason of failure.
+ @since 1.6.0
+ */
+- (NSDictionary *)documentForId:(NSString *)identifier fields:(NSArray *)fields error:(NSError **)error;
+
 - (BOOL)documentTypes:(void (^)(NSString *, NSError **))processor error:(NSError **)error;
 
 /** Processes documents of given type with given owner.
@@ -300,6 +378,53 @@ EXTERN_API(NSString *) const kAIQAttachmentRejectionReason;
               processor:(void (^)(NSDictionary *, NSError **))processor
                   error:(NSError **)error;
 
+/** Processes documents of given type matching given predicate.
+ 
+ This method can be used to retrieve a list of documents identified by given document type and matching given
+ predicate. The predicate is evaluated by the storage itself, so documents which do not match it are never decoded.
+ 
+ @param type Type of business documents to retrieve. Must not be nil.
+ @param predicate Predicate which documents must match. May be nil, in which case all documents of given type are
+ processed.
+ @param processor Processor to be applied to raw business documents before adding to the result array. If the
+ processor sets an error passed as its argument, the whole call will fail with given error. Must not be nil.
+ @param error If defined, will store an error in case of any failures. May be nil.
+ @return YES if the processing finished successfully, NO otherwise, in which case the error parameter will contain the
+ reason of failure.
+ @since 1.6.0
+ @see AIQPredicate
+ @see createIndexForField:ofDocumentsOfType:error:
+ */
+- (BOOL)documentsOfType:(NSString *)type
+               matching:(AIQPredicate *)predicate
+              processor:(void (^)(NSDictionary *, NSError **))processor
+                  error:(NSError **)error;
+
+/** Processes selected fields of documents of given type matching given predicate.
+ 
+ This method works like documentsOfType:matching:processor:error: but passes only the requested fields to the
+ processor. The fields are extracted by the storage itself, so the rest of the document is never decoded. System
+ fields are always included. Fields which are not defined in the document, or which are null, are omitted.
+ 
+ @param type Type of business documents to retrieve. Must not be nil.
+ @param predicate Predicate which documents must match. May be nil, in which case all documents of given type are
+ processed.
+ @param fields Array of field names to retrieve. Nested fields can be specified by separating the path components with
+ a dot. May be nil, in which case all fields are retrieved.
+ @param processor Processor to be applied to raw business documents before adding to the result array. If the
+ processor sets an error passed as its argument, the whole call will fail with given error. Must not be nil.
+ @param error If defined, will store an error in case of any failures. May be nil.
+ @return YES if the processing finished successfully, NO otherwise, in which case the error parameter will contain the
+ reason of failure.
+ @since 1.6.0
+ @see AIQPredicate
+ */
+- (BOOL)documentsOfType:(NSString *)type
+               matching:(AIQPredicate *)predicate
+                 fields:(NSArray *)fields
+              processor:(void (^)(NSDictionary *, NSError **))processor
+                  error:(NSError **)error;
+
 /** Creates a new document of given type with given fields.
  
  This method can be used to create a new document of given type and containing given fields.
@@ -345,6 +470,165 @@ EXTERN_API(NSString *) const kAIQAttachmentRejectionReason;
  */
 - (BOOL)deleteDocumentWithId:(NSString *)identifier error:(NSError **)error;
 
+/** Creates new documents of given type with given fields.
+ 
+ This method can be used to create many documents of given type in one transaction. Documents which could not be
+ created are reported individually and do not affect the remaining ones. AIQDidChangeDocumentsNotification is posted
+ once for all created documents.
+ 
+ @param type Type of documents to create. Must not be nil.
+ @param fields Array of dictionaries containing fields to define for the new documents. Must not be nil.
+ @param error If defined, will store an error in case of any failures. May be nil.
+ @return Array containing, for every element of the fields array and in the same order, either the newly created
+ document or an NSError describing why it could not be created. Nil if the whole operation failed, in which case the
+ error parameter will contain the reason of failure.
+ @since 1.6.0
+ 
+ @warning If the field dictionaries contain any of the system fields, these fields will be filtered out.
+ */
+- (NSArray *)createDocumentsOfType:(NSString *)type withFields:(NSArray *)fields error:(NSError **)error;
+
+/** Updates fields of many documents.
+ 
+ This method can be used to update many documents in one transaction. Every element of the documents array must contain
+ the document identifier stored under the kAIQDocumentId key, along with the new fields of the document. Documents
+ which could not be updated are reported individually and do not affect the remaining ones.
+ AIQDidChangeDocumentsNotification is posted once for all updated documents.
+ 
+ @param documents Array of dictionaries containing document identifiers and new fields. Must not be nil.
+ @param error If defined, will store an error in case of any failures. May be nil.
+ @return Array containing, for every element of the documents array and in the same order, either the updated
+ document or an NSError describing why it could not be updated. Nil if the whole operation failed, in which case the
+ error parameter will contain the reason of failure.
+ @since 1.6.0
+ 
+ @warning Updated documents will only contain fields defined in the new field dictionaries, see
+ updateFields:forDocumentWithId:error:.
+ */
+- (NSArray *)updateDocuments:(NSArray *)documents error:(NSError **)error;
+
+/** Deletes documents identified by given identifiers.
+ 
+ This method can be used to delete many documents in one transaction. Identifiers of documents which do not exist or
+ could not be deleted are reported individually without affecting the other documents, an identifier given more than
+ once is deleted once. AIQDidChangeDocumentsNotification is posted once for all deleted documents.
+ 
+ @param identifiers Array of identifiers of documents to delete. Must not be nil.
+ @param error If defined, will store an error in case of any failures. May be nil.
+ @return Array containing, for every element of the identifiers array and in the same order, either @YES if the
+ document has been deleted or an NSError describing why it could not be deleted. Nil if the whole operation failed, in
+ which case none of the documents has been deleted and the error parameter will contain the reason of failure.
+ @since 1.6.0
+ */
+- (NSArray *)deleteDocumentsWithIds:(NSArray *)identifiers error:(NSError **)error;
+
+/**---------------------------------------------------------------------------------------
+ * @name Live queries
+ * ---------------------------------------------------------------------------------------
+ */
+
+/** Creates a live query over documents of given type.
+ 
+ This method can be used to keep a sorted list of documents up to date without querying the whole list again every
+ time a document changes. The handler is first called with the initial result set and then with the documents which
+ have been inserted into, updated in or removed from the result set by local changes or by the synchronization.
+ 
+ @param type Type of business documents to observe. Must not be nil.
+ @param predicate Predicate which documents must match. May be nil, in which case all documents of given type are
+ observed.
+ @param sortDescriptors Array of NSSortDescriptor instances applied to document fields. May be nil, in which case
+ documents are sorted by their identifiers.
+ @param handler Handler called on the session callback queue whenever the result set changes. Must not be nil.
+ @param error If defined, will store an error in case of any failures. May be nil.
+ @return Live query or nil if the query could not be created, in which case the error parameter will contain the
+ reason of failure. The query stays active until it is invalidated or the session is closed.
+ @since 1.6.0
+ @see AIQLiveQuery
+ */
+- (AIQLiveQuery *)liveQueryForDocumentsOfType:(NSString *)type
+                                     matching:(AIQPredicate *)predicate
+                              sortDescriptors:(NSArray *)sortDescriptors
+                                      handler:(void (^)(AIQLiveQuery *query, NSArray *inserted, NSArray *updated, NSArray *removed))handler
+                                        error:(NSError **)error;
+
+/**---------------------------------------------------------------------------------------
+ * @name Index management
+ * ---------------------------------------------------------------------------------------
+ */
+
+/** Declares an index on given field for documents of given type.
+ 
+ This method can be used to speed up documentsOfType:matching:processor:error: calls which filter documents of given
+ type by given field. Declaring an index which already exists has no effect. Indexes are persistent, have to be
+ declared only once and cover the documents of the solution this store belongs to.
+ 
+ @param field Name of the field to index. Must not be nil and must not be a system field.
+ @param type Type of documents for which to index the field. Must not be nil.
+ @param error If defined, will store an error in case of any failures. May be nil.
+ @return YES if the index has been declared, NO otherwise, in which case the error parameter will contain the reason of
+ failure.
+ @since 1.6.0
+ */
+- (BOOL)createIndexForField:(NSString *)field ofDocumentsOfType:(NSString *)type error:(NSError **)error;
+
+/** Removes an index on given field for documents of given type.
+ 
+ This method can be used to remove an index declared with createIndexForField:ofDocumentsOfType:error:. Removing an
+ index which does not exist has no effect. Indexes declared for the same field and type by other solutions are kept.
+ 
+ @param field Name of the indexed field. Must not be nil.
+ @param type Type of documents for which the field has been indexed. Must not be nil.
+ @param error If defined, will store an error in case of any failures. May be nil.
+ @return YES if the index has been removed, NO otherwise, in which case the error parameter will contain the reason of
+ failure.
+ @since 1.6.0
+ */
+- (BOOL)dropIndexForField:(NSString *)field ofDocumentsOfType:(NSString *)type error:(NSError **)error;
+
+/** Declares a full-text search index on given fields for documents of given type.
+ 
+ This method can be used to make documents of given type searchable with searchDocumentsOfType:forText:limit:error:.
+ The index is built from the documents already stored and is maintained by the storage itself on every change made
+ locally or by the synchronization. Declaring an index on the same fields again has no effect, declaring it on other
+ fields rebuilds the index.
+ 
+ @param fields Array of names of the fields to index. Must not be nil or empty and must not contain system fields.
+ @param type Type of documents for which to index the fields. Must not be nil.
+ @param error If defined, will store an error in case of any failures. May be nil.
+ @return YES if the index has been declared, NO otherwise, in which case the error parameter will contain the reason of
+ failure.
+ @since 1.6.0
+ */
+- (BOOL)createSearchIndexForFields:(NSArray *)fields ofDocumentsOfType:(NSString *)type error:(NSError **)error;
+
+/** Removes a full-text search index for documents of given type.
+ 
+ @param type Type of documents for which the search index has been declared. Must not be nil.
+ @param error If defined, will store an error in case of any failures. May be nil.
+ @return YES if the index has been removed or did not exist, NO otherwise, in which case the error parameter will
+ contain the reason of failure.
+ @since 1.6.0
+ */
+- (BOOL)dropSearchIndexForDocumentsOfType:(NSString *)type error:(NSError **)error;
+
+/** Searches documents of given type for given text.
+ 
+ This method can be used to search documents for which a search index has been declared with
+ createSearchIndexForFields:ofDocumentsOfType:error:. Documents are not decoded, only their identifiers are returned.
+ 
+ @param type Type of documents to search. Must not be nil and must have a search index declared.
+ @param text Text to search for. Must not be nil. Documents matching all words are returned, a word ending with an
+ asterisk matches any word starting with it, e.g. "pum*". Query operators are not interpreted.
+ @param limit Maximum number of results to return, 0 for no limit.
+ @param error If defined, will store an error in case of any failures. May be nil.
+ @return Array of search results, best matches first, or nil if searching failed, in which case the error parameter
+ will contain the reason of failure. Every result is a dictionary containing the document identifier stored under the
+ kAIQDocumentId key, the rank stored under the kAIQSearchResultRank key and the snippet stored under the
+ kAIQSearchResultSnippet key.
+ @since 1.6.0
+ */
+- (NSArray *)searchDocumentsOfType:(NSString *)type forText:(NSString *)text limit:(NSUInteger)limit error:(NSError **)error;
+
 /**---------------------------------------------------------------------------------------
  * @name Attachment management
  * ---------------------------------------------------------------------------------------
@@ -458,7 +742,8 @@ EXTERN_API(NSString *) const kAIQAttachmentRejectionReason;
 
 /** Retrieves the data for given resource identifier.
  
- This method can be used to retrieve the data for given resource identifier.
+ This method can be used to retrieve the data for given resource identifier. Large attachments are memory mapped
+ rather than read into memory.
  
  @param name Name of the attachment for which to return the data. Must not be nil and must exist in the data store.
  @param identifier Document identifier for which to return the data. Must not be nil and must exist in the data store.
@@ -469,6 +754,41 @@ EXTERN_API(NSString *) const kAIQAttachmentRejectionReason;
  */
 - (NSData *)dataForAttachmentWithName:(NSString *)name fromDocumentWithId:(NSString *)identifier error:(NSError **)error;
 
+/** Opens a stream for the data of given attachment.
+ 
+ This method can be used to read large attachments without loading them into memory at once. The returned stream
+ is not opened, it is up to the caller to open and close it.
+ 
+ @param name Name of the attachment for which to return the stream. Must not be nil and must exist in the data store.
+ @param identifier Document identifier for which to return the stream. Must not be nil and must exist in the data store.
+ @param error If defined, will store an error in case of any failures. May be nil.
+ @return Input stream for given attachment or nil if the data does not exist or if retrieving failed, in which case
+ the error parameter will contain the reason of failure.
+ @since 1.6.0
+ */
+- (NSInputStream *)streamForAttachmentWithName:(NSString *)name fromDocumentWithId:(NSString *)identifier error:(NSError **)error;
+
+/** Retrieves the data for given attachment in chunks.
+ 
+ This method can be used to read large attachments without loading them into memory at once. Given processor is
+ called synchronously for every chunk, in order.
+ 
+ @param name Name of the attachment for which to return the data. Must not be nil and must exist in the data store.
+ @param identifier Document identifier for which to return the data. Must not be nil and must exist in the data store.
+ @param chunkSize Maximum size of a single chunk, in bytes. Must be greater than zero.
+ @param processor Processor block called for every chunk. Must not be nil. The processor may stop reading by
+ setting the error parameter.
+ @param error If defined, will store an error in case of any failures. May be nil.
+ @return YES if all chunks were processed, NO otherwise, in which case the error parameter will contain the reason
+ of failure.
+ @since 1.6.0
+ */
+- (BOOL)dataForAttachmentWithName:(NSString *)name
+               fromDocumentWithId:(NSString *)identifier
+                        chunkSize:(NSUInteger)chunkSize
+                        processor:(void (^)(NSData *data, NSError **error))processor
+                            error:(NSError **)error;
+
 /** Retrieves the data for given file path.
 
  This method can be used to retrieve the data for the given file path.
@@ -483,6 +803,131 @@ EXTERN_API(NSString *) const kAIQAttachmentRejectionReason;
 
 - (void)close;
 
+/**---------------------------------------------------------------------------------------
+ * @name Asynchronous access
+ * ---------------------------------------------------------------------------------------
+ */
+
+/** Asynchronously retrieves a document for given identifier.
+ 
+ The document is retrieved on a background queue and passed to the completion block on the session callback queue.
+ 
+ @param identifier Identifier of the document to retrieve. Must not be nil.
+ @param completion Block called with the document or with the reason of failure. May be nil.
+ @since 1.6.0
+ @see documentForId:error:
+ */
+- (void)documentForId:(NSString *)identifier completion:(void (^)(NSDictionary *document, NSError *error))completion;
+
+/** Asynchronously retrieves selected fields of a document for given identifier.
+ 
+ The fields are retrieved on a background queue and passed to the completion block on the session callback queue.
+ 
+ @param identifier Identifier of the document to retrieve. Must not be nil.
+ @param fields Array of field names to retrieve. May be nil, in which case all fields are retrieved.
+ @param completion Block called with the document or with the reason of failure. May be nil.
+ @since 1.6.0
+ @see documentForId:fields:error:
+ */
+- (void)documentForId:(NSString *)identifier fields:(NSArray *)fields completion:(void (^)(NSDictionary *document, NSError *error))completion;
+
+/** Asynchronously retrieves documents of given type matching given predicate.
+ 
+ The documents are retrieved on a background queue and passed to the completion block on the session callback queue.
+ 
+ @param type Type of business documents to retrieve. Must not be nil.
+ @param predicate Predicate which documents must match. May be nil.
+ @param fields Array of field names to retrieve. May be nil, in which case all fields are retrieved.
+ @param completion Block called with an array of documents or with the reason of failure. May be nil.
+ @since 1.6.0
+ @see documentsOfType:matching:fields:processor:error:
+ */
+- (void)documentsOfType:(NSString *)type
+               matching:(AIQPredicate *)predicate
+                 fields:(NSArray *)fields
+             completion:(void (^)(NSArray *documents, NSError *error))completion;
+
+/** Asynchronously creates a new document of given type with given fields.
+ 
+ The document is created on the session write queue and passed to the completion block on the session callback queue.
+ 
+ @param type Type of a document to create. Must not be nil.
+ @param fields Dictionary containing fields to define for the new document. Must not be nil.
+ @param completion Block called with the created document or with the reason of failure. May be nil.
+ @since 1.6.0
+ @see createDocumentOfType:withFields:error:
+ */
+- (void)createDocumentOfType:(NSString *)type withFields:(NSDictionary *)fields completion:(void (^)(NSDictionary *document, NSError *error))completion;
+
+/** Asynchronously updates fields of a document with given identifier.
+ 
+ The document is updated on the session write queue and passed to the completion block on the session callback queue.
+ 
+ @param fields Dictionary containing fields to update. Must not be nil.
+ @param identifier Identifier of the document to update. Must not be nil.
+ @param completion Block called with the updated document or with the reason of failure. May be nil.
+ @since 1.6.0
+ @see updateFields:forDocumentWithId:error:
+ */
+- (void)updateFields:(NSDictionary *)fields forDocumentWithId:(NSString *)identifier completion:(void (^)(NSDictionary *document, NSError *error))completion;
+
+/** Asynchronously deletes a document with given identifier.
+ 
+ The document is deleted on the session write queue and the completion block is called on the session callback queue.
+ 
+ @param identifier Identifier of the document to delete. Must not be nil.
+ @param completion Block called with nil or with the reason of failure. May be nil.
+ @since 1.6.0
+ @see deleteDocumentWithId:error:
+ */
+- (void)deleteDocumentWithId:(NSString *)identifier completion:(void (^)(NSError *error))completion;
+
+/** Asynchronously creates documents of given type.
+ 
+ The documents are created on the session write queue and the results are passed to the completion block on the session callback queue.
+ 
+ @param type Type of documents to create. Must not be nil.
+ @param fields Array of field dictionaries, one for every document to create. Must not be nil.
+ @param completion Block called with an array of per document results or with the reason of failure. May be nil.
+ @since 1.6.0
+ @see createDocumentsOfType:withFields:error:
+ */
+- (void)createDocumentsOfType:(NSString *)type withFields:(NSArray *)fields completion:(void (^)(NSArray *results, NSError *error))completion;
+
+/** Asynchronously updates given documents.
+ 
+ The documents are updated on the session write queue and the results are passed to the completion block on the session callback queue.
+ 
+ @param documents Array of documents to update. Must not be nil.
+ @param completion Block called with an array of per document results or with the reason of failure. May be nil.
+ @since 1.6.0
+ @see updateDocuments:error:
+ */
+- (void)updateDocuments:(NSArray *)documents completion:(void (^)(NSArray *results, NSError *error))completion;
+
+/** Asynchronously deletes documents with given identifiers.
+ 
+ The documents are deleted on the session write queue and the results are passed to the completion block on the session callback queue.
+ 
+ @param identifiers Array of identifiers of documents to delete. Must not be nil.
+ @param completion Block called with an array of per document results or with the reason of failure. May be nil.
+ @since 1.6.0
+ @see deleteDocumentsWithIds:error:
+ */
+- (void)deleteDocumentsWithIds:(NSArray *)identifiers completion:(void (^)(NSArray *results, NSError *error))completion;
+
+/** Asynchronously retrieves the data for given attachment.
+ 
+ The data is retrieved on a background queue and passed to the completion block on the session callback queue.
+ 
+ @param name Name of the attachment for which to return the data. Must not be nil.
+ @param identifier Document identifier for which to return the data. Must not be nil.
+ @param completion Block called with the data or with the reason of failure. May be nil.
+ @since 1.6.0
+ @see dataForAttachmentWithName:fromDocumentWithId:error:
+ */
+- (void)dataForAttachmentWithName:(NSString *)name fromDocumentWithId:(NSString *)identifier completion:(void (^)(NSData *data, NSError *error))completion;
+
 @end
 
 #endif /* AIQCoreLib_AIQDataStore_h */
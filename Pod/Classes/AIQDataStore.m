@@ -3,8 +3,18 @@
 
 #import "AIQDataStore.h"
 #import "AIQError.h"
-#import "AIQJSON.h"
+#import "AIQLiveQuery.h"
+#import "AIQPredicate.h"
 #import "AIQSession.h"
+#import "AIQSynchronization.h"
+#import "Dispatcher.h"
+#import "DocumentCache.h"
+#import "DocumentCodec.h"
+#import "FMDatabase+Helpers.h"
+#import "LiveQueryCenter.h"
+#import "NSFileManager+Helpers.h"
+#import "SearchIndex.h"
+#import "common.h"
 
 
 NSString *const kAIQDocumentId = @"_id";
@@ -14,6 +24,9 @@ NSString *const kAIQDocumentLaunchableId = @"_launchable";
 NSString *const kAIQDocumentStatus = @"_status";
 NSString *const kAIQDocumentRejectionReason = @"_reason";
 
+NSString *const kAIQSearchResultRank = @"rank";
+NSString *const kAIQSearchResultSnippet = @"snippet";
+
 NSString *const kAIQAttachmentName = @"name";
 NSString *const kAIQAttachmentContentType = @"contentType";
 NSString *const kAIQAttachmentRevision = @"_rev";
@@ -21,11 +34,44 @@ NSString *const kAIQAttachmentStatus = @"status";
 NSString *const kAIQAttachmentState = @"state";
 NSString *const kAIQAttachmentRejectionReason = @"reason";
 
+NSString *const AIQDidChangeDocumentsNotification = @"AIQDidChangeDocumentsNotification";
+NSString *const AIQCreatedDocumentIdsUserInfoKey = @"AIQCreatedDocumentIdsUserInfoKey";
+NSString *const AIQUpdatedDocumentIdsUserInfoKey = @"AIQUpdatedDocumentIdsUserInfoKey";
+NSString *const AIQDeletedDocumentIdsUserInfoKey = @"AIQDeletedDocumentIdsUserInfoKey";
+
+@interface AIQPredicate ()
+
++ (NSString *)expressionForField:(NSString *)field column:(NSString *)column error:(NSError **)error;
++ (NSString *)projectionForFields:(NSArray *)fields column:(NSString *)column error:(NSError **)error;
++ (NSMutableDictionary *)dictionaryFromProjection:(NSData *)projection fields:(NSArray *)fields;
++ (NSString *)literalForString:(NSString *)string;
++ (NSString *)identifierForString:(NSString *)string;
+- (NSString *)SQLForColumn:(NSString *)column arguments:(NSMutableArray *)arguments error:(NSError **)error;
+
+@end
+
+@interface AIQLiveQuery ()
+
+- (instancetype)initWithDataStore:(AIQDataStore *)dataStore
+                         solution:(NSString *)solution
+                             type:(NSString *)type
+                        predicate:(AIQPredicate *)predicate
+                  sortDescriptors:(NSArray *)sortDescriptors
+                          handler:(AIQLiveQueryHandler)handler
+                           center:(LiveQueryCenter *)center
+                       dispatcher:(Dispatcher *)dispatcher;
+- (void)start;
+
+@end
+
 @interface AIQDataStore () {
     NSFileManager *_fileManager;
     NSString *_basePath;
     FMDatabasePool *_pool;
     NSString *_solution;
+    DocumentCache *_cache;
+    Dispatcher *_dispatcher;
+    LiveQueryCenter *_liveQueries;
 }
 
 @end
@@ -62,8 +108,11 @@ NSString *const kAIQAttachmentRejectionReason = @"reason";
     if (self) {
         _basePath = [[session valueForKey:@"basePath"] stringByAppendingPathComponent:solution];
         _solution = solution;
-        _pool = [FMDatabasePool databasePoolWithPath:[session valueForKey:@"dbPath"]];
+        _pool = [FMDatabasePool documentPoolWithPath:[session valueForKey:@"dbPath"]];
         _fileManager = [NSFileManager new];
+        _dispatcher = [session valueForKey:@"dispatcher"];
+        _liveQueries = [session valueForKey:@"liveQueryCenter"];
+        _cache = [session valueForKey:@"documentCache"];
     }
     
     return self;
@@ -89,6 +138,10 @@ NSString *const kAIQAttachmentRejectionReason = @"reason";
 }
 
 - (NSDictionary *)documentForId:(NSString *)identifier error:(NSError *__autoreleasing *)error {
+    return [self documentForId:identifier fields:nil error:error];
+}
+
+- (NSDictionary *)documentForId:(NSString *)identifier fields:(NSArray *)fields error:(NSError *__autoreleasing *)error {
     if (error) {
         *error = nil;
     }
@@ -100,15 +153,42 @@ NSString *const kAIQAttachmentRejectionReason = @"reason";
         return nil;
     }
     
+    // with the cache enabled the data is read separately, only if the cached copy is stale
+    BOOL cached = ((! fields) && (_cache.capacity != 0));
+    NSString *projection = cached ? @"NULL" : @"data";
+    if (fields) {
+        projection = [AIQPredicate projectionForFields:fields column:@"data" error:error];
+        if (! projection) {
+            return nil;
+        }
+    }
+    
+    NSString *query = [NSString stringWithFormat:@"SELECT type, status, rejectionReason, %@, revision, launchable FROM documents "
+                       "WHERE solution = ? AND identifier = ? AND status != ?",
+                       projection];
+    
     __block NSDictionary *result = nil;
     
     [_pool inDatabase:^(FMDatabase *db) {
-        FMResultSet *rs = [db executeQuery:@"SELECT type, status, rejectionReason, data, revision, launchable FROM documents "
-                           "WHERE solution = ? AND identifier = ? AND status != ?",
-                           _solution, identifier, @(AIQSynchronizationStatusDeleted)];
+        FMResultSet *rs = [db executeQuery:query, _solution, identifier, @(AIQSynchronizationStatusDeleted)];
         if (rs) {
             if ([rs next]) {
-                NSMutableDictionary *data = [[rs dataForColumnIndex:3] JSONObject];
+                NSMutableDictionary *data = nil;
+                if (cached) {
+                    data = [[self cachedDataForId:identifier
+                                         revision:[rs objectForColumnIndex:4]
+                                           status:[rs objectForColumnIndex:1]
+                                         database:db] mutableCopy];
+                    if (! data) {
+                        [rs close];
+                        if (error) {
+                            *error = [AIQError errorWithCode:AIQErrorContainerFault message:[db lastError].localizedDescription];
+                        }
+                        return;
+                    }
+                } else {
+                    data = [self dataFromResultSet:rs columnIndex:3 fields:fields];
+                }
                 data[kAIQDocumentId] = identifier;
                 data[kAIQDocumentType] = [rs stringForColumnIndex:0];
                 data[kAIQDocumentStatus] = [rs objectForColumnIndex:1];
@@ -178,6 +258,30 @@ NSString *const kAIQAttachmentRejectionReason = @"reason";
 - (BOOL)documentsOfType:(NSString *)type
               processor:(void (^)(NSDictionary *, NSError *__autoreleasing *))processor
                   error:(NSError *__autoreleasing *)error {
+    return [self documentsOfType:type matching:nil processor:processor error:error];
+}
+
+- (BOOL)documentsOfType:(NSString *)type
+               matching:(AIQPredicate *)predicate
+              processor:(void (^)(NSDictionary *, NSError *__autoreleasing *))processor
+                  error:(NSError *__autoreleasing *)error {
+    return [self documentsOfType:type matching:predicate fields:nil processor:processor error:error];
+}
+
+- (BOOL)documentsOfType:(NSString *)type
+               matching:(AIQPredicate *)predicate
+                 fields:(NSArray *)fields
+              processor:(void (^)(NSDictionary *, NSError *__autoreleasing *))processor
+                  error:(NSError *__autoreleasing *)error {
+    return [self documentsOfType:type matching:predicate fields:fields identifiers:nil processor:processor error:error];
+}
+
+- (BOOL)documentsOfType:(NSString *)type
+               matching:(AIQPredicate *)predicate
+                 fields:(NSArray *)fields
+            identifiers:(NSArray *)identifiers
+              processor:(void (^)(NSDictionary *, NSError *__autoreleasing *))processor
+                  error:(NSError *__autoreleasing *)error {
     if (error) {
         *error = nil;
     }
@@ -203,18 +307,47 @@ NSString *const kAIQAttachmentRejectionReason = @"reason";
         return NO;
     }
     
+    NSMutableArray *arguments = [NSMutableArray arrayWithObject:@(AIQSynchronizationStatusDeleted)];
+    NSString *clause = @"1";
+    if (predicate) {
+        clause = [predicate SQLForColumn:@"data" arguments:arguments error:error];
+        if (! clause) {
+            return NO;
+        }
+    }
+    
+    NSString *projection = @"data";
+    if (fields) {
+        projection = [AIQPredicate projectionForFields:fields column:@"data" error:error];
+        if (! projection) {
+            return NO;
+        }
+    }
+    
+    if (identifiers) {
+        NSMutableArray *placeholders = [NSMutableArray arrayWithCapacity:identifiers.count];
+        for (NSString *identifier in identifiers) {
+            [placeholders addObject:@"?"];
+            [arguments addObject:identifier];
+        }
+        clause = [NSString stringWithFormat:@"(%@) AND identifier IN (%@)", clause, [placeholders componentsJoinedByString:@", "]];
+    }
+    
+    // solution and type are inlined so that SQLite can use the partial indexes declared for them
+    NSString *query = [NSString stringWithFormat:@"SELECT identifier, status, rejectionReason, %@, revision, launchable FROM documents "
+                       "WHERE solution = %@ AND type = %@ AND status != ? AND (%@) "
+                       "ORDER BY identifier ASC",
+                       projection, [AIQPredicate literalForString:_solution], [AIQPredicate literalForString:type], clause];
+    
     __block BOOL result = YES;
     
     [_pool inDatabase:^(FMDatabase *db) {
-        FMResultSet *rs = [db executeQuery:@"SELECT identifier, status, rejectionReason, data, revision, launchable FROM documents "
-                           "WHERE solution = ? AND type = ? AND status != ? "
-                           "ORDER BY identifier ASC",
-                           _solution, type, @(AIQSynchronizationStatusDeleted)];
+        FMResultSet *rs = [db executeQuery:query withArgumentsInArray:arguments];
         if (rs) {
             NSError *localError = nil;
             while ([rs next]) {
                 @autoreleasepool {
-                    NSMutableDictionary *data = [[[rs dataForColumnIndex:3] JSONObject] mutableCopy];
+                    NSMutableDictionary *data = [self dataFromResultSet:rs columnIndex:3 fields:fields];
                     data[kAIQDocumentId] = [rs stringForColumnIndex:0];
                     data[kAIQDocumentType] = type;
                     data[kAIQDocumentStatus] = [rs objectForColumnIndex:1];
@@ -273,20 +406,23 @@ NSString *const kAIQAttachmentRejectionReason = @"reason";
         return nil;
     }
     
+    NSMutableDictionary *filtered = [NSMutableDictionary dictionary];
+    for (NSString *field in fields) {
+        if ([field characterAtIndex:0] != '_') {
+            filtered[field] = fields[field];
+        }
+    }
+    
+    // encoding and compression happen before a connection is taken
+    NSData *data = [DocumentCodec dataWithObject:filtered];
+    
     __block NSDictionary *result = nil;
     
     [_pool inDatabase:^(FMDatabase *db) {
         NSString *identifier = [[NSUUID UUID] UUIDString];
         
-        NSMutableDictionary *filtered = [NSMutableDictionary dictionary];
-        for (NSString *field in fields) {
-            if ([field characterAtIndex:0] != '_') {
-                filtered[field] = fields[field];
-            }
-        }
-        
         if (! [db executeUpdate:@"INSERT INTO documents (solution, identifier, type, status, data) VALUES (?, ?, ?, ?, ?)",
-                                 _solution, identifier, type, @(AIQSynchronizationStatusCreated), [filtered JSONData]]) {
+                                 _solution, identifier, type, @(AIQSynchronizationStatusCreated), data]) {
             if (error) {
                 *error = [AIQError errorWithCode:AIQErrorContainerFault message:[db lastError].localizedDescription];
             }
@@ -299,6 +435,10 @@ NSString *const kAIQAttachmentRejectionReason = @"reason";
         result = [filtered copy];
     }];
     
+    if (result) {
+        [_liveQueries didChangeDocumentsWithIds:@[result[kAIQDocumentId]] solution:_solution];
+    }
+    
     return result;
 }
 
@@ -323,6 +463,16 @@ NSString *const kAIQAttachmentRejectionReason = @"reason";
         return nil;
     }
     
+    NSMutableDictionary *filtered = [NSMutableDictionary dictionary];
+    for (NSString *field in fields) {
+        if ([field characterAtIndex:0] != '_') {
+            filtered[field] = fields[field];
+        }
+    }
+    
+    // encoding and compression happen before a connection is taken
+    NSData *data = [DocumentCodec dataWithObject:filtered];
+    
     __block NSDictionary *result = nil;
     
     [_pool inDatabase:^(FMDatabase *db) {
@@ -335,15 +485,10 @@ NSString *const kAIQAttachmentRejectionReason = @"reason";
                 NSString *type = [rs stringForColumnIndex:1];
                 [rs close];
                 
-                NSMutableDictionary *filtered = [NSMutableDictionary dictionary];
-                for (NSString *field in fields) {
-                    if ([field characterAtIndex:0] != '_') {
-                        filtered[field] = fields[field];
-                    }
-                }
-                
                 if ([db executeUpdate:@"UPDATE documents SET status = ?, data = ?, rejectionReason = NULL WHERE solution = ? AND identifier = ?",
-                                       @(status), [filtered JSONData], _solution, identifier]) {
+                                       @(status), data, _solution, identifier]) {
+                    [_cache invalidateDocumentWithId:identifier solution:_solution];
+                    [_liveQueries didChangeDocumentsWithIds:@[identifier] solution:_solution];
                     filtered[kAIQDocumentId] = identifier;
                     filtered[kAIQDocumentType] = type;
                     filtered[kAIQDocumentStatus] = @(status);
@@ -446,9 +591,290 @@ NSString *const kAIQAttachmentRejectionReason = @"reason";
         result = YES;
     }];
     
+    if (result) {
+        // invalidated once the transaction is committed, so readers cannot cache the old version in between
+        [_cache invalidateDocumentWithId:identifier solution:_solution];
+        [_liveQueries didChangeDocumentsWithIds:@[identifier] solution:_solution];
+    }
+    
     return result;
 }
 
+- (NSArray *)createDocumentsOfType:(NSString *)type withFields:(NSArray *)fields error:(NSError *__autoreleasing *)error {
+    if (error) {
+        *error = nil;
+    }
+    
+    if (! type) {
+        if (error) {
+            *error = [AIQError errorWithCode:AIQErrorInvalidArgument message:@"Type not specified"];
+        }
+        return nil;
+    }
+    
+    if ([type characterAtIndex:0] == '_') {
+        if (error) {
+            *error = [AIQError errorWithCode:AIQErrorInvalidArgument message:@"Restricted document type"];
+        }
+        return nil;
+    }
+    
+    if (! fields) {
+        if (error) {
+            *error = [AIQError errorWithCode:AIQErrorInvalidArgument message:@"Fields not specified"];
+        }
+        return nil;
+    }
+    
+    __block NSMutableArray *result = [NSMutableArray arrayWithCapacity:fields.count];
+    NSMutableArray *created = [NSMutableArray array];
+    NSArray *prepared = [self preparedDocuments:fields];
+    
+    [_pool inTransaction:^(FMDatabase *db, BOOL *rollback) {
+        // connections are shared through the pool, the statement cache is only kept for the duration of the batch
+        BOOL shouldCacheStatements = db.shouldCacheStatements;
+        db.shouldCacheStatements = YES;
+        
+        for (id entry in prepared) {
+            @autoreleasepool {
+                if (entry == [NSNull null]) {
+                    [result addObject:[AIQError errorWithCode:AIQErrorInvalidArgument message:@"Fields not specified"]];
+                    continue;
+                }
+                
+                NSString *identifier = [[NSUUID UUID] UUIDString];
+                NSMutableDictionary *filtered = entry[0];
+                
+                if (! [db executeUpdate:@"INSERT INTO documents (solution, identifier, type, status, data) VALUES (?, ?, ?, ?, ?)",
+                                         _solution, identifier, type, @(AIQSynchronizationStatusCreated), entry[1]]) {
+                    [result addObject:[AIQError errorWithCode:AIQErrorContainerFault message:[db lastError].localizedDescription]];
+                    continue;
+                }
+                
+                filtered[kAIQDocumentId] = identifier;
+                filtered[kAIQDocumentType] = type;
+                filtered[kAIQDocumentStatus] = @(AIQSynchronizationStatusCreated);
+                [result addObject:[filtered copy]];
+                [created addObject:identifier];
+            }
+        }
+        
+        db.shouldCacheStatements = shouldCacheStatements;
+    }];
+    
+    if (created.count != 0) {
+        [_liveQueries didChangeDocumentsWithIds:created solution:_solution];
+        NOTIFY(AIQDidChangeDocumentsNotification, self, (@{AIQSolutionUserInfoKey: _solution,
+                                                           AIQCreatedDocumentIdsUserInfoKey: created,
+                                                           AIQUpdatedDocumentIdsUserInfoKey: @[],
+                                                           AIQDeletedDocumentIdsUserInfoKey: @[]}));
+    }
+    
+    return [result copy];
+}
+
+- (NSArray *)updateDocuments:(NSArray *)documents error:(NSError *__autoreleasing *)error {
+    if (error) {
+        *error = nil;
+    }
+    
+    if (! documents) {
+        if (error) {
+            *error = [AIQError errorWithCode:AIQErrorInvalidArgument message:@"Documents not specified"];
+        }
+        return nil;
+    }
+    
+    NSMutableArray *identifiers = [NSMutableArray arrayWithCapacity:documents.count];
+    for (NSDictionary *document in documents) {
+        if (([document isKindOfClass:[NSDictionary class]]) && ([document[kAIQDocumentId] isKindOfClass:[NSString class]])) {
+            [identifiers addObject:document[kAIQDocumentId]];
+        }
+    }
+    
+    __block NSMutableArray *result = nil;
+    NSMutableArray *updated = [NSMutableArray array];
+    NSArray *prepared = [self preparedDocuments:documents];
+    
+    [_pool inTransaction:^(FMDatabase *db, BOOL *rollback) {
+        BOOL shouldCacheStatements = db.shouldCacheStatements;
+        db.shouldCacheStatements = YES;
+        
+        NSDictionary *rows = [self rowsForIds:identifiers columns:@"status, type" database:db];
+        if (! rows) {
+            db.shouldCacheStatements = shouldCacheStatements;
+            *rollback = YES;
+            if (error) {
+                *error = [AIQError errorWithCode:AIQErrorContainerFault message:[db lastError].localizedDescription];
+            }
+            return;
+        }
+        
+        result = [NSMutableArray arrayWithCapacity:documents.count];
+        for (NSUInteger i = 0; i < documents.count; i++) {
+            @autoreleasepool {
+                NSDictionary *document = documents[i];
+                if (! [document isKindOfClass:[NSDictionary class]]) {
+                    [result addObject:[AIQError errorWithCode:AIQErrorInvalidArgument message:@"Fields not specified"]];
+                    continue;
+                }
+                
+                NSString *identifier = document[kAIQDocumentId];
+                if (! [identifier isKindOfClass:[NSString class]]) {
+                    [result addObject:[AIQError errorWithCode:AIQErrorInvalidArgument message:@"Identifier not specified"]];
+                    continue;
+                }
+                
+                NSArray *row = rows[identifier];
+                if ((! row) || ([row[0] integerValue] == AIQSynchronizationStatusDeleted) || ([row[1] hasPrefix:@"_"])) {
+                    [result addObject:[AIQError errorWithCode:AIQErrorIdNotFound message:@"Document not found"]];
+                    continue;
+                }
+                
+                AIQSynchronizationStatus status = [row[0] integerValue];
+                status = (status == AIQSynchronizationStatusCreated) ? AIQSynchronizationStatusCreated : AIQSynchronizationStatusUpdated;
+                
+                NSMutableDictionary *filtered = prepared[i][0];
+                
+                if (! [db executeUpdate:@"UPDATE documents SET status = ?, data = ?, rejectionReason = NULL WHERE solution = ? AND identifier = ?",
+                                         @(status), prepared[i][1], _solution, identifier]) {
+                    [result addObject:[AIQError errorWithCode:AIQErrorContainerFault message:[db lastError].localizedDescription]];
+                    continue;
+                }
+                
+                filtered[kAIQDocumentId] = identifier;
+                filtered[kAIQDocumentType] = row[1];
+                filtered[kAIQDocumentStatus] = @(status);
+                [result addObject:[filtered copy]];
+                [updated addObject:identifier];
+            }
+        }
+        
+        db.shouldCacheStatements = shouldCacheStatements;
+    }];
+    
+    for (NSString *identifier in updated) {
+        [_cache invalidateDocumentWithId:identifier solution:_solution];
+    }
+    
+    if (updated.count != 0) {
+        [_liveQueries didChangeDocumentsWithIds:updated solution:_solution];
+        NOTIFY(AIQDidChangeDocumentsNotification, self, (@{AIQSolutionUserInfoKey: _solution,
+                                                           AIQCreatedDocumentIdsUserInfoKey: @[],
+                                                           AIQUpdatedDocumentIdsUserInfoKey: updated,
+                                                           AIQDeletedDocumentIdsUserInfoKey: @[]}));
+    }
+    
+    return [result copy];
+}
+
+- (NSArray *)deleteDocumentsWithIds:(NSArray *)identifiers error:(NSError *__autoreleasing *)error {
+    if (error) {
+        *error = nil;
+    }
+    
+    if (! identifiers) {
+        if (error) {
+            *error = [AIQError errorWithCode:AIQErrorInvalidArgument message:@"Identifiers not specified"];
+        }
+        return nil;
+    }
+    
+    // an identifier given more than once is deleted once and shares the result of its first occurrence
+    NSOrderedSet *unique = [NSOrderedSet orderedSetWithArray:identifiers];
+    
+    __block NSMutableArray *result = nil;
+    NSMutableDictionary *outcomes = [NSMutableDictionary dictionaryWithCapacity:unique.count];
+    NSMutableArray *deleted = [NSMutableArray array];
+    NSMutableArray *paths = [NSMutableArray array];
+    
+    [_pool inTransaction:^(FMDatabase *db, BOOL *rollback) {
+        BOOL shouldCacheStatements = db.shouldCacheStatements;
+        db.shouldCacheStatements = YES;
+        
+        NSDictionary *rows = [self rowsForIds:unique.array columns:@"status, revision, type" database:db];
+        if (! rows) {
+            db.shouldCacheStatements = shouldCacheStatements;
+            *rollback = YES;
+            if (error) {
+                *error = [AIQError errorWithCode:AIQErrorContainerFault message:[db lastError].localizedDescription];
+            }
+            return;
+        }
+        
+        for (id identifier in unique) {
+            NSArray *row = [identifier isKindOfClass:[NSString class]] ? rows[identifier] : nil;
+            if ((! row) || ([row[0] integerValue] == AIQSynchronizationStatusDeleted) || ([row[2] hasPrefix:@"_"])) {
+                outcomes[identifier] = [AIQError errorWithCode:AIQErrorIdNotFound message:@"Document not found"];
+                continue;
+            }
+            
+            // every document is deleted within a savepoint, a failure only undoes the statements of that document
+            NSError *localError = nil;
+            if (! [db startSavePointWithName:@"document" error:&localError]) {
+                outcomes[identifier] = [AIQError errorWithCode:AIQErrorContainerFault message:localError.localizedDescription];
+                continue;
+            }
+            
+            AIQSynchronizationStatus status = [row[0] integerValue];
+            unsigned long long revision = [row[1] isKindOfClass:[NSNumber class]] ? [row[1] unsignedLongLongValue] : 0;
+            BOOL removed = ((status == AIQSynchronizationStatusCreated) || ((status == AIQSynchronizationStatusRejected) && (revision == 0)));
+            BOOL success;
+            if (removed) {
+                // Just delete the document and its attachments
+                success = ([db executeUpdate:@"DELETE FROM documents WHERE solution = ? AND identifier = ?", _solution, identifier]) &&
+                          ([db executeUpdate:@"DELETE FROM attachments WHERE solution = ? AND identifier = ?", _solution, identifier]);
+            } else {
+                // Send delete request to the backend
+                success = ([db executeUpdate:@"UPDATE documents SET status = ? WHERE solution = ? AND identifier = ?",
+                                              @(AIQSynchronizationStatusDeleted), _solution, identifier]) &&
+                          ([db executeUpdate:@"UPDATE attachments SET status = ? WHERE solution = ? AND identifier = ?",
+                                              @(AIQSynchronizationStatusDeleted), _solution, identifier]);
+            }
+            
+            if (! success) {
+                outcomes[identifier] = [AIQError errorWithCode:AIQErrorContainerFault message:[db lastError].localizedDescription];
+                [db rollbackToSavePointWithName:@"document" error:nil];
+                [db releaseSavePointWithName:@"document" error:nil];
+                continue;
+            }
+            
+            [db releaseSavePointWithName:@"document" error:nil];
+            
+            if (removed) {
+                [paths addObject:[_basePath stringByAppendingPathComponent:identifier]];
+            }
+            outcomes[identifier] = @YES;
+            [deleted addObject:identifier];
+        }
+        
+        db.shouldCacheStatements = shouldCacheStatements;
+        
+        result = [NSMutableArray arrayWithCapacity:identifiers.count];
+        for (id identifier in identifiers) {
+            [result addObject:outcomes[identifier]];
+        }
+    }];
+    
+    for (NSString *path in paths) {
+        [_fileManager removeItemAtPath:path error:nil];
+    }
+    
+    for (NSString *identifier in deleted) {
+        [_cache invalidateDocumentWithId:identifier solution:_solution];
+    }
+    
+    if (deleted.count != 0) {
+        [_liveQueries didChangeDocumentsWithIds:deleted solution:_solution];
+        NOTIFY(AIQDidChangeDocumentsNotification, self, (@{AIQSolutionUserInfoKey: _solution,
+                                                           AIQCreatedDocumentIdsUserInfoKey: @[],
+                                                           AIQUpdatedDocumentIdsUserInfoKey: @[],
+                                                           AIQDeletedDocumentIdsUserInfoKey: deleted}));
+    }
+    
+    return [result copy];
+}
+
 - (BOOL)attachmentWithName:(NSString *)name existsForDocumentWithId:(NSString *)identifier {
     if ((! name) || (! identifier)) {
         return NO;
@@ -491,45 +917,7 @@ NSString *const kAIQAttachmentRejectionReason = @"reason";
     __block NSDictionary *result = nil;
     
     [_pool inDatabase:^(FMDatabase *db) {
-        FMResultSet *rs = [db executeQuery:@"SELECT status FROM documents WHERE solution = ? AND identifier = ? AND status != ? AND type NOT LIKE '\\_%' ESCAPE '\\'",
-                                            _solution, identifier, @(AIQSynchronizationStatusDeleted)];
-        if (! rs) {
-            if (error) {
-                *error = [AIQError errorWithCode:AIQErrorContainerFault message:[db lastError].localizedDescription];
-            }
-            return;
-        }
-        
-        if (! [rs next]) {
-            if (error) {
-                *error = [AIQError errorWithCode:AIQErrorIdNotFound message:@"Document not found"];
-            }
-            return;
-        }
-        [rs close];
-        
-        rs = [db executeQuery:@"SELECT contentType, status, state, rejectionReason, revision FROM attachments "
-                               "WHERE solution = ? AND identifier = ? AND name = ? AND status != ?",
-                               _solution, identifier, name, @(AIQSynchronizationStatusDeleted)];
-        if (rs) {
-            if ([rs next]) {
-                NSMutableDictionary *data = [NSMutableDictionary dictionary];
-                data[kAIQAttachmentName] = name;
-                data[kAIQAttachmentContentType] = [rs stringForColumnIndex:0];
-                data[kAIQAttachmentStatus] = [rs objectForColumnIndex:1];
-                data[kAIQAttachmentState] = [rs objectForColumnIndex:2];
-                if (! [rs columnIndexIsNull:3]) {
-                    data[kAIQAttachmentRejectionReason] = [rs objectForColumnIndex:3];
-                }
-                data[kAIQAttachmentRevision] = [rs objectForColumnIndex:4];
-                result = [data copy];
-            } else if (error) {
-                *error = [AIQError errorWithCode:AIQErrorNameNotFound message:@"Attachment not found"];
-            }
-            [rs close];
-        } else if (error) {
-            *error = [AIQError errorWithCode:AIQErrorContainerFault message:[db lastError].localizedDescription];
-        }
+        result = [self attachmentWithName:name forDocumentWithId:identifier inDatabase:db error:error];
     }];
     
     return result;
@@ -1024,43 +1412,93 @@ NSString *const kAIQAttachmentRejectionReason = @"reason";
         return nil;
     }
     
-    if (! [self documentExistsWithId:identifier]) {
+    NSString *path = [self pathForAttachmentWithName:name fromDocumentWithId:identifier error:error];
+    if (! path) {
+        return nil;
+    }
+    
+    // mapping keeps large attachments out of the heap
+    return [_fileManager mappedContentsAtPath:path error:error];
+}
+
+- (NSInputStream *)streamForAttachmentWithName:(NSString *)name fromDocumentWithId:(NSString *)identifier error:(NSError *__autoreleasing *)error {
+    if (error) {
+        *error = nil;
+    }
+    
+    if (! identifier) {
         if (error) {
-            *error = [AIQError errorWithCode:AIQErrorIdNotFound message:@"Document not found"];
+            *error = [AIQError errorWithCode:AIQErrorInvalidArgument message:@"Identifier not specified"];
         }
         return nil;
     }
     
-    if (! [self attachmentWithName:name existsForDocumentWithId:identifier]) {
+    if (! name) {
         if (error) {
-            *error = [AIQError errorWithCode:AIQErrorNameNotFound message:@"Attachment not found"];
+            *error = [AIQError errorWithCode:AIQErrorInvalidArgument message:@"Name not specified"];
         }
         return nil;
     }
     
-    NSString *path = [[_basePath stringByAppendingPathComponent:identifier] stringByAppendingPathComponent:name];
-    if (! [_fileManager fileExistsAtPath:path]) {
+    NSString *path = [self pathForAttachmentWithName:name fromDocumentWithId:identifier error:error];
+    if (! path) {
+        return nil;
+    }
+    
+    NSInputStream *stream = [NSInputStream inputStreamWithFileAtPath:path];
+    if (! stream) {
         if (error) {
             *error = [AIQError errorWithCode:AIQErrorResourceNotFound message:@"Resource not found"];
         }
         return nil;
     }
     
-    return [_fileManager contentsAtPath:path];
+    return stream;
 }
 
-- (NSData *)dataForAttachmentAtPath:(NSString *)path {
-    NSFileManager* fileManager = [NSFileManager defaultManager];
-    NSData *data;
-
-    if ([path hasPrefix:@"file:///"]) {
-        NSString *absPath = [path stringByReplacingOccurrencesOfString:@"file://"
-                                                            withString:@""];
-
-        if (![fileManager fileExistsAtPath:absPath]) {
-            NSLog(@"File not found: %@", absPath);
-            return nil;
-        }
+- (BOOL)dataForAttachmentWithName:(NSString *)name
+               fromDocumentWithId:(NSString *)identifier
+                        chunkSize:(NSUInteger)chunkSize
+                        processor:(void (^)(NSData *, NSError *__autoreleasing *))processor
+                            error:(NSError *__autoreleasing *)error {
+    if (error) {
+        *error = nil;
+    }
+    
+    if (! identifier) {
+        if (error) {
+            *error = [AIQError errorWithCode:AIQErrorInvalidArgument message:@"Identifier not specified"];
+        }
+        return NO;
+    }
+    
+    if (! name) {
+        if (error) {
+            *error = [AIQError errorWithCode:AIQErrorInvalidArgument message:@"Name not specified"];
+        }
+        return NO;
+    }
+    
+    NSString *path = [self pathForAttachmentWithName:name fromDocumentWithId:identifier error:error];
+    if (! path) {
+        return NO;
+    }
+    
+    return [_fileManager readContentsAtPath:path chunkSize:chunkSize processor:processor error:error];
+}
+
+- (NSData *)dataForAttachmentAtPath:(NSString *)path {
+    NSFileManager* fileManager = [NSFileManager defaultManager];
+    NSData *data;
+
+    if ([path hasPrefix:@"file:///"]) {
+        NSString *absPath = [path stringByReplacingOccurrencesOfString:@"file://"
+                                                            withString:@""];
+
+        if (![fileManager fileExistsAtPath:absPath]) {
+            NSLog(@"File not found: %@", absPath);
+            return nil;
+        }
 
         data = [fileManager contentsAtPath:absPath];
 
@@ -1126,6 +1564,216 @@ NSString *const kAIQAttachmentRejectionReason = @"reason";
     return data;
 }
 
+- (AIQLiveQuery *)liveQueryForDocumentsOfType:(NSString *)type
+                                     matching:(AIQPredicate *)predicate
+                              sortDescriptors:(NSArray *)sortDescriptors
+                                      handler:(AIQLiveQueryHandler)handler
+                                        error:(NSError *__autoreleasing *)error {
+    if (error) {
+        *error = nil;
+    }
+    
+    if (! type) {
+        if (error) {
+            *error = [AIQError errorWithCode:AIQErrorInvalidArgument message:@"Type not specified"];
+        }
+        return nil;
+    }
+    
+    if ([type characterAtIndex:0] == '_') {
+        if (error) {
+            *error = [AIQError errorWithCode:AIQErrorInvalidArgument message:@"Restricted document type"];
+        }
+        return nil;
+    }
+    
+    if (! handler) {
+        if (error) {
+            *error = [AIQError errorWithCode:AIQErrorInvalidArgument message:@"Handler not specified"];
+        }
+        return nil;
+    }
+    
+    if (predicate) {
+        // fail early rather than on the first refresh
+        if (! [predicate SQLForColumn:@"data" arguments:[NSMutableArray array] error:error]) {
+            return nil;
+        }
+    }
+    
+    AIQLiveQuery *query = [[AIQLiveQuery alloc] initWithDataStore:self
+                                                         solution:_solution
+                                                             type:type
+                                                        predicate:predicate
+                                                  sortDescriptors:sortDescriptors
+                                                          handler:handler
+                                                           center:_liveQueries
+                                                       dispatcher:_dispatcher];
+    [query start];
+    
+    return query;
+}
+
+- (BOOL)createIndexForField:(NSString *)field ofDocumentsOfType:(NSString *)type error:(NSError *__autoreleasing *)error {
+    if (error) {
+        *error = nil;
+    }
+    
+    if (! type) {
+        if (error) {
+            *error = [AIQError errorWithCode:AIQErrorInvalidArgument message:@"Type not specified"];
+        }
+        return NO;
+    }
+    
+    if ([type characterAtIndex:0] == '_') {
+        if (error) {
+            *error = [AIQError errorWithCode:AIQErrorInvalidArgument message:@"Restricted document type"];
+        }
+        return NO;
+    }
+    
+    NSString *expression = [AIQPredicate expressionForField:field column:@"data" error:error];
+    if (! expression) {
+        return NO;
+    }
+    
+    // indexes belong to a solution, other solutions declare and drop their own
+    NSString *name = [AIQPredicate identifierForString:[NSString stringWithFormat:@"documents:%@:%@:%@", _solution, type, field]];
+    NSString *query = [NSString stringWithFormat:@"CREATE INDEX IF NOT EXISTS %@ ON documents(%@) WHERE solution = %@ AND type = %@",
+                       name, expression, [AIQPredicate literalForString:_solution], [AIQPredicate literalForString:type]];
+    
+    __block BOOL result = YES;
+    
+    [_pool inDatabase:^(FMDatabase *db) {
+        if (! [db executeUpdate:query]) {
+            result = NO;
+            if (error) {
+                *error = [AIQError errorWithCode:AIQErrorContainerFault message:[db lastError].localizedDescription];
+            }
+        }
+    }];
+    
+    return result;
+}
+
+- (BOOL)dropIndexForField:(NSString *)field ofDocumentsOfType:(NSString *)type error:(NSError *__autoreleasing *)error {
+    if (error) {
+        *error = nil;
+    }
+    
+    if (! type) {
+        if (error) {
+            *error = [AIQError errorWithCode:AIQErrorInvalidArgument message:@"Type not specified"];
+        }
+        return NO;
+    }
+    
+    if (! field) {
+        if (error) {
+            *error = [AIQError errorWithCode:AIQErrorInvalidArgument message:@"Field not specified"];
+        }
+        return NO;
+    }
+    
+    NSString *name = [AIQPredicate identifierForString:[NSString stringWithFormat:@"documents:%@:%@:%@", _solution, type, field]];
+    NSString *query = [NSString stringWithFormat:@"DROP INDEX IF EXISTS %@", name];
+    
+    __block BOOL result = YES;
+    
+    [_pool inDatabase:^(FMDatabase *db) {
+        if (! [db executeUpdate:query]) {
+            result = NO;
+            if (error) {
+                *error = [AIQError errorWithCode:AIQErrorContainerFault message:[db lastError].localizedDescription];
+            }
+        }
+    }];
+    
+    return result;
+}
+
+- (BOOL)createSearchIndexForFields:(NSArray *)fields ofDocumentsOfType:(NSString *)type error:(NSError *__autoreleasing *)error {
+    if (error) {
+        *error = nil;
+    }
+    
+    if (! type) {
+        if (error) {
+            *error = [AIQError errorWithCode:AIQErrorInvalidArgument message:@"Type not specified"];
+        }
+        return NO;
+    }
+    
+    if ([type characterAtIndex:0] == '_') {
+        if (error) {
+            *error = [AIQError errorWithCode:AIQErrorInvalidArgument message:@"Restricted document type"];
+        }
+        return NO;
+    }
+    
+    __block BOOL result = NO;
+    
+    [_pool inTransaction:^(FMDatabase *db, BOOL *rollback) {
+        result = [SearchIndex createIndexForFields:fields type:type solution:_solution table:@"documents" inDatabase:db error:error];
+        *rollback = ! result;
+    }];
+    
+    return result;
+}
+
+- (BOOL)dropSearchIndexForDocumentsOfType:(NSString *)type error:(NSError *__autoreleasing *)error {
+    if (error) {
+        *error = nil;
+    }
+    
+    if (! type) {
+        if (error) {
+            *error = [AIQError errorWithCode:AIQErrorInvalidArgument message:@"Type not specified"];
+        }
+        return NO;
+    }
+    
+    __block BOOL result = NO;
+    
+    [_pool inTransaction:^(FMDatabase *db, BOOL *rollback) {
+        result = [SearchIndex dropIndexForType:type solution:_solution table:@"documents" inDatabase:db error:error];
+        *rollback = ! result;
+    }];
+    
+    return result;
+}
+
+- (NSArray *)searchDocumentsOfType:(NSString *)type forText:(NSString *)text limit:(NSUInteger)limit error:(NSError *__autoreleasing *)error {
+    if (error) {
+        *error = nil;
+    }
+    
+    if (! type) {
+        if (error) {
+            *error = [AIQError errorWithCode:AIQErrorInvalidArgument message:@"Type not specified"];
+        }
+        return nil;
+    }
+    
+    if (! text) {
+        if (error) {
+            *error = [AIQError errorWithCode:AIQErrorInvalidArgument message:@"Text not specified"];
+        }
+        return nil;
+    }
+    
+    NSString *condition = [NSString stringWithFormat:@"d.status != %ld", (long)AIQSynchronizationStatusDeleted];
+    
+    __block NSArray *result = nil;
+    
+    [_pool inDatabase:^(FMDatabase *db) {
+        result = [SearchIndex search:text type:type solution:_solution table:@"documents" condition:condition limit:limit inDatabase:db error:error];
+    }];
+    
+    return result;
+}
+
 - (BOOL)hasUnsynchronizedDocumentsOfType:(NSString *)type {
     if (! type) {
         return NO;
@@ -1165,4 +1813,287 @@ NSString *const kAIQAttachmentRejectionReason = @"reason";
     return [NSString stringWithFormat:@"<AIQDataStore: %p (%@)>", self, [_basePath lastPathComponent]];
 }
 
+#pragma mark - Asynchronous API
+
+- (void)documentForId:(NSString *)identifier completion:(void (^)(NSDictionary *document, NSError *error))completion {
+    [_dispatcher read:^{
+        NSError *error = nil;
+        NSDictionary *document = [self documentForId:identifier error:&error];
+        if (completion) {
+            [_dispatcher complete:^{
+                completion(document, error);
+            }];
+        }
+    }];
+}
+
+- (void)documentForId:(NSString *)identifier fields:(NSArray *)fields completion:(void (^)(NSDictionary *document, NSError *error))completion {
+    [_dispatcher read:^{
+        NSError *error = nil;
+        NSDictionary *document = [self documentForId:identifier fields:fields error:&error];
+        if (completion) {
+            [_dispatcher complete:^{
+                completion(document, error);
+            }];
+        }
+    }];
+}
+
+- (void)documentsOfType:(NSString *)type
+               matching:(AIQPredicate *)predicate
+                 fields:(NSArray *)fields
+             completion:(void (^)(NSArray *documents, NSError *error))completion {
+    [_dispatcher read:^{
+        NSError *error = nil;
+        NSMutableArray *result = [NSMutableArray array];
+        BOOL success = [self documentsOfType:type matching:predicate fields:fields processor:^(NSDictionary *document, NSError *__autoreleasing *processorError) {
+            [result addObject:document];
+        } error:&error];
+        NSArray *documents = success ? [result copy] : nil;
+        if (completion) {
+            [_dispatcher complete:^{
+                completion(documents, error);
+            }];
+        }
+    }];
+}
+
+- (void)createDocumentOfType:(NSString *)type withFields:(NSDictionary *)fields completion:(void (^)(NSDictionary *document, NSError *error))completion {
+    [_dispatcher write:^{
+        NSError *error = nil;
+        NSDictionary *document = [self createDocumentOfType:type withFields:fields error:&error];
+        if (completion) {
+            [_dispatcher complete:^{
+                completion(document, error);
+            }];
+        }
+    }];
+}
+
+- (void)updateFields:(NSDictionary *)fields forDocumentWithId:(NSString *)identifier completion:(void (^)(NSDictionary *document, NSError *error))completion {
+    [_dispatcher write:^{
+        NSError *error = nil;
+        NSDictionary *document = [self updateFields:fields forDocumentWithId:identifier error:&error];
+        if (completion) {
+            [_dispatcher complete:^{
+                completion(document, error);
+            }];
+        }
+    }];
+}
+
+- (void)deleteDocumentWithId:(NSString *)identifier completion:(void (^)(NSError *error))completion {
+    [_dispatcher write:^{
+        NSError *error = nil;
+        [self deleteDocumentWithId:identifier error:&error];
+        if (completion) {
+            [_dispatcher complete:^{
+                completion(error);
+            }];
+        }
+    }];
+}
+
+- (void)createDocumentsOfType:(NSString *)type withFields:(NSArray *)fields completion:(void (^)(NSArray *results, NSError *error))completion {
+    [_dispatcher write:^{
+        NSError *error = nil;
+        NSArray *results = [self createDocumentsOfType:type withFields:fields error:&error];
+        if (completion) {
+            [_dispatcher complete:^{
+                completion(results, error);
+            }];
+        }
+    }];
+}
+
+- (void)updateDocuments:(NSArray *)documents completion:(void (^)(NSArray *results, NSError *error))completion {
+    [_dispatcher write:^{
+        NSError *error = nil;
+        NSArray *results = [self updateDocuments:documents error:&error];
+        if (completion) {
+            [_dispatcher complete:^{
+                completion(results, error);
+            }];
+        }
+    }];
+}
+
+- (void)deleteDocumentsWithIds:(NSArray *)identifiers completion:(void (^)(NSArray *results, NSError *error))completion {
+    [_dispatcher write:^{
+        NSError *error = nil;
+        NSArray *results = [self deleteDocumentsWithIds:identifiers error:&error];
+        if (completion) {
+            [_dispatcher complete:^{
+                completion(results, error);
+            }];
+        }
+    }];
+}
+
+- (void)dataForAttachmentWithName:(NSString *)name fromDocumentWithId:(NSString *)identifier completion:(void (^)(NSData *data, NSError *error))completion {
+    [_dispatcher read:^{
+        NSError *error = nil;
+        NSData *data = [self dataForAttachmentWithName:name fromDocumentWithId:identifier error:&error];
+        if (completion) {
+            [_dispatcher complete:^{
+                completion(data, error);
+            }];
+        }
+    }];
+}
+
+#pragma mark - Private API
+
+- (NSDictionary *)attachmentWithName:(NSString *)name
+                   forDocumentWithId:(NSString *)identifier
+                          inDatabase:(FMDatabase *)db
+                               error:(NSError *__autoreleasing *)error {
+    // validates the document and the attachment in one go, a.name is NULL if only the document exists
+    FMResultSet *rs = [db executeQuery:@"SELECT a.name, a.contentType, a.status, a.state, a.rejectionReason, a.revision FROM documents d "
+                       "LEFT OUTER JOIN attachments a ON a.solution = d.solution AND a.identifier = d.identifier AND a.name = ? AND a.status != ? "
+                       "WHERE d.solution = ? AND d.identifier = ? AND d.status != ? AND d.type NOT LIKE '\\_%' ESCAPE '\\'",
+                       name, @(AIQSynchronizationStatusDeleted), _solution, identifier, @(AIQSynchronizationStatusDeleted)];
+    if (! rs) {
+        if (error) {
+            *error = [AIQError errorWithCode:AIQErrorContainerFault message:[db lastError].localizedDescription];
+        }
+        return nil;
+    }
+    
+    if (! [rs next]) {
+        [rs close];
+        if (error) {
+            *error = [AIQError errorWithCode:AIQErrorIdNotFound message:@"Document not found"];
+        }
+        return nil;
+    }
+    
+    if ([rs columnIndexIsNull:0]) {
+        [rs close];
+        if (error) {
+            *error = [AIQError errorWithCode:AIQErrorNameNotFound message:@"Attachment not found"];
+        }
+        return nil;
+    }
+    
+    NSMutableDictionary *data = [NSMutableDictionary dictionary];
+    data[kAIQAttachmentName] = name;
+    data[kAIQAttachmentContentType] = [rs stringForColumnIndex:1];
+    data[kAIQAttachmentStatus] = [rs objectForColumnIndex:2];
+    data[kAIQAttachmentState] = [rs objectForColumnIndex:3];
+    if (! [rs columnIndexIsNull:4]) {
+        data[kAIQAttachmentRejectionReason] = [rs objectForColumnIndex:4];
+    }
+    data[kAIQAttachmentRevision] = [rs objectForColumnIndex:5];
+    [rs close];
+    
+    return [data copy];
+}
+
+- (NSString *)pathForAttachmentWithName:(NSString *)name fromDocumentWithId:(NSString *)identifier error:(NSError *__autoreleasing *)error {
+    __block NSDictionary *attachment = nil;
+    
+    [_pool inDatabase:^(FMDatabase *db) {
+        attachment = [self attachmentWithName:name forDocumentWithId:identifier inDatabase:db error:error];
+    }];
+    
+    if (! attachment) {
+        return nil;
+    }
+    
+    return [[_basePath stringByAppendingPathComponent:identifier] stringByAppendingPathComponent:name];
+}
+
+- (NSArray *)preparedDocuments:(NSArray *)documents {
+    // documents are filtered and encoded before the transaction, so that compression does not hold up other writers
+    NSMutableArray *prepared = [NSMutableArray arrayWithCapacity:documents.count];
+    for (NSDictionary *document in documents) {
+        @autoreleasepool {
+            if (! [document isKindOfClass:[NSDictionary class]]) {
+                [prepared addObject:[NSNull null]];
+                continue;
+            }
+
+            NSMutableDictionary *filtered = [NSMutableDictionary dictionary];
+            for (NSString *field in document) {
+                if ([field characterAtIndex:0] != '_') {
+                    filtered[field] = document[field];
+                }
+            }
+            [prepared addObject:@[filtered, [DocumentCodec dataWithObject:filtered] ?: [NSNull null]]];
+        }
+    }
+    return prepared;
+}
+
+- (NSDictionary *)rowsForIds:(NSArray *)identifiers columns:(NSString *)columns database:(FMDatabase *)db {
+    NSMutableDictionary *rows = [NSMutableDictionary dictionaryWithCapacity:identifiers.count];
+    NSMutableArray *valid = [NSMutableArray arrayWithCapacity:identifiers.count];
+    for (id identifier in identifiers) {
+        if ([identifier isKindOfClass:[NSString class]]) {
+            [valid addObject:identifier];
+        }
+    }
+    
+    // SQLite limits the number of host parameters, so the identifiers are queried in chunks
+    for (NSUInteger offset = 0; offset < valid.count; offset += 500) {
+        NSArray *chunk = [valid subarrayWithRange:NSMakeRange(offset, MIN(500, valid.count - offset))];
+        NSMutableArray *placeholders = [NSMutableArray arrayWithCapacity:chunk.count];
+        for (NSUInteger i = 0; i < chunk.count; i++) {
+            [placeholders addObject:@"?"];
+        }
+        
+        NSString *query = [NSString stringWithFormat:@"SELECT identifier, %@ FROM documents WHERE solution = ? AND identifier IN (%@)",
+                           columns, [placeholders componentsJoinedByString:@", "]];
+        FMResultSet *rs = [db executeQuery:query withArgumentsInArray:[@[_solution] arrayByAddingObjectsFromArray:chunk]];
+        if (! rs) {
+            return nil;
+        }
+        
+        while ([rs next]) {
+            NSMutableArray *row = [NSMutableArray arrayWithCapacity:[rs columnCount] - 1];
+            for (int i = 1; i < [rs columnCount]; i++) {
+                [row addObject:[rs objectForColumnIndex:i]];
+            }
+            rows[[rs stringForColumnIndex:0]] = row;
+        }
+        [rs close];
+    }
+    
+    return rows;
+}
+
+- (NSDictionary *)cachedDataForId:(NSString *)identifier revision:(id)revision status:(id)status database:(FMDatabase *)db {
+    NSDictionary *data = [_cache documentForId:identifier solution:_solution revision:revision status:status];
+    if (data) {
+        return data;
+    }
+    
+    // taken before the read so that a write racing with it keeps the stale copy out of the cache
+    NSUInteger generation = _cache.generation;
+    
+    FMResultSet *rs = [db executeQuery:@"SELECT data FROM documents WHERE solution = ? AND identifier = ?", _solution, identifier];
+    if (! rs) {
+        return nil;
+    }
+    
+    if ([rs next]) {
+        NSData *raw = [rs dataForColumnIndex:0];
+        
+        // cached documents are shared between callers so they must not contain mutable containers
+        data = [DocumentCodec objectWithData:raw mutable:NO];
+        [_cache storeDocument:data forId:identifier solution:_solution revision:revision status:status cost:[DocumentCodec costOfObject:data] generation:generation];
+    }
+    [rs close];
+    
+    return data ?: @{};
+}
+
+- (NSMutableDictionary *)dataFromResultSet:(FMResultSet *)rs columnIndex:(int)columnIndex fields:(NSArray *)fields {
+    if (fields) {
+        return [AIQPredicate dictionaryFromProjection:[rs dataForColumnIndex:columnIndex] fields:fields];
+    }
+    return [DocumentCodec objectWithData:[rs dataForColumnIndex:columnIndex] mutable:YES];
+}
+
 @end
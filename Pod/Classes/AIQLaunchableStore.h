@@ -12,12 +12,15 @@ EXTERN_API(NSString *) const AIQDidDownloadLaunchableNotification;
 EXTERN_API(NSString *) const AIQLaunchableDidFailNotification;
 
 EXTERN_API(NSString *) const AIQLaunchableIconDidChangeNotification;
+EXTERN_API(NSString *) const AIQLaunchableDidBecomeReadyNotification;
+EXTERN_API(NSString *) const AIQLaunchablesReloadDidProgressNotification;
 
 EXTERN_API(NSString *) const kAIQLaunchableSolution;
 EXTERN_API(NSString *) const kAIQLaunchableName;
 EXTERN_API(NSString *) const kAIQLaunchablePath;
 EXTERN_API(NSString *) const kAIQLaunchableIconPath;
 EXTERN_API(NSString *) const kAIQLaunchableAvailable;
+EXTERN_API(NSString *) const kAIQLaunchableReady;
 EXTERN_API(NSString *) const kAIQLaunchableNotification;
 
 EXTERN_API(NSString *) const AIQLaunchableNameUserInfoKey;
@@ -27,5 +30,11 @@ EXTERN_API(NSString *) const AIQLaunchableIconPathUserInfoKey;
 - (BOOL)reload:(NSError **)error;
 - (BOOL)processLaunchables:(void (^)(NSDictionary *, NSError **))processor error:(NSError **)error;
 - (NSDictionary *)launchableWithId:(NSString *)identifier error:(NSError **)error;
+- (BOOL)prepareLaunchableWithId:(NSString *)identifier error:(NSError **)error;
+
+- (void)reloadWithCompletion:(void (^)(NSError *error))completion;
+- (void)launchablesWithCompletion:(void (^)(NSArray *launchables, NSError *error))completion;
+- (void)launchableWithId:(NSString *)identifier completion:(void (^)(NSDictionary *launchable, NSError *error))completion;
+- (void)prepareLaunchableWithId:(NSString *)identifier completion:(void (^)(NSError *error))completion;
 
 @end
@@ -2,11 +2,15 @@
 
 #import "AIQDataStore.h"
 #import "AIQError.h"
-#import "AIQJSON.h"
 #import "AIQLaunchableStore.h"
 #import "AIQLog.h"
 #import "AIQSession.h"
 #import "AIQSynchronization.h"
+#import "BridgeRuntime.h"
+#import "Dispatcher.h"
+#import "DocumentCodec.h"
+#import "FMDatabase+Helpers.h"
+#import "LaunchableArchive.h"
 #import "common.h"
 #import "ZipArchive.h"
 
@@ -20,12 +24,15 @@ NSString *const AIQDidDownloadLaunchableNotification = @"AIQDidDownloadLaunchabl
 NSString *const AIQLaunchableDidFailNotification = @"AIQLaunchableDidFailNotification";
 
 NSString *const AIQLaunchableIconDidChangeNotification = @"AIQLaunchableIconDidChangeNotification";
+NSString *const AIQLaunchableDidBecomeReadyNotification = @"AIQLaunchableDidBecomeReadyNotification";
+NSString *const AIQLaunchablesReloadDidProgressNotification = @"AIQLaunchablesReloadDidProgressNotification";
 
 NSString *const kAIQLaunchableSolution = @"kAIQLaunchableSolution";
 NSString *const kAIQLaunchableName = @"kAIQLaunchableName";
 NSString *const kAIQLaunchablePath = @"kAIQLaunchablePath";
 NSString *const kAIQLaunchableIconPath = @"kAIQLaunchableIconPath";
 NSString *const kAIQLaunchableAvailable = @"kAIQLaunchableAvailable";
+NSString *const kAIQLaunchableReady = @"kAIQLaunchableReady";
 NSString *const kAIQLaunchableNotification = @"kAIQLaunchableNotification";
 
 NSString *const AIQLaunchableNameUserInfoKey = @"AIQLaunchableNameUserInfoKey";
@@ -35,139 +42,84 @@ NSString *const AIQLaunchableIconPathUserInfoKey = @"AIQLaunchableIconPathUserIn
 @implementation AIQLaunchableStore {
     FMDatabaseQueue *_queue;
     NSString *_basePath;
+    Dispatcher *_dispatcher;
+    dispatch_queue_t _extractionQueue;
 }
 
 - (instancetype)initForSession:(AIQSession *)session error:(NSError *__autoreleasing *)error {
     self = [super init];
     if (self) {
         _basePath = [session valueForKey:@"basePath"];
-        _queue = [FMDatabaseQueue databaseQueueWithPath:[session valueForKey:@"dbPath"]];
+        _queue = [FMDatabaseQueue documentQueueWithPath:[session valueForKey:@"dbPath"]];
+        _dispatcher = [session valueForKey:@"dispatcher"];
+        _extractionQueue = dispatch_queue_create("com.appearnetworks.aiq.launchables",
+                                                 dispatch_queue_attr_make_with_qos_class(DISPATCH_QUEUE_SERIAL, QOS_CLASS_UTILITY, 0));
     }
     return self;
 }
 
 - (BOOL)reload:(NSError *__autoreleasing *)error {
-    __block BOOL success = YES;
+    if (error) {
+        *error = nil;
+    }
     
-    [_queue inDatabase:^(FMDatabase *db) {
-        FMResultSet *rs = [db executeQuery:@"SELECT a.solution, a.identifier, a.name, d.data FROM attachments a, documents d "
-                           "WHERE a.solution = d.solution AND a.identifier = d.identifier AND a.name = 'content' AND a.state = ?",
-                           @(AIQAttachmentStateAvailable)];
-        if (! rs) {
-            if (error) {
-                *error = [AIQError errorWithCode:AIQErrorContainerFault message:[db lastError].localizedDescription];
-            }
-            success = NO;
-            return;
-        }
-        
-        NSFileManager *fileManager = [NSFileManager defaultManager];
+    NSArray *launchables = [self extractableLaunchablesWithId:nil error:error];
+    if (! launchables) {
+        return NO;
+    }
+    
+    // extraction is CPU and disk bound, dispatch_apply keeps the number of workers at the number of active cores
+    NSUInteger count = launchables.count;
+    __block NSUInteger completed = 0;
+    __block NSError *firstError = nil;
+    NSObject *progressLock = [NSObject new];
+    dispatch_apply(count, dispatch_get_global_queue(qos_class_self(), 0), ^(size_t index) {
         NSError *localError = nil;
-        while ([rs next]) {
-            NSString *solution = [rs stringForColumnIndex:0];
-            NSString *identifier = [rs stringForColumnIndex:1];
-            NSString *name = [rs stringForColumnIndex:2];
-            NSDictionary *data = [[rs dataForColumnIndex:3] JSONObject];
-            
-            NSString *path = [[[_basePath stringByAppendingPathComponent:solution] stringByAppendingPathComponent:identifier] stringByAppendingPathComponent:name];
-            NSString *appPath = [path stringByAppendingPathExtension:@"webapp"];
-            NSString *tmpPath = [path stringByAppendingPathExtension:@"unzipped"];
-            NSString *canaryPath = [appPath stringByAppendingPathComponent:@".aiq_canary"];
-            
-            if ([fileManager fileExistsAtPath:tmpPath]) {
-                if (! [fileManager removeItemAtPath:tmpPath error:&localError]) {
-                    if (error) {
-                        *error = [AIQError errorWithCode:AIQErrorContainerFault message:localError.localizedDescription];
-                    }
-                    success = NO;
-                    return;
-                }
-            }
-            
-            if ([fileManager fileExistsAtPath:canaryPath]) {
-                continue;
-            }
-            
-            ZipArchive *zip = [ZipArchive new];
-            if (! [zip UnzipOpenFile:path]) {
-                if (error) {
-                    *error = [AIQError errorWithCode:AIQErrorContainerFault message:@"Could not open zip file"];
-                }
-                success = NO;
-                return;
+        BOOL success = [self extractLaunchable:launchables[index] error:&localError];
+        @synchronized(progressLock) {
+            if ((! success) && (! firstError)) {
+                firstError = localError;
             }
-            
-            if (! [zip UnzipFileTo:tmpPath overWrite:YES]) {
-                if (error) {
-                    *error = [AIQError errorWithCode:AIQErrorContainerFault message:@"Could not extract zip file"];
-                }
-                success = NO;
-                return;
-            }
-            
-            if (! [[data valueForKeyPath:@"config.mock"] boolValue]) {
-                NSString *bundlePath = [[NSBundle mainBundle] pathForResource:@"AIQJSBridge" ofType:@"bundle"];
-                if (! [self copyFile:@"cordova.js" from:bundlePath to:tmpPath using:fileManager error:&localError]) {
-                    if (error) {
-                        *error = [AIQError errorWithCode:AIQErrorContainerFault message:localError.localizedDescription];
-                    }
-                    success = NO;
-                    break;
-                }
-                if (! [self copyFile:@"cordova_plugins.js" from:bundlePath to:tmpPath using:fileManager error:&localError]) {
-                    if (error) {
-                        *error = [AIQError errorWithCode:AIQErrorContainerFault message:localError.localizedDescription];
-                    }
-                    success = NO;
-                    break;
-                }
-                if (! [self copyFile:@"plugins" from:bundlePath to:tmpPath using:fileManager error:&localError]) {
-                    if (error) {
-                        *error = [AIQError errorWithCode:AIQErrorContainerFault message:localError.localizedDescription];
-                    }
-                    success = NO;
-                    break;
-                }
-                if (! [self copyFile:@"cordova.js"
-                                from:bundlePath
-                              toFile:@"aiq-api.js"
-                                  in:[tmpPath stringByAppendingPathComponent:@"aiq"]
-                               using:fileManager
-                               error:&localError]) {
-                    if (error) {
-                        *error = [AIQError errorWithCode:AIQErrorContainerFault message:localError.localizedDescription];
-                    }
-                    success = NO;
-                    break;
-                }
-            }
-            
-            if ([fileManager fileExistsAtPath:appPath isDirectory:nil]) {
-                if (! [fileManager removeItemAtPath:appPath error:&localError]) {
-                    if (error) {
-                        *error = [AIQError errorWithCode:AIQErrorContainerFault message:localError.localizedDescription];
-                    }
-                    success = NO;
-                    break;
-                }
-            }
-            
-            if (! [fileManager moveItemAtPath:tmpPath toPath:appPath error:&localError]) {
-                if (error) {
-                    *error = [AIQError errorWithCode:AIQErrorContainerFault message:localError.localizedDescription];
-                }
-                [rs close];
-                success = NO;
-                break;
-            }
-            
-            [fileManager createFileAtPath:canaryPath contents:[NSData data] attributes:@{NSFileProtectionKey: NSFileProtectionComplete}];
+            completed++;
+            NOTIFY(AIQLaunchablesReloadDidProgressNotification, self, @{AIQAttachmentProgressUserInfoKey: @((float)completed / count)});
         }
-        
-        [rs close];
-    }];
+    });
     
-    return success;
+    if (firstError) {
+        if (error) {
+            *error = firstError;
+        }
+        return NO;
+    }
+    
+    return YES;
+}
+
+- (BOOL)prepareLaunchableWithId:(NSString *)identifier error:(NSError *__autoreleasing *)error {
+    if (error) {
+        *error = nil;
+    }
+    
+    if (! identifier) {
+        if (error) {
+            *error = [AIQError errorWithCode:AIQErrorInvalidArgument message:@"Identifier not specified"];
+        }
+        return NO;
+    }
+    
+    NSArray *launchables = [self extractableLaunchablesWithId:identifier error:error];
+    if (! launchables) {
+        return NO;
+    }
+    
+    if (launchables.count == 0) {
+        if (error) {
+            *error = [AIQError errorWithCode:AIQErrorIdNotFound message:@"Launchable not found"];
+        }
+        return NO;
+    }
+    
+    return [self extractLaunchable:launchables.firstObject error:error];
 }
 
 - (BOOL)processLaunchables:(void (^)(NSDictionary *, NSError *__autoreleasing *))processor error:(NSError *__autoreleasing *)error {
@@ -211,18 +163,19 @@ NSString *const AIQLaunchableIconPathUserInfoKey = @"AIQLaunchableIconPathUserIn
             }
             
             NSMutableDictionary *mutable = [NSMutableDictionary dictionary];
-            NSDictionary *document = [[rs dataForColumnIndex:2] JSONObject];
+            NSString *name = [DocumentCodec valueForPath:@[@"name"] inData:[rs dataForColumnIndex:2]];
             NSString *iconPath = [folder stringByAppendingPathComponent:@"icon"];
             mutable[kAIQDocumentId] = identifier;
             mutable[kAIQLaunchableSolution] = solution;
-            if (document[@"name"]) {
-                mutable[kAIQLaunchableName] = document[@"name"];
+            if (name) {
+                mutable[kAIQLaunchableName] = name;
             }
             mutable[kAIQLaunchablePath] = launchablePath;
             if ([[NSFileManager defaultManager] fileExistsAtPath:iconPath isDirectory:nil]) {
                 mutable[kAIQLaunchableIconPath] = iconPath;
             }
             mutable[kAIQLaunchableAvailable] = @([rs intForColumnIndex:3] == AIQAttachmentStateAvailable);
+            mutable[kAIQLaunchableReady] = @([[NSFileManager defaultManager] fileExistsAtPath:[launchablePath stringByAppendingPathComponent:@".aiq_canary"]]);
             
             NSError *localError = nil;
             processor(mutable, &localError);
@@ -286,20 +239,21 @@ NSString *const AIQLaunchableIconPathUserInfoKey = @"AIQLaunchableIconPathUserIn
         
         NSString *solution = [rs stringForColumnIndex:0];
         NSString *folder = [[_basePath stringByAppendingPathComponent:solution] stringByAppendingPathComponent:identifier];
-        NSDictionary *document = [[rs dataForColumnIndex:1] JSONObject];
+        NSString *name = [DocumentCodec valueForPath:@[@"name"] inData:[rs dataForColumnIndex:1]];
+        NSString *launchablePath = [folder stringByAppendingPathComponent:@"content.webapp"];
         NSString *iconPath = [folder stringByAppendingPathComponent:@"icon"];
         NSMutableDictionary *mutable = [NSMutableDictionary dictionary];
         mutable[kAIQDocumentId] = identifier;
         mutable[kAIQLaunchableSolution] = solution;
-        mutable[kAIQLaunchableSolution] = solution;
-        if (document[@"name"]) {
-            mutable[kAIQLaunchableName] = document[@"name"];
+        if (name) {
+            mutable[kAIQLaunchableName] = name;
         }
-        mutable[kAIQLaunchablePath] = [folder stringByAppendingPathComponent:@"content.webapp"];
+        mutable[kAIQLaunchablePath] = launchablePath;
         if ([[NSFileManager defaultManager] fileExistsAtPath:iconPath isDirectory:nil]) {
             mutable[kAIQLaunchableIconPath] = iconPath;
         }
         mutable[kAIQLaunchableAvailable] = [rs objectForColumnIndex:2];
+        mutable[kAIQLaunchableReady] = @([[NSFileManager defaultManager] fileExistsAtPath:[launchablePath stringByAppendingPathComponent:@".aiq_canary"]]);
         result = [mutable copy];
         [rs close];
     }];
@@ -307,34 +261,192 @@ NSString *const AIQLaunchableIconPathUserInfoKey = @"AIQLaunchableIconPathUserIn
     return result;
 }
 
-- (BOOL)copyFile:(NSString *)file
-            from:(NSString *)source
-              to:(NSString *)target
-           using:(NSFileManager *)fileManager
-           error:(NSError *__autoreleasing *)error {
-    return [self copyFile:file from:source toFile:file in:target using:fileManager error:error];
+- (void)reloadWithCompletion:(void (^)(NSError *))completion {
+    [_dispatcher write:^{
+        NSError *error = nil;
+        [self reload:&error];
+        if (completion) {
+            [_dispatcher complete:^{
+                completion(error);
+            }];
+        }
+    }];
+}
+
+- (void)launchablesWithCompletion:(void (^)(NSArray *, NSError *))completion {
+    [_dispatcher read:^{
+        NSError *error = nil;
+        NSMutableArray *result = [NSMutableArray array];
+        BOOL success = [self processLaunchables:^(NSDictionary *launchable, NSError *__autoreleasing *processorError) {
+            [result addObject:launchable];
+        } error:&error];
+        NSArray *launchables = success ? [result copy] : nil;
+        if (completion) {
+            [_dispatcher complete:^{
+                completion(launchables, error);
+            }];
+        }
+    }];
+}
+
+- (void)launchableWithId:(NSString *)identifier completion:(void (^)(NSDictionary *, NSError *))completion {
+    [_dispatcher read:^{
+        NSError *error = nil;
+        NSDictionary *launchable = [self launchableWithId:identifier error:&error];
+        if (completion) {
+            [_dispatcher complete:^{
+                completion(launchable, error);
+            }];
+        }
+    }];
+}
+
+- (void)prepareLaunchableWithId:(NSString *)identifier completion:(void (^)(NSError *))completion {
+    // extraction is serialized by the store, so the priority path does not have to wait behind queued writes
+    [_dispatcher read:^{
+        NSError *error = nil;
+        [self prepareLaunchableWithId:identifier error:&error];
+        if (completion) {
+            [_dispatcher complete:^{
+                completion(error);
+            }];
+        }
+    }];
+}
+
+- (void)reloadInBackground:(void (^)(NSError *))completion {
+    dispatch_async(_extractionQueue, ^{
+        NSError *error = nil;
+        [self reload:&error];
+        if (completion) {
+            completion(error);
+        }
+    });
 }
 
-- (BOOL)copyFile:(NSString *)sourceFile
-            from:(NSString *)sourceFolder
-          toFile:(NSString *)targetFile
-              in:(NSString *)targetFolder
-           using:(NSFileManager *)fileManager
-           error:(NSError *__autoreleasing *)error {
-    NSString *source = [sourceFolder stringByAppendingPathComponent:sourceFile];
-    NSString *target = [targetFolder stringByAppendingPathComponent:targetFile];
+- (NSArray *)extractableLaunchablesWithId:(NSString *)identifier error:(NSError *__autoreleasing *)error {
+    __block NSMutableArray *result = nil;
     
-    if ([fileManager fileExistsAtPath:targetFolder]) {
-        if ([fileManager fileExistsAtPath:target]) {
-            if (! [fileManager removeItemAtPath:target error:error]) {
+    [_queue inDatabase:^(FMDatabase *db) {
+        NSString *query = @"SELECT a.solution, a.identifier, a.name, d.data FROM attachments a, documents d "
+                           "WHERE a.solution = d.solution AND a.identifier = d.identifier AND a.name = 'content' AND a.state = ?";
+        FMResultSet *rs = identifier ?
+            [db executeQuery:[query stringByAppendingString:@" AND a.identifier = ?"], @(AIQAttachmentStateAvailable), identifier] :
+            [db executeQuery:query, @(AIQAttachmentStateAvailable)];
+        if (! rs) {
+            if (error) {
+                *error = [AIQError errorWithCode:AIQErrorContainerFault message:[db lastError].localizedDescription];
+            }
+            return;
+        }
+        
+        // rows are collected first so that the connection is not held while unzipping
+        result = [NSMutableArray array];
+        while ([rs next]) {
+            [result addObject:@{@"solution": [rs stringForColumnIndex:0],
+                                @"identifier": [rs stringForColumnIndex:1],
+                                @"name": [rs stringForColumnIndex:2],
+                                @"mock": @([[DocumentCodec valueForPath:@[@"config", @"mock"] inData:[rs dataForColumnIndex:3]] boolValue])}];
+        }
+        [rs close];
+    }];
+    
+    return result;
+}
+
+- (BOOL)extractLaunchable:(NSDictionary *)launchable error:(NSError *__autoreleasing *)error {
+    NSString *solution = launchable[@"solution"];
+    NSString *identifier = launchable[@"identifier"];
+    NSString *path = [[[_basePath stringByAppendingPathComponent:solution] stringByAppendingPathComponent:identifier] stringByAppendingPathComponent:launchable[@"name"]];
+    NSString *appPath = [path stringByAppendingPathExtension:@"webapp"];
+    NSString *tmpPath = [path stringByAppendingPathExtension:@"unzipped"];
+    NSString *canaryPath = [appPath stringByAppendingPathComponent:@".aiq_canary"];
+    NSFileManager *fileManager = [NSFileManager defaultManager];
+    NSError *localError = nil;
+    
+    // the background reload, the on demand path and the synchronizer may race for the same launchable
+    @synchronized([AIQLaunchableStore extractionLockForPath:path]) {
+        if ([fileManager fileExistsAtPath:tmpPath]) {
+            if (! [fileManager removeItemAtPath:tmpPath error:&localError]) {
+                if (error) {
+                    *error = [AIQError errorWithCode:AIQErrorContainerFault message:localError.localizedDescription];
+                }
                 return NO;
             }
         }
-    } else if (! [fileManager createDirectoryAtPath:targetFolder withIntermediateDirectories:YES attributes:nil error:error]) {
-        return NO;
+        
+        if ([fileManager fileExistsAtPath:canaryPath]) {
+            return YES;
+        }
+        
+        ZipArchive *zip = [ZipArchive new];
+        if (! [zip UnzipOpenFile:path]) {
+            if (error) {
+                *error = [AIQError errorWithCode:AIQErrorContainerFault message:@"Could not open zip file"];
+            }
+            return NO;
+        }
+        
+        if (! [zip UnzipFileTo:tmpPath overWrite:YES]) {
+            if (error) {
+                *error = [AIQError errorWithCode:AIQErrorContainerFault message:@"Could not extract zip file"];
+            }
+            return NO;
+        }
+        
+        NSDictionary *manifest = [LaunchableArchive manifestForArchiveAtPath:path];
+        if (manifest) {
+            [LaunchableArchive writeManifest:manifest toFolderAtPath:tmpPath];
+        }
+        
+        if (! [launchable[@"mock"] boolValue]) {
+            if (! [BridgeRuntime linkIntoFolderAtPath:tmpPath basePath:_basePath error:error]) {
+                return NO;
+            }
+        }
+        
+        if ([fileManager fileExistsAtPath:appPath isDirectory:nil]) {
+            if (! [fileManager removeItemAtPath:appPath error:&localError]) {
+                if (error) {
+                    *error = [AIQError errorWithCode:AIQErrorContainerFault message:localError.localizedDescription];
+                }
+                return NO;
+            }
+        }
+        
+        if (! [fileManager moveItemAtPath:tmpPath toPath:appPath error:&localError]) {
+            if (error) {
+                *error = [AIQError errorWithCode:AIQErrorContainerFault message:localError.localizedDescription];
+            }
+            return NO;
+        }
+        
+        [fileManager createFileAtPath:canaryPath contents:[NSData data] attributes:@{NSFileProtectionKey: NSFileProtectionComplete}];
     }
     
-    return [fileManager copyItemAtPath:source toPath:target error:error];
+    NOTIFY(AIQLaunchableDidBecomeReadyNotification, self, (@{AIQDocumentIdUserInfoKey: identifier,
+                                                             AIQSolutionUserInfoKey: solution,
+                                                             AIQLaunchablePathUserInfoKey: appPath}));
+    
+    return YES;
+}
+
++ (id)extractionLockForPath:(NSString *)path {
+    // locks are shared by all stores and synchronizers, each of them works on the same folders
+    static NSMutableDictionary *locks;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        locks = [NSMutableDictionary dictionary];
+    });
+    
+    @synchronized(locks) {
+        id lock = locks[path];
+        if (! lock) {
+            lock = [NSObject new];
+            locks[path] = lock;
+        }
+        return lock;
+    }
 }
 
 @end
@@ -1,14 +1,23 @@
 #import <FMDB/FMDB.h>
 
-#import "AIQJSON.h"
 #import "AIQLaunchableStore.h"
 #import "AIQLaunchableSynchronizer.h"
 #import "AIQLog.h"
 #import "AIQSession.h"
 #import "AIQSynchronization.h"
+#import "BridgeRuntime.h"
+#import "DocumentCodec.h"
+#import "FMDatabase+Helpers.h"
+#import "LaunchableArchive.h"
 #import "ZipArchive.h"
 #import "common.h"
 
+@interface AIQLaunchableStore ()
+
++ (id)extractionLockForPath:(NSString *)path;
+
+@end
+
 @interface AIQLaunchableSynchronizer () {
     FMDatabasePool *_pool;
     NSString *_basePath;
@@ -22,7 +31,7 @@
     self = [super init];
     if (self) {
         _basePath = [session valueForKey:@"basePath"];
-        _pool = [FMDatabasePool databasePoolWithPath:[session valueForKey:@"dbPath"]];
+        _pool = [FMDatabasePool documentPoolWithPath:[session valueForKey:@"dbPath"]];
     }
     return self;
 }
@@ -41,7 +50,7 @@
             return;
         }
         
-        NSDictionary *document = [[rs dataForColumnIndex:0] JSONObject];
+        NSDictionary *document = [DocumentCodec objectWithData:[rs dataForColumnIndex:0] mutable:YES];
         [rs close];
         
         NSString *name = document[@"name"];
@@ -70,7 +79,7 @@
             return;
         }
         
-        NSDictionary *document = [[rs dataForColumnIndex:0] JSONObject];
+        NSDictionary *document = [DocumentCodec objectWithData:[rs dataForColumnIndex:0] mutable:YES];
         [rs close];
         
         rs = [db executeQuery:@"SELECT state FROM attachments WHERE solution = ? AND identifier = ? AND name = 'icon'", solution, identifier];
@@ -139,7 +148,7 @@
                 return;
             }
             
-            NSDictionary *document = [[rs dataForColumnIndex:0] JSONObject];
+            NSDictionary *document = [DocumentCodec objectWithData:[rs dataForColumnIndex:0] mutable:YES];
             [rs close];
             NSString *name = document[@"name"];
             if (! name) {
@@ -187,7 +196,7 @@
                 return;
             }
             
-            NSDictionary *document = [[rs dataForColumnIndex:0] JSONObject];
+            NSDictionary *document = [DocumentCodec objectWithData:[rs dataForColumnIndex:0] mutable:YES];
             [rs close];
             NSString *name = document[@"name"];
             if (! name) {
@@ -220,7 +229,7 @@
                 return;
             }
             
-            document = [[rs dataForColumnIndex:0] JSONObject];
+            document = [DocumentCodec objectWithData:[rs dataForColumnIndex:0] mutable:YES];
             [rs close];
             
             rs = [db executeQuery:@"SELECT state FROM attachments WHERE solution = ? AND identifier = ? AND name = 'icon'", solution, identifier];
@@ -243,80 +252,84 @@
         NSFileManager *fileManager = [NSFileManager defaultManager];
         NSString *appPath = [path stringByAppendingPathExtension:@"webapp"];
         NSString *tmpPath = [path stringByAppendingPathExtension:@"unzipped"];
-        NSError *error = nil;
-        
-        if ([fileManager fileExistsAtPath:tmpPath]) {
-            AIQLogCInfo(1, @"Temporary folder for application %@ exists, cleaning up", identifier);
-            if (! [fileManager removeItemAtPath:tmpPath error:&error]) {
-                AIQLogCError(1, @"Failed to clean up launchable %@: %@", identifier, error.localizedDescription);
-                NOTIFY(AIQLaunchableDidFailNotification, self, (@{AIQDocumentIdUserInfoKey: identifier, AIQSolutionUserInfoKey: solution}));
-                return;
-            }
-        }
-        
-        ZipArchive *zip = [ZipArchive new];
-        
-        if (! [zip UnzipOpenFile:path]) {
-            AIQLogCError(1, @"Could not open zip file for application %@", identifier);
-            NOTIFY(AIQLaunchableDidFailNotification, self, (@{AIQDocumentIdUserInfoKey: identifier, AIQSolutionUserInfoKey: solution}));
-            return;
-        }
-        
-        if (! [zip UnzipFileTo:tmpPath overWrite:YES]) {
-            AIQLogCError(4, @"Could not extract application %@", identifier);
-            NOTIFY(AIQLaunchableDidFailNotification, self, (@{AIQDocumentIdUserInfoKey: identifier, AIQSolutionUserInfoKey: solution}));
-            return;
-        }
+        NSString *canaryPath = [appPath stringByAppendingPathComponent:@".aiq_canary"];
         
-        if ([[document valueForKeyPath:@"config.mock"] boolValue]) {
-            AIQLogCInfo(1, @"Application %@ is in mock mode, skipping core API", identifier);
-        } else {
-            AIQLogCInfo(1, @"Copying core API into application %@", identifier);
-            NSString *bundlePath = [[NSBundle mainBundle] pathForResource:@"AIQJSBridge" ofType:@"bundle"];
-            if (! [self copyFile:@"cordova.js" from:bundlePath to:tmpPath using:fileManager error:&error]) {
-                AIQLogCError(1, @"Failed to copy bridge files to launchable %@: %@", identifier, error.localizedDescription);
-                NOTIFY(AIQLaunchableDidFailNotification, self, (@{AIQDocumentIdUserInfoKey: identifier, AIQSolutionUserInfoKey: solution}));
-                return;
+        // the store extracts into the same folders when it reloads, so both go through its lock
+        @synchronized([AIQLaunchableStore extractionLockForPath:path]) {
+            NSError *error = nil;
+            BOOL updated = NO;
+            
+            if ([fileManager fileExistsAtPath:canaryPath]) {
+                // the launchable stays unavailable until it is consistent again, a failed update falls back to a full extraction
+                [fileManager removeItemAtPath:canaryPath error:nil];
+                updated = [LaunchableArchive updateFolderAtPath:appPath fromArchiveAtPath:path stagingPath:tmpPath error:&error];
+                if (! updated) {
+                    AIQLogCInfo(1, @"Could not update application %@ in place, extracting it: %@", identifier, error.localizedDescription);
+                }
             }
-            if (! [self copyFile:@"cordova_plugins.js" from:bundlePath to:tmpPath using:fileManager error:&error]) {
-                AIQLogCError(1, @"Failed to copy bridge files to launchable %@: %@", identifier, error.localizedDescription);
-                NOTIFY(AIQLaunchableDidFailNotification, self, (@{AIQDocumentIdUserInfoKey: identifier, AIQSolutionUserInfoKey: solution}));
-                return;
+            
+            NSString *targetPath = updated ? appPath : tmpPath;
+            
+            if ((! updated) && ([fileManager fileExistsAtPath:tmpPath])) {
+                AIQLogCInfo(1, @"Temporary folder for application %@ exists, cleaning up", identifier);
+                if (! [fileManager removeItemAtPath:tmpPath error:&error]) {
+                    AIQLogCError(1, @"Failed to clean up launchable %@: %@", identifier, error.localizedDescription);
+                    NOTIFY(AIQLaunchableDidFailNotification, self, (@{AIQDocumentIdUserInfoKey: identifier, AIQSolutionUserInfoKey: solution}));
+                    return;
+                }
             }
-            if (! [self copyFile:@"plugins" from:bundlePath to:tmpPath using:fileManager error:&error]) {
-                AIQLogCError(1, @"Failed to copy bridge files to launchable %@: %@", identifier, error.localizedDescription);
-                NOTIFY(AIQLaunchableDidFailNotification, self, (@{AIQDocumentIdUserInfoKey: identifier, AIQSolutionUserInfoKey: solution}));
-                return;
+            
+            if (! updated) {
+                ZipArchive *zip = [ZipArchive new];
+            
+                if (! [zip UnzipOpenFile:path]) {
+                    AIQLogCError(1, @"Could not open zip file for application %@", identifier);
+                    NOTIFY(AIQLaunchableDidFailNotification, self, (@{AIQDocumentIdUserInfoKey: identifier, AIQSolutionUserInfoKey: solution}));
+                    return;
+                }
+            
+                if (! [zip UnzipFileTo:tmpPath overWrite:YES]) {
+                    AIQLogCError(4, @"Could not extract application %@", identifier);
+                    NOTIFY(AIQLaunchableDidFailNotification, self, (@{AIQDocumentIdUserInfoKey: identifier, AIQSolutionUserInfoKey: solution}));
+                    return;
+                }
+            
+                NSDictionary *manifest = [LaunchableArchive manifestForArchiveAtPath:path];
+                if (manifest) {
+                    [LaunchableArchive writeManifest:manifest toFolderAtPath:tmpPath];
+                }
             }
-            if (! [self copyFile:@"cordova.js"
-                            from:bundlePath
-                          toFile:@"aiq-api.js"
-                              in:[tmpPath stringByAppendingPathComponent:@"aiq"]
-                           using:fileManager
-                           error:&error]) {
-                AIQLogCError(1, @"Failed to copy bridge files to launchable %@: %@", identifier, error.localizedDescription);
-                NOTIFY(AIQLaunchableDidFailNotification, self, (@{AIQDocumentIdUserInfoKey: identifier, AIQSolutionUserInfoKey: solution}));
-                return;
+            
+            if ([[document valueForKeyPath:@"config.mock"] boolValue]) {
+                AIQLogCInfo(1, @"Application %@ is in mock mode, skipping core API", identifier);
+            } else {
+                AIQLogCInfo(1, @"Linking core API into application %@", identifier);
+                if (! [BridgeRuntime linkIntoFolderAtPath:targetPath basePath:_basePath error:&error]) {
+                    AIQLogCError(1, @"Failed to link bridge files to launchable %@: %@", identifier, error.localizedDescription);
+                    NOTIFY(AIQLaunchableDidFailNotification, self, (@{AIQDocumentIdUserInfoKey: identifier, AIQSolutionUserInfoKey: solution}));
+                    return;
+                }
             }
-        }
-        
-        if ([fileManager fileExistsAtPath:appPath isDirectory:nil]) {
-            if (! [fileManager removeItemAtPath:appPath error:&error]) {
-                AIQLogCError(1, @"Failed to remove old data for launchable %@: %@", identifier, error.localizedDescription);
-                NOTIFY(AIQLaunchableDidFailNotification, self, (@{AIQDocumentIdUserInfoKey: identifier, AIQSolutionUserInfoKey: solution}));
-                return;
+            
+            if (! updated) {
+                if ([fileManager fileExistsAtPath:appPath isDirectory:nil]) {
+                    if (! [fileManager removeItemAtPath:appPath error:&error]) {
+                        AIQLogCError(1, @"Failed to remove old data for launchable %@: %@", identifier, error.localizedDescription);
+                        NOTIFY(AIQLaunchableDidFailNotification, self, (@{AIQDocumentIdUserInfoKey: identifier, AIQSolutionUserInfoKey: solution}));
+                        return;
+                    }
+                }
+            
+                if (! [fileManager moveItemAtPath:tmpPath toPath:appPath error:&error]) {
+                    AIQLogCError(1, @"Failed to move data for launchable %@: %@", identifier, error.localizedDescription);
+                    NOTIFY(AIQLaunchableDidFailNotification, self, (@{AIQDocumentIdUserInfoKey: identifier, AIQSolutionUserInfoKey: solution}));
+                    return;
+                }
             }
+            
+            [fileManager createFileAtPath:canaryPath contents:[NSData data] attributes:@{NSFileProtectionKey: NSFileProtectionComplete}];
         }
         
-        if (! [fileManager moveItemAtPath:tmpPath toPath:appPath error:&error]) {
-            AIQLogCError(1, @"Failed to move data for launchable %@: %@", identifier, error.localizedDescription);
-            NOTIFY(AIQLaunchableDidFailNotification, self, (@{AIQDocumentIdUserInfoKey: identifier, AIQSolutionUserInfoKey: solution}));
-            return;
-        }
-        
-        NSString *canaryPath = [appPath stringByAppendingPathComponent:@".aiq_canary"];
-        [fileManager createFileAtPath:canaryPath contents:[NSData data] attributes:@{NSFileProtectionKey: NSFileProtectionComplete}];
-        
         NSMutableDictionary *info = [NSMutableDictionary dictionary];
         info[AIQDocumentIdUserInfoKey] = identifier;
         info[AIQSolutionUserInfoKey] = solution;
@@ -357,34 +370,4 @@
     }
 }
 
-- (BOOL)copyFile:(NSString *)file
-            from:(NSString *)source
-              to:(NSString *)target
-           using:(NSFileManager *)fileManager
-           error:(NSError *__autoreleasing *)error {
-    return [self copyFile:file from:source toFile:file in:target using:fileManager error:error];
-}
-
-- (BOOL)copyFile:(NSString *)sourceFile
-            from:(NSString *)sourceFolder
-          toFile:(NSString *)targetFile
-              in:(NSString *)targetFolder
-           using:(NSFileManager *)fileManager
-           error:(NSError *__autoreleasing *)error {
-    NSString *source = [sourceFolder stringByAppendingPathComponent:sourceFile];
-    NSString *target = [targetFolder stringByAppendingPathComponent:targetFile];
-    
-    if ([fileManager fileExistsAtPath:targetFolder]) {
-        if ([fileManager fileExistsAtPath:target]) {
-            if (! [fileManager removeItemAtPath:target error:error]) {
-                return NO;
-            }
-        }
-    } else if (! [fileManager createDirectoryAtPath:targetFolder withIntermediateDirectories:YES attributes:nil error:error]) {
-        return NO;
-    }
-    
-    return [fileManager copyItemAtPath:source toPath:target error:error];
-}
-
 @end
@@ -0,0 +1,77 @@
+#ifndef AIQCoreLib_AIQLiveQuery_h
+#define AIQCoreLib_AIQLiveQuery_h
+
+#import <Foundation/Foundation.h>
+
+/*!
+ @header AIQLiveQuery.h
+ @author Marcin Lukow, Simon Jarbrant
+ @copyright 2016 Appear Networks Systems AB
+ @updated 2016-05-16
+ @brief Live queries which keep a sorted result set of documents up to date.
+ @version 1.6.0
+ */
+
+@class AIQLiveQuery;
+@class AIQPredicate;
+
+/** Handler called by live queries whenever their result set changes.
+ 
+ @param query Live query whose result set has changed. Its documents property contains the current result set.
+ @param inserted Array of documents which started matching the query.
+ @param updated Array of documents which still match the query but have changed.
+ @param removed Array of identifiers of documents which no longer match the query.
+ @since 1.6.0
+ */
+typedef void (^AIQLiveQueryHandler)(AIQLiveQuery *query, NSArray *inserted, NSArray *updated, NSArray *removed);
+
+/** Live query over documents of given type.
+ 
+ Live queries are created by liveQueryForDocumentsOfType:matching:sortDescriptors:handler:error: method of the
+ AIQDataStore module. The handler is first called with the initial result set, passed as inserted documents, and
+ then whenever documents created, updated or deleted locally or by the synchronization change the result set. Only
+ the changed documents are retrieved from the storage, the result set is never queried again as a whole.
+ 
+ Handlers are called on the callback queue of the session. Live queries stay active until they are invalidated or
+ the session is closed.
+ 
+ @since 1.6.0
+ @see AIQDataStore
+ */
+@interface AIQLiveQuery : NSObject
+
+/** Type of documents matched by the query.
+ 
+ @since 1.6.0
+ */
+@property (nonatomic, readonly) NSString *type;
+
+/** Predicate which documents must match, may be nil.
+ 
+ @since 1.6.0
+ */
+@property (nonatomic, readonly) AIQPredicate *predicate;
+
+/** Sort descriptors defining the order of documents, applied to document fields. Documents comparing equal are
+ ordered by their identifiers.
+ 
+ @since 1.6.0
+ */
+@property (nonatomic, readonly) NSArray *sortDescriptors;
+
+/** Current result set of the query, sorted according to sort descriptors. Empty until the handler is called for the
+ first time.
+ 
+ @since 1.6.0
+ */
+@property (nonatomic, readonly) NSArray *documents;
+
+/** Stops the query. The handler will not be called after this method returns.
+ 
+ @since 1.6.0
+ */
+- (void)invalidate;
+
+@end
+
+#endif /* AIQCoreLib_AIQLiveQuery_h */
@@ -0,0 +1,234 @@
+#import "AIQDataStore.h"
+#import "AIQLiveQuery.h"
+#import "AIQLog.h"
+#import "Dispatcher.h"
+#import "LiveQueryCenter.h"
+
+@interface AIQDataStore ()
+
+- (BOOL)documentsOfType:(NSString *)type
+               matching:(AIQPredicate *)predicate
+                 fields:(NSArray *)fields
+            identifiers:(NSArray *)identifiers
+              processor:(void (^)(NSDictionary *, NSError **))processor
+                  error:(NSError **)error;
+
+@end
+
+@interface AIQLiveQuery () {
+    AIQDataStore *_dataStore;
+    NSString *_solution;
+    AIQLiveQueryHandler _handler;
+    LiveQueryCenter *_center;
+    Dispatcher *_dispatcher;
+    dispatch_queue_t _queue;
+    NSComparator _comparator;
+    NSMutableArray *_results;
+    NSMutableDictionary *_index;
+    NSMutableSet *_pending;
+    BOOL _reloadAll;
+    BOOL _scheduled;
+    BOOL _loaded;
+    BOOL _valid;
+}
+
+@end
+
+@implementation AIQLiveQuery
+
+- (instancetype)initWithDataStore:(AIQDataStore *)dataStore
+                         solution:(NSString *)solution
+                             type:(NSString *)type
+                        predicate:(AIQPredicate *)predicate
+                  sortDescriptors:(NSArray *)sortDescriptors
+                          handler:(AIQLiveQueryHandler)handler
+                           center:(LiveQueryCenter *)center
+                       dispatcher:(Dispatcher *)dispatcher {
+    self = [super init];
+    if (self) {
+        _dataStore = dataStore;
+        _solution = [solution copy];
+        _type = [type copy];
+        _predicate = predicate;
+        _sortDescriptors = sortDescriptors ? [sortDescriptors copy] : @[];
+        _handler = [handler copy];
+        _center = center;
+        _dispatcher = dispatcher;
+        _queue = dispatch_queue_create("com.appearnetworks.aiq.livequery", DISPATCH_QUEUE_SERIAL);
+        _documents = @[];
+        _results = [NSMutableArray array];
+        _index = [NSMutableDictionary dictionary];
+        _pending = [NSMutableSet set];
+        _valid = YES;
+
+        NSArray *descriptors = _sortDescriptors;
+        _comparator = ^NSComparisonResult(NSDictionary *left, NSDictionary *right) {
+            for (NSSortDescriptor *descriptor in descriptors) {
+                NSComparisonResult result = [descriptor compareObject:left toObject:right];
+                if (result != NSOrderedSame) {
+                    return result;
+                }
+            }
+            // identifiers keep the order total, so that documents can be located by binary search
+            return [left[kAIQDocumentId] compare:right[kAIQDocumentId]];
+        };
+    }
+    return self;
+}
+
+- (NSString *)solution {
+    return _solution;
+}
+
+- (void)start {
+    [_center addQuery:self];
+    [self documentsDidChange:nil];
+}
+
+- (void)documentsDidChange:(NSArray *)identifiers {
+    @synchronized(self) {
+        if (! _valid) {
+            return;
+        }
+
+        if (identifiers) {
+            [_pending addObjectsFromArray:identifiers];
+        } else {
+            _reloadAll = YES;
+        }
+
+        if (_scheduled) {
+            return;
+        }
+        _scheduled = YES;
+    }
+
+    dispatch_async(_queue, ^{
+        [self refresh];
+    });
+}
+
+- (void)invalidate {
+    @synchronized(self) {
+        if (! _valid) {
+            return;
+        }
+        _valid = NO;
+        _handler = nil;
+    }
+    [_center removeQuery:self];
+}
+
+- (void)dealloc {
+    [self invalidate];
+}
+
+- (NSString *)description {
+    return [NSString stringWithFormat:@"<AIQLiveQuery: %p (%@, %lu documents)>", self, _type, (unsigned long)_documents.count];
+}
+
+#pragma mark - Private API
+
+- (void)refresh {
+    NSArray *identifiers;
+    @synchronized(self) {
+        identifiers = _reloadAll ? nil : [_pending allObjects];
+        [_pending removeAllObjects];
+        _reloadAll = NO;
+        _scheduled = NO;
+        if (! _valid) {
+            return;
+        }
+    }
+
+    NSMutableDictionary *matching = [NSMutableDictionary dictionary];
+    void (^processor)(NSDictionary *, NSError *__autoreleasing *) = ^(NSDictionary *document, NSError *__autoreleasing *error) {
+        matching[document[kAIQDocumentId]] = [document copy];
+    };
+
+    NSError *error = nil;
+    BOOL success = YES;
+    if (identifiers) {
+        // only the changed documents are read, in chunks to stay below the SQLite argument limit
+        for (NSUInteger offset = 0; (success) && (offset < identifiers.count); offset += 500) {
+            NSArray *chunk = [identifiers subarrayWithRange:NSMakeRange(offset, MIN(500, identifiers.count - offset))];
+            success = [_dataStore documentsOfType:_type matching:_predicate fields:nil identifiers:chunk processor:processor error:&error];
+        }
+    } else {
+        success = [_dataStore documentsOfType:_type matching:_predicate fields:nil identifiers:nil processor:processor error:&error];
+        NSMutableSet *all = [NSMutableSet setWithArray:_index.allKeys];
+        [all addObjectsFromArray:matching.allKeys];
+        identifiers = [all allObjects];
+    }
+
+    if (! success) {
+        AIQLogCWarn(1, @"Did fail to refresh live query for type %@: %@", _type, error.localizedDescription);
+        return;
+    }
+
+    NSMutableArray *inserted = [NSMutableArray array];
+    NSMutableArray *updated = [NSMutableArray array];
+    NSMutableArray *removed = [NSMutableArray array];
+
+    for (NSString *identifier in identifiers) {
+        NSDictionary *previous = _index[identifier];
+        NSDictionary *current = matching[identifier];
+
+        if ((! previous) && (! current)) {
+            continue;
+        }
+
+        if ((previous) && (current) && ([previous isEqualToDictionary:current])) {
+            continue;
+        }
+
+        if (previous) {
+            NSUInteger index = [_results indexOfObject:previous
+                                         inSortedRange:NSMakeRange(0, _results.count)
+                                               options:NSBinarySearchingFirstEqual
+                                       usingComparator:_comparator];
+            if (index == NSNotFound) {
+                index = [_results indexOfObjectIdenticalTo:previous];
+            }
+            [_results removeObjectAtIndex:index];
+            [_index removeObjectForKey:identifier];
+        }
+
+        if (current) {
+            NSUInteger index = [_results indexOfObject:current
+                                         inSortedRange:NSMakeRange(0, _results.count)
+                                               options:NSBinarySearchingInsertionIndex
+                                       usingComparator:_comparator];
+            [_results insertObject:current atIndex:index];
+            _index[identifier] = current;
+        }
+
+        if ((previous) && (current)) {
+            [updated addObject:current];
+        } else if (current) {
+            [inserted addObject:current];
+        } else {
+            [removed addObject:identifier];
+        }
+    }
+
+    if ((_loaded) && (inserted.count == 0) && (updated.count == 0) && (removed.count == 0)) {
+        return;
+    }
+    _loaded = YES;
+
+    NSArray *documents = [_results copy];
+    [_dispatcher complete:^{
+        AIQLiveQueryHandler handler;
+        @synchronized(self) {
+            if (! _valid) {
+                return;
+            }
+            _documents = documents;
+            handler = _handler;
+        }
+        handler(self, inserted, updated, removed);
+    }];
+}
+
+@end
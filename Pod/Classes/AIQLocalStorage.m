@@ -2,15 +2,34 @@
 
 #import "AIQDataStore.h"
 #import "AIQError.h"
-#import "AIQJSON.h"
 #import "AIQLocalStorage.h"
+#import "AIQPredicate.h"
 #import "AIQSession.h"
+#import "AIQSynchronization.h"
+#import "Dispatcher.h"
+#import "DocumentCodec.h"
+#import "FMDatabase+Helpers.h"
+#import "NSFileManager+Helpers.h"
+#import "SearchIndex.h"
+#import "common.h"
+
+@interface AIQPredicate ()
+
++ (NSString *)expressionForField:(NSString *)field column:(NSString *)column error:(NSError **)error;
++ (NSString *)projectionForFields:(NSArray *)fields column:(NSString *)column error:(NSError **)error;
++ (NSMutableDictionary *)dictionaryFromProjection:(NSData *)projection fields:(NSArray *)fields;
++ (NSString *)literalForString:(NSString *)string;
++ (NSString *)identifierForString:(NSString *)string;
+- (NSString *)SQLForColumn:(NSString *)column arguments:(NSMutableArray *)arguments error:(NSError **)error;
+
+@end
 
 @interface AIQLocalStorage () {
     NSString *_basePath;
     NSString *_solution;
     FMDatabasePool *_pool;
     NSFileManager *_fileManager;
+    Dispatcher *_dispatcher;
 }
 
 @end
@@ -51,8 +70,9 @@
     if (self) {
         _basePath = [[[session valueForKey:@"basePath"] stringByAppendingPathComponent:solution] stringByAppendingPathComponent:@"local"];
         _solution = solution;
-        _pool = [FMDatabasePool databasePoolWithPath:[session valueForKey:@"dbPath"]];
+        _pool = [FMDatabasePool documentPoolWithPath:[session valueForKey:@"dbPath"]];
         _fileManager = [NSFileManager new];
+        _dispatcher = [session valueForKey:@"dispatcher"];
     }
     
     return self;
@@ -79,6 +99,10 @@
 }
 
 - (NSDictionary *)documentForId:(NSString *)identifier error:(NSError *__autoreleasing *)error {
+    return [self documentForId:identifier fields:nil error:error];
+}
+
+- (NSDictionary *)documentForId:(NSString *)identifier fields:(NSArray *)fields error:(NSError *__autoreleasing *)error {
     if (error) {
         *error = nil;
     }
@@ -90,10 +114,20 @@
         return nil;
     }
     
+    NSString *projection = @"data";
+    if (fields) {
+        projection = [AIQPredicate projectionForFields:fields column:@"data" error:error];
+        if (! projection) {
+            return nil;
+        }
+    }
+    
+    NSString *query = [NSString stringWithFormat:@"SELECT type, %@ FROM localdocuments WHERE solution = ? AND identifier = ?", projection];
+    
     __block NSDictionary *result = nil;
     
     [_pool inDatabase:^(FMDatabase *db) {
-        FMResultSet *rs = [db executeQuery:@"SELECT type, data FROM localdocuments WHERE solution = ? AND identifier = ?", _solution, identifier];
+        FMResultSet *rs = [db executeQuery:query, _solution, identifier];
         if (! rs) {
             if (error) {
                 *error = [AIQError errorWithCode:AIQErrorContainerFault message:[db lastError].localizedDescription];
@@ -102,7 +136,7 @@
         }
         
         if ([rs next]) {
-            NSMutableDictionary *data = [[rs dataForColumnIndex:1] JSONObject];
+            NSMutableDictionary *data = [self dataFromResultSet:rs columnIndex:1 fields:fields];
             data[kAIQDocumentId] = identifier;
             data[kAIQDocumentType] = [rs stringForColumnIndex:0];
             result = [data copy];
@@ -116,6 +150,21 @@
 }
 
 - (BOOL)documentsOfType:(NSString *)type processor:(void (^)(NSDictionary *, NSError **))processor error:(NSError *__autoreleasing *)error {
+    return [self documentsOfType:type matching:nil processor:processor error:error];
+}
+
+- (BOOL)documentsOfType:(NSString *)type
+               matching:(AIQPredicate *)predicate
+              processor:(void (^)(NSDictionary *, NSError **))processor
+                  error:(NSError *__autoreleasing *)error {
+    return [self documentsOfType:type matching:predicate fields:nil processor:processor error:error];
+}
+
+- (BOOL)documentsOfType:(NSString *)type
+               matching:(AIQPredicate *)predicate
+                 fields:(NSArray *)fields
+              processor:(void (^)(NSDictionary *, NSError **))processor
+                  error:(NSError *__autoreleasing *)error {
     if (error) {
         *error = nil;
     }
@@ -134,10 +183,31 @@
         return NO;
     }
     
+    NSMutableArray *arguments = [NSMutableArray array];
+    NSString *clause = @"1";
+    if (predicate) {
+        clause = [predicate SQLForColumn:@"data" arguments:arguments error:error];
+        if (! clause) {
+            return NO;
+        }
+    }
+    
+    NSString *projection = @"data";
+    if (fields) {
+        projection = [AIQPredicate projectionForFields:fields column:@"data" error:error];
+        if (! projection) {
+            return NO;
+        }
+    }
+    
+    // solution and type are inlined so that SQLite can use the partial indexes declared for them
+    NSString *query = [NSString stringWithFormat:@"SELECT identifier, %@ FROM localdocuments WHERE solution = %@ AND type = %@ AND (%@)",
+                       projection, [AIQPredicate literalForString:_solution], [AIQPredicate literalForString:type], clause];
+    
     __block BOOL result = YES;
     
     [_pool inDatabase:^(FMDatabase *db) {
-        FMResultSet *rs = [db executeQuery:@"SELECT identifier, data FROM localdocuments WHERE solution = ? AND type = ?", _solution, type];
+        FMResultSet *rs = [db executeQuery:query withArgumentsInArray:arguments];
         if (! rs) {
             result = NO;
             if (error) {
@@ -148,7 +218,7 @@
         
         NSError *localError = nil;
         while ([rs next]) {
-            NSMutableDictionary *data = [[rs dataForColumnIndex:1] JSONObject];
+            NSMutableDictionary *data = [self dataFromResultSet:rs columnIndex:1 fields:fields];
             data[kAIQDocumentId] = [rs stringForColumnIndex:0];
             data[kAIQDocumentType] = type;
             processor(data, &localError);
@@ -205,9 +275,12 @@
         }
     }
     
+    // encoding and compression happen before a connection is taken
+    NSData *data = [DocumentCodec dataWithObject:filtered];
+    
     [_pool inDatabase:^(FMDatabase *db) {
         if (! [db executeUpdate:@"INSERT INTO localdocuments (solution, identifier, type, data) VALUES (?, ?, ?, ?)",
-               _solution, identifier, type, [filtered JSONData]]) {
+               _solution, identifier, type, data]) {
             filtered = nil;
             if (error) {
                 *error = [AIQError errorWithCode:AIQErrorContainerFault message:[db lastError].localizedDescription];
@@ -251,6 +324,9 @@
         }
     }
     
+    // encoding and compression happen before a connection is taken
+    NSData *data = [DocumentCodec dataWithObject:filtered];
+    
     [_pool inDatabase:^(FMDatabase *db) {
         FMResultSet *rs = [db executeQuery:@"SELECT type FROM localdocuments WHERE solution = ? AND identifier = ?", _solution, identifier];
         if (! rs) {
@@ -274,7 +350,7 @@
         [rs close];
         
         if (! [db executeUpdate:@"UPDATE localdocuments SET data = ? WHERE solution = ? AND identifier = ?",
-               [filtered JSONData], _solution, identifier]) {
+               data, _solution, identifier]) {
             filtered = nil;
             if (error) {
                 *error = [AIQError errorWithCode:AIQErrorContainerFault message:[db lastError].localizedDescription];
@@ -329,6 +405,397 @@
     return result;
 }
 
+- (NSArray *)createDocumentsOfType:(NSString *)type withFields:(NSArray *)fields error:(NSError *__autoreleasing *)error {
+    if (error) {
+        *error = nil;
+    }
+    
+    if (! type) {
+        if (error) {
+            *error = [AIQError errorWithCode:AIQErrorInvalidArgument message:@"Type not specified"];
+        }
+        return nil;
+    }
+    
+    if (! fields) {
+        if (error) {
+            *error = [AIQError errorWithCode:AIQErrorInvalidArgument message:@"Fields not specified"];
+        }
+        return nil;
+    }
+    
+    NSMutableArray *identifiers = [NSMutableArray arrayWithCapacity:fields.count];
+    for (NSDictionary *item in fields) {
+        if (([item isKindOfClass:[NSDictionary class]]) && ([item[kAIQDocumentId] isKindOfClass:[NSString class]])) {
+            [identifiers addObject:item[kAIQDocumentId]];
+        }
+    }
+    
+    __block NSMutableArray *result = nil;
+    NSMutableArray *created = [NSMutableArray array];
+    NSArray *prepared = [self preparedDocuments:fields];
+    
+    [_pool inTransaction:^(FMDatabase *db, BOOL *rollback) {
+        db.shouldCacheStatements = YES;
+        
+        NSMutableDictionary *existing = [[self rowsForIds:identifiers database:db] mutableCopy];
+        if (! existing) {
+            *rollback = YES;
+            if (error) {
+                *error = [AIQError errorWithCode:AIQErrorContainerFault message:[db lastError].localizedDescription];
+            }
+            return;
+        }
+        
+        result = [NSMutableArray arrayWithCapacity:fields.count];
+        for (NSUInteger i = 0; i < fields.count; i++) {
+            @autoreleasepool {
+                NSDictionary *item = fields[i];
+                if (! [item isKindOfClass:[NSDictionary class]]) {
+                    [result addObject:[AIQError errorWithCode:AIQErrorInvalidArgument message:@"Fields not specified"]];
+                    continue;
+                }
+                
+                NSString *identifier = item[kAIQDocumentId];
+                if (identifier) {
+                    if (existing[identifier]) {
+                        [result addObject:[AIQError errorWithCode:AIQErrorInvalidArgument message:@"Duplicate document identifier"]];
+                        continue;
+                    }
+                } else {
+                    identifier = [[NSUUID UUID] UUIDString];
+                }
+                
+                NSMutableDictionary *filtered = prepared[i][0];
+                
+                if (! [db executeUpdate:@"INSERT INTO localdocuments (solution, identifier, type, data) VALUES (?, ?, ?, ?)",
+                       _solution, identifier, type, prepared[i][1]]) {
+                    [result addObject:[AIQError errorWithCode:AIQErrorContainerFault message:[db lastError].localizedDescription]];
+                    continue;
+                }
+                
+                existing[identifier] = type;
+                filtered[kAIQDocumentId] = identifier;
+                filtered[kAIQDocumentType] = type;
+                [result addObject:[filtered copy]];
+                [created addObject:identifier];
+            }
+        }
+    }];
+    
+    if (created.count != 0) {
+        NOTIFY(AIQDidChangeDocumentsNotification, self, (@{AIQSolutionUserInfoKey: _solution,
+                                                           AIQCreatedDocumentIdsUserInfoKey: created,
+                                                           AIQUpdatedDocumentIdsUserInfoKey: @[],
+                                                           AIQDeletedDocumentIdsUserInfoKey: @[]}));
+    }
+    
+    return [result copy];
+}
+
+- (NSArray *)updateDocuments:(NSArray *)documents error:(NSError *__autoreleasing *)error {
+    if (error) {
+        *error = nil;
+    }
+    
+    if (! documents) {
+        if (error) {
+            *error = [AIQError errorWithCode:AIQErrorInvalidArgument message:@"Documents not specified"];
+        }
+        return nil;
+    }
+    
+    NSMutableArray *identifiers = [NSMutableArray arrayWithCapacity:documents.count];
+    for (NSDictionary *document in documents) {
+        if (([document isKindOfClass:[NSDictionary class]]) && ([document[kAIQDocumentId] isKindOfClass:[NSString class]])) {
+            [identifiers addObject:document[kAIQDocumentId]];
+        }
+    }
+    
+    __block NSMutableArray *result = nil;
+    NSMutableArray *updated = [NSMutableArray array];
+    NSArray *prepared = [self preparedDocuments:documents];
+    
+    [_pool inTransaction:^(FMDatabase *db, BOOL *rollback) {
+        db.shouldCacheStatements = YES;
+        
+        NSDictionary *types = [self rowsForIds:identifiers database:db];
+        if (! types) {
+            *rollback = YES;
+            if (error) {
+                *error = [AIQError errorWithCode:AIQErrorContainerFault message:[db lastError].localizedDescription];
+            }
+            return;
+        }
+        
+        result = [NSMutableArray arrayWithCapacity:documents.count];
+        for (NSUInteger i = 0; i < documents.count; i++) {
+            @autoreleasepool {
+                NSDictionary *document = documents[i];
+                if (! [document isKindOfClass:[NSDictionary class]]) {
+                    [result addObject:[AIQError errorWithCode:AIQErrorInvalidArgument message:@"Fields not specified"]];
+                    continue;
+                }
+                
+                NSString *identifier = document[kAIQDocumentId];
+                if (! [identifier isKindOfClass:[NSString class]]) {
+                    [result addObject:[AIQError errorWithCode:AIQErrorInvalidArgument message:@"Identifier not specified"]];
+                    continue;
+                }
+                
+                NSString *type = types[identifier];
+                if (! type) {
+                    [result addObject:[AIQError errorWithCode:AIQErrorIdNotFound message:@"Document not found"]];
+                    continue;
+                }
+                
+                NSMutableDictionary *filtered = prepared[i][0];
+                
+                if (! [db executeUpdate:@"UPDATE localdocuments SET data = ? WHERE solution = ? AND identifier = ?",
+                       prepared[i][1], _solution, identifier]) {
+                    [result addObject:[AIQError errorWithCode:AIQErrorContainerFault message:[db lastError].localizedDescription]];
+                    continue;
+                }
+                
+                filtered[kAIQDocumentId] = identifier;
+                filtered[kAIQDocumentType] = type;
+                [result addObject:[filtered copy]];
+                [updated addObject:identifier];
+            }
+        }
+    }];
+    
+    if (updated.count != 0) {
+        NOTIFY(AIQDidChangeDocumentsNotification, self, (@{AIQSolutionUserInfoKey: _solution,
+                                                           AIQCreatedDocumentIdsUserInfoKey: @[],
+                                                           AIQUpdatedDocumentIdsUserInfoKey: updated,
+                                                           AIQDeletedDocumentIdsUserInfoKey: @[]}));
+    }
+    
+    return [result copy];
+}
+
+- (NSArray *)deleteDocumentsWithIds:(NSArray *)identifiers error:(NSError *__autoreleasing *)error {
+    if (error) {
+        *error = nil;
+    }
+    
+    if (! identifiers) {
+        if (error) {
+            *error = [AIQError errorWithCode:AIQErrorInvalidArgument message:@"Identifiers not specified"];
+        }
+        return nil;
+    }
+    
+    __block NSMutableArray *result = nil;
+    NSMutableArray *deleted = [NSMutableArray array];
+    
+    [_pool inTransaction:^(FMDatabase *db, BOOL *rollback) {
+        db.shouldCacheStatements = YES;
+        
+        result = [NSMutableArray arrayWithCapacity:identifiers.count];
+        for (NSString *identifier in identifiers) {
+            if (! [identifier isKindOfClass:[NSString class]]) {
+                [result addObject:[AIQError errorWithCode:AIQErrorInvalidArgument message:@"Identifier not specified"]];
+                continue;
+            }
+            
+            if (! [db executeUpdate:@"DELETE FROM localdocuments WHERE solution = ? AND identifier = ?", _solution, identifier]) {
+                // the whole batch is rolled back, there are no partial deletes
+                *rollback = YES;
+                result = nil;
+                [deleted removeAllObjects];
+                if (error) {
+                    *error = [AIQError errorWithCode:AIQErrorContainerFault message:[db lastError].localizedDescription];
+                }
+                return;
+            }
+            
+            if ([db changes] != 1) {
+                [result addObject:[AIQError errorWithCode:AIQErrorIdNotFound message:@"Document not found"]];
+                continue;
+            }
+            
+            if (! [db executeUpdate:@"DELETE FROM localattachments WHERE solution = ? AND identifier = ?", _solution, identifier]) {
+                *rollback = YES;
+                result = nil;
+                [deleted removeAllObjects];
+                if (error) {
+                    *error = [AIQError errorWithCode:AIQErrorContainerFault message:[db lastError].localizedDescription];
+                }
+                return;
+            }
+            
+            [result addObject:@YES];
+            [deleted addObject:identifier];
+        }
+    }];
+    
+    for (NSString *identifier in deleted) {
+        [_fileManager removeItemAtPath:[_basePath stringByAppendingPathComponent:identifier] error:nil];
+    }
+    
+    if (deleted.count != 0) {
+        NOTIFY(AIQDidChangeDocumentsNotification, self, (@{AIQSolutionUserInfoKey: _solution,
+                                                           AIQCreatedDocumentIdsUserInfoKey: @[],
+                                                           AIQUpdatedDocumentIdsUserInfoKey: @[],
+                                                           AIQDeletedDocumentIdsUserInfoKey: deleted}));
+    }
+    
+    return [result copy];
+}
+
+- (BOOL)createIndexForField:(NSString *)field ofDocumentsOfType:(NSString *)type error:(NSError *__autoreleasing *)error {
+    if (error) {
+        *error = nil;
+    }
+    
+    if (! type) {
+        if (error) {
+            *error = [AIQError errorWithCode:AIQErrorInvalidArgument message:@"Type not specified"];
+        }
+        return NO;
+    }
+    
+    NSString *expression = [AIQPredicate expressionForField:field column:@"data" error:error];
+    if (! expression) {
+        return NO;
+    }
+    
+    // indexes belong to a solution, other solutions declare and drop their own
+    NSString *name = [AIQPredicate identifierForString:[NSString stringWithFormat:@"localdocuments:%@:%@:%@", _solution, type, field]];
+    NSString *query = [NSString stringWithFormat:@"CREATE INDEX IF NOT EXISTS %@ ON localdocuments(%@) WHERE solution = %@ AND type = %@",
+                       name, expression, [AIQPredicate literalForString:_solution], [AIQPredicate literalForString:type]];
+    
+    __block BOOL result = YES;
+    
+    [_pool inDatabase:^(FMDatabase *db) {
+        if (! [db executeUpdate:query]) {
+            result = NO;
+            if (error) {
+                *error = [AIQError errorWithCode:AIQErrorContainerFault message:[db lastError].localizedDescription];
+            }
+        }
+    }];
+    
+    return result;
+}
+
+- (BOOL)dropIndexForField:(NSString *)field ofDocumentsOfType:(NSString *)type error:(NSError *__autoreleasing *)error {
+    if (error) {
+        *error = nil;
+    }
+    
+    if (! type) {
+        if (error) {
+            *error = [AIQError errorWithCode:AIQErrorInvalidArgument message:@"Type not specified"];
+        }
+        return NO;
+    }
+    
+    if (! field) {
+        if (error) {
+            *error = [AIQError errorWithCode:AIQErrorInvalidArgument message:@"Field not specified"];
+        }
+        return NO;
+    }
+    
+    NSString *name = [AIQPredicate identifierForString:[NSString stringWithFormat:@"localdocuments:%@:%@:%@", _solution, type, field]];
+    NSString *query = [NSString stringWithFormat:@"DROP INDEX IF EXISTS %@", name];
+    
+    __block BOOL result = YES;
+    
+    [_pool inDatabase:^(FMDatabase *db) {
+        if (! [db executeUpdate:query]) {
+            result = NO;
+            if (error) {
+                *error = [AIQError errorWithCode:AIQErrorContainerFault message:[db lastError].localizedDescription];
+            }
+        }
+    }];
+    
+    return result;
+}
+
+- (BOOL)createSearchIndexForFields:(NSArray *)fields ofDocumentsOfType:(NSString *)type error:(NSError *__autoreleasing *)error {
+    if (error) {
+        *error = nil;
+    }
+    
+    if (! type) {
+        if (error) {
+            *error = [AIQError errorWithCode:AIQErrorInvalidArgument message:@"Type not specified"];
+        }
+        return NO;
+    }
+    
+    if ([type characterAtIndex:0] == '_') {
+        if (error) {
+            *error = [AIQError errorWithCode:AIQErrorInvalidArgument message:@"Restricted document type"];
+        }
+        return NO;
+    }
+    
+    __block BOOL result = NO;
+    
+    [_pool inTransaction:^(FMDatabase *db, BOOL *rollback) {
+        result = [SearchIndex createIndexForFields:fields type:type solution:_solution table:@"localdocuments" inDatabase:db error:error];
+        *rollback = ! result;
+    }];
+    
+    return result;
+}
+
+- (BOOL)dropSearchIndexForDocumentsOfType:(NSString *)type error:(NSError *__autoreleasing *)error {
+    if (error) {
+        *error = nil;
+    }
+    
+    if (! type) {
+        if (error) {
+            *error = [AIQError errorWithCode:AIQErrorInvalidArgument message:@"Type not specified"];
+        }
+        return NO;
+    }
+    
+    __block BOOL result = NO;
+    
+    [_pool inTransaction:^(FMDatabase *db, BOOL *rollback) {
+        result = [SearchIndex dropIndexForType:type solution:_solution table:@"localdocuments" inDatabase:db error:error];
+        *rollback = ! result;
+    }];
+    
+    return result;
+}
+
+- (NSArray *)searchDocumentsOfType:(NSString *)type forText:(NSString *)text limit:(NSUInteger)limit error:(NSError *__autoreleasing *)error {
+    if (error) {
+        *error = nil;
+    }
+    
+    if (! type) {
+        if (error) {
+            *error = [AIQError errorWithCode:AIQErrorInvalidArgument message:@"Type not specified"];
+        }
+        return nil;
+    }
+    
+    if (! text) {
+        if (error) {
+            *error = [AIQError errorWithCode:AIQErrorInvalidArgument message:@"Text not specified"];
+        }
+        return nil;
+    }
+    
+    __block NSArray *result = nil;
+    
+    [_pool inDatabase:^(FMDatabase *db) {
+        result = [SearchIndex search:text type:type solution:_solution table:@"localdocuments" condition:nil limit:limit inDatabase:db error:error];
+    }];
+    
+    return result;
+}
+
 - (BOOL)attachmentWithName:(NSString *)name existsForDocumentWithId:(NSString *)identifier {
     if ((! name) || (! identifier)) {
         return NO;
@@ -371,28 +838,10 @@
         return nil;
     }
     
-    if (! [self documentExistsWithId:identifier]) {
-        if (error) {
-            *error = [AIQError errorWithCode:AIQErrorIdNotFound message:@"Document not found"];
-        }
-        return nil;
-    }
-    
     __block NSDictionary *result = nil;
     
     [_pool inDatabase:^(FMDatabase *db) {
-        FMResultSet *rs = [db executeQuery:@"SELECT contentType FROM localattachments WHERE solution = ? AND identifier = ? AND name = ?",
-                           _solution, identifier, name];
-        if (rs) {
-            if ([rs next]) {
-                result = @{kAIQAttachmentName: name, kAIQAttachmentContentType: [rs stringForColumnIndex:0]};
-            } else if (error) {
-                *error = [AIQError errorWithCode:AIQErrorNameNotFound message:@"Attachment not found"];
-            }
-            [rs close];
-        } else if (error) {
-            *error = [AIQError errorWithCode:AIQErrorContainerFault message:[db lastError].localizedDescription];
-        }
+        result = [self attachmentWithName:name forDocumentWithId:identifier inDatabase:db error:error];
     }];
     
     return result;
@@ -755,29 +1204,318 @@
         return nil;
     }
     
-    if (! [self documentExistsWithId:identifier]) {
+    NSString *path = [self pathForAttachmentWithName:name fromDocumentWithId:identifier error:error];
+    if (! path) {
+        return nil;
+    }
+    
+    // mapping keeps large attachments out of the heap
+    return [_fileManager mappedContentsAtPath:path error:error];
+}
+
+- (NSInputStream *)streamForAttachmentWithName:(NSString *)name fromDocumentWithId:(NSString *)identifier error:(NSError *__autoreleasing *)error {
+    if (error) {
+        *error = nil;
+    }
+    
+    if (! identifier) {
         if (error) {
-            *error = [AIQError errorWithCode:AIQErrorIdNotFound message:@"Document not found"];
+            *error = [AIQError errorWithCode:AIQErrorInvalidArgument message:@"Identifier not specified"];
         }
         return nil;
     }
     
-    if (! [self attachmentWithName:name existsForDocumentWithId:identifier]) {
+    if (! name) {
         if (error) {
-            *error = [AIQError errorWithCode:AIQErrorNameNotFound message:@"Attachment not found"];
+            *error = [AIQError errorWithCode:AIQErrorInvalidArgument message:@"Name not specified"];
         }
         return nil;
     }
     
-    NSString *path = [[_basePath stringByAppendingPathComponent:identifier] stringByAppendingPathComponent:name];
-    if (! [_fileManager fileExistsAtPath:path]) {
+    NSString *path = [self pathForAttachmentWithName:name fromDocumentWithId:identifier error:error];
+    if (! path) {
+        return nil;
+    }
+    
+    NSInputStream *stream = [NSInputStream inputStreamWithFileAtPath:path];
+    if (! stream) {
         if (error) {
             *error = [AIQError errorWithCode:AIQErrorResourceNotFound message:@"Resource not found"];
         }
         return nil;
     }
     
-    return [_fileManager contentsAtPath:path];
+    return stream;
+}
+
+- (BOOL)dataForAttachmentWithName:(NSString *)name
+               fromDocumentWithId:(NSString *)identifier
+                        chunkSize:(NSUInteger)chunkSize
+                        processor:(void (^)(NSData *, NSError *__autoreleasing *))processor
+                            error:(NSError *__autoreleasing *)error {
+    if (error) {
+        *error = nil;
+    }
+    
+    if (! identifier) {
+        if (error) {
+            *error = [AIQError errorWithCode:AIQErrorInvalidArgument message:@"Identifier not specified"];
+        }
+        return NO;
+    }
+    
+    if (! name) {
+        if (error) {
+            *error = [AIQError errorWithCode:AIQErrorInvalidArgument message:@"Name not specified"];
+        }
+        return NO;
+    }
+    
+    NSString *path = [self pathForAttachmentWithName:name fromDocumentWithId:identifier error:error];
+    if (! path) {
+        return NO;
+    }
+    
+    return [_fileManager readContentsAtPath:path chunkSize:chunkSize processor:processor error:error];
+}
+
+#pragma mark - Asynchronous API
+
+- (void)documentForId:(NSString *)identifier completion:(void (^)(NSDictionary *document, NSError *error))completion {
+    [_dispatcher read:^{
+        NSError *error = nil;
+        NSDictionary *document = [self documentForId:identifier error:&error];
+        if (completion) {
+            [_dispatcher complete:^{
+                completion(document, error);
+            }];
+        }
+    }];
+}
+
+- (void)documentForId:(NSString *)identifier fields:(NSArray *)fields completion:(void (^)(NSDictionary *document, NSError *error))completion {
+    [_dispatcher read:^{
+        NSError *error = nil;
+        NSDictionary *document = [self documentForId:identifier fields:fields error:&error];
+        if (completion) {
+            [_dispatcher complete:^{
+                completion(document, error);
+            }];
+        }
+    }];
+}
+
+- (void)documentsOfType:(NSString *)type
+               matching:(AIQPredicate *)predicate
+                 fields:(NSArray *)fields
+             completion:(void (^)(NSArray *documents, NSError *error))completion {
+    [_dispatcher read:^{
+        NSError *error = nil;
+        NSMutableArray *result = [NSMutableArray array];
+        BOOL success = [self documentsOfType:type matching:predicate fields:fields processor:^(NSDictionary *document, NSError *__autoreleasing *processorError) {
+            [result addObject:document];
+        } error:&error];
+        NSArray *documents = success ? [result copy] : nil;
+        if (completion) {
+            [_dispatcher complete:^{
+                completion(documents, error);
+            }];
+        }
+    }];
+}
+
+- (void)createDocumentOfType:(NSString *)type withFields:(NSDictionary *)fields completion:(void (^)(NSDictionary *document, NSError *error))completion {
+    [_dispatcher write:^{
+        NSError *error = nil;
+        NSDictionary *document = [self createDocumentOfType:type withFields:fields error:&error];
+        if (completion) {
+            [_dispatcher complete:^{
+                completion(document, error);
+            }];
+        }
+    }];
+}
+
+- (void)updateFields:(NSDictionary *)fields forDocumentWithId:(NSString *)identifier completion:(void (^)(NSDictionary *document, NSError *error))completion {
+    [_dispatcher write:^{
+        NSError *error = nil;
+        NSDictionary *document = [self updateFields:fields forDocumentWithId:identifier error:&error];
+        if (completion) {
+            [_dispatcher complete:^{
+                completion(document, error);
+            }];
+        }
+    }];
+}
+
+- (void)deleteDocumentWithId:(NSString *)identifier completion:(void (^)(NSError *error))completion {
+    [_dispatcher write:^{
+        NSError *error = nil;
+        [self deleteDocumentWithId:identifier error:&error];
+        if (completion) {
+            [_dispatcher complete:^{
+                completion(error);
+            }];
+        }
+    }];
+}
+
+- (void)createDocumentsOfType:(NSString *)type withFields:(NSArray *)fields completion:(void (^)(NSArray *results, NSError *error))completion {
+    [_dispatcher write:^{
+        NSError *error = nil;
+        NSArray *results = [self createDocumentsOfType:type withFields:fields error:&error];
+        if (completion) {
+            [_dispatcher complete:^{
+                completion(results, error);
+            }];
+        }
+    }];
+}
+
+- (void)updateDocuments:(NSArray *)documents completion:(void (^)(NSArray *results, NSError *error))completion {
+    [_dispatcher write:^{
+        NSError *error = nil;
+        NSArray *results = [self updateDocuments:documents error:&error];
+        if (completion) {
+            [_dispatcher complete:^{
+                completion(results, error);
+            }];
+        }
+    }];
+}
+
+- (void)deleteDocumentsWithIds:(NSArray *)identifiers completion:(void (^)(NSArray *results, NSError *error))completion {
+    [_dispatcher write:^{
+        NSError *error = nil;
+        NSArray *results = [self deleteDocumentsWithIds:identifiers error:&error];
+        if (completion) {
+            [_dispatcher complete:^{
+                completion(results, error);
+            }];
+        }
+    }];
+}
+
+- (void)dataForAttachmentWithName:(NSString *)name fromDocumentWithId:(NSString *)identifier completion:(void (^)(NSData *data, NSError *error))completion {
+    [_dispatcher read:^{
+        NSError *error = nil;
+        NSData *data = [self dataForAttachmentWithName:name fromDocumentWithId:identifier error:&error];
+        if (completion) {
+            [_dispatcher complete:^{
+                completion(data, error);
+            }];
+        }
+    }];
+}
+
+#pragma mark - Private API
+
+- (NSDictionary *)attachmentWithName:(NSString *)name
+                   forDocumentWithId:(NSString *)identifier
+                          inDatabase:(FMDatabase *)db
+                               error:(NSError *__autoreleasing *)error {
+    // validates the document and the attachment in one go, a.name is NULL if only the document exists
+    FMResultSet *rs = [db executeQuery:@"SELECT a.name, a.contentType FROM localdocuments d "
+                       "LEFT OUTER JOIN localattachments a ON a.solution = d.solution AND a.identifier = d.identifier AND a.name = ? "
+                       "WHERE d.solution = ? AND d.identifier = ?",
+                       name, _solution, identifier];
+    if (! rs) {
+        if (error) {
+            *error = [AIQError errorWithCode:AIQErrorContainerFault message:[db lastError].localizedDescription];
+        }
+        return nil;
+    }
+    
+    if (! [rs next]) {
+        [rs close];
+        if (error) {
+            *error = [AIQError errorWithCode:AIQErrorIdNotFound message:@"Document not found"];
+        }
+        return nil;
+    }
+    
+    if ([rs columnIndexIsNull:0]) {
+        [rs close];
+        if (error) {
+            *error = [AIQError errorWithCode:AIQErrorNameNotFound message:@"Attachment not found"];
+        }
+        return nil;
+    }
+    
+    NSDictionary *result = @{kAIQAttachmentName: name, kAIQAttachmentContentType: [rs stringForColumnIndex:1]};
+    [rs close];
+    
+    return result;
+}
+
+- (NSString *)pathForAttachmentWithName:(NSString *)name fromDocumentWithId:(NSString *)identifier error:(NSError *__autoreleasing *)error {
+    __block NSDictionary *attachment = nil;
+    
+    [_pool inDatabase:^(FMDatabase *db) {
+        attachment = [self attachmentWithName:name forDocumentWithId:identifier inDatabase:db error:error];
+    }];
+    
+    if (! attachment) {
+        return nil;
+    }
+    
+    return [[_basePath stringByAppendingPathComponent:identifier] stringByAppendingPathComponent:name];
+}
+
+- (NSArray *)preparedDocuments:(NSArray *)documents {
+    // documents are filtered and encoded before the transaction, so that compression does not hold up other writers
+    NSMutableArray *prepared = [NSMutableArray arrayWithCapacity:documents.count];
+    for (NSDictionary *document in documents) {
+        @autoreleasepool {
+            if (! [document isKindOfClass:[NSDictionary class]]) {
+                [prepared addObject:[NSNull null]];
+                continue;
+            }
+
+            NSMutableDictionary *filtered = [NSMutableDictionary dictionary];
+            for (NSString *field in document) {
+                if ([field characterAtIndex:0] != '_') {
+                    filtered[field] = document[field];
+                }
+            }
+            [prepared addObject:@[filtered, [DocumentCodec dataWithObject:filtered] ?: [NSNull null]]];
+        }
+    }
+    return prepared;
+}
+
+- (NSDictionary *)rowsForIds:(NSArray *)identifiers database:(FMDatabase *)db {
+    NSMutableDictionary *types = [NSMutableDictionary dictionaryWithCapacity:identifiers.count];
+    
+    // SQLite limits the number of host parameters, so the identifiers are queried in chunks
+    for (NSUInteger offset = 0; offset < identifiers.count; offset += 500) {
+        NSArray *chunk = [identifiers subarrayWithRange:NSMakeRange(offset, MIN(500, identifiers.count - offset))];
+        NSMutableArray *placeholders = [NSMutableArray arrayWithCapacity:chunk.count];
+        for (NSUInteger i = 0; i < chunk.count; i++) {
+            [placeholders addObject:@"?"];
+        }
+        
+        NSString *query = [NSString stringWithFormat:@"SELECT identifier, type FROM localdocuments WHERE solution = ? AND identifier IN (%@)",
+                           [placeholders componentsJoinedByString:@", "]];
+        FMResultSet *rs = [db executeQuery:query withArgumentsInArray:[@[_solution] arrayByAddingObjectsFromArray:chunk]];
+        if (! rs) {
+            return nil;
+        }
+        
+        while ([rs next]) {
+            types[[rs stringForColumnIndex:0]] = [rs stringForColumnIndex:1];
+        }
+        [rs close];
+    }
+    
+    return types;
+}
+
+- (NSMutableDictionary *)dataFromResultSet:(FMResultSet *)rs columnIndex:(int)columnIndex fields:(NSArray *)fields {
+    if (fields) {
+        return [AIQPredicate dictionaryFromProjection:[rs dataForColumnIndex:columnIndex] fields:fields];
+    }
+    return [DocumentCodec objectWithData:[rs dataForColumnIndex:columnIndex] mutable:YES];
 }
 
 @end
@@ -244,6 +244,36 @@ EXTERN_API(NSString *) const kAIQMessageSound;
  */
 EXTERN_API(NSString *) const kAIQMessageVibrate;
 
+/** Key for the number of stored messages.
+ 
+ This key is used to store the number of messages of given type stored in the client, regardless of whether they
+ are active. It can be used to retrieve the total count from counts returned by countsOfMessagesOfType:error:.
+ 
+ @since 1.6.0
+ @see countsOfMessagesOfType:error:
+ */
+EXTERN_API(NSString *) const kAIQMessageCountTotal;
+
+/** Key for the number of active messages.
+ 
+ This key is used to store the number of messages of given type which are currently active. It can be used to
+ retrieve the active count from counts returned by countsOfMessagesOfType:error:.
+ 
+ @since 1.6.0
+ @see countsOfMessagesOfType:error:
+ */
+EXTERN_API(NSString *) const kAIQMessageCountActive;
+
+/** Key for the number of unread messages.
+ 
+ This key is used to store the number of active messages of given type which have not been read. It can be used to
+ retrieve the unread count from counts returned by countsOfMessagesOfType:error:.
+ 
+ @since 1.6.0
+ @see countsOfMessagesOfType:error:
+ */
+EXTERN_API(NSString *) const kAIQMessageCountUnread;
+
 /** Message received event name.
  
  This is the name of the event generated by NSNotificationCenter when a message has been received and stored
@@ -253,6 +283,17 @@ EXTERN_API(NSString *) const kAIQMessageVibrate;
  */
 EXTERN_API(NSString *) const AIQDidReceiveMessageNotification;
 
+/** Messages received event name.
+ 
+ This is the name of the event generated by NSNotificationCenter once for all messages of a solution which have
+ been received together, after the individual AIQDidReceiveMessageNotification events. Observers refreshing a
+ list of messages can use it to refresh only once.
+ 
+ @since 1.6.0
+ @see AIQReceivedMessageIdsUserInfoKey
+ */
+EXTERN_API(NSString *) const AIQDidReceiveMessagesNotification;
+
 /** Message updated event name.
  
  This is the name of the event generated by NSNotificationCenter when a message has been updated in the
@@ -262,6 +303,17 @@ EXTERN_API(NSString *) const AIQDidReceiveMessageNotification;
  */
 EXTERN_API(NSString *) const AIQDidUpdateMessageNotification;
 
+/** Messages updated event name.
+ 
+ This is the name of the event generated by NSNotificationCenter once for all messages of a solution which have
+ been updated together, after the individual AIQDidUpdateMessageNotification events. Observers refreshing a
+ list of messages can use it to refresh only once.
+ 
+ @since 1.6.0
+ @see AIQUpdatedMessageIdsUserInfoKey
+ */
+EXTERN_API(NSString *) const AIQDidUpdateMessagesNotification;
+
 /** Message expired event name.
  
  This is the name of the event generated by NSNotificationCenter when a message has expired and is about to
@@ -271,6 +323,17 @@ EXTERN_API(NSString *) const AIQDidUpdateMessageNotification;
  */
 EXTERN_API(NSString *) const AIQDidExpireMessageNotification;
 
+/** Messages expired event name.
+ 
+ This is the name of the event generated by NSNotificationCenter once for all messages of a solution which have
+ expired at the same time, after the individual AIQDidExpireMessageNotification events. Observers refreshing a
+ list of messages can use it to refresh only once.
+ 
+ @since 1.6.0
+ @see AIQExpiredMessageIdsUserInfoKey
+ */
+EXTERN_API(NSString *) const AIQDidExpireMessagesNotification;
+
 /** Message read event name.
  
  This is the name of the event generated by NSNotificationCenter when a message has been marked as read.
@@ -281,6 +344,17 @@ EXTERN_API(NSString *) const AIQDidExpireMessageNotification;
  */
 EXTERN_API(NSString *) const AIQDidReadMessageNotification;
 
+/** Message counts changed event name.
+ 
+ This is the name of the event generated by NSNotificationCenter when the counts of messages of one or more types
+ have changed. Changes happening shortly after each other are reported with a single event per solution.
+ 
+ @since 1.6.0
+ @see AIQMessageTypesUserInfoKey
+ @see countsOfMessagesOfType:error:
+ */
+EXTERN_API(NSString *) const AIQDidChangeMessageCountsNotification;
+
 /** Message attachment available event name.
  
  This is the name of the event generated by NSNotificationCenter when a server originated message attachment
@@ -356,6 +430,42 @@ EXTERN_API(NSString *) const AIQMessageTypeUserInfoKey;
 
 EXTERN_API(NSString *) const AIQMessageDestinationUserInfoKey;
 
+/** User info key for identifiers of received messages.
+ 
+ This key is used to store an array of identifiers of messages which have been received together.
+ 
+ @since 1.6.0
+ @see AIQDidReceiveMessagesNotification
+ */
+EXTERN_API(NSString *) const AIQReceivedMessageIdsUserInfoKey;
+
+/** User info key for identifiers of updated messages.
+ 
+ This key is used to store an array of identifiers of messages which have been updated together.
+ 
+ @since 1.6.0
+ @see AIQDidUpdateMessagesNotification
+ */
+EXTERN_API(NSString *) const AIQUpdatedMessageIdsUserInfoKey;
+
+/** User info key for identifiers of expired messages.
+ 
+ This key is used to store an array of identifiers of messages which have expired at the same time.
+ 
+ @since 1.6.0
+ @see AIQDidExpireMessagesNotification
+ */
+EXTERN_API(NSString *) const AIQExpiredMessageIdsUserInfoKey;
+
+/** User info key for message types.
+ 
+ This key is used to store an array of message types whose counts have changed.
+ 
+ @since 1.6.0
+ @see AIQDidChangeMessageCountsNotification
+ */
+EXTERN_API(NSString *) const AIQMessageTypesUserInfoKey;
+
 /** AIQMessaging module.
  
  Messaging module can be used to access active message documents.
@@ -455,6 +565,25 @@ EXTERN_API(NSString *) const AIQMessageDestinationUserInfoKey;
  */
 - (BOOL)deleteMessageWithId:(NSString *)identifier error:(NSError **)error;
 
+/** Returns counts of messages of given type.
+ 
+ This method can be used to retrieve the number of stored, active and unread messages of given type without
+ listing them. The counts are maintained by the data store, so retrieving them does not depend on the number of
+ messages.
+ 
+ @param type Type of messages to count. Must not be nil.
+ @param error If defined, will store an error in case of any failures. May be nil.
+ @return Dictionary with message counts stored under kAIQMessageCountTotal, kAIQMessageCountActive and
+ kAIQMessageCountUnread keys, or nil if retrieving the counts failed, in which case the error parameter will contain
+ the reason of failure.
+ 
+ @since 1.6.0
+ @see AIQDidChangeMessageCountsNotification
+ 
+ @note Counts do not take message relevance into account.
+ */
+- (NSDictionary *)countsOfMessagesOfType:(NSString *)type error:(NSError **)error;
+
 /**---------------------------------------------------------------------------------------
  * @name Attachment management
  * ---------------------------------------------------------------------------------------
@@ -508,7 +637,8 @@ EXTERN_API(NSString *) const AIQMessageDestinationUserInfoKey;
 
 /** Retrieves the data for given resource identifier.
  
- This method can be used to retrieve the data for given resource identifier.
+ This method can be used to retrieve the data for given resource identifier. Large attachments are memory mapped
+ rather than read into memory.
  
  @param name Name of the attachment for which to return the data. Must not be nil and must exist in the data store.
  @param identifier Message identifier for which to return the data. Must not be nil and must exist in the data store.
@@ -520,6 +650,41 @@ EXTERN_API(NSString *) const AIQMessageDestinationUserInfoKey;
 
 - (NSData *)dataForAttachmentWithName:(NSString *)name fromMessageWithId:(NSString *)identifier error:(NSError **)error;
 
+/** Opens a stream for the data of given attachment.
+ 
+ This method can be used to read large attachments without loading them into memory at once. The returned stream
+ is not opened, it is up to the caller to open and close it.
+ 
+ @param name Name of the attachment for which to return the stream. Must not be nil and must exist in the data store.
+ @param identifier Message identifier for which to return the stream. Must not be nil and must exist in the data store.
+ @param error If defined, will store an error in case of any failures. May be nil.
+ @return Input stream for given attachment or nil if the data does not exist or if retrieving failed, in which case
+ the error parameter will contain the reason of failure.
+ @since 1.6.0
+ */
+- (NSInputStream *)streamForAttachmentWithName:(NSString *)name fromMessageWithId:(NSString *)identifier error:(NSError **)error;
+
+/** Retrieves the data for given attachment in chunks.
+ 
+ This method can be used to read large attachments without loading them into memory at once. Given processor is
+ called synchronously for every chunk, in order.
+ 
+ @param name Name of the attachment for which to return the data. Must not be nil and must exist in the data store.
+ @param identifier Message identifier for which to return the data. Must not be nil and must exist in the data store.
+ @param chunkSize Maximum size of a single chunk, in bytes. Must be greater than zero.
+ @param processor Processor block called for every chunk. Must not be nil. The processor may stop reading by
+ setting the error parameter.
+ @param error If defined, will store an error in case of any failures. May be nil.
+ @return YES if all chunks were processed, NO otherwise, in which case the error parameter will contain the reason
+ of failure.
+ @since 1.6.0
+ */
+- (BOOL)dataForAttachmentWithName:(NSString *)name
+                fromMessageWithId:(NSString *)identifier
+                        chunkSize:(NSUInteger)chunkSize
+                        processor:(void (^)(NSData *data, NSError **error))processor
+                            error:(NSError **)error;
+
 /**---------------------------------------------------------------------------------------
  * @name Client originated messaging
  * ---------------------------------------------------------------------------------------
@@ -739,6 +904,115 @@ EXTERN_API(NSString *) const AIQMessageDestinationUserInfoKey;
                                processor:(void (^)(NSDictionary *, NSError **))processor
                                    error:(NSError **)error;
 
+/**---------------------------------------------------------------------------------------
+ * @name Asynchronous access
+ * ---------------------------------------------------------------------------------------
+ */
+
+/** Asynchronously retrieves a message for given identifier.
+ 
+ The message is retrieved on a background queue and passed to the completion block on the session callback queue.
+ 
+ @param identifier Identifier of the message to retrieve. Must not be nil.
+ @param completion Block called with the message or with the reason of failure. May be nil.
+ @since 1.6.0
+ @see messageForId:error:
+ */
+- (void)messageForId:(NSString *)identifier completion:(void (^)(NSDictionary *message, NSError *error))completion;
+
+/** Asynchronously retrieves messages of given type.
+ 
+ The messages are retrieved on a background queue and passed to the completion block on the session callback queue.
+ 
+ @param type Type of messages to retrieve. Must not be nil.
+ @param order Order in which to return messages.
+ @param completion Block called with an array of messages or with the reason of failure. May be nil.
+ @since 1.6.0
+ @see messagesOfType:order:processor:error:
+ */
+- (void)messagesOfType:(NSString *)type
+                 order:(AIQMessageOrder)order
+            completion:(void (^)(NSArray *messages, NSError *error))completion;
+
+/** Asynchronously marks a message with given identifier as read.
+ 
+ The message is updated on the session write queue and the completion block is called on the session callback queue.
+ 
+ @param identifier Identifier of the message to mark as read. Must not be nil.
+ @param completion Block called with nil or with the reason of failure. May be nil.
+ @since 1.6.0
+ @see markMessageAsReadForId:error:
+ */
+- (void)markMessageAsReadForId:(NSString *)identifier completion:(void (^)(NSError *error))completion;
+
+/** Asynchronously deletes a message with given identifier.
+ 
+ The message is deleted on the session write queue and the completion block is called on the session callback queue.
+ 
+ @param identifier Identifier of the message to delete. Must not be nil.
+ @param completion Block called with nil or with the reason of failure. May be nil.
+ @since 1.6.0
+ @see deleteMessageWithId:error:
+ */
+- (void)deleteMessageWithId:(NSString *)identifier completion:(void (^)(NSError *error))completion;
+
+/** Asynchronously retrieves counts of messages of given type.
+ 
+ The counts are retrieved on a background queue and passed to the completion block on the session callback queue.
+ 
+ @param type Type of messages to count. Must not be nil.
+ @param completion Block called with the message counts or with the reason of failure. May be nil.
+ @since 1.6.0
+ @see countsOfMessagesOfType:error:
+ */
+- (void)countsOfMessagesOfType:(NSString *)type completion:(void (^)(NSDictionary *counts, NSError *error))completion;
+
+/** Asynchronously retrieves the data for given attachment.
+ 
+ The data is retrieved on a background queue and passed to the completion block on the session callback queue.
+ 
+ @param name Name of the attachment for which to return the data. Must not be nil.
+ @param identifier Message identifier for which to return the data. Must not be nil.
+ @param completion Block called with the data or with the reason of failure. May be nil.
+ @since 1.6.0
+ @see dataForAttachmentWithName:fromMessageWithId:error:
+ */
+- (void)dataForAttachmentWithName:(NSString *)name fromMessageWithId:(NSString *)identifier completion:(void (^)(NSData *data, NSError *error))completion;
+
+/** Asynchronously creates a client originated message.
+ 
+ The message is queued on the session write queue and its status is passed to the completion block on the session
+ callback queue.
+ 
+ @param payload Message payload to be send to the given destination. Must not be nil.
+ @param attachments An optional array of attachment descriptors to be sent together with the messages. May be nil.
+ @param identifier Identifier of a launchable to be indicated as a message sender. Can be nil.
+ @param destination The name of the destination to which to dispatch the message. Must not be nil.
+ @param urgent Indicates whether the message should be dispatched immediately.
+ @param expectResponse Indicates whether the message is expected to get a response from your enterprise IT server.
+ @param completion Block called with the status descriptor of the queued message or with the reason of failure. May be nil.
+ @since 1.6.0
+ @see sendMessage:withAttachments:from:to:urgent:expectResponse:error:
+ */
+- (void)sendMessage:(NSDictionary *)payload
+     withAttachments:(NSArray *)attachments
+                from:(NSString *)identifier
+                  to:(NSString *)destination
+              urgent:(BOOL)urgent
+      expectResponse:(BOOL)expectResponse
+          completion:(void (^)(NSDictionary *status, NSError *error))completion;
+
+/** Asynchronously retrieves the status of a client originated message.
+ 
+ The status is retrieved on a background queue and passed to the completion block on the session callback queue.
+ 
+ @param identifier Identifier of the message for which to retrieve the status. Must not be nil.
+ @param completion Block called with the status descriptor or with the reason of failure. May be nil.
+ @since 1.6.0
+ @see statusOfMessageWithId:error:
+ */
+- (void)statusOfMessageWithId:(NSString *)identifier completion:(void (^)(NSDictionary *status, NSError *error))completion;
+
 @end
 
 #endif /* AIQCoreLib_AIQMessaging_h */
@@ -1,10 +1,5 @@
 #import <FMDB/FMDB.h>
 
-#if TARGET_OS_IPHONE
-    #import <UIKit/UIKit.h>
-    #import <AssetsLibrary/AssetsLibrary.h>
-#endif
-
 #import "AIQContext.h"
 #import "AIQError.h"
 #import "AIQLog.h"
@@ -13,9 +8,14 @@
 #import "AIQSession.h"
 #import "AIQSynchronization.h"
 #import "AIQSynchronizer.h"
-#import "AIQJSON.h"
+#import "Dispatcher.h"
+#import "DocumentCache.h"
+#import "DocumentCodec.h"
+#import "FMDatabase+Helpers.h"
 #import "common.h"
-#import "NSDictionary+Helpers.h"
+#import "NSFileManager+Helpers.h"
+#import "RelevanceMatcher.h"
+#import "ResourceValidator.h"
 
 NSString *const kAIQMessageType = @"type";
 NSString *const kAIQMessageDestination = @"destination";
@@ -33,10 +33,18 @@ NSString *const kAIQMessageText = @"message";
 NSString *const kAIQMessageSound = @"sound";
 NSString *const kAIQMessageVibrate = @"vibration";
 
+NSString *const kAIQMessageCountTotal = @"total";
+NSString *const kAIQMessageCountActive = @"active";
+NSString *const kAIQMessageCountUnread = @"unread";
+
 NSString *const AIQDidReceiveMessageNotification = @"AIQDidReceiveMessageNotification";
+NSString *const AIQDidReceiveMessagesNotification = @"AIQDidReceiveMessagesNotification";
 NSString *const AIQDidUpdateMessageNotification = @"AIQDidUpdateMessageNotification";
+NSString *const AIQDidUpdateMessagesNotification = @"AIQDidUpdateMessagesNotification";
 NSString *const AIQDidExpireMessageNotification = @"AIQDidExpireMessageNotification";
+NSString *const AIQDidExpireMessagesNotification = @"AIQDidExpireMessagesNotification";
 NSString *const AIQDidReadMessageNotification = @"AIQDidReadMessageNotification";
+NSString *const AIQDidChangeMessageCountsNotification = @"AIQDidChangeMessageCountsNotification";
 
 NSString *const AIQMessageAttachmentDidBecomeAvailableNotification = @"AIQMessageAttachmentDidBecomeAvailableNotification";
 NSString *const AIQMessageAttachmentDidBecomeUnavailableNotification = @"AIQMessageAttachmentDidBecomeUnavailableNotification";
@@ -50,6 +58,18 @@ NSString *const AIQDidFailMessageNotification = @"AIQDidFailMessageNotification"
 
 NSString *const AIQMessageTypeUserInfoKey = @"AIQMessageTypeUserInfoKey";
 NSString *const AIQMessageDestinationUserInfoKey = @"AIQMessageDestinationUserInfoKey";
+NSString *const AIQReceivedMessageIdsUserInfoKey = @"AIQReceivedMessageIdsUserInfoKey";
+NSString *const AIQUpdatedMessageIdsUserInfoKey = @"AIQUpdatedMessageIdsUserInfoKey";
+NSString *const AIQExpiredMessageIdsUserInfoKey = @"AIQExpiredMessageIdsUserInfoKey";
+NSString *const AIQMessageTypesUserInfoKey = @"AIQMessageTypesUserInfoKey";
+
+static NSTimeInterval const kResourceValidationTimeout = 10.0;
+
+@interface AIQContext ()
+
+- (NSDictionary *)snapshot:(NSError **)error;
+
+@end
 
 @interface AIQSynchronization ()
 
@@ -66,6 +86,8 @@ NSString *const AIQMessageDestinationUserInfoKey = @"AIQMessageDestinationUserIn
     NSString *_basePath;
     BOOL _hasMessages;
     NSTimeInterval _nextActionDate;
+    DocumentCache *_cache;
+    Dispatcher *_dispatcher;
 }
 
 @end
@@ -89,7 +111,9 @@ NSString *const AIQMessageDestinationUserInfoKey = @"AIQMessageDestinationUserIn
         _session = session;
         _solution = solution;
         _basePath = [[session valueForKey:@"basePath"] stringByAppendingPathComponent:solution];
-        _pool = [FMDatabasePool databasePoolWithPath:[session valueForKey:@"dbPath"]];
+        _pool = [FMDatabasePool documentPoolWithPath:[session valueForKey:@"dbPath"]];
+        _cache = [session valueForKey:@"documentCache"];
+        _dispatcher = [session valueForKey:@"dispatcher"];
 
         NSError *localError = nil;
         _context = [session context:&localError];
@@ -127,17 +151,24 @@ NSString *const AIQMessageDestinationUserInfoKey = @"AIQMessageDestinationUserIn
         *error = nil;
     }
     
+    // with the cache enabled the data is read separately, only if the cached copy is stale
+    BOOL cached = (_cache.capacity != 0);
+    NSString *query = [NSString stringWithFormat:@"SELECT m.type, m.created, m.activeFrom, m.timeToLive, m.read, d.launchable, %@, d.revision, d.status "
+                       "FROM somessages m, documents d "
+                       "WHERE m.solution = ? "
+                       "AND m.solution = d.solution "
+                       "AND m.identifier = ? "
+                       "AND m.identifier = d.identifier "
+                       "AND m.activeAt <= ? "
+                       "AND m.expiresAt >= ?",
+                       cached ? @"NULL" : @"d.data"];
+    
     __block NSDictionary *result = nil;
+    NSDictionary *context = [self contextSnapshot];
     
     [_pool inDatabase:^(FMDatabase *db) {
-        FMResultSet *rs = [db executeQuery:@"SELECT m.type, m.created, m.activeFrom, m.timeToLive, m.read, d.launchable, d.data FROM somessages m, documents d "
-                           "WHERE m.solution = ? "
-                           "AND m.solution = d.solution "
-                           "AND m.identifier = ? "
-                           "AND m.identifier = d.identifier "
-                           "AND DATETIME(m.activeFrom / 1000, 'unixepoch') <= DATETIME('now') "
-                           "AND DATETIME(m.activeFrom / 1000 + m.timeToLive, 'unixepoch') >= DATETIME('now')",
-                           _solution, identifier];
+        NSNumber *now = @((long long)[[NSDate date] timeIntervalSince1970]);
+        FMResultSet *rs = [db executeQuery:query, _solution, identifier, now, now];
         if (! rs) {
             if (error) {
                 *error = [AIQError errorWithCode:AIQErrorContainerFault message:[db lastError].localizedDescription];
@@ -164,10 +195,22 @@ NSString *const AIQMessageDestinationUserInfoKey = @"AIQMessageDestinationUserIn
         mutable[kAIQMessageTimeToLive] = [rs objectForColumnIndex:3];
         mutable[kAIQMessageRead] = @([rs boolForColumnIndex:4]);
         
-        NSDictionary *document = [[rs dataForColumnIndex:6] JSONObject];
+        NSDictionary *document = nil;
+        if (cached) {
+            document = [self cachedDocumentForId:identifier
+                                        revision:[rs objectForColumnIndex:7]
+                                          status:[rs objectForColumnIndex:8]
+                                        database:db];
+        } else {
+            document = [DocumentCodec objectWithData:[rs dataForColumnIndex:6] mutable:YES];
+        }
         
         NSError *localError = nil;
-        mutable[kAIQMessageRelevant] = @([self isRelevant:document error:&localError]);
+        mutable[kAIQMessageRelevant] = @([self isRelevant:document
+                                                identifier:identifier
+                                                  revision:[rs objectForColumnIndex:7]
+                                                   context:context
+                                                     error:&localError]);
 //        if (localError) {
 //            [rs close];
 //            if (error) {
@@ -222,30 +265,33 @@ NSString *const AIQMessageDestinationUserInfoKey = @"AIQMessageDestinationUserIn
     }
 
     __block BOOL result = YES;
+    // the context is read once for the whole listing, relevance is then evaluated in memory
+    NSDictionary *context = [self contextSnapshot];
     
     [_pool inDatabase:^(FMDatabase *db) {
+        NSNumber *now = @((long long)[[NSDate date] timeIntervalSince1970]);
         FMResultSet *rs;
         
         if (order == AIQMessageOrderAscending) {
-            rs = [db executeQuery:@"SELECT m.identifier, m.created, m.activeFrom, m.timeToLive, m.read, d.launchable, d.data FROM somessages m, documents d "
+            rs = [db executeQuery:@"SELECT m.identifier, m.created, m.activeFrom, m.timeToLive, m.read, d.launchable, d.data, d.revision FROM somessages m, documents d "
                   "WHERE m.solution = ? "
                   "AND m.solution = d.solution "
                   "AND m.type = ? "
                   "AND m.identifier = d.identifier "
-                  "AND DATETIME(m.activeFrom / 1000, 'unixepoch') <= DATETIME('now') "
-                  "AND DATETIME(m.activeFrom / 1000 + m.timeToLive, 'unixepoch') >= DATETIME('now') "
+                  "AND m.activeAt <= ? "
+                  "AND m.expiresAt >= ? "
                   "ORDER BY activeFrom ASC, created ASC",
-                  _solution, type];
+                  _solution, type, now, now];
         } else {
-            rs = [db executeQuery:@"SELECT m.identifier, m.created, m.activeFrom, m.timeToLive, m.read, d.launchable, d.data FROM somessages m, documents d "
+            rs = [db executeQuery:@"SELECT m.identifier, m.created, m.activeFrom, m.timeToLive, m.read, d.launchable, d.data, d.revision FROM somessages m, documents d "
                   "WHERE m.solution = ? "
                   "AND m.solution = d.solution "
                   "AND m.type = ? "
                   "AND m.identifier = d.identifier "
-                  "AND DATETIME(m.activeFrom / 1000, 'unixepoch') <= DATETIME('now') "
-                  "AND DATETIME(m.activeFrom / 1000 + m.timeToLive, 'unixepoch') >= DATETIME('now') "
+                  "AND m.activeAt <= ? "
+                  "AND m.expiresAt >= ? "
                   "ORDER BY activeFrom DESC, created DESC",
-                  _solution, type];
+                  _solution, type, now, now];
         }
         
         if (! rs) {
@@ -268,11 +314,14 @@ NSString *const AIQMessageDestinationUserInfoKey = @"AIQMessageDestinationUserIn
             mutable[kAIQMessageTimeToLive] = [rs objectForColumnIndex:3];
             mutable[kAIQMessageRead] = @([rs boolForColumnIndex:4]);
             
-            NSDictionary *document = [[rs dataForColumnIndex:6] JSONObject];
+            NSDictionary *document = [DocumentCodec objectWithData:[rs dataForColumnIndex:6] mutable:YES];
             
             NSError *localError = nil;
-            mutable[kAIQMessageRelevant] = @([self isRelevant:document error:nil]);
-//            mutable[kAIQMessageRelevant] = @([self isRelevant:document error:&localError]);
+            mutable[kAIQMessageRelevant] = @([self isRelevant:document
+                                                    identifier:mutable[kAIQDocumentId]
+                                                      revision:[rs objectForColumnIndex:7]
+                                                       context:context
+                                                         error:nil]);
 //            if (localError) {
 //                result = NO;
 //                if (error) {
@@ -327,10 +376,9 @@ NSString *const AIQMessageDestinationUserInfoKey = @"AIQMessageDestinationUserIn
     __block BOOL result = NO;
     
     [_pool inDatabase:^(FMDatabase *db) {
-        FMResultSet *rs = [db executeQuery:@"SELECT type FROM somessages WHERE solution = ? AND identifier = ? "
-                           "AND DATETIME(activeFrom / 1000, 'unixepoch') <= DATETIME('now') "
-                           "AND DATETIME(activeFrom / 1000 + timeToLive, 'unixepoch') >= DATETIME('now')",
-                           _solution, identifier];
+        NSNumber *now = @((long long)[[NSDate date] timeIntervalSince1970]);
+        FMResultSet *rs = [db executeQuery:@"SELECT type FROM somessages WHERE solution = ? AND identifier = ? AND activeAt <= ? AND expiresAt >= ?",
+                           _solution, identifier, now, now];
         if (! rs) {
             if (error) {
                 *error = [AIQError errorWithCode:AIQErrorContainerFault message:[db lastError].localizedDescription];
@@ -354,6 +402,7 @@ NSString *const AIQMessageDestinationUserInfoKey = @"AIQMessageDestinationUserIn
             result = YES;
             
             NOTIFY(AIQDidReadMessageNotification, self, (@{AIQDocumentIdUserInfoKey: identifier, AIQMessageTypeUserInfoKey: type}));
+            [[self synchronizer] countsDidChangeForType:type solution:_solution];
         } else if (error) {
             *error = [AIQError errorWithCode:AIQErrorContainerFault message:[db lastError].localizedDescription];
         }
@@ -369,32 +418,85 @@ NSString *const AIQMessageDestinationUserInfoKey = @"AIQMessageDestinationUserIn
     
     __block BOOL result = NO;
 
+    __block NSString *type = nil;
+
     [_pool inDatabase:^(FMDatabase *db) {
-        if (! [db executeUpdate:@"DELETE FROM somessages WHERE solution = ? AND identifier = ? "
-               "AND DATETIME(activeFrom / 1000, 'unixepoch') <= DATETIME('now') "
-               "AND DATETIME(activeFrom / 1000 + timeToLive, 'unixepoch') >= DATETIME('now')",
-               _solution, identifier]) {
+        NSNumber *now = @((long long)[[NSDate date] timeIntervalSince1970]);
+        FMResultSet *rs = [db executeQuery:@"SELECT type FROM somessages WHERE solution = ? AND identifier = ? AND activeAt <= ? AND expiresAt >= ?",
+                           _solution, identifier, now, now];
+        if (! rs) {
             if (error) {
                 *error = [AIQError errorWithCode:AIQErrorContainerFault message:[db lastError].localizedDescription];
             }
             return;
         }
         
-        if ([db changes] != 1) {
+        if (! [rs next]) {
+            [rs close];
             if (error) {
                 *error = [AIQError errorWithCode:AIQErrorIdNotFound message:@"Message not found"];
             }
             return;
         }
         
+        type = [rs stringForColumnIndex:0];
+        [rs close];
+        
+        if (! [db executeUpdate:@"DELETE FROM somessages WHERE solution = ? AND identifier = ?", _solution, identifier]) {
+            if (error) {
+                *error = [AIQError errorWithCode:AIQErrorContainerFault message:[db lastError].localizedDescription];
+            }
+            return;
+        }
+        
         result = [self deleteMessageDocumentWithId:identifier solution:_solution inDatabase:db error:error];
     }];
     
-    [((AIQMessagingSynchronizer *)[[_session synchronization:nil] synchronizerForType:@"_backendmessage"]) scheduleNextNotification];
+    AIQMessagingSynchronizer *synchronizer = [self synchronizer];
+    if (type) {
+        [synchronizer countsDidChangeForType:type solution:_solution];
+    }
+    [synchronizer scheduleNextNotification];
 
     return result;
 }
 
+- (NSDictionary *)countsOfMessagesOfType:(NSString *)type error:(NSError *__autoreleasing *)error {
+    if (error) {
+        *error = nil;
+    }
+    
+    if (! type) {
+        if (error) {
+            *error = [AIQError errorWithCode:AIQErrorInvalidArgument message:@"Type not specified"];
+        }
+        return nil;
+    }
+    
+    __block NSDictionary *counts = nil;
+    
+    [_pool inDatabase:^(FMDatabase *db) {
+        FMResultSet *rs = [db executeQuery:@"SELECT total, active, unread FROM somessagecounts WHERE solution = ? AND type = ?", _solution, type];
+        if (! rs) {
+            if (error) {
+                *error = [AIQError errorWithCode:AIQErrorContainerFault message:[db lastError].localizedDescription];
+            }
+            return;
+        }
+        
+        if ([rs next]) {
+            counts = @{kAIQMessageCountTotal: @([rs longLongIntForColumnIndex:0]),
+                       kAIQMessageCountActive: @([rs longLongIntForColumnIndex:1]),
+                       kAIQMessageCountUnread: @([rs longLongIntForColumnIndex:2])};
+        } else {
+            counts = @{kAIQMessageCountTotal: @0, kAIQMessageCountActive: @0, kAIQMessageCountUnread: @0};
+        }
+        [rs close];
+    }];
+    
+    return counts;
+}
+
 - (BOOL)attachmentWithName:(NSString *)name existsForMessageWithId:(NSString *)identifier {
     if (! name) {
         return NO;
@@ -403,11 +505,11 @@ NSString *const AIQMessageDestinationUserInfoKey = @"AIQMessageDestinationUserIn
     __block BOOL result = NO;
     
     [_pool inDatabase:^(FMDatabase *db) {
+        NSNumber *now = @((long long)[[NSDate date] timeIntervalSince1970]);
         FMResultSet *rs = [db executeQuery:@"SELECT COUNT(*) FROM attachments a, somessages m "
-                           "WHERE m.solution = ? AND m.solution = a.solution AND m.identifier = ? AND m.identifier = a.identifier AND a.name = ?"
-                           "AND DATETIME(m.activeFrom / 1000, 'unixepoch') <= DATETIME('now') "
-                           "AND DATETIME(m.activeFrom / 1000 + m.timeToLive, 'unixepoch') >= DATETIME('now')",
-                           _solution, identifier, name];
+                           "WHERE m.solution = ? AND m.solution = a.solution AND m.identifier = ? AND m.identifier = a.identifier AND a.name = ? "
+                           "AND m.activeAt <= ? AND m.expiresAt >= ?",
+                           _solution, identifier, name, now, now];
         if (! rs) {
             return;
         }
@@ -580,42 +682,79 @@ NSString *const AIQMessageDestinationUserInfoKey = @"AIQMessageDestinationUserIn
         return nil;
     }
     
-    if (! [self messageExistsWithId:identifier]) {
+    NSString *path = [self pathForAttachmentWithName:name fromMessageWithId:identifier error:error];
+    if (! path) {
+        return nil;
+    }
+    
+    // mapping keeps large attachments out of the heap
+    return [[NSFileManager defaultManager] mappedContentsAtPath:path error:error];
+}
+
+- (NSInputStream *)streamForAttachmentWithName:(NSString *)name fromMessageWithId:(NSString *)identifier error:(NSError **)error {
+    if (error) {
+        *error = nil;
+    }
+    
+    if (! name) {
         if (error) {
-            *error = [AIQError errorWithCode:AIQErrorIdNotFound message:@"Message not found"];
+            *error = [AIQError errorWithCode:AIQErrorInvalidArgument message:@"Name not specified"];
+        }
+        return nil;
+    }
+    
+    if (! identifier) {
+        if (error) {
+            *error = [AIQError errorWithCode:AIQErrorInvalidArgument message:@"Identifier not specified"];
         }
         return nil;
     }
     
-    __block NSData *data = nil;
+    NSString *path = [self pathForAttachmentWithName:name fromMessageWithId:identifier error:error];
+    if (! path) {
+        return nil;
+    }
     
-    [_pool inDatabase:^(FMDatabase *db) {
-        FMResultSet *rs = [db executeQuery:@"SELECT COUNT(*) FROM attachments a, documents d WHERE a.solution = ? AND a.identifier = ? AND a.name = ? AND a.status != ? AND d.status != ? AND a.solution = d.solution AND a.identifier = d.identifier",
-                           _solution, identifier, name, @(AIQSynchronizationStatusDeleted), @(AIQSynchronizationStatusDeleted)];
-        BOOL exists = NO;
-        if (rs) {
-            exists = ([rs next]) && ([rs intForColumnIndex:0] == 1);
-            [rs close];
+    NSInputStream *stream = [NSInputStream inputStreamWithFileAtPath:path];
+    if (! stream) {
+        if (error) {
+            *error = [AIQError errorWithCode:AIQErrorResourceNotFound message:@"Resource not found"];
         }
-        if (! exists) {
-            if (error) {
-                *error = [AIQError errorWithCode:AIQErrorNameNotFound message:@"Attachment not found"];
-            }
+        return nil;
+    }
+    
+    return stream;
+}
+
+- (BOOL)dataForAttachmentWithName:(NSString *)name
+                fromMessageWithId:(NSString *)identifier
+                        chunkSize:(NSUInteger)chunkSize
+                        processor:(void (^)(NSData *, NSError **))processor
+                            error:(NSError **)error {
+    if (error) {
+        *error = nil;
+    }
+    
+    if (! name) {
+        if (error) {
+            *error = [AIQError errorWithCode:AIQErrorInvalidArgument message:@"Name not specified"];
         }
-        
-        NSString *path = [[_basePath stringByAppendingPathComponent:identifier] stringByAppendingPathComponent:name];
-        NSFileManager *fileManager = [NSFileManager defaultManager];
-        if (! [fileManager fileExistsAtPath:path]) {
-            if (error) {
-                *error = [AIQError errorWithCode:AIQErrorResourceNotFound message:@"Resource not found"];
-            }
-            return;
+        return NO;
+    }
+    
+    if (! identifier) {
+        if (error) {
+            *error = [AIQError errorWithCode:AIQErrorInvalidArgument message:@"Identifier not specified"];
         }
-        
-        data = [fileManager contentsAtPath:path];
-    }];
+        return NO;
+    }
+    
+    NSString *path = [self pathForAttachmentWithName:name fromMessageWithId:identifier error:error];
+    if (! path) {
+        return NO;
+    }
     
-    return data;
+    return [[NSFileManager defaultManager] readContentsAtPath:path chunkSize:chunkSize processor:processor error:error];
 }
 
 - (void)close {
@@ -682,7 +821,330 @@ NSString *const AIQMessageDestinationUserInfoKey = @"AIQMessageDestinationUserIn
     if (error) {
         *error = nil;
     }
+    
+    NSArray *resources = [self resourcesOfMessage:payload withAttachments:attachments from:identifier to:destination error:error];
+    if (! resources) {
+        return nil;
+    }
+    
+    if (! [[ResourceValidator sharedValidator] resourcesExist:resources timeout:kResourceValidationTimeout]) {
+        if (error) {
+            *error = [AIQError errorWithCode:AIQErrorResourceNotFound message:@"Resource not found"];
+        }
+        return nil;
+    }
+    
+    return [self queueMessage:payload withAttachments:attachments from:identifier to:destination urgent:urgent expectResponse:expectResponse error:error];
+}
+
+- (NSDictionary *)statusOfMessageWithId:(NSString *)identifier error:(NSError **)error {
+    if (error) {
+        *error = nil;
+    }
+
+    if (! identifier) {
+        if (error) {
+            *error = [AIQError errorWithCode:AIQErrorInvalidArgument message:@"Identifier not specified"];
+        }
+        return nil;
+    }
+    
+    __block NSMutableDictionary *status = nil;
+    
+    [_pool inDatabase:^(FMDatabase *db) {
+        FMResultSet *rs = [db executeQuery:@"SELECT destination, created, state, response FROM comessages WHERE solution = ? AND identifier = ?",
+                           _solution, identifier];
+        if (! rs) {
+            if (error) {
+                *error = [AIQError errorWithCode:AIQErrorContainerFault message:[db lastError].localizedDescription];
+            }
+            return;
+        }
+        
+        if ([rs next]) {
+            status = [NSMutableDictionary dictionary];
+            status[kAIQDocumentId] = identifier;
+            status[kAIQMessageDestination] = [rs stringForColumnIndex:0];
+            status[kAIQMessageCreated] = [rs objectForColumnIndex:1];
+            status[kAIQMessageState] = [rs objectForColumnIndex:2];
+            if (! [rs columnIndexIsNull:3]) {
+                status[kAIQMessageBody] = [rs stringForColumnIndex:3];
+            }
+        } else if (error) {
+            *error = [AIQError errorWithCode:AIQErrorIdNotFound message:@"Message not found"];
+        }
+        [rs close];
+    }];
+    
+    return status ? [status copy] : nil;
+}
+
+- (BOOL)statusesOfMessagesForDestination:(NSString *)destination
+                               processor:(void (^)(NSDictionary *, NSError **))processor
+                                   error:(NSError **)error {
+    if (error) {
+        *error = nil;
+    }
+    
+    if (! destination) {
+        if (error) {
+            *error = [AIQError errorWithCode:AIQErrorInvalidArgument message:@"Destination not specified"];
+        }
+        return NO;
+    }
+
+    __block BOOL result = YES;
+    
+    [_pool inDatabase:^(FMDatabase *db) {
+        FMResultSet *rs = [db executeQuery:@"SELECT identifier, created, state, response FROM comessages WHERE solution = ? AND destination = ?",
+                           _solution, destination];
+        if (! rs) {
+            result = NO;
+            if (error) {
+                *error = [AIQError errorWithCode:AIQErrorContainerFault message:[db lastError].localizedDescription];
+            }
+            return;
+        }
+        
+        while ([rs next]) {
+            NSMutableDictionary *status = [NSMutableDictionary dictionary];
+            status[kAIQDocumentId] = [rs stringForColumnIndex:0];
+            status[kAIQMessageDestination] = destination;
+            status[kAIQMessageCreated] = [rs objectForColumnIndex:1];
+            status[kAIQMessageState] = [rs objectForColumnIndex:2];
+            if (! [rs columnIndexIsNull:3]) {
+                status[kAIQMessageBody] = [rs stringForColumnIndex:3];
+            }
+            
+            NSError *localError = nil;
+            processor(status, &localError);
+            if (localError) {
+                result = NO;
+                if (error) {
+                    *error = localError;
+                }
+                break;
+            }
+        }
+        
+        [rs close];
+    }];
+    
+    return result;
+}
+
+#pragma mark - Asynchronous API
+
+- (void)messageForId:(NSString *)identifier completion:(void (^)(NSDictionary *message, NSError *error))completion {
+    [_dispatcher read:^{
+        NSError *error = nil;
+        NSDictionary *message = [self messageForId:identifier error:&error];
+        if (completion) {
+            [_dispatcher complete:^{
+                completion(message, error);
+            }];
+        }
+    }];
+}
+
+- (void)messagesOfType:(NSString *)type
+                 order:(AIQMessageOrder)order
+            completion:(void (^)(NSArray *messages, NSError *error))completion {
+    [_dispatcher read:^{
+        NSError *error = nil;
+        NSMutableArray *result = [NSMutableArray array];
+        BOOL success = [self messagesOfType:type order:order processor:^(NSDictionary *message, NSError *__autoreleasing *processorError) {
+            [result addObject:message];
+        } error:&error];
+        NSArray *messages = success ? [result copy] : nil;
+        if (completion) {
+            [_dispatcher complete:^{
+                completion(messages, error);
+            }];
+        }
+    }];
+}
+
+- (void)markMessageAsReadForId:(NSString *)identifier completion:(void (^)(NSError *error))completion {
+    [_dispatcher write:^{
+        NSError *error = nil;
+        [self markMessageAsReadForId:identifier error:&error];
+        if (completion) {
+            [_dispatcher complete:^{
+                completion(error);
+            }];
+        }
+    }];
+}
+
+- (void)deleteMessageWithId:(NSString *)identifier completion:(void (^)(NSError *error))completion {
+    [_dispatcher write:^{
+        NSError *error = nil;
+        [self deleteMessageWithId:identifier error:&error];
+        if (completion) {
+            [_dispatcher complete:^{
+                completion(error);
+            }];
+        }
+    }];
+}
+
+- (void)countsOfMessagesOfType:(NSString *)type completion:(void (^)(NSDictionary *counts, NSError *error))completion {
+    [_dispatcher read:^{
+        NSError *error = nil;
+        NSDictionary *counts = [self countsOfMessagesOfType:type error:&error];
+        if (completion) {
+            [_dispatcher complete:^{
+                completion(counts, error);
+            }];
+        }
+    }];
+}
+
+- (void)dataForAttachmentWithName:(NSString *)name fromMessageWithId:(NSString *)identifier completion:(void (^)(NSData *data, NSError *error))completion {
+    [_dispatcher read:^{
+        NSError *error = nil;
+        NSData *data = [self dataForAttachmentWithName:name fromMessageWithId:identifier error:&error];
+        if (completion) {
+            [_dispatcher complete:^{
+                completion(data, error);
+            }];
+        }
+    }];
+}
+
+- (void)sendMessage:(NSDictionary *)payload
+     withAttachments:(NSArray *)attachments
+                from:(NSString *)identifier
+                  to:(NSString *)destination
+              urgent:(BOOL)urgent
+      expectResponse:(BOOL)expectResponse
+          completion:(void (^)(NSDictionary *status, NSError *error))completion {
+    [_dispatcher read:^{
+        NSError *error = nil;
+        NSArray *resources = [self resourcesOfMessage:payload withAttachments:attachments from:identifier to:destination error:&error];
+        if (! resources) {
+            if (completion) {
+                [_dispatcher complete:^{
+                    completion(nil, error);
+                }];
+            }
+            return;
+        }
+        
+        // resources are checked without holding any of the dispatcher queues
+        [[ResourceValidator sharedValidator] validateResources:resources timeout:kResourceValidationTimeout completion:^(BOOL exist) {
+            if (! exist) {
+                if (completion) {
+                    [_dispatcher complete:^{
+                        completion(nil, [AIQError errorWithCode:AIQErrorResourceNotFound message:@"Resource not found"]);
+                    }];
+                }
+                return;
+            }
+            
+            [_dispatcher write:^{
+                NSError *error = nil;
+                NSDictionary *status = [self queueMessage:payload withAttachments:attachments from:identifier to:destination urgent:urgent expectResponse:expectResponse error:&error];
+                if (completion) {
+                    [_dispatcher complete:^{
+                        completion(status, error);
+                    }];
+                }
+            }];
+        }];
+    }];
+}
+
+- (void)statusOfMessageWithId:(NSString *)identifier completion:(void (^)(NSDictionary *status, NSError *error))completion {
+    [_dispatcher read:^{
+        NSError *error = nil;
+        NSDictionary *status = [self statusOfMessageWithId:identifier error:&error];
+        if (completion) {
+            [_dispatcher complete:^{
+                completion(status, error);
+            }];
+        }
+    }];
+}
+
+#pragma mark - Private API
+
+- (NSString *)pathForAttachmentWithName:(NSString *)name fromMessageWithId:(NSString *)identifier error:(NSError *__autoreleasing *)error {
+    __block NSString *path = nil;
+    
+    [_pool inDatabase:^(FMDatabase *db) {
+        // validates the message and the attachment in one go, a.name is NULL if only the message exists
+        FMResultSet *rs = [db executeQuery:@"SELECT a.name FROM somessages m "
+                           "JOIN documents d ON d.solution = m.solution AND d.identifier = m.identifier AND d.status != ? "
+                           "LEFT OUTER JOIN attachments a ON a.solution = d.solution AND a.identifier = d.identifier AND a.name = ? AND a.status != ? "
+                           "WHERE m.solution = ? AND m.identifier = ?",
+                           @(AIQSynchronizationStatusDeleted), name, @(AIQSynchronizationStatusDeleted), _solution, identifier];
+        if (! rs) {
+            if (error) {
+                *error = [AIQError errorWithCode:AIQErrorContainerFault message:[db lastError].localizedDescription];
+            }
+            return;
+        }
+        
+        if (! [rs next]) {
+            [rs close];
+            if (error) {
+                *error = [AIQError errorWithCode:AIQErrorIdNotFound message:@"Message not found"];
+            }
+            return;
+        }
+        
+        BOOL exists = ! [rs columnIndexIsNull:0];
+        [rs close];
+        
+        if (! exists) {
+            if (error) {
+                *error = [AIQError errorWithCode:AIQErrorNameNotFound message:@"Attachment not found"];
+            }
+            return;
+        }
+        
+        path = [[_basePath stringByAppendingPathComponent:identifier] stringByAppendingPathComponent:name];
+    }];
+    
+    return path;
+}
+
+- (NSDictionary *)cachedDocumentForId:(NSString *)identifier revision:(id)revision status:(id)status database:(FMDatabase *)db {
+    NSDictionary *document = [_cache documentForId:identifier solution:_solution revision:revision status:status];
+    if (document) {
+        return document;
+    }
+    
+    // a message rewritten while it is decoded must not end up in the cache
+    NSUInteger generation = _cache.generation;
+    
+    FMResultSet *rs = [db executeQuery:@"SELECT data FROM documents WHERE solution = ? AND identifier = ?", _solution, identifier];
+    if (! rs) {
+        AIQLogCError(1, @"Could not retrieve message %@: %@", identifier, [db lastError].localizedDescription);
+        return nil;
+    }
+    
+    if ([rs next]) {
+        NSData *data = [rs dataForColumnIndex:0];
+        
+        // cached documents are shared between callers so they must not contain mutable containers
+        document = [DocumentCodec objectWithData:data mutable:NO];
+        [_cache storeDocument:document forId:identifier solution:_solution revision:revision status:status cost:[DocumentCodec costOfObject:document] generation:generation];
+    }
+    [rs close];
+    
+    return document;
+}
 
+- (NSArray *)resourcesOfMessage:(NSDictionary *)payload
+                withAttachments:(NSArray *)attachments
+                           from:(NSString *)identifier
+                             to:(NSString *)destination
+                          error:(NSError *__autoreleasing *)error {
+    NSMutableArray *resources = [NSMutableArray array];
+    
     if (! payload) {
         if (error) {
             *error = [AIQError errorWithCode:AIQErrorInvalidArgument message:@"Payload not specified"];
@@ -746,17 +1208,22 @@ NSString *const AIQMessageDestinationUserInfoKey = @"AIQMessageDestinationUserIn
                 }
                 return nil;
             }
-            
-            if (! [self dataExistsForURL:resourceUrl]) {
-                if (error) {
-                    *error = [AIQError errorWithCode:AIQErrorResourceNotFound message:@"Resource not found"];
-                }
-                return nil;
-            }
+            [resources addObject:resourceUrl];
         }
     }
     
+    return resources;
+}
+
+- (NSDictionary *)queueMessage:(NSDictionary *)payload
+               withAttachments:(NSArray *)attachments
+                          from:(NSString *)identifier
+                            to:(NSString *)destination
+                        urgent:(BOOL)urgent
+                expectResponse:(BOOL)expectResponse
+                         error:(NSError *__autoreleasing *)error {
     NSString *messageIdentifier = [[NSUUID UUID] UUIDString];
+    NSData *data = [DocumentCodec dataWithObject:payload];
     __block NSDictionary *status;
 
     [_pool inTransaction:^(FMDatabase *db, BOOL *rollback) {
@@ -766,7 +1233,7 @@ NSString *const AIQMessageDestinationUserInfoKey = @"AIQMessageDestinationUserIn
                _solution,
                messageIdentifier,
                destination,
-               [payload JSONData],
+               data,
                @(urgent),
                identifier,
                @(timestamp),
@@ -805,190 +1272,55 @@ NSString *const AIQMessageDestinationUserInfoKey = @"AIQMessageDestinationUserIn
 
     if (urgent) {
         AIQLogCInfo(1, @"Message %@ is urgent, forcing push", messageIdentifier);
-        [((AIQMessagingSynchronizer *)[[_session synchronization:nil] synchronizerForType:@"_backendmessage"]) pushMessages];
+        [[self synchronizer] pushMessages];
     }
 
     return status;
 }
 
-- (NSDictionary *)statusOfMessageWithId:(NSString *)identifier error:(NSError **)error {
-    if (error) {
-        *error = nil;
-    }
+- (AIQMessagingSynchronizer *)synchronizer {
+    return (AIQMessagingSynchronizer *)[[_session synchronization:nil] synchronizerForType:@"_backendmessage"];
+}
 
-    if (! identifier) {
-        if (error) {
-            *error = [AIQError errorWithCode:AIQErrorInvalidArgument message:@"Identifier not specified"];
-        }
+- (NSDictionary *)contextSnapshot {
+    if (! _context) {
         return nil;
     }
     
-    __block NSMutableDictionary *status = nil;
-    
-    [_pool inDatabase:^(FMDatabase *db) {
-        FMResultSet *rs = [db executeQuery:@"SELECT destination, created, state, response FROM comessages WHERE solution = ? AND identifier = ?",
-                           _solution, identifier];
-        if (! rs) {
-            if (error) {
-                *error = [AIQError errorWithCode:AIQErrorContainerFault message:[db lastError].localizedDescription];
-            }
-            return;
-        }
-        
-        if ([rs next]) {
-            status = [NSMutableDictionary dictionary];
-            status[kAIQDocumentId] = identifier;
-            status[kAIQMessageDestination] = [rs stringForColumnIndex:0];
-            status[kAIQMessageCreated] = [rs objectForColumnIndex:1];
-            status[kAIQMessageState] = [rs objectForColumnIndex:2];
-            if (! [rs columnIndexIsNull:3]) {
-                status[kAIQMessageBody] = [rs stringForColumnIndex:3];
-            }
-        } else if (error) {
-            *error = [AIQError errorWithCode:AIQErrorIdNotFound message:@"Message not found"];
-        }
-        [rs close];
-    }];
+    NSError *error = nil;
+    NSDictionary *snapshot = [_context snapshot:&error];
+    if (! snapshot) {
+        AIQLogCWarn(1, @"Did fail to retrieve context: %@", error.localizedDescription);
+        return @{};
+    }
     
-    return status ? [status copy] : nil;
+    return snapshot;
 }
 
-- (BOOL)statusesOfMessagesForDestination:(NSString *)destination
-                               processor:(void (^)(NSDictionary *, NSError **))processor
-                                   error:(NSError **)error {
+- (BOOL)isRelevant:(NSDictionary *)message
+        identifier:(NSString *)identifier
+          revision:(id)revision
+           context:(NSDictionary *)context
+             error:(NSError *__autoreleasing *)error {
     if (error) {
         *error = nil;
     }
     
-    if (! destination) {
-        if (error) {
-            *error = [AIQError errorWithCode:AIQErrorInvalidArgument message:@"Destination not specified"];
-        }
-        return NO;
-    }
-
-    __block BOOL result = YES;
-    
-    [_pool inDatabase:^(FMDatabase *db) {
-        FMResultSet *rs = [db executeQuery:@"SELECT identifier, created, state, response FROM comessages WHERE solution = ? AND destination = ?",
-                           _solution, destination];
-        if (! rs) {
-            result = NO;
-            if (error) {
-                *error = [AIQError errorWithCode:AIQErrorContainerFault message:[db lastError].localizedDescription];
-            }
-            return;
-        }
-        
-        while ([rs next]) {
-            NSMutableDictionary *status = [NSMutableDictionary dictionary];
-            status[kAIQDocumentId] = [rs stringForColumnIndex:0];
-            status[kAIQMessageDestination] = destination;
-            status[kAIQMessageCreated] = [rs objectForColumnIndex:1];
-            status[kAIQMessageState] = [rs objectForColumnIndex:2];
-            if (! [rs columnIndexIsNull:3]) {
-                status[kAIQMessageBody] = [rs stringForColumnIndex:3];
-            }
-            
-            NSError *localError = nil;
-            processor(status, &localError);
-            if (localError) {
-                result = NO;
-                if (error) {
-                    *error = localError;
-                }
-                break;
-            }
-        }
-        
-        [rs close];
-    }];
-    
-    return result;
-}
-
-#pragma mark - Private API
-
-- (BOOL)dataExistsForURL:(NSString *)resourceUrl {
-    NSURL *url;
-    if ([resourceUrl rangeOfString:@"://"].location == NSNotFound) {
-        // file URL
-        url = [NSURL fileURLWithPath:resourceUrl];
-    } else {
-        url = [NSURL URLWithString:resourceUrl];
-    }
-    
-    if ([url.scheme hasPrefix:@"aiq-"]) {
-        return YES;
-    } else if ([url.scheme isEqualToString:@"assets-library"]) {
-        return [self existsInAssetsLibrary:url];
-    } else {
-        NSMutableURLRequest *request = [NSMutableURLRequest requestWithURL:url cachePolicy:NSURLRequestReloadIgnoringCacheData timeoutInterval:10.0];
-        request.HTTPMethod = @"HEAD";
-        [request setValue:@"close" forHTTPHeaderField:@"Connection"];
-        NSHTTPURLResponse *response = nil;
-        NSError *error = nil;
-        NSData *data = [NSURLConnection sendSynchronousRequest:request returningResponse:&response error:&error];
-        
-        if (response.statusCode == 301) {
-            NSString *location = response.allHeaderFields[@"Location"];
-            if (location) {
-                return [self dataExistsForURL:location];
-            } else {
-                return NO;
-            }
-        } else {
-            return (data != nil) && (response.expectedContentLength > 0);
-        }
-    }
-}
-
--(BOOL)existsInAssetsLibrary:(NSURL*)path {
-    dispatch_group_t group = dispatch_group_create();
-    dispatch_group_enter(group);
-    __block BOOL flag = YES;
-    
-    ALAssetsLibrary *assetslibrary = [ALAssetsLibrary new];
-    [assetslibrary assetForURL:path resultBlock:^(ALAsset *asset) {
-        ALAssetRepresentation *representation = [asset defaultRepresentation];
-        CGImageRef reference = [representation fullScreenImage];
-        if (reference) {
-            flag = YES;
-            dispatch_group_leave(group);
-        }
-    } failureBlock:^(NSError *error) {
-        flag = NO;
-    }];
-    
-    dispatch_group_wait(group, DISPATCH_TIME_FOREVER);
-    
-    return flag;
-}
-
-- (BOOL)isRelevant:(NSDictionary *)message
-             error:(NSError *__autoreleasing *)error {
-    if (! _context) {
-        AIQLogCWarn(1, @"No context, message %@ is always relevant", message[kAIQDocumentId]);
+    if (! context) {
+        AIQLogCWarn(1, @"No context, message %@ is always relevant", identifier);
         return YES;
     }
 
     NSDictionary *condition = message[@"notification"][@"condition"];
-    if (condition) {
-        NSArray *keys = [condition allKeys];
-        for (int i = 0; i < keys.count; i++) {
-            NSString *key = keys[i];
-            id provider = [_context valueForName:key error:error];
-            if (provider) {
-                if (! [provider matches:condition[key] error:error]) {
-                    return NO;
-                }
-            } else {
-                return NO;
-            }
-        }
+    if (! condition) {
+        return YES;
     }
-
-    return YES;
+    
+    RelevanceMatcher *matcher = [RelevanceMatcher matcherForCondition:condition
+                                                             solution:_solution
+                                                           identifier:identifier
+                                                             revision:revision];
+    return [matcher matchesContext:context error:error];
 }
 
 - (BOOL)deleteMessageDocumentWithId:(NSString *)identifier solution:(NSString *)solution inDatabase:(FMDatabase *)db error:(NSError *__autoreleasing *)error {
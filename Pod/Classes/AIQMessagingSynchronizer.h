@@ -10,5 +10,6 @@
 - (void)scheduleNextNotification;
 - (void)pushMessages;
 - (void)handleUnauthorized;
+- (void)countsDidChangeForType:(NSString *)type solution:(NSString *)solution;
 
 @end
@@ -14,16 +14,33 @@
 #import "AIQSession.h"
 #import "AIQSynchronization.h"
 #import "AIQSynchronizationManager.h"
+#import "DeadlineHeap.h"
+#import "DocumentCodec.h"
+#import "FMDatabase+Helpers.h"
 #import "Reachability.h"
+#import "RelevanceMatcher.h"
+#import "SendMessageBatchOperation.h"
 #import "SendMessageOperation.h"
 #import "common.h"
 
+@interface AIQContext ()
+
+- (NSDictionary *)snapshot:(NSError **)error;
+
+@end
+
+@interface AIQSynchronization ()
+
+- (BOOL)queueUnavailableAttachmentsOfDocuments:(NSArray *)documents error:(NSError **)error;
+- (void)cancelDownloadsForDocumentWithId:(NSString *)identifier solution:(NSString *)solution;
+
+@end
+
 @interface AIQMessagingSynchronizer () {
     AIQSession *_session;
     FMDatabasePool *_pool;
     NSString *_basePath;
-    BOOL _hasMessages;
-    NSTimeInterval _previousActionDate;
+    DeadlineHeap *_deadlines;
     NSTimeInterval _nextActionDate;
     NSTimer *_timer;
     NSOperationQueue *_operationQueue;
@@ -31,20 +48,43 @@
     AIQContext *_context;
     Reachability *_reachability;
     NetworkStatus _networkStatus;
+    BOOL _batchingNotSupported;
+    NSThread *_networkThread;
+    NSMutableDictionary *_changedCounts;
 }
 
 @end
 
+static NSUInteger const kMaximumBatchSize = 50;
+static NSTimeInterval const kCoalescingInterval = 1.0;
+static NSTimeInterval const kCountsCoalescingInterval = 0.25;
+static NSString *const kDeadlineActivation = @"activation";
+static NSString *const kDeadlineExpiration = @"expiration";
+static NSString *const kEventReceived = @"received";
+static NSString *const kEventUpdated = @"updated";
+static NSString *const kEventExpired = @"expired";
+
+// activation, admission of attachments and ingestion all decide on the same window, so that a message which has been
+// activated always has its attachments admitted
+static BOOL IsMessageActive(NSTimeInterval activeFrom, NSTimeInterval timeToLive, NSTimeInterval now) {
+    return ((activeFrom <= now) && (activeFrom + timeToLive >= now));
+}
+
 @implementation AIQMessagingSynchronizer
 
 - (instancetype)initForSession:(AIQSession *)session {
     self = [super init];
     if (self) {
         _basePath = [session valueForKey:@"basePath"];
-        _pool = [FMDatabasePool databasePoolWithPath:[session valueForKey:@"dbPath"]];
+        _pool = [FMDatabasePool documentPoolWithPath:[session valueForKey:@"dbPath"]];
+        _deadlines = [DeadlineHeap new];
+        _changedCounts = [NSMutableDictionary dictionary];
         _nextActionDate = [[NSDate distantFuture] timeIntervalSince1970];
         _operationQueue = [NSOperationQueue new];
         _operationQueue.maxConcurrentOperationCount = 1;
+        _networkThread = [[NSThread alloc] initWithTarget:[AIQMessagingSynchronizer class] selector:@selector(runNetworkThread) object:nil];
+        _networkThread.name = @"com.appearnetworks.aiq.AIQMessagingSynchronizer.network";
+        [_networkThread start];
         _session = session;
         _context = [session context:nil];
         _serialQueue = dispatch_queue_create("com.appearnetworks.aiq.AIQMessagingSynchronizer", DISPATCH_QUEUE_SERIAL);
@@ -68,7 +108,6 @@
         LISTEN(self, @selector(applicationWillEnterForeground:), UIApplicationWillEnterForegroundNotification);
 #endif
         
-        _previousActionDate = [NSDate date].timeIntervalSince1970;
         [self scheduleNextNotification];
     }
     return self;
@@ -76,209 +115,83 @@
 
 - (void)didCreateDocument:(NSString *)identifier type:(NSString *)type solution:(NSString *)solution {
     dispatch_async(_serialQueue, ^{
-        [_pool inDatabase:^(FMDatabase *db) {
-            FMResultSet *rs = [db executeQuery:@"SELECT data FROM documents WHERE solution = ? AND identifier = ?", solution, identifier];
-            if (! rs) {
-                AIQLogCError(1, @"Did fail to retrieve message document %@: %@", identifier, [db lastError].localizedDescription);
-                return;
-            }
-            
-            if (! [rs next]) {
-                [rs close];
-                AIQLogCError(1, @"Message document %@ not found", identifier);
-                return;
-            }
-            
-            NSMutableDictionary *message = [[rs dataForColumnIndex:0] JSONObject];
-            [rs close];
-            
-            NSString *messageType = message[kAIQMessageType];
-            NSTimeInterval timeToLive = [message[kAIQMessageTimeToLive] doubleValue];
-            NSTimeInterval now = [[NSDate date] timeIntervalSince1970];
-            NSTimeInterval activeFrom = [message[kAIQMessageActiveFrom] doubleValue] / 1000.0f;
-            
-            if (activeFrom + timeToLive <= now) {
-                // message has already expired
-                AIQLogCInfo(1, @"Message %@ (%@) is already expired, removing", identifier, messageType);
-                [self deleteMessageDocumentWithId:identifier solution:solution inDatabase:db];
-                return;
-            }
-            
-            AIQLogCInfo(1, @"Creating message %@ (%@)", identifier, messageType);
-            if (! [db executeUpdate:@"INSERT OR REPLACE INTO somessages (solution, identifier, type, revision, created, activeFrom, timeToLive, read)"
-                   "VALUES (?, ?, ?, ?, ?, ?, ?, COALESCE((SELECT read FROM somessages WHERE identifier = ?), 0))",
-                   solution, identifier, messageType, message[@"revision"], message[kAIQMessageCreated], message[kAIQMessageActiveFrom], @(timeToLive), @NO]) {
-                AIQLogCError(1, @"Error storing message %@: %@", identifier, [db lastError].localizedDescription);
-                return;
-            }
-            
-            _hasMessages = YES;
-            message[kAIQDocumentId] = identifier;
-            message[@"solution"] = solution;
-            
-            if (! _hasMessages) {
-                _previousActionDate = now;
-            }
-            
-            if ((activeFrom <= now) && (activeFrom + timeToLive >= now)) {
-                // message is active, check expiration date
-                AIQLogCInfo(1, @"Message %@ (%@) is already active", identifier, messageType);
-                
-                // message is active
-                NOTIFY(AIQDidReceiveMessageNotification, self, (@{AIQDocumentIdUserInfoKey: identifier,
-                                                                  AIQMessageTypeUserInfoKey: messageType,
-                                                                  AIQSolutionUserInfoKey: solution}));
-                if (activeFrom + timeToLive < _nextActionDate) {
-                    _nextActionDate = activeFrom + timeToLive;
-                    NSDate *date = [NSDate dateWithTimeIntervalSince1970:_nextActionDate];
-                    AIQLogCInfo(1, @"Message %@ (%@) scheduled for expiration on %@", identifier, messageType, date);
-                    [self runTimerAt:_nextActionDate];
-                } else {
-                    AIQLogCInfo(1, @"Message %@ (%@) not scheduled for expiration yet", identifier, messageType);
-                }
-            } else if (activeFrom >= now) {
-                // message is pending activation
-                if (activeFrom < _nextActionDate) {
-                    _nextActionDate = activeFrom;
-                    NSDate *date = [NSDate dateWithTimeIntervalSince1970:_nextActionDate];
-                    AIQLogCInfo(1, @"Message %@ (%@) scheduled for activation on %@", identifier, messageType, date);
-                    [self runTimerAt:_nextActionDate];
-                } else {
-                    AIQLogCInfo(1, @"Message %@ (%@) not scheduled for activation yet", identifier, messageType);
-                }
-            }
-            
-            if ([messageType isEqualToString:@"_comessageresponse"]) {
-                [self handleCOMessageResponse:message[kAIQMessagePayload] forMessageWithId:identifier solution:solution inDatabase:db];
-            }
-        }];
+        NSDictionary *content = [self contentOfMessageDocumentWithId:identifier solution:solution];
+        if (content) {
+            [self ingestChanges:@[@{@"change": @"create", @"identifier": identifier, @"solution": solution, @"content": content}]];
+        }
     });
 }
 
 - (void)didUpdateDocument:(NSString *)identifier type:(NSString *)type solution:(NSString *)solution {
     dispatch_async(_serialQueue, ^{
-        [_pool inDatabase:^(FMDatabase *db) {
-            FMResultSet *rs = [db executeQuery:@"SELECT d.data, m.activeFrom / 1000, m.timeToLive, m.revision FROM documents d, somessages m "
-                               "WHERE d.solution = ? AND d.identifier = ? AND d.solution = m.solution AND d.identifier = m.identifier",
-                               solution, identifier];
-            if (! rs) {
-                AIQLogCError(1, @"Did fail to retrieve message document %@: %@", identifier, [db lastError].localizedDescription);
-                return;
-            }
-            
-            if (! [rs next]) {
-                [rs close];
-                AIQLogCError(1, @"Message document %@ not found", identifier);
-                return;
-            }
-            
-            NSMutableDictionary *newMessage = [[rs dataForColumnIndex:0] JSONObject];
-            NSTimeInterval oldActiveFrom = [rs doubleForColumnIndex:1];
-            NSTimeInterval oldTimeToLive = [rs doubleForColumnIndex:2];
-            long long oldRevision = [rs longLongIntForColumnIndex:3];
-            [rs close];
-            
-            NSTimeInterval newActiveFrom = [newMessage[kAIQMessageActiveFrom] doubleValue] / 1000.0f;
-            NSTimeInterval newTimeToLive = [newMessage[kAIQMessageTimeToLive] doubleValue];
-            NSString *messageType = newMessage[kAIQMessageType];
-            
-            long long newRevision = [newMessage[@"revision"] longLongValue];
-            BOOL payloadUpdated = (newRevision > oldRevision);
-            AIQLogCInfo(1, @"Updating message %@ (%@)", identifier, messageType);
-            if (! [db executeUpdate:@"INSERT OR REPLACE INTO somessages (solution, identifier, type, revision, created, activeFrom, timeToLive, read)"
-                   "VALUES (?, ?, ?, ?, ?, ?, ?, COALESCE((SELECT read FROM somessages WHERE identifier = ?), 0))",
-                   solution, identifier, messageType, newMessage[@"revision"], newMessage[kAIQMessageCreated], newMessage[kAIQMessageActiveFrom], @(newTimeToLive), @(! payloadUpdated)]) {
-                AIQLogCError(1, @"Error updating message %@: %@", identifier, [db lastError].localizedDescription);
-                return;
-            }
-            
-            newMessage[@"solution"] = solution;
-            
-            NSTimeInterval now = [[NSDate date] timeIntervalSince1970];
-            BOOL wasActive = ((oldActiveFrom <= now) && (oldActiveFrom + oldTimeToLive >= now));
-            BOOL isActive = ((newActiveFrom <= now) && (newActiveFrom + newTimeToLive >= now));
-            if (! _hasMessages) {
-                _previousActionDate = now;
-            }
-            
-            if ((wasActive) && (! isActive)) {
-                AIQLogCInfo(1, @"Updated message %@ (%@) becomes inactive", identifier, messageType);
-                if (newActiveFrom < _nextActionDate) {
-                    _nextActionDate = newActiveFrom;
-                    NSDate *date = [NSDate dateWithTimeIntervalSince1970:_nextActionDate];
-                    AIQLogCInfo(1, @"Message %@ (%@) scheduled for activation on %@", identifier, messageType, date);
-                    [self runTimerAt:_nextActionDate];
-                }
-                
-                if ([self deleteMessageDocumentWithId:identifier solution:solution inDatabase:db]) {
-                    NOTIFY(AIQDidExpireMessageNotification, self, (@{AIQDocumentIdUserInfoKey: identifier,
-                                                                     AIQMessageTypeUserInfoKey: messageType,
-                                                                     AIQSolutionUserInfoKey: solution}));
-                }
-            } else if ((! wasActive) && (isActive)) {
-                AIQLogCInfo(1, @"Updated message %@ (%@) becomes active", identifier, messageType);
-                NOTIFY(AIQDidReceiveMessageNotification, self, (@{AIQDocumentIdUserInfoKey: identifier,
-                                                                  AIQMessageTypeUserInfoKey: messageType,
-                                                                  AIQSolutionUserInfoKey: solution}));
-                if (newActiveFrom + newTimeToLive < _nextActionDate) {
-                    _nextActionDate = newActiveFrom + newTimeToLive;
-                    NSDate *date = [NSDate dateWithTimeIntervalSince1970:_nextActionDate];
-                    AIQLogCInfo(1, @"Message %@ (%@) scheduled for expiration on %@", identifier, messageType, date);
-                    [self runTimerAt:_nextActionDate];
-                }
-            } else {
-                AIQLogCInfo(1, @"Validity did not change for message %@ (%@)", identifier, messageType);
-            }
-            
-            if (payloadUpdated) {
-                AIQLogCInfo(1, @"Payload updated for message %@ (%@)", identifier, messageType);
-                NOTIFY(AIQDidUpdateMessageNotification, self, (@{AIQDocumentIdUserInfoKey: identifier,
-                                                                 AIQMessageTypeUserInfoKey: messageType,
-                                                                 AIQSolutionUserInfoKey: solution}));
-            }
-        }];
+        NSDictionary *content = [self contentOfMessageDocumentWithId:identifier solution:solution];
+        if (content) {
+            [self ingestChanges:@[@{@"change": @"update", @"identifier": identifier, @"solution": solution, @"content": content}]];
+        }
     });
 }
 
 - (void)didDeleteDocument:(NSString *)identifier type:(NSString *)type solution:(NSString *)solution {
     dispatch_async(_serialQueue, ^{
-        AIQLogCInfo(1, @"Deleting message %@", identifier);
-        
-        [_pool inDatabase:^(FMDatabase *db) {
-            FMResultSet *rs = [db executeQuery:@"SELECT type FROM somessages WHERE solution = ? AND identifier = ?", solution, identifier];
-            if (! rs) {
-                AIQLogCError(1, @"Did fail to retrieve message document %@: %@", identifier, [db lastError].localizedDescription);
-                return;
-            }
-            
-            if (! [rs next]) {
-                [rs close];
-                AIQLogCError(1, @"Message document %@ not found", identifier);
-                return;
-            }
-            
-            NSString *messageType = [rs stringForColumnIndex:0];
-            [rs close];
+        [self ingestChanges:@[@{@"change": @"delete", @"identifier": identifier, @"solution": solution}]];
+    });
+}
+
+- (void)didChangeDocuments:(NSArray *)changes type:(NSString *)type {
+    dispatch_async(_serialQueue, ^{
+        AIQLogCInfo(1, @"Ingesting %lu message changes", (unsigned long)changes.count);
+        [self ingestChanges:changes];
+    });
+}
+
+- (NSArray *)admitAttachments:(NSArray *)attachments type:(NSString *)type {
+    NSTimeInterval now = [[NSDate date] timeIntervalSince1970];
+    NSMutableDictionary *decisions = [NSMutableDictionary dictionary];
+    NSMutableArray *admitted = [NSMutableArray arrayWithCapacity:attachments.count];
+    NSDictionary *context = nil;
+    
+    // attachments of messages nobody will see are not worth the bandwidth, they are admitted once the message activates
+    for (NSDictionary *attachment in attachments) {
+        NSArray *key = @[attachment[@"solution"], attachment[@"identifier"]];
+        NSNumber *decision = decisions[key];
+        if (! decision) {
+            NSDictionary *message = attachment[@"content"];
+            NSTimeInterval activeFrom = [message[kAIQMessageActiveFrom] doubleValue] / 1000.0f;
+            NSTimeInterval timeToLive = [message[kAIQMessageTimeToLive] doubleValue];
+            NSDictionary *condition = message[@"notification"][@"condition"];
             
-            NSError *error = nil;
-            if ([messageType isEqualToString:@"_comessageresponse"]) {
-                if (! [self expireCOMessageForResponseId:identifier solution:solution inDatabase:db error:&error]) {
-                    AIQLogCWarn(1, @"Failed to expire client originated message %@: %@", identifier, error.localizedDescription);
+            if (! IsMessageActive(activeFrom, timeToLive, now)) {
+                decision = @NO;
+            } else if ((! condition) || (! _context)) {
+                decision = @YES;
+            } else {
+                if (! context) {
+                    NSError *error = nil;
+                    context = [_context snapshot:&error];
+                    if (! context) {
+                        AIQLogCWarn(1, @"Did fail to retrieve context: %@", error.localizedDescription);
+                        context = @{};
+                    }
                 }
+                RelevanceMatcher *matcher = [RelevanceMatcher matcherForCondition:condition
+                                                                         solution:attachment[@"solution"]
+                                                                       identifier:attachment[@"identifier"]
+                                                                         revision:attachment[@"revision"]];
+                decision = @([matcher matchesContext:context error:nil]);
             }
+            decisions[key] = decision;
             
-            if (! [db executeUpdate:@"DELETE FROM somessages WHERE solution = ? AND identifier = ?", solution, identifier]) {
-                AIQLogCError(1, @"Error deleting message %@: %@", identifier, [db lastError].localizedDescription);
-                return;
+            if (! decision.boolValue) {
+                AIQLogCInfo(1, @"Deferring attachments of message %@", attachment[@"identifier"]);
             }
-            
-            NOTIFY(AIQDidExpireMessageNotification, self, (@{AIQDocumentIdUserInfoKey: identifier,
-                                                             AIQMessageTypeUserInfoKey: messageType,
-                                                             AIQSolutionUserInfoKey: solution}));
-            
-            [self scheduleNextNotification];
-        }];
-    });
+        }
+        
+        if (decision.boolValue) {
+            [admitted addObject:attachment];
+        }
+    }
+    
+    return admitted;
 }
 
 - (void)didSynchronizeDocument:(NSString *)identifier type:(NSString *)type solution:(NSString *)solution {
@@ -399,6 +312,12 @@
 
 - (void)close {
     [[NSNotificationCenter defaultCenter] removeObserver:self];
+    if (_networkThread) {
+        [_operationQueue cancelAllOperations];
+        [_networkThread cancel];
+        [[AIQMessagingSynchronizer class] performSelector:@selector(stopNetworkThread) onThread:_networkThread withObject:nil waitUntilDone:NO];
+        _networkThread = nil;
+    }
     if (_timer) {
         [_timer invalidate];
         _timer = nil;
@@ -410,111 +329,496 @@
 }
 
 - (void)scheduleNextNotification {
-    if (! _hasMessages) {
-        AIQLogCInfo(1, @"No messages to schedule");
-        return;
+    dispatch_async(_serialQueue, ^{
+        [self reloadDeadlines];
+    });
+}
+
+- (void)didFireMessageEvent {
+    dispatch_async(_serialQueue, ^{
+        // deadlines falling into the same tick are handled together
+        NSTimeInterval now = [NSDate date].timeIntervalSince1970;
+        NSMutableArray *activated = [NSMutableArray array];
+        NSMutableArray *expired = [NSMutableArray array];
+        BOOL deferred = NO;
+        for (NSDictionary *deadline in [_deadlines popObjectsUntil:now + kCoalescingInterval]) {
+            NSString *solution = deadline[@"solution"];
+            NSString *identifier = deadline[@"identifier"];
+            NSString *type = deadline[@"type"];
+            if ([deadline[@"event"] isEqualToString:kDeadlineActivation]) {
+                // messages are looked up by activeFrom, activating one ahead of time would announce a message nobody can open
+                NSTimeInterval activeFrom = [deadline[@"activeFrom"] doubleValue];
+                if (activeFrom > now) {
+                    [_deadlines setDeadline:activeFrom forKey:@[solution, identifier] object:deadline];
+                    deferred = YES;
+                    continue;
+                }
+                [activated addObject:deadline];
+                [_deadlines setDeadline:[deadline[@"expiresAt"] doubleValue]
+                                 forKey:@[solution, identifier]
+                                 object:@{@"event": kDeadlineExpiration, @"solution": solution, @"identifier": identifier, @"type": type}];
+            } else {
+                [expired addObject:deadline];
+            }
+        }
+        
+        if (activated.count != 0) {
+            [self didActivateMessages:activated];
+        }
+        
+        if (expired.count != 0) {
+            [self didExpireMessages:expired];
+        }
+        
+        // a deferred activation may be the deadline the timer just fired for, the timer has to be armed again
+        [self scheduleTimer:deferred];
+    });
+}
+
+- (void)didActivateMessages:(NSArray *)messages {
+    // the active flag backs the message counts, it is raised for all messages of the tick at once
+    [_pool inTransaction:^(FMDatabase *db, BOOL *rollback) {
+        for (NSDictionary *message in messages) {
+            if (! [db executeUpdate:@"UPDATE somessages SET active = 1 WHERE solution = ? AND identifier = ?", message[@"solution"], message[@"identifier"]]) {
+                AIQLogCError(1, @"Did fail to activate message %@: %@", message[@"identifier"], [db lastError].localizedDescription);
+            }
+        }
+    }];
+    
+    NSMutableArray *events = [NSMutableArray arrayWithCapacity:messages.count];
+    NSMutableArray *documents = [NSMutableArray arrayWithCapacity:messages.count];
+    for (NSDictionary *message in messages) {
+        AIQLogCInfo(1, @"Message %@ (%@) activated", message[@"identifier"], message[@"type"]);
+        [events addObject:@[kEventReceived, message]];
+        [documents addObject:@[message[@"solution"], message[@"identifier"]]];
+        [self countsDidChangeForType:message[@"type"] solution:message[@"solution"]];
+    }
+    [self postEvents:events];
+    
+    // attachments deferred until activation can be downloaded now, other messages have nothing new to admit
+    NSError *error = nil;
+    if (! [[_session synchronization:nil] queueUnavailableAttachmentsOfDocuments:documents error:&error]) {
+        AIQLogCWarn(1, @"Did fail to queue attachments of activated messages: %@", error.localizedDescription);
+    }
+}
+
+- (void)didExpireMessages:(NSArray *)messages {
+    NSMutableArray *deleted = [NSMutableArray arrayWithCapacity:messages.count];
+    NSMutableArray *pending = [NSMutableArray array];
+    NSNumber *now = @((long long)[NSDate date].timeIntervalSince1970);
+    
+    [_pool inTransaction:^(FMDatabase *db, BOOL *rollback) {
+        for (NSDictionary *message in messages) {
+            NSString *solution = message[@"solution"];
+            NSString *identifier = message[@"identifier"];
+            NSString *type = message[@"type"];
+            
+            // deadlines are popped ahead of time and may be stale, only messages which really expired are deleted
+            if (! [db executeUpdate:@"DELETE FROM somessages WHERE solution = ? AND identifier = ? AND expiresAt <= ?", solution, identifier, now]) {
+                AIQLogCError(1, @"Did fail to delete message %@: %@", identifier, [db lastError].localizedDescription);
+                continue;
+            }
+            
+            if ([db changes] != 1) {
+                FMResultSet *rs = [db executeQuery:@"SELECT activeFrom, timeToLive FROM somessages WHERE solution = ? AND identifier = ?", solution, identifier];
+                if (! rs) {
+                    AIQLogCError(1, @"Did fail to retrieve message %@: %@", identifier, [db lastError].localizedDescription);
+                } else if ([rs next]) {
+                    [pending addObject:@{@"solution": solution,
+                                         @"identifier": identifier,
+                                         @"type": type,
+                                         @"activeFrom": @([rs doubleForColumnIndex:0] / 1000.0f),
+                                         @"timeToLive": @([rs doubleForColumnIndex:1])}];
+                } else {
+                    AIQLogCError(1, @"Message %@ not found", identifier);
+                }
+                [rs close];
+                continue;
+            }
+            
+            AIQLogCInfo(1, @"Message %@ (%@) expired", identifier, type);
+            
+            if ([type isEqualToString:@"_comessageresponse"]) {
+                NSError *error = nil;
+                if (! [self expireCOMessageForResponseId:identifier solution:solution inDatabase:db error:&error]) {
+                    AIQLogCWarn(1, @"Failed to expire client originated message %@: %@", identifier, error.localizedDescription);
+                }
+            }
+            
+            if ([self deleteMessageDocumentWithId:identifier solution:solution inDatabase:db]) {
+                [deleted addObject:message];
+            }
+        }
+    }];
+    
+    // messages which have not expired yet are put back with their current deadline
+    for (NSDictionary *message in pending) {
+        [self scheduleMessageWithId:message[@"identifier"]
+                               type:message[@"type"]
+                           solution:message[@"solution"]
+                         activeFrom:[message[@"activeFrom"] doubleValue]
+                         timeToLive:[message[@"timeToLive"] doubleValue]];
     }
     
+    NSMutableArray *events = [NSMutableArray arrayWithCapacity:deleted.count];
+    for (NSDictionary *message in deleted) {
+        [events addObject:@[kEventExpired, message]];
+        [self countsDidChangeForType:message[@"type"] solution:message[@"solution"]];
+    }
+    [self postEvents:events];
+    [self cancelDownloadsForEvents:events];
+}
+
+- (void)reloadDeadlines {
+    [_deadlines removeAllDeadlines];
+    
+    [self refreshActiveMessages];
+    
     [_pool inDatabase:^(FMDatabase *db) {
-        FMResultSet *rs = [db executeQuery:@"SELECT CASE WHEN activeFrom / 1000 > ? THEN activeFrom / 1000 ELSE activeFrom / 1000 + timeToLive END AS date "
-                           "FROM somessages "
-                           "WHERE date > ? "
-                           "ORDER BY date ASC LIMIT 1",
-                           @(_previousActionDate),
-                           @(_previousActionDate)];
+        FMResultSet *rs = [db executeQuery:@"SELECT solution, identifier, type, activeFrom, timeToLive FROM somessages WHERE expiresAt >= ?",
+                           @((long long)[NSDate date].timeIntervalSince1970)];
         if (! rs) {
             AIQLogCError(1, @"Did fail to schedule next message: %@", [db lastError].localizedDescription);
             return;
         }
         
-        if (! [rs next]) {
-            AIQLogCInfo(1, @"No messages to schedule");
-            [rs close];
-            _hasMessages = NO;
-            _nextActionDate = [[NSDate distantFuture] timeIntervalSince1970];
+        while ([rs next]) {
+            [self scheduleMessageWithId:[rs stringForColumnIndex:1]
+                                   type:[rs stringForColumnIndex:2]
+                               solution:[rs stringForColumnIndex:0]
+                             activeFrom:[rs doubleForColumnIndex:3] / 1000.0f
+                             timeToLive:[rs doubleForColumnIndex:4]];
+        }
+        [rs close];
+    }];
+    
+    [self scheduleTimer:YES];
+}
+
+- (NSDictionary *)contentOfMessageDocumentWithId:(NSString *)identifier solution:(NSString *)solution {
+    __block NSDictionary *content = nil;
+    
+    [_pool inDatabase:^(FMDatabase *db) {
+        FMResultSet *rs = [db executeQuery:@"SELECT data FROM documents WHERE solution = ? AND identifier = ?", solution, identifier];
+        if (! rs) {
+            AIQLogCError(1, @"Did fail to retrieve message document %@: %@", identifier, [db lastError].localizedDescription);
             return;
         }
         
-        _nextActionDate = [rs doubleForColumnIndex:0];
+        if ([rs next]) {
+            content = [DocumentCodec objectWithData:[rs dataForColumnIndex:0] mutable:NO];
+        } else {
+            AIQLogCError(1, @"Message document %@ not found", identifier);
+        }
+        [rs close];
+    }];
+    
+    return content;
+}
+
+- (void)ingestChanges:(NSArray *)changes {
+    NSMutableArray *events = [NSMutableArray array];
+    NSMutableSet *counted = [NSMutableSet set];
+    
+    // the whole batch is stored in a single transaction, observers are told once it has been committed
+    [_pool inTransaction:^(FMDatabase *db, BOOL *rollback) {
+        for (NSDictionary *change in changes) {
+            if ([change[@"change"] isEqualToString:@"delete"]) {
+                [self removeMessageWithId:change[@"identifier"] solution:change[@"solution"] inDatabase:db events:events counted:counted];
+            } else {
+                [self storeMessage:change[@"content"] withId:change[@"identifier"] solution:change[@"solution"] inDatabase:db events:events counted:counted];
+            }
+        }
+    }];
+    
+    [self postEvents:events];
+    [self cancelDownloadsForEvents:events];
+    for (NSArray *pair in counted) {
+        [self countsDidChangeForType:pair[1] solution:pair[0]];
+    }
+    [self scheduleTimer:NO];
+}
+
+- (void)storeMessage:(NSDictionary *)message
+              withId:(NSString *)identifier
+            solution:(NSString *)solution
+          inDatabase:(FMDatabase *)db
+              events:(NSMutableArray *)events
+             counted:(NSMutableSet *)counted {
+    if (! message[kAIQMessageType]) {
+        AIQLogCError(1, @"Message document %@ has no type", identifier);
+        return;
+    }
+    
+    FMResultSet *rs = [db executeQuery:@"SELECT type, activeAt, expiresAt, revision, read FROM somessages WHERE solution = ? AND identifier = ?", solution, identifier];
+    if (! rs) {
+        AIQLogCError(1, @"Did fail to retrieve message %@: %@", identifier, [db lastError].localizedDescription);
+        return;
+    }
+    
+    BOOL exists = [rs next];
+    NSString *oldType = nil;
+    NSTimeInterval oldActiveAt = 0.0;
+    NSTimeInterval oldExpiresAt = 0.0;
+    long long oldRevision = 0;
+    BOOL oldRead = NO;
+    if (exists) {
+        oldType = [rs stringForColumnIndex:0];
+        oldActiveAt = [rs doubleForColumnIndex:1];
+        oldExpiresAt = [rs doubleForColumnIndex:2];
+        oldRevision = [rs longLongIntForColumnIndex:3];
+        oldRead = [rs boolForColumnIndex:4];
+    }
+    [rs close];
+    
+    NSString *messageType = message[kAIQMessageType];
+    NSTimeInterval timeToLive = [message[kAIQMessageTimeToLive] doubleValue];
+    NSTimeInterval activeFrom = [message[kAIQMessageActiveFrom] doubleValue] / 1000.0f;
+    NSTimeInterval now = [[NSDate date] timeIntervalSince1970];
+    
+    if ((! exists) && (activeFrom + timeToLive <= now)) {
+        AIQLogCInfo(1, @"Message %@ (%@) is already expired, removing", identifier, messageType);
+        [self deleteMessageDocumentWithId:identifier solution:solution inDatabase:db];
+        return;
+    }
+    
+    // the read flag survives updates which do not touch the payload
+    BOOL payloadUpdated = ((exists) && ([message[@"revision"] longLongValue] > oldRevision));
+    BOOL read = ((exists) && (! payloadUpdated) && (oldRead));
+    
+    AIQLogCInfo(1, @"%@ message %@ (%@)", exists ? @"Updating" : @"Creating", identifier, messageType);
+    if (! [db executeUpdate:@"INSERT OR REPLACE INTO somessages (solution, identifier, type, revision, created, activeFrom, timeToLive, read) "
+           "VALUES (?, ?, ?, ?, ?, ?, ?, ?)",
+           solution, identifier, messageType, message[@"revision"], message[kAIQMessageCreated], message[kAIQMessageActiveFrom], @(timeToLive), @(read)]) {
+        AIQLogCError(1, @"Error storing message %@: %@", identifier, [db lastError].localizedDescription);
+        return;
+    }
+    
+    if (oldType) {
+        [counted addObject:@[solution, oldType]];
+    }
+    [counted addObject:@[solution, messageType]];
+    
+    BOOL wasActive = ((exists) && (oldActiveAt <= now) && (oldExpiresAt >= now));
+    BOOL isActive = IsMessageActive(activeFrom, timeToLive, now);
+    NSDictionary *event = @{@"solution": solution, @"identifier": identifier, @"type": messageType};
+    
+    if ((wasActive) && (! isActive)) {
+        AIQLogCInfo(1, @"Updated message %@ (%@) becomes inactive", identifier, messageType);
+        if ([self deleteMessageDocumentWithId:identifier solution:solution inDatabase:db]) {
+            [events addObject:@[kEventExpired, event]];
+        }
+    } else if ((! wasActive) && (isActive)) {
+        AIQLogCInfo(1, @"Message %@ (%@) is active", identifier, messageType);
+        [events addObject:@[kEventReceived, event]];
+    }
+    
+    if (payloadUpdated) {
+        AIQLogCInfo(1, @"Payload updated for message %@ (%@)", identifier, messageType);
+        [events addObject:@[kEventUpdated, event]];
+    }
+    
+    [self scheduleMessageWithId:identifier type:messageType solution:solution activeFrom:activeFrom timeToLive:timeToLive];
+    
+    if ((! exists) && ([messageType isEqualToString:@"_comessageresponse"])) {
+        [self handleCOMessageResponse:message[kAIQMessagePayload] forMessageWithId:identifier solution:solution inDatabase:db];
+    }
+}
+
+- (void)removeMessageWithId:(NSString *)identifier
+                   solution:(NSString *)solution
+                 inDatabase:(FMDatabase *)db
+                     events:(NSMutableArray *)events
+                    counted:(NSMutableSet *)counted {
+    AIQLogCInfo(1, @"Deleting message %@", identifier);
+    
+    FMResultSet *rs = [db executeQuery:@"SELECT type FROM somessages WHERE solution = ? AND identifier = ?", solution, identifier];
+    if (! rs) {
+        AIQLogCError(1, @"Did fail to retrieve message document %@: %@", identifier, [db lastError].localizedDescription);
+        return;
+    }
+    
+    if (! [rs next]) {
+        [rs close];
+        AIQLogCError(1, @"Message document %@ not found", identifier);
+        return;
+    }
+    
+    NSString *messageType = [rs stringForColumnIndex:0];
+    [rs close];
+    
+    NSError *error = nil;
+    if ([messageType isEqualToString:@"_comessageresponse"]) {
+        if (! [self expireCOMessageForResponseId:identifier solution:solution inDatabase:db error:&error]) {
+            AIQLogCWarn(1, @"Failed to expire client originated message %@: %@", identifier, error.localizedDescription);
+        }
+    }
+    
+    if (! [db executeUpdate:@"DELETE FROM somessages WHERE solution = ? AND identifier = ?", solution, identifier]) {
+        AIQLogCError(1, @"Error deleting message %@: %@", identifier, [db lastError].localizedDescription);
+        return;
+    }
+    
+    [events addObject:@[kEventExpired, @{@"solution": solution, @"identifier": identifier, @"type": messageType}]];
+    [counted addObject:@[solution, messageType]];
+    [_deadlines removeDeadlineForKey:@[solution, identifier]];
+}
+
+- (void)cancelDownloadsForEvents:(NSArray *)events {
+    AIQSynchronization *synchronization = nil;
+    for (NSArray *event in events) {
+        if (! [event[0] isEqualToString:kEventExpired]) {
+            continue;
+        }
+        if (! synchronization) {
+            synchronization = [_session synchronization:nil];
+        }
+        [synchronization cancelDownloadsForDocumentWithId:event[1][@"identifier"] solution:event[1][@"solution"]];
+    }
+}
+
+- (void)postEvents:(NSArray *)events {
+    NSDictionary *notifications = @{kEventReceived: AIQDidReceiveMessageNotification,
+                                    kEventUpdated: AIQDidUpdateMessageNotification,
+                                    kEventExpired: AIQDidExpireMessageNotification};
+    NSDictionary *batchNotifications = @{kEventReceived: @[AIQDidReceiveMessagesNotification, AIQReceivedMessageIdsUserInfoKey],
+                                         kEventUpdated: @[AIQDidUpdateMessagesNotification, AIQUpdatedMessageIdsUserInfoKey],
+                                         kEventExpired: @[AIQDidExpireMessagesNotification, AIQExpiredMessageIdsUserInfoKey]};
+    
+    NSMutableDictionary *batches = [NSMutableDictionary dictionary];
+    for (NSArray *event in events) {
+        NSDictionary *message = event[1];
+        NOTIFY(notifications[event[0]], self, (@{AIQDocumentIdUserInfoKey: message[@"identifier"],
+                                                 AIQMessageTypeUserInfoKey: message[@"type"],
+                                                 AIQSolutionUserInfoKey: message[@"solution"]}));
+        
+        NSArray *key = @[event[0], message[@"solution"]];
+        if (! batches[key]) {
+            batches[key] = [NSMutableArray array];
+        }
+        [batches[key] addObject:message[@"identifier"]];
+    }
+    
+    // observers refreshing a list of messages only need to do it once per solution
+    for (NSArray *key in batches) {
+        NSArray *batch = batchNotifications[key[0]];
+        NOTIFY(batch[0], self, (@{AIQSolutionUserInfoKey: key[1], batch[1]: [batches[key] copy]}));
+    }
+}
+
+- (void)refreshActiveMessages {
+    // deadlines passed while the application was not running leave the active flag behind
+    NSNumber *now = @((long long)[[NSDate date] timeIntervalSince1970]);
+    NSMutableArray *changed = [NSMutableArray array];
+    
+    [_pool inTransaction:^(FMDatabase *db, BOOL *rollback) {
+        FMResultSet *rs = [db executeQuery:@"SELECT DISTINCT solution, type FROM somessages WHERE active <> (activeAt <= ? AND expiresAt >= ?)", now, now];
+        if (! rs) {
+            AIQLogCError(1, @"Did fail to retrieve outdated messages: %@", [db lastError].localizedDescription);
+            return;
+        }
+        
+        while ([rs next]) {
+            [changed addObject:@[[rs stringForColumnIndex:0], [rs stringForColumnIndex:1]]];
+        }
         [rs close];
         
-        NSDate *date = [NSDate dateWithTimeIntervalSince1970:_nextActionDate];
-        AIQLogCInfo(1, @"Next message event scheduled for %@", date);
-        [self runTimerAt:_nextActionDate];
+        if (changed.count == 0) {
+            return;
+        }
+        
+        if (! [db executeUpdate:@"UPDATE somessages SET active = (activeAt <= ? AND expiresAt >= ?) WHERE active <> (activeAt <= ? AND expiresAt >= ?)", now, now, now, now]) {
+            AIQLogCError(1, @"Did fail to refresh active messages: %@", [db lastError].localizedDescription);
+            [changed removeAllObjects];
+            *rollback = YES;
+        }
     }];
+    
+    for (NSArray *pair in changed) {
+        [self countsDidChangeForType:pair[1] solution:pair[0]];
+    }
 }
 
-- (void)didFireMessageEvent {
+- (void)countsDidChangeForType:(NSString *)type solution:(NSString *)solution {
+    if ((! type) || (! solution)) {
+        return;
+    }
+    
     dispatch_async(_serialQueue, ^{
-        [_pool inDatabase:^(FMDatabase *db) {
-            NSTimeInterval now = [NSDate date].timeIntervalSince1970;
-            FMResultSet *rs = [db executeQuery:@"SELECT "
-                               "solution,"
-                               "identifier,"
-                               "type,"
-                               "CASE WHEN activeFrom / 1000 = ? THEN activeFrom / 1000 ELSE activeFrom / 1000 + timeToLive END AS date,"
-                               "CASE WHEN activeFrom / 1000 = ? THEN 0 ELSE 1 END "
-                               "FROM somessages "
-                               "WHERE date = ? "
-                               "ORDER BY date ASC",
-                               @(_nextActionDate),
-                               @(_nextActionDate),
-                               @(_nextActionDate)];
-            if (! rs) {
-                AIQLogCError(1, @"Did fail to schedule next message: %@", [db lastError].localizedDescription);
-                return;
-            }
-            
-            while ([rs next]) {
-                NSString *solution = [rs stringForColumnIndex:0];
-                NSString *identifier = [rs stringForColumnIndex:1];
-                NSString *type = [rs stringForColumnIndex:2];
-                BOOL active = [rs boolForColumnIndex:4];
-                if (active) {
-                    [self didExpireMessageWithId:identifier type:type inSolution:solution];
-                } else {
-                    [self didActivateMessageWithId:identifier type:type inSolution:solution];
-                }
-            }
-            [rs close];
-            
-            _previousActionDate = now;
-            [self scheduleNextNotification];
-        }];
+        // changes falling into the same interval are announced with a single notification per solution
+        BOOL scheduled = (_changedCounts.count != 0);
+        NSMutableSet *types = _changedCounts[solution];
+        if (! types) {
+            types = [NSMutableSet set];
+            _changedCounts[solution] = types;
+        }
+        [types addObject:type];
+        
+        if (! scheduled) {
+            dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(kCountsCoalescingInterval * NSEC_PER_SEC)), _serialQueue, ^{
+                [self postCountChanges];
+            });
+        }
     });
 }
 
-- (void)didActivateMessageWithId:(NSString *)identifier type:(NSString *)type inSolution:(NSString *)solution {
-    AIQLogCInfo(1, @"Message %@ (%@) activated", identifier, type);
-    NOTIFY(AIQDidReceiveMessageNotification, self, (@{AIQDocumentIdUserInfoKey: identifier,
-                                                      AIQMessageTypeUserInfoKey: type,
-                                                      AIQSolutionUserInfoKey: solution}));
+- (void)postCountChanges {
+    NSDictionary *changed = [_changedCounts copy];
+    [_changedCounts removeAllObjects];
+    
+    for (NSString *solution in changed) {
+        NOTIFY(AIQDidChangeMessageCountsNotification, self, (@{AIQSolutionUserInfoKey: solution,
+                                                               AIQMessageTypesUserInfoKey: [changed[solution] allObjects]}));
+    }
 }
 
-- (void)didExpireMessageWithId:(NSString *)identifier type:(NSString *)type inSolution:(NSString *)solution {
-    __block NSError *error = nil;
-    AIQLogCInfo(1, @"Message %@ (%@) expired", identifier, type);
+- (void)scheduleMessageWithId:(NSString *)identifier
+                         type:(NSString *)type
+                     solution:(NSString *)solution
+                   activeFrom:(NSTimeInterval)activeFrom
+                   timeToLive:(NSTimeInterval)timeToLive {
+    NSTimeInterval now = [NSDate date].timeIntervalSince1970;
+    NSArray *key = @[solution, identifier];
     
-    if ([type isEqualToString:@"_comessageresponse"]) {
-        [_pool inDatabase:^(FMDatabase *db) {
-            if (! [self expireCOMessageForResponseId:identifier solution:solution inDatabase:db error:&error]) {
-                AIQLogCWarn(1, @"Failed to expire client originated message %@: %@", identifier, error.localizedDescription);
-            }
-        }];
+    if (activeFrom > now) {
+        // message is pending activation, its expiration is scheduled once it becomes active
+        [_deadlines setDeadline:activeFrom
+                         forKey:key
+                         object:@{@"event": kDeadlineActivation, @"solution": solution, @"identifier": identifier, @"type": type, @"activeFrom": @(activeFrom), @"expiresAt": @(activeFrom + timeToLive)}];
+    } else if (activeFrom + timeToLive >= now) {
+        [_deadlines setDeadline:activeFrom + timeToLive
+                         forKey:key
+                         object:@{@"event": kDeadlineExpiration, @"solution": solution, @"identifier": identifier, @"type": type}];
+    } else {
+        [_deadlines removeDeadlineForKey:key];
+    }
+}
+
+- (void)scheduleTimer:(BOOL)force {
+    NSTimeInterval next = _deadlines.earliestDeadline;
+    if ((! force) && (next == _nextActionDate)) {
+        return;
     }
     
-    if ([self deleteMessageWithId:identifier solution:solution]) {
-        NOTIFY(AIQDidExpireMessageNotification, self, (@{AIQDocumentIdUserInfoKey: identifier,
-                                                         AIQMessageTypeUserInfoKey: type,
-                                                         AIQSolutionUserInfoKey: solution}));
+    _nextActionDate = next;
+    if (_deadlines.count == 0) {
+        AIQLogCInfo(1, @"No messages to schedule");
+    } else {
+        AIQLogCInfo(1, @"Next message event scheduled for %@", [NSDate dateWithTimeIntervalSince1970:_nextActionDate]);
     }
+    [self runTimerAt:_nextActionDate];
 }
 
 - (void)pushMessages {
     AIQLogCInfo(1, @"Pushing client originated messages");
     
+    BOOL batching = ((! _batchingNotSupported) && ([_session propertyForName:@"comessagebatch"] != nil));
+    
     [_pool inDatabase:^(FMDatabase *db) {
-        FMResultSet *rs = [db executeQuery:@"SELECT solution, identifier FROM comessages WHERE state = ? ORDER BY orderId ASC", @(AIQMessageStateQueued)];
+        // urgent messages go first, messages without attachments are grouped into batches between the others
+        FMResultSet *rs = [db executeQuery:@"SELECT c.solution, c.identifier, "
+                           "EXISTS (SELECT 1 FROM coattachments a WHERE a.solution = c.solution AND a.identifier = c.identifier) "
+                           "FROM comessages c WHERE c.state = ? ORDER BY c.urgent DESC, c.orderId ASC", @(AIQMessageStateQueued)];
         if (! rs) {
             AIQLogCError(1, @"Could not retrieve queued messages: %@", [db lastError].localizedDescription);
             return;
@@ -522,29 +826,99 @@
         
         [_operationQueue setSuspended:YES];
         
+        NSMutableSet *queued = [NSMutableSet set];
+        for (NSOperation *operation in _operationQueue.operations) {
+            if (operation.isFinished) {
+                continue;
+            }
+            if ([operation isKindOfClass:[SendMessageBatchOperation class]]) {
+                for (NSArray *message in ((SendMessageBatchOperation *)operation).messages) {
+                    [queued addObject:message[1]];
+                }
+            } else if ([operation isKindOfClass:[SendMessageOperation class]]) {
+                [queued addObject:((SendMessageOperation *)operation).identifier];
+            }
+        }
+        
+        NSMutableArray *batch = [NSMutableArray array];
         while ([rs next]) {
+            NSString *solution = [rs stringForColumnIndex:0];
             NSString *identifier = [rs stringForColumnIndex:1];
             
-            SendMessageOperation *operation = [SendMessageOperation new];
-            operation.solution = [rs stringForColumnIndex:0];
-            operation.identifier = identifier;
-            operation.synchronizer = self;
-            operation.thread = [NSThread mainThread];
-            if ([_operationQueue.operations containsObject:operation]) {
+            if ([queued containsObject:identifier]) {
                 AIQLogCInfo(1, @"Message %@ already in the upload queue", identifier);
                 continue;
             }
+            
+            if ((batching) && (! [rs boolForColumnIndex:2])) {
+                [batch addObject:@[solution, identifier]];
+                if (batch.count == kMaximumBatchSize) {
+                    [self enqueueBatch:batch];
+                    batch = [NSMutableArray array];
+                }
+                continue;
+            }
+            
+            [self enqueueBatch:batch];
+            batch = [NSMutableArray array];
+            
+            SendMessageOperation *operation = [SendMessageOperation new];
+            operation.solution = solution;
+            operation.identifier = identifier;
+            operation.synchronizer = self;
+            operation.thread = _networkThread;
             AIQLogCInfo(1, @"Adding message %@ to the upload queue", identifier);
             operation.timeout = 60.0f;
             [_operationQueue addOperation:operation];
         }
         [rs close];
         
+        [self enqueueBatch:batch];
+        
         [_operationQueue setSuspended:NO];
     }];
 }
 
+- (void)enqueueBatch:(NSArray *)messages {
+    if (messages.count == 0) {
+        return;
+    }
+    
+    if (messages.count == 1) {
+        SendMessageOperation *operation = [SendMessageOperation new];
+        operation.solution = messages[0][0];
+        operation.identifier = messages[0][1];
+        operation.synchronizer = self;
+        operation.thread = _networkThread;
+        operation.timeout = 60.0f;
+        AIQLogCInfo(1, @"Adding message %@ to the upload queue", operation.identifier);
+        [_operationQueue addOperation:operation];
+        return;
+    }
+    
+    SendMessageBatchOperation *operation = [SendMessageBatchOperation new];
+    operation.messages = [messages copy];
+    operation.synchronizer = self;
+    operation.thread = _networkThread;
+    operation.timeout = 60.0f;
+    AIQLogCInfo(1, @"Adding a batch of %lu messages to the upload queue", (unsigned long)messages.count);
+    [_operationQueue addOperation:operation];
+}
+
+- (void)batchingNotSupported {
+    _batchingNotSupported = YES;
+    [self pushMessages];
+}
+
 - (void)handleUnauthorized {
+    // closing the session reaches the session delegate, which expects the main thread
+    if (! [NSThread isMainThread]) {
+        dispatch_async(dispatch_get_main_queue(), ^{
+            [self handleUnauthorized];
+        });
+        return;
+    }
+    
     AIQLogCInfo(1, @"Login session has expired, cancelling and logging out");
     
     [_operationQueue cancelAllOperations];
@@ -639,29 +1013,6 @@
     return YES;
 }
 
-- (BOOL)deleteMessageWithId:(NSString *)identifier solution:(NSString *)solution {
-    __block BOOL result = NO;
-    
-    [_pool inDatabase:^(FMDatabase *db) {
-        if (! [db executeUpdate:@"DELETE FROM somessages WHERE solution = ? AND identifier = ? "
-               "AND DATETIME(activeFrom / 1000, 'unixepoch') <= DATETIME('now') "
-               "AND DATETIME(activeFrom / 1000 + timeToLive, 'unixepoch') >= DATETIME('now')",
-               solution, identifier]) {
-            AIQLogCError(1, @"Did fail to delete message %@: %@", identifier, [db lastError].localizedDescription);
-            return;
-        }
-        
-        if ([db changes] != 1) {
-            AIQLogCError(1, @"Message %@ not found", identifier);
-            return;
-        }
-        
-        result = [self deleteMessageDocumentWithId:identifier solution:solution inDatabase:db];
-    }];
-    
-    return result;
-}
-
 - (void)synchronizationComplete:(NSNotification *)notification {
     [self pushMessages];
 }
@@ -688,6 +1039,14 @@
 }
 
 - (void)runTimerAt:(NSTimeInterval)time {
+    // timers have to be invalidated on the thread they were scheduled on
+    if (! [NSThread isMainThread]) {
+        dispatch_async(dispatch_get_main_queue(), ^{
+            [self runTimerAt:time];
+        });
+        return;
+    }
+    
     if (_timer) {
         [_timer invalidate];
     }
@@ -701,6 +1060,23 @@
     [[NSRunLoop mainRunLoop] addTimer:_timer forMode:NSDefaultRunLoopMode];
 }
 
++ (void)runNetworkThread {
+    @autoreleasepool {
+        // the port keeps the run loop alive while no connection is scheduled
+        NSRunLoop *runLoop = [NSRunLoop currentRunLoop];
+        [runLoop addPort:[NSMachPort port] forMode:NSDefaultRunLoopMode];
+        while (! [NSThread currentThread].isCancelled) {
+            @autoreleasepool {
+                [runLoop runMode:NSDefaultRunLoopMode beforeDate:[NSDate distantFuture]];
+            }
+        }
+    }
+}
+
++ (void)stopNetworkThread {
+    CFRunLoopStop(CFRunLoopGetCurrent());
+}
+
 - (void)applicationWillEnterForeground:(NSNotification *)notification {
     [self scheduleNextNotification];
 }
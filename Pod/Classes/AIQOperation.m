@@ -4,6 +4,7 @@
 #import "AIQLog.h"
 #import "AIQOperation.h"
 #import "AIQSession.h"
+#import "FMDatabase+Helpers.h"
 
 @interface AIQSession ()
 
@@ -98,7 +99,7 @@
 
 - (FMDatabasePool *)pool {
     if (! _pool) {
-        _pool = [FMDatabasePool databasePoolWithPath:[[_synchronization valueForKey:@"session"] valueForKey:@"dbPath"]];
+        _pool = [FMDatabasePool documentPoolWithPath:[[_synchronization valueForKey:@"session"] valueForKey:@"dbPath"]];
     }
     return _pool;
 }
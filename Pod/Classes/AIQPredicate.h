@@ -0,0 +1,122 @@
+#ifndef AIQCoreLib_AIQPredicate_h
+#define AIQCoreLib_AIQPredicate_h
+
+#import <Foundation/Foundation.h>
+
+/*!
+ @header AIQPredicate.h
+ @author Marcin Lukow, Simon Jarbrant
+ @copyright 2016 Appear Networks Systems AB
+ @updated 2016-05-16
+ @brief Predicates which can be used to filter documents by their field values.
+ @version 1.6.0
+ */
+
+/** Predicate describing a condition on document fields.
+
+ Predicates are evaluated by the document storage itself, without decoding documents which do not match. They can
+ be used together with documentsOfType:matching:processor:error: from AIQDataStore and AIQLocalStorage modules.
+
+ Field names may refer to nested fields by separating the path components with a dot, e.g. "address.city".
+ System fields (the ones starting with an underscore) cannot be used in predicates.
+
+ @since 1.6.0
+ @see AIQDataStore
+ @see AIQLocalStorage
+ */
+@interface AIQPredicate : NSObject
+
+/** Returns a predicate matching documents whose field is equal to given value.
+
+ @param field Name of the field to compare. Must not be nil.
+ @param value Value to compare with. Can be a string, a number or NSNull, in which case the predicate matches
+ documents in which the field is missing or null.
+ @return Predicate, will not be nil.
+ @since 1.6.0
+ */
++ (instancetype)predicateWithField:(NSString *)field equalTo:(id)value;
+
+/** Returns a predicate matching documents whose field is not equal to given value.
+
+ @param field Name of the field to compare. Must not be nil.
+ @param value Value to compare with. Can be a string, a number or NSNull, in which case the predicate matches
+ documents in which the field is defined.
+ @return Predicate, will not be nil.
+ @since 1.6.0
+ */
++ (instancetype)predicateWithField:(NSString *)field notEqualTo:(id)value;
+
+/** Returns a predicate matching documents whose field is less than given value.
+
+ @param field Name of the field to compare. Must not be nil.
+ @param value Value to compare with. Must be a string or a number.
+ @return Predicate, will not be nil.
+ @since 1.6.0
+ */
++ (instancetype)predicateWithField:(NSString *)field lessThan:(id)value;
+
+/** Returns a predicate matching documents whose field is less than or equal to given value.
+
+ @param field Name of the field to compare. Must not be nil.
+ @param value Value to compare with. Must be a string or a number.
+ @return Predicate, will not be nil.
+ @since 1.6.0
+ */
++ (instancetype)predicateWithField:(NSString *)field lessThanOrEqualTo:(id)value;
+
+/** Returns a predicate matching documents whose field is greater than given value.
+
+ @param field Name of the field to compare. Must not be nil.
+ @param value Value to compare with. Must be a string or a number.
+ @return Predicate, will not be nil.
+ @since 1.6.0
+ */
++ (instancetype)predicateWithField:(NSString *)field greaterThan:(id)value;
+
+/** Returns a predicate matching documents whose field is greater than or equal to given value.
+
+ @param field Name of the field to compare. Must not be nil.
+ @param value Value to compare with. Must be a string or a number.
+ @return Predicate, will not be nil.
+ @since 1.6.0
+ */
++ (instancetype)predicateWithField:(NSString *)field greaterThanOrEqualTo:(id)value;
+
+/** Returns a predicate matching documents whose field falls within given range, inclusive.
+
+ @param field Name of the field to compare. Must not be nil.
+ @param lower Lower bound of the range. Must be a string or a number. NSNull leaves the range open on the left side.
+ @param upper Upper bound of the range. Must be a string or a number. NSNull leaves the range open on the right side.
+ @return Predicate, will not be nil.
+ @since 1.6.0
+ */
++ (instancetype)predicateWithField:(NSString *)field between:(id)lower and:(id)upper;
+
+/** Returns a predicate matching documents whose field is equal to any of given values.
+
+ @param field Name of the field to compare. Must not be nil.
+ @param values Values to compare with. Must not be nil and must contain only strings and numbers.
+ @return Predicate, will not be nil.
+ @since 1.6.0
+ */
++ (instancetype)predicateWithField:(NSString *)field in:(NSArray *)values;
+
+/** Returns a predicate matching documents which match all given predicates.
+
+ @param predicates Array of AIQPredicate instances. Must not be nil.
+ @return Predicate, will not be nil.
+ @since 1.6.0
+ */
++ (instancetype)predicateMatchingAll:(NSArray *)predicates;
+
+/** Returns a predicate matching documents which match any of given predicates.
+
+ @param predicates Array of AIQPredicate instances. Must not be nil.
+ @return Predicate, will not be nil.
+ @since 1.6.0
+ */
++ (instancetype)predicateMatchingAny:(NSArray *)predicates;
+
+@end
+
+#endif /* AIQCoreLib_AIQPredicate_h */
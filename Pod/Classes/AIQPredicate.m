@@ -0,0 +1,309 @@
+#import "AIQError.h"
+#import "AIQJSON.h"
+#import "AIQPredicate.h"
+
+typedef NS_ENUM(NSInteger, AIQPredicateOperator) {
+    AIQPredicateOperatorEqual,
+    AIQPredicateOperatorNotEqual,
+    AIQPredicateOperatorLess,
+    AIQPredicateOperatorLessOrEqual,
+    AIQPredicateOperatorGreater,
+    AIQPredicateOperatorGreaterOrEqual,
+    AIQPredicateOperatorBetween,
+    AIQPredicateOperatorIn,
+    AIQPredicateOperatorAll,
+    AIQPredicateOperatorAny
+};
+
+@interface AIQPredicate () {
+    AIQPredicateOperator _operator;
+    NSString *_field;
+    NSArray *_values;
+}
+
+@end
+
+@implementation AIQPredicate
+
++ (instancetype)predicateWithField:(NSString *)field equalTo:(id)value {
+    return [[AIQPredicate alloc] initWithOperator:AIQPredicateOperatorEqual field:field values:value ? @[value] : nil];
+}
+
++ (instancetype)predicateWithField:(NSString *)field notEqualTo:(id)value {
+    return [[AIQPredicate alloc] initWithOperator:AIQPredicateOperatorNotEqual field:field values:value ? @[value] : nil];
+}
+
++ (instancetype)predicateWithField:(NSString *)field lessThan:(id)value {
+    return [[AIQPredicate alloc] initWithOperator:AIQPredicateOperatorLess field:field values:value ? @[value] : nil];
+}
+
++ (instancetype)predicateWithField:(NSString *)field lessThanOrEqualTo:(id)value {
+    return [[AIQPredicate alloc] initWithOperator:AIQPredicateOperatorLessOrEqual field:field values:value ? @[value] : nil];
+}
+
++ (instancetype)predicateWithField:(NSString *)field greaterThan:(id)value {
+    return [[AIQPredicate alloc] initWithOperator:AIQPredicateOperatorGreater field:field values:value ? @[value] : nil];
+}
+
++ (instancetype)predicateWithField:(NSString *)field greaterThanOrEqualTo:(id)value {
+    return [[AIQPredicate alloc] initWithOperator:AIQPredicateOperatorGreaterOrEqual field:field values:value ? @[value] : nil];
+}
+
++ (instancetype)predicateWithField:(NSString *)field between:(id)lower and:(id)upper {
+    return [[AIQPredicate alloc] initWithOperator:AIQPredicateOperatorBetween
+                                            field:field
+                                           values:@[lower ?: [NSNull null], upper ?: [NSNull null]]];
+}
+
++ (instancetype)predicateWithField:(NSString *)field in:(NSArray *)values {
+    return [[AIQPredicate alloc] initWithOperator:AIQPredicateOperatorIn field:field values:values];
+}
+
++ (instancetype)predicateMatchingAll:(NSArray *)predicates {
+    return [[AIQPredicate alloc] initWithOperator:AIQPredicateOperatorAll field:nil values:predicates];
+}
+
++ (instancetype)predicateMatchingAny:(NSArray *)predicates {
+    return [[AIQPredicate alloc] initWithOperator:AIQPredicateOperatorAny field:nil values:predicates];
+}
+
++ (NSString *)pathForField:(NSString *)field error:(NSError *__autoreleasing *)error {
+    if (error) {
+        *error = nil;
+    }
+
+    if (! [field isKindOfClass:[NSString class]]) {
+        if (error) {
+            *error = [AIQError errorWithCode:AIQErrorInvalidArgument message:@"Field not specified"];
+        }
+        return nil;
+    }
+
+    NSMutableString *path = [NSMutableString stringWithString:@"$"];
+    for (NSString *component in [field componentsSeparatedByString:@"."]) {
+        if ((component.length == 0) || ([component rangeOfString:@"\""].location != NSNotFound)) {
+            if (error) {
+                *error = [AIQError errorWithCode:AIQErrorInvalidArgument message:[NSString stringWithFormat:@"Invalid field: %@", field]];
+            }
+            return nil;
+        }
+        [path appendFormat:@".\"%@\"", component];
+    }
+
+    if ([field characterAtIndex:0] == '_') {
+        if (error) {
+            *error = [AIQError errorWithCode:AIQErrorInvalidArgument message:@"Restricted field"];
+        }
+        return nil;
+    }
+
+    // the path has to be a literal, otherwise SQLite will not match the expression against declared indexes
+    return [AIQPredicate literalForString:path];
+}
+
++ (NSString *)expressionForField:(NSString *)field column:(NSString *)column error:(NSError *__autoreleasing *)error {
+    NSString *path = [AIQPredicate pathForField:field error:error];
+    if (! path) {
+        return nil;
+    }
+    return [NSString stringWithFormat:@"aiq_extract(%@, %@)", column, path];
+}
+
++ (NSString *)projectionForFields:(NSArray *)fields column:(NSString *)column error:(NSError *__autoreleasing *)error {
+    if (error) {
+        *error = nil;
+    }
+
+    if (fields.count == 0) {
+        return @"NULL";
+    }
+
+    NSMutableArray *paths = [NSMutableArray arrayWithCapacity:fields.count + 1];
+    for (NSString *field in fields) {
+        NSString *path = [AIQPredicate pathForField:field error:error];
+        if (! path) {
+            return nil;
+        }
+        [paths addObject:path];
+    }
+
+    if (paths.count == 1) {
+        // aiq_extract, like json_extract, returns a JSON array only when given more than one path
+        [paths addObject:paths[0]];
+    }
+
+    return [NSString stringWithFormat:@"aiq_extract(%@, %@)", column, [paths componentsJoinedByString:@", "]];
+}
+
++ (NSMutableDictionary *)dictionaryFromProjection:(NSData *)projection fields:(NSArray *)fields {
+    NSMutableDictionary *result = [NSMutableDictionary dictionaryWithCapacity:fields.count];
+    NSArray *values = projection ? [projection JSONObject] : nil;
+    if (! [values isKindOfClass:[NSArray class]]) {
+        return result;
+    }
+
+    for (NSUInteger i = 0; (i < fields.count) && (i < values.count); i++) {
+        id value = values[i];
+        if (value == [NSNull null]) {
+            continue;
+        }
+
+        NSArray *components = [fields[i] componentsSeparatedByString:@"."];
+        NSMutableDictionary *parent = result;
+        for (NSUInteger j = 0; j < components.count - 1; j++) {
+            NSMutableDictionary *child = parent[components[j]];
+            if (! [child isKindOfClass:[NSMutableDictionary class]]) {
+                child = [NSMutableDictionary dictionary];
+                parent[components[j]] = child;
+            }
+            parent = child;
+        }
+        parent[components.lastObject] = value;
+    }
+    return result;
+}
+
++ (NSString *)literalForString:(NSString *)string {
+    return [NSString stringWithFormat:@"'%@'", [string stringByReplacingOccurrencesOfString:@"'" withString:@"''"]];
+}
+
++ (NSString *)identifierForString:(NSString *)string {
+    return [NSString stringWithFormat:@"\"%@\"", [string stringByReplacingOccurrencesOfString:@"\"" withString:@"\"\""]];
+}
+
+- (instancetype)initWithOperator:(AIQPredicateOperator)operator field:(NSString *)field values:(NSArray *)values {
+    self = [super init];
+    if (self) {
+        _operator = operator;
+        _field = [field copy];
+        _values = [values copy];
+    }
+    return self;
+}
+
+- (NSString *)SQLForColumn:(NSString *)column arguments:(NSMutableArray *)arguments error:(NSError *__autoreleasing *)error {
+    if (error) {
+        *error = nil;
+    }
+
+    if (! _values) {
+        if (error) {
+            *error = [AIQError errorWithCode:AIQErrorInvalidArgument message:@"Value not specified"];
+        }
+        return nil;
+    }
+
+    if ((_operator == AIQPredicateOperatorAll) || (_operator == AIQPredicateOperatorAny)) {
+        if (_values.count == 0) {
+            return (_operator == AIQPredicateOperatorAll) ? @"1" : @"0";
+        }
+
+        NSMutableArray *clauses = [NSMutableArray arrayWithCapacity:_values.count];
+        for (id predicate in _values) {
+            if (! [predicate isKindOfClass:[AIQPredicate class]]) {
+                if (error) {
+                    *error = [AIQError errorWithCode:AIQErrorInvalidArgument message:@"Invalid predicate"];
+                }
+                return nil;
+            }
+            NSString *clause = [predicate SQLForColumn:column arguments:arguments error:error];
+            if (! clause) {
+                return nil;
+            }
+            [clauses addObject:[NSString stringWithFormat:@"(%@)", clause]];
+        }
+        return [clauses componentsJoinedByString:(_operator == AIQPredicateOperatorAll) ? @" AND " : @" OR "];
+    }
+
+    NSString *expression = [AIQPredicate expressionForField:_field column:column error:error];
+    if (! expression) {
+        return nil;
+    }
+
+    for (id value in _values) {
+        if ((! [value isKindOfClass:[NSString class]]) &&
+            (! [value isKindOfClass:[NSNumber class]]) &&
+            (! [value isKindOfClass:[NSNull class]])) {
+            if (error) {
+                *error = [AIQError errorWithCode:AIQErrorInvalidArgument message:[NSString stringWithFormat:@"Invalid value for field %@", _field]];
+            }
+            return nil;
+        }
+    }
+
+    id value = _values.firstObject;
+
+    if ((_operator == AIQPredicateOperatorEqual) || (_operator == AIQPredicateOperatorNotEqual)) {
+        BOOL equal = (_operator == AIQPredicateOperatorEqual);
+        if (value == [NSNull null]) {
+            return [NSString stringWithFormat:@"%@ IS %@NULL", expression, equal ? @"" : @"NOT "];
+        }
+        [arguments addObject:value];
+        return [NSString stringWithFormat:@"%@ %@ ?", expression, equal ? @"=" : @"!="];
+    }
+
+    if (_operator == AIQPredicateOperatorIn) {
+        if (_values.count == 0) {
+            return @"0";
+        }
+        NSMutableArray *placeholders = [NSMutableArray arrayWithCapacity:_values.count];
+        for (id value in _values) {
+            if (value == [NSNull null]) {
+                if (error) {
+                    *error = [AIQError errorWithCode:AIQErrorInvalidArgument message:[NSString stringWithFormat:@"Invalid value for field %@", _field]];
+                }
+                return nil;
+            }
+            [placeholders addObject:@"?"];
+            [arguments addObject:value];
+        }
+        return [NSString stringWithFormat:@"%@ IN (%@)", expression, [placeholders componentsJoinedByString:@", "]];
+    }
+
+    if (_operator == AIQPredicateOperatorBetween) {
+        id lower = _values[0];
+        id upper = _values[1];
+        if ((lower == [NSNull null]) && (upper == [NSNull null])) {
+            return [NSString stringWithFormat:@"%@ IS NOT NULL", expression];
+        }
+        if (lower == [NSNull null]) {
+            [arguments addObject:upper];
+            return [NSString stringWithFormat:@"%@ <= ?", expression];
+        }
+        if (upper == [NSNull null]) {
+            [arguments addObject:lower];
+            return [NSString stringWithFormat:@"%@ >= ?", expression];
+        }
+        [arguments addObject:lower];
+        [arguments addObject:upper];
+        return [NSString stringWithFormat:@"%@ BETWEEN ? AND ?", expression];
+    }
+
+    if (value == [NSNull null]) {
+        if (error) {
+            *error = [AIQError errorWithCode:AIQErrorInvalidArgument message:[NSString stringWithFormat:@"Invalid value for field %@", _field]];
+        }
+        return nil;
+    }
+
+    NSString *operator = nil;
+    if (_operator == AIQPredicateOperatorLess) {
+        operator = @"<";
+    } else if (_operator == AIQPredicateOperatorLessOrEqual) {
+        operator = @"<=";
+    } else if (_operator == AIQPredicateOperatorGreater) {
+        operator = @">";
+    } else {
+        operator = @">=";
+    }
+    [arguments addObject:value];
+    return [NSString stringWithFormat:@"%@ %@ ?", expression, operator];
+}
+
+- (NSString *)description {
+    NSMutableArray *arguments = [NSMutableArray array];
+    NSString *sql = [self SQLForColumn:@"data" arguments:arguments error:nil];
+    return [NSString stringWithFormat:@"<AIQPredicate: %p (%@ %@)>", self, sql, arguments];
+}
+
+@end
@@ -135,6 +135,25 @@ EXTERN_API(NSString *) const kAIQUserPermissions;
 
 EXTERN_API(NSString *) const AIQSessionStatusCodeKey;
 
+/** Startup timeline key for the name of a step.
+ 
+ This key is used to store the name of a session open step in the entries of the startupTimeline array.
+ 
+ @since 1.6.0
+ @see startupTimeline
+ */
+EXTERN_API(NSString *) const kAIQStartupStepName;
+
+/** Startup timeline key for the duration of a step.
+ 
+ This key is used to store the duration of a session open step, in seconds, in the entries of the startupTimeline
+ array.
+ 
+ @since 1.6.0
+ @see startupTimeline
+ */
+EXTERN_API(NSString *) const kAIQStartupStepDuration;
+
 @class AIQContext;
 @class AIQDataStore;
 @class AIQDirectCall;
@@ -376,6 +395,17 @@ EXTERN_API(NSString *) const AIQSessionStatusCodeKey;
  */
 - (id)propertyForName:(NSString *)name;
 
+/** Sets a session property for given name.
+ 
+ This method can be used to store session properties. Properties are kept in memory and written to persistent storage
+ shortly afterwards, so that a burst of updates results in a single write. Pending updates are also written when the
+ session is closed or the application enters background.
+ 
+ @param property The value of the property. May be nil, in which case the property is removed.
+ @param name The name of the property to store. Must not be nil.
+ 
+ @since 1.0.4
+ */
 - (void)setProperty:(id)property forName:(NSString *)name;
 
 - (BOOL)hasRole:(NSString *)role;
@@ -468,6 +498,82 @@ EXTERN_API(NSString *) const AIQSessionStatusCodeKey;
  */
 - (AIQSynchronization *)synchronization:(NSError **)error;
 
+/**---------------------------------------------------------------------------------------
+ * @name Document cache
+ * ---------------------------------------------------------------------------------------
+ */
+
+/** Memory budget of the decoded document cache, in bytes.
+ 
+ Documents retrieved by AIQDataStore and AIQMessaging modules are kept decoded in memory, up to given budget, and
+ reused as long as their revision and status do not change. Every document is charged with an estimate of its decoded
+ size. Least recently used documents are evicted first and the whole cache is purged when the application receives a
+ memory warning. Setting the budget to 0 disables the cache.
+ 
+ Default value is 0.
+ 
+ @since 1.6.0
+ */
+@property (nonatomic, assign) NSUInteger documentCacheLimit;
+
+/** Number of document reads served from the decoded document cache.
+ 
+ @since 1.6.0
+ @see documentCacheLimit
+ */
+@property (nonatomic, readonly) NSUInteger documentCacheHits;
+
+/** Number of document reads which could not be served from the decoded document cache.
+ 
+ @since 1.6.0
+ @see documentCacheLimit
+ */
+@property (nonatomic, readonly) NSUInteger documentCacheMisses;
+
+/**---------------------------------------------------------------------------------------
+ * @name Asynchronous access
+ * ---------------------------------------------------------------------------------------
+ */
+
+/** Queue on which completion blocks of asynchronous module methods are called.
+ 
+ Asynchronous variants of AIQDataStore, AIQLocalStorage, AIQMessaging and AIQLaunchableStore methods perform their
+ work on library managed queues, reads concurrently and writes one at a time, and report back on this queue.
+ Setting it to nil restores the default value.
+ 
+ Default value is the main queue.
+ 
+ @since 1.6.0
+ */
+@property (nonatomic, retain) dispatch_queue_t callbackQueue;
+
+/** Quality of service with which asynchronous module methods are performed.
+ 
+ Default value is NSQualityOfServiceUserInitiated.
+ 
+ @since 1.6.0
+ @see callbackQueue
+ */
+@property (nonatomic, assign) NSQualityOfService qualityOfService;
+
+/**---------------------------------------------------------------------------------------
+ * @name Startup timeline
+ * ---------------------------------------------------------------------------------------
+ */
+
+/** Durations of the steps performed when the session was last opened or resumed.
+ 
+ Each entry is a dictionary containing the step name under kAIQStartupStepName and its duration in seconds under
+ kAIQStartupStepDuration, in the order in which the steps have finished. Steps are folders, journal, migrations,
+ launchables and modules. When launchables have to be extracted again after a bridge upgrade, this happens in the
+ background after the session is opened and an extraction step is appended once it finishes. Until then launchables
+ which are not extracted yet report NO under kAIQLaunchableReady and can be extracted on demand with
+ [AIQLaunchableStore prepareLaunchableWithId:error:].
+ 
+ @since 1.6.0
+ */
+@property (nonatomic, readonly) NSArray *startupTimeline;
+
 @end
 
 #endif /* AIQCoreLib_AIQSession_h */
@@ -20,6 +20,10 @@
 #import "AIQMessagingSynchronizer.h"
 #import "AIQSession.h"
 #import "AIQSynchronization.h"
+#import "BridgeRuntime.h"
+#import "Dispatcher.h"
+#import "DocumentCache.h"
+#import "LiveQueryCenter.h"
 #import "NSString+Helpers.h"
 
 NSInteger const AIQSessionCredentialsError = 3001;
@@ -40,8 +44,11 @@ NSString *const kAIQUserEmail = @"email";
 NSString *const kAIQUserRoles = @"roles";
 NSString *const kAIQUserGroups = @"groups";
 NSString *const kAIQUserPermissions = @"permissions";
+NSString *const kAIQStartupStepName = @"name";
+NSString *const kAIQStartupStepDuration = @"duration";
 
 static AIQSession *currentSession = nil;
+static NSTimeInterval const kPropertySynchronizationDelay = 1.0;
 
 @interface AIQContext ()
 
@@ -64,6 +71,7 @@ static AIQSession *currentSession = nil;
 @interface AIQLaunchableStore ()
 
 - (instancetype)initForSession:(AIQSession *)session error:(NSError **)error;
+- (void)reloadInBackground:(void (^)(NSError *error))completion;
 
 @end
 
@@ -102,6 +110,14 @@ static AIQSession *currentSession = nil;
     NSString *_basePath;
     NSString *_dbPath;
     NSString *_organizationName;
+    DocumentCache *_documentCache;
+    Dispatcher *_dispatcher;
+    LiveQueryCenter *_liveQueryCenter;
+    NSObject *_propertyLock;
+    NSUInteger _propertyUpdates;
+    BOOL _propertiesChanged;
+    BOOL _propertySynchronizationScheduled;
+    NSMutableArray *_startupTimeline;
 }
 
 @end
@@ -169,11 +185,6 @@ static AIQSession *currentSession = nil;
         if (! [result prepare:error]) {
             return nil;
         }
-        AIQLaunchableStore *launchableStore = [[AIQLaunchableStore alloc] initForSession:result error:error];
-        if (! launchableStore) {
-            return nil;
-        }
-        [result setValue:launchableStore forKey:@"launchableStore"];
         
         AIQContext *context = [[AIQContext alloc] initForSession:result error:error];
         if (! context) {
@@ -191,10 +202,23 @@ static AIQSession *currentSession = nil;
     self = [super init];
     if (self) {
         _timeoutInterval = AIQSessionDefaultTimeoutInterval;
+        _documentCache = [DocumentCache new];
+        _dispatcher = [Dispatcher new];
+        _liveQueryCenter = [LiveQueryCenter new];
+        _propertyLock = [NSObject new];
+        _startupTimeline = [NSMutableArray array];
+#if TARGET_OS_IPHONE
+        LISTEN(self, @selector(applicationDidEnterBackground:), UIApplicationDidEnterBackgroundNotification);
+        LISTEN(self, @selector(applicationDidEnterBackground:), UIApplicationWillTerminateNotification);
+#endif
     }
     return self;
 }
 
+- (void)dealloc {
+    [[NSNotificationCenter defaultCenter] removeObserver:self];
+}
+
 - (BOOL)openForUser:(NSString *)username
        withPassword:(NSString *)password
      inOrganization:(NSString *)organization
@@ -378,6 +402,10 @@ static AIQSession *currentSession = nil;
             _context = nil;
         }
         
+        [_documentCache purge];
+        [_liveQueryCenter invalidateAll];
+        [self flushProperties];
+        
         NSUserDefaults *defaults = [NSUserDefaults standardUserDefaults];
         NSMutableDictionary *root = [[defaults dictionaryForKey:@"AIQCoreLib"] mutableCopy];
         [root removeObjectForKey:@"currentSession"];
@@ -385,18 +413,18 @@ static AIQSession *currentSession = nil;
         [defaults synchronize];
         
         NSDictionary *body = @{@"deviceId": root[@"deviceId"]};
-        NSString *logout = _session[@"logout"];
+        NSString *logout = [self propertyForName:@"logout"];
         NSMutableURLRequest *request = [NSMutableURLRequest requestWithURL:[NSURL URLWithString:logout]
                                                                cachePolicy:NSURLRequestReloadIgnoringCacheData
                                                            timeoutInterval:_timeoutInterval];
         request.HTTPMethod = @"POST";
         request.HTTPBody = [[body JSONString] dataUsingEncoding:NSUTF8StringEncoding];
         [request setValue:@"application/json" forHTTPHeaderField:@"Content-Type"];
-        [request setValue:[NSString stringWithFormat:@"BEARER %@", _session[@"accessToken"]] forHTTPHeaderField:@"Authorization"];
+        [request setValue:[NSString stringWithFormat:@"BEARER %@", [self propertyForName:@"accessToken"]] forHTTPHeaderField:@"Authorization"];
         [NSURLConnection connectionWithRequest:request delegate:nil];
         
         _sessionKey = nil;
-        _session = nil;
+        [self replaceSession:nil];
         
         currentSession = nil;
         _sessionOpened = NO;
@@ -426,7 +454,7 @@ static AIQSession *currentSession = nil;
         [_connection cancel];
         _connection = nil;
         _sessionKey = nil;
-        _session = nil;
+        [self replaceSession:nil];
         return YES;
     }
 }
@@ -436,29 +464,45 @@ static AIQSession *currentSession = nil;
 }
 
 - (id)propertyForName:(NSString *)name {
-    if (! _session) {
-        return nil;
-    }
-    
     if (! name) {
         return nil;
     }
     
-    id value = [_session valueForKey:name];
-    return value ? [value copy] : nil;
+    @synchronized(_propertyLock) {
+        // values are copied when they are set, so they can be handed out as they are
+        return _session[name];
+    }
 }
 
 - (void)setProperty:(id)property forName:(NSString *)name {
-    if (! _session) {
+    if (! name) {
         return;
     }
     
-    if (! name) {
-        return;
+    @synchronized(_propertyLock) {
+        if (! _session) {
+            return;
+        }
+        
+        id value = [property copy];
+        id current = _session[name];
+        if ((value == current) || ([value isEqual:current])) {
+            return;
+        }
+        
+        _session[name] = value;
+        _propertiesChanged = YES;
+        
+        if ((_propertyUpdates != 0) || (_propertySynchronizationScheduled)) {
+            return;
+        }
+        _propertySynchronizationScheduled = YES;
     }
     
-    _session[name] = property;
-    [self synchronizeProperties];
+    // updates arriving in quick succession are written to the user defaults at once
+    dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(kPropertySynchronizationDelay * NSEC_PER_SEC)), dispatch_get_main_queue(), ^{
+        [self synchronizeProperties];
+    });
 }
 
 - (BOOL)hasRole:(NSString *)role {
@@ -466,7 +510,7 @@ static AIQSession *currentSession = nil;
         return NO;
     }
     
-    return [_session[kAIQUser][kAIQUserRoles] containsObject:role];
+    return [[self propertyForName:kAIQUser][kAIQUserRoles] containsObject:role];
 }
 
 - (BOOL)hasPermission:(NSString *)permission {
@@ -474,7 +518,7 @@ static AIQSession *currentSession = nil;
         return NO;
     }
     
-    return [_session[kAIQUser][kAIQUserPermissions] containsObject:permission];
+    return [[self propertyForName:kAIQUser][kAIQUserPermissions] containsObject:permission];
 }
 
 - (BOOL)solutions:(void (^)(NSString *, NSError *__autoreleasing *))processor error:(NSError *__autoreleasing *)error {
@@ -542,6 +586,44 @@ static AIQSession *currentSession = nil;
     return _synchronization;
 }
 
+- (NSUInteger)documentCacheLimit {
+    return _documentCache.capacity;
+}
+
+- (void)setDocumentCacheLimit:(NSUInteger)documentCacheLimit {
+    _documentCache.capacity = documentCacheLimit;
+}
+
+- (NSUInteger)documentCacheHits {
+    return _documentCache.hits;
+}
+
+- (NSUInteger)documentCacheMisses {
+    return _documentCache.misses;
+}
+
+- (dispatch_queue_t)callbackQueue {
+    return _dispatcher.callbackQueue;
+}
+
+- (void)setCallbackQueue:(dispatch_queue_t)callbackQueue {
+    _dispatcher.callbackQueue = callbackQueue;
+}
+
+- (NSQualityOfService)qualityOfService {
+    return _dispatcher.qualityOfService;
+}
+
+- (void)setQualityOfService:(NSQualityOfService)qualityOfService {
+    _dispatcher.qualityOfService = qualityOfService;
+}
+
+- (NSArray *)startupTimeline {
+    @synchronized(_startupTimeline) {
+        return [_startupTimeline copy];
+    }
+}
+
 - (NSString *)description {
     return [NSString stringWithFormat:@"<AIQSession: %p (%@)>", self, _sessionKey];
 }
@@ -552,7 +634,7 @@ static AIQSession *currentSession = nil;
     AIQLogCWarn(1, @"Connection failed: %@", error.localizedDescription);
     [_connection unscheduleFromRunLoop:[NSRunLoop mainRunLoop] forMode:NSRunLoopCommonModes];
     _connection = nil;
-    _session = nil;
+    [self replaceSession:nil];
     _sessionKey = nil;
     
     if (_delegate) {
@@ -608,7 +690,7 @@ static AIQSession *currentSession = nil;
     
     if ((_statusCode != 200) || (! json)) {
         _connection = nil;
-        _session = nil;
+        [self replaceSession:nil];
         _sessionKey = nil;
         if (_delegate) {
             if ((json) && (json[@"error"])) {
@@ -661,23 +743,28 @@ static AIQSession *currentSession = nil;
             userProfile[kAIQUserPermissions] = @[];
         }
         
-        _session[@"accessToken"] = accessToken;
-        _session[kAIQUser] = [userProfile copy];
-        if (json[@"protocol_version"]) {
-            _session[@"protocolVersion"] = json[@"protocol_version"];
-        } else {
-            _session[@"protocolVersion"] = @0;
-        }
-
-        if (json[@"sync_interval"]) {
-            _session[@"syncInterval"] = json[@"sync_interval"];
-        } else {
-            // Remember to unset any old value that might still be present
-            [_session removeObjectForKey:@"syncInterval"];
+        // properties are handed out without copying, so they are only ever replaced under the property lock
+        NSString *deviceURL;
+        @synchronized(_propertyLock) {
+            _session[@"accessToken"] = [accessToken copy];
+            _session[kAIQUser] = [userProfile copy];
+            if (json[@"protocol_version"]) {
+                _session[@"protocolVersion"] = [json[@"protocol_version"] copy];
+            } else {
+                _session[@"protocolVersion"] = @0;
+            }
+            
+            if (json[@"sync_interval"]) {
+                _session[@"syncInterval"] = [json[@"sync_interval"] copy];
+            } else {
+                // Remember to unset any old value that might still be present
+                [_session removeObjectForKey:@"syncInterval"];
+            }
+            
+            deviceURL = _session[@"deviceURL"];
+            [_session removeObjectForKey:@"deviceURL"];
         }
         
-        NSString *deviceURL = _session[@"deviceURL"];
-        [_session removeObjectForKey:@"deviceURL"];
         NSMutableURLRequest *request = [NSMutableURLRequest requestWithURL:[NSURL URLWithString:deviceURL]
                                                                cachePolicy:NSURLRequestReloadIgnoringCacheData
                                                            timeoutInterval:_timeoutInterval];
@@ -691,22 +778,29 @@ static AIQSession *currentSession = nil;
     } else if (json[@"links"]) {
         if (_session) {
             NSDictionary *links = json[@"links"];
-            if (links[@"logout"]) {
-                _session[@"logout"] = links[@"logout"];
-            }
-            if (links[@"startdatasync"]) {
-                _session[@"startdatasync"] = links[@"startdatasync"];
-            }
-            if (links[@"direct"]) {
-                _session[@"direct"] = links[@"direct"];
-            }
-            if (links[@"comessage"]) {
-                _session[@"comessage"] = links[@"comessage"];
+            @synchronized(_propertyLock) {
+                if (links[@"logout"]) {
+                    _session[@"logout"] = [links[@"logout"] copy];
+                }
+                if (links[@"startdatasync"]) {
+                    _session[@"startdatasync"] = [links[@"startdatasync"] copy];
+                }
+                if (links[@"direct"]) {
+                    _session[@"direct"] = [links[@"direct"] copy];
+                }
+                if (links[@"comessage"]) {
+                    _session[@"comessage"] = [links[@"comessage"] copy];
+                }
+                if (links[@"comessagebatch"]) {
+                    _session[@"comessagebatch"] = [links[@"comessagebatch"] copy];
+                } else {
+                    [_session removeObjectForKey:@"comessagebatch"];
+                }
             }
             
             NSError *error = nil;
             if (! [self prepare:&error]) {
-                _session = nil;
+                [self replaceSession:nil];
                 _sessionKey = nil;
                 if (_delegate) {
                     [_delegate session:self openDidFailWithError:error];
@@ -720,7 +814,9 @@ static AIQSession *currentSession = nil;
             newRoot[@"currentSession"] = _sessionKey;
             NSDictionary *sessions = newRoot[@"sessions"];
             NSMutableDictionary *newSessions = sessions ? [sessions mutableCopy] : [NSMutableDictionary dictionary];
-            newSessions[_sessionKey] = _session;
+            @synchronized(_propertyLock) {
+                newSessions[_sessionKey] = [_session copy];
+            }
             newRoot[@"sessions"] = newSessions;
             [defaults setObject:newRoot forKey:@"AIQCoreLib"];
             [defaults synchronize];
@@ -739,23 +835,25 @@ static AIQSession *currentSession = nil;
             
             NSUserDefaults *defaults = [NSUserDefaults standardUserDefaults];
             NSDictionary *root = [defaults dictionaryForKey:@"AIQCoreLib"];
+            NSMutableDictionary *session;
             if (root) {
                 NSDictionary *sessions = root[@"sessions"];
                 if (sessions) {
-                    NSDictionary *session = sessions[_sessionKey];
-                    if (session) {
-                        _session = [session mutableCopy];
+                    NSDictionary *stored = sessions[_sessionKey];
+                    if (stored) {
+                        session = [stored mutableCopy];
                     } else {
-                        _session = [NSMutableDictionary dictionary];
+                        session = [NSMutableDictionary dictionary];
                     }
                 } else {
-                    _session = [NSMutableDictionary dictionary];
+                    session = [NSMutableDictionary dictionary];
                 }
             } else {
-                _session = [NSMutableDictionary dictionary];
+                session = [NSMutableDictionary dictionary];
             }
-            _session[@"deviceURL"] = deviceURL;
-            _session[kAIQOrganizationName] = _organizationName;
+            session[@"deviceURL"] = [deviceURL copy];
+            session[kAIQOrganizationName] = _organizationName;
+            [self replaceSession:session];
             _organizationName = nil;
             
             NSMutableURLRequest *request = [NSMutableURLRequest requestWithURL:[NSURL URLWithString:tokenURL]
@@ -775,17 +873,66 @@ static AIQSession *currentSession = nil;
 
 #pragma mark - Private API
 
-- (void)synchronizeProperties {
+- (void)replaceSession:(NSMutableDictionary *)session {
+    @synchronized(_propertyLock) {
+        _session = session;
+    }
+}
+
+- (void)beginPropertyUpdates {
+    @synchronized(_propertyLock) {
+        _propertyUpdates++;
+    }
+}
+
+- (void)endPropertyUpdates {
+    @synchronized(_propertyLock) {
+        if (_propertyUpdates != 0) {
+            _propertyUpdates--;
+        }
+        if ((_propertyUpdates != 0) || (! _propertiesChanged)) {
+            return;
+        }
+    }
+    
+    [self synchronizeProperties];
+}
+
+- (void)applicationDidEnterBackground:(NSNotification *)notification {
+    [self flushProperties];
+}
+
+- (BOOL)flushProperties {
+    NSDictionary *properties;
+    NSString *sessionKey;
+    @synchronized(_propertyLock) {
+        _propertySynchronizationScheduled = NO;
+        if ((! _propertiesChanged) || (! _session) || (! _sessionKey)) {
+            return NO;
+        }
+        _propertiesChanged = NO;
+        properties = [_session copy];
+        sessionKey = _sessionKey;
+    }
+    
     NSUserDefaults *defaults = [NSUserDefaults standardUserDefaults];
     NSMutableDictionary *root = [[defaults dictionaryForKey:@"AIQCoreLib"] mutableCopy];
     NSMutableDictionary *sessions = [root[@"sessions"] mutableCopy];
-    sessions[_sessionKey] = _session;
+    sessions[sessionKey] = properties;
     root[@"sessions"] = sessions;
     [defaults setValue:root forKey:@"AIQCoreLib"];
     [defaults synchronize];
-    NSString *deviceToken = [defaults valueForKey:@"AIQDeviceToken"];
     
-    if ((_session[@"push"]) && (deviceToken) && (! _pushNotificationsFailed) && (! _registeredForPushNotifications) && (! _connection)) {
+    return YES;
+}
+
+- (void)synchronizeProperties {
+    if (! [self flushProperties]) {
+        return;
+    }
+    
+    NSString *deviceToken = [[NSUserDefaults standardUserDefaults] valueForKey:@"AIQDeviceToken"];
+    if (([self propertyForName:@"push"]) && (deviceToken) && (! _pushNotificationsFailed) && (! _registeredForPushNotifications) && (! _connection)) {
         [self registerForPushNotifications:deviceToken];
     }
 }
@@ -793,13 +940,13 @@ static AIQSession *currentSession = nil;
 - (void)registerForPushNotifications:(NSString *)deviceToken {
     AIQLogCInfo(1, @"Registering for push notifications");
     
-    NSMutableURLRequest *request = [NSMutableURLRequest requestWithURL:[NSURL URLWithString:_session[@"push"]]
+    NSMutableURLRequest *request = [NSMutableURLRequest requestWithURL:[NSURL URLWithString:[self propertyForName:@"push"]]
                                                            cachePolicy:NSURLRequestReloadIgnoringCacheData
                                                        timeoutInterval:_timeoutInterval];
     request.HTTPMethod = @"PUT";
     request.HTTPBody = [@{@"service": @"apn", @"token": deviceToken} JSONData];
     [request setValue:@"application/json" forHTTPHeaderField:@"Content-Type"];
-    [request setValue:[NSString stringWithFormat:@"BEARER %@", _session[@"accessToken"]] forHTTPHeaderField:@"Authorization"];
+    [request setValue:[NSString stringWithFormat:@"BEARER %@", [self propertyForName:@"accessToken"]] forHTTPHeaderField:@"Authorization"];
     
     _connection = [[NSURLConnection alloc] initWithRequest:request delegate:self startImmediately:NO];
     [_connection scheduleInRunLoop:[NSRunLoop mainRunLoop] forMode:NSRunLoopCommonModes];
@@ -807,17 +954,31 @@ static AIQSession *currentSession = nil;
 }
 
 - (BOOL)prepare:(NSError *__autoreleasing *)error {
+    @synchronized(_startupTimeline) {
+        [_startupTimeline removeAllObjects];
+    }
+    
     if (! [self preparePool:error]) {
         return NO;
     }
     
+    CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
     if (! [self prepareModules:error]) {
         return NO;
     }
+    [self recordStartupStep:@"modules" since:start];
     
     return YES;
 }
 
+- (CFAbsoluteTime)recordStartupStep:(NSString *)name since:(CFAbsoluteTime)start {
+    CFAbsoluteTime now = CFAbsoluteTimeGetCurrent();
+    @synchronized(_startupTimeline) {
+        [_startupTimeline addObject:@{kAIQStartupStepName: name, kAIQStartupStepDuration: @(now - start)}];
+    }
+    return now;
+}
+
 - (BOOL)prepareModules:(NSError *__autoreleasing *)error {
     _synchronization = [[AIQSynchronization alloc] initForSession:self];
     [_synchronization registerSynchronizer:[[AIQLaunchableSynchronizer alloc] initForSession:self] forType:@"_launchable"];
@@ -870,15 +1031,18 @@ static AIQSession *currentSession = nil;
     _basePath = NSSearchPathForDirectoriesInDomains(NSApplicationSupportDirectory, NSUserDomainMask, YES).firstObject;
     _basePath = [_basePath stringByAppendingPathComponent:[NSString stringWithFormat:@"%02lX", (long)_sessionKey.hash]];
     
+    CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
     if (! [self handleDataVersioning:error]) {
         return NO;
     }
+    start = [self recordStartupStep:@"folders" since:start];
     
     _dbPath = [_basePath stringByAppendingPathComponent:@"data.sqlite3"];
     
     if (! [self setWriteAheadLocking:error]) {
         return NO;
     }
+    start = [self recordStartupStep:@"journal" since:start];
     
     FMDBMigrationManager *manager = [FMDBMigrationManager managerWithDatabaseAtPath:_dbPath migrationsBundle:[NSBundle bundleForClass:[AIQSession class]]];
     if (! [manager hasMigrationsTable]) {
@@ -894,6 +1058,7 @@ static AIQSession *currentSession = nil;
             return NO;
         }
     }
+    start = [self recordStartupStep:@"migrations" since:start];
     
     _launchableStore = [[AIQLaunchableStore alloc] initForSession:self error:error];
     if (! _launchableStore) {
@@ -903,6 +1068,7 @@ static AIQSession *currentSession = nil;
     if (! [self handleLaunchableMigration:error]) {
         return NO;
     }
+    [self recordStartupStep:@"launchables" since:start];
     
     return YES;
 }
@@ -951,37 +1117,21 @@ static AIQSession *currentSession = nil;
                 return NO;
             }
         }
-        [_session removeObjectForKey:@"download"];
+        @synchronized(_propertyLock) {
+            [_session removeObjectForKey:@"download"];
+        }
     }
     
     return YES;
 }
 
 - (BOOL)handleLaunchableMigration:(NSError *__autoreleasing *)error {
-    Class jsBridgeClass = NSClassFromString(@"AIQJSBridgeInternal");
-    if (jsBridgeClass) {
-        SEL selector = NSSelectorFromString(@"cordovaVersion");
-        NSMethodSignature *signature = [jsBridgeClass methodSignatureForSelector:selector];
-        NSInvocation *invocation = [NSInvocation invocationWithMethodSignature:signature];
-        [invocation setSelector:selector];
-        [invocation setTarget:jsBridgeClass];
-        [invocation invoke];
-        void *tmp;
-        [invocation getReturnValue:&tmp];
-        NSString *currentCordovaVersion = (__bridge NSString *)tmp;
-        
-        selector = NSSelectorFromString(@"apiLevel");
-        signature = [jsBridgeClass methodSignatureForSelector:selector];
-        invocation = [NSInvocation invocationWithMethodSignature:signature];
-        [invocation setSelector:selector];
-        [invocation setTarget:jsBridgeClass];
-        [invocation invoke];
-        NSUInteger currentApiLevel;
-        [invocation getReturnValue:&currentApiLevel];
-        
+    NSString *currentCordovaVersion;
+    NSUInteger currentApiLevel;
+    if ([BridgeRuntime getCordovaVersion:&currentCordovaVersion apiLevel:&currentApiLevel]) {
         AIQLogCInfo(1, @"Current Cordova version is %@", currentCordovaVersion);
         
-        NSString *oldCordovaVersion = _session[@"cordovaVersion"];
+        NSString *oldCordovaVersion = [self propertyForName:@"cordovaVersion"];
         if ( oldCordovaVersion) {
             AIQLogCInfo(1, @"Old Cordova version is %@", oldCordovaVersion);
         } else {
@@ -992,8 +1142,9 @@ static AIQSession *currentSession = nil;
         AIQLogCInfo(1, @"Current API level is %lu", (unsigned long)currentApiLevel);
         
         NSUInteger oldApiLevel;
-        if (_session[@"apiLevel"]) {
-            oldApiLevel = [_session[@"apiLevel"] integerValue];
+        NSNumber *apiLevel = [self propertyForName:@"apiLevel"];
+        if (apiLevel) {
+            oldApiLevel = apiLevel.integerValue;
             AIQLogCInfo(1, @"Old API level is %lu", (unsigned long)oldApiLevel);
         } else {
             AIQLogCInfo(1, @"No API level property available");
@@ -1002,13 +1153,23 @@ static AIQSession *currentSession = nil;
         
         if ((oldApiLevel < currentApiLevel) ||
             ([oldCordovaVersion compare:currentCordovaVersion options:NSNumericSearch] == NSOrderedAscending)) {
-            AIQLogCInfo(1, @"Reloading launchables");
-            // time to migrate
-            _session[@"cordovaVersion"] = currentCordovaVersion;
-            _session[@"apiLevel"] = @(currentApiLevel);
-            if (! [_launchableStore reload:error]) {
-                return NO;
-            }
+            AIQLogCInfo(1, @"Reloading launchables in the background");
+            // versions are only recorded once every launchable has been extracted so that a failed reload is retried
+            CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+            __weak AIQSession *weakSelf = self;
+            [_launchableStore reloadInBackground:^(NSError *localError) {
+                AIQSession *session = weakSelf;
+                if (! session) {
+                    return;
+                }
+                [session recordStartupStep:@"extraction" since:start];
+                if (localError) {
+                    AIQLogCError(1, @"Failed to reload launchables: %@", localError.localizedDescription);
+                    return;
+                }
+                [session setProperty:currentCordovaVersion forName:@"cordovaVersion"];
+                [session setProperty:@(currentApiLevel) forName:@"apiLevel"];
+            }];
         } else {
             AIQLogCInfo(1, @"API levels are up to date");
         }
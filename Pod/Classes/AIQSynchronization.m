@@ -10,7 +10,11 @@
 #import "AIQSynchronization.h"
 #import "AIQSynchronizer.h"
 #import "DeleteOperation.h"
+#import "DocumentCache.h"
+#import "DocumentCodec.h"
 #import "DownloadOperation.h"
+#import "FMDatabase+Helpers.h"
+#import "LiveQueryCenter.h"
 #import "UploadOperation.h"
 #import "GZIP.h"
 #import "common.h"
@@ -57,6 +61,8 @@ NSString *const AIQAttachmentErrorNotification = @"AIQAttachmentErrorNotificatio
 @interface AIQSession ()
 
 - (void)synchronizeProperties;
+- (void)beginPropertyUpdates;
+- (void)endPropertyUpdates;
 
 @end
 
@@ -71,6 +77,9 @@ NSString *const AIQAttachmentErrorNotification = @"AIQAttachmentErrorNotificatio
     NSString *_basePath;
     FMDatabaseQueue *_dbQueue;
     NSMutableDictionary *_synchronizers;
+    DocumentCache *_documentCache;
+    LiveQueryCenter *_liveQueries;
+    NSMutableDictionary *_documentChanges;
 }
 
 @end
@@ -81,8 +90,11 @@ NSString *const AIQAttachmentErrorNotification = @"AIQAttachmentErrorNotificatio
     self = [super init];
     if (self) {
         _session = session;
-        _dbQueue = [FMDatabaseQueue databaseQueueWithPath:[session valueForKey:@"dbPath"]];
+        _dbQueue = [FMDatabaseQueue documentQueueWithPath:[session valueForKey:@"dbPath"]];
         _basePath = [session valueForKey:@"basePath"];
+        _documentCache = [session valueForKey:@"documentCache"];
+        _liveQueries = [session valueForKey:@"liveQueryCenter"];
+        _documentChanges = [NSMutableDictionary dictionary];
         
         host_basic_info_data_t hostInfo;
         mach_msg_type_number_t infoCount;
@@ -287,6 +299,8 @@ NSString *const AIQAttachmentErrorNotification = @"AIQAttachmentErrorNotificatio
         }
         handler(AIQSynchronizationResultNewData);
     }];
+    
+    [self flushDocumentChanges];
 }
 
 - (void)synchronizeWithCompletionHandler:(void (^)(AIQSynchronizationResult))handler {
@@ -465,7 +479,7 @@ NSString *const AIQAttachmentErrorNotification = @"AIQAttachmentErrorNotificatio
                 doc[@"_deleted"] = @YES;
             } else {
                 NSUInteger protocolVersion = [[_session propertyForName:@"protocolVersion"] integerValue];
-                NSDictionary *content = [[rs dataForColumnIndex:0] JSONObject];
+                NSDictionary *content = [DocumentCodec objectWithData:[rs dataForColumnIndex:0] mutable:YES];
                 if (protocolVersion == 0) {
                     for (NSString *key in content) {
                         doc[key] = content[key];
@@ -639,6 +653,8 @@ NSString *const AIQAttachmentErrorNotification = @"AIQAttachmentErrorNotificatio
         }
     }];
     
+    [self flushDocumentChanges];
+    
     if ((! _shouldCancel) && (error)) {
         if (_delegate) {
             [_delegate synchronization:self didFailWithError:error];
@@ -795,6 +811,9 @@ NSString *const AIQAttachmentErrorNotification = @"AIQAttachmentErrorNotificatio
 }
 
 - (void)storeLinks:(NSDictionary *)links {
+    // links of a single response are written to the user defaults at once
+    [_session beginPropertyUpdates];
+    
     if (links[@"nextDownload"]) {
         [_session setProperty:links[@"nextDownload"] forName:@"download"];
     } else if (links[@"download"]) {
@@ -820,6 +839,8 @@ NSString *const AIQAttachmentErrorNotification = @"AIQAttachmentErrorNotificatio
     } else if (links[@"push"]) {
         [_session setProperty:links[@"push"] forName:@"push"];
     }
+    
+    [_session endPropertyUpdates];
 }
 
 - (BOOL)insertDocumentWithId:(NSString *)identifier
@@ -852,14 +873,16 @@ NSString *const AIQAttachmentErrorNotification = @"AIQAttachmentErrorNotificatio
                              "(solution, identifier, type, revision, status, launchable, data)"
                              "VALUES"
                              "(?, ?, ?, ?, ?, ?, ?)",
-                             solution, identifier, type, change[@"_rev"], @(AIQSynchronizationStatusSynchronized), change[@"_launchable"], [content JSONData]]) {
+                             solution, identifier, type, change[@"_rev"], @(AIQSynchronizationStatusSynchronized), change[@"_launchable"], [DocumentCodec dataWithObject:content]]) {
         localError = [AIQError errorWithCode:AIQErrorContainerFault message:[db lastError].localizedDescription];
         AIQLogCError(1, @"Could not update document %@: %@", identifier, localError.localizedDescription);
         *error = localError;
         return NO;
     }
     
-    [[self synchronizerForType:type] didCreateDocument:identifier type:type solution:solution];
+    [_documentCache invalidateDocumentWithId:identifier solution:solution];
+    [_liveQueries didChangeDocumentsWithIds:@[identifier] solution:solution];
+    [self collectChange:@"create" ofDocumentWithId:identifier type:type solution:solution content:content];
     AIQLogCInfo(1, @"Did insert document %@ (%@) in solution %@", identifier, type, solution);
     
     return YES;
@@ -937,12 +960,15 @@ NSString *const AIQAttachmentErrorNotification = @"AIQAttachmentErrorNotificatio
     }
     
     if (! [db executeUpdate:@"UPDATE documents SET revision = ?, status = ?, launchable = ?, data = ? WHERE solution = ? AND identifier = ?",
-           @(newRevision), @(AIQSynchronizationStatusSynchronized), change[@"_launchable"], [content JSONData], solution, identifier]) {
+           @(newRevision), @(AIQSynchronizationStatusSynchronized), change[@"_launchable"], [DocumentCodec dataWithObject:content], solution, identifier]) {
         localError = [db lastError];
         AIQLogCError(1, @"Could not update document %@: %@", identifier, localError.localizedDescription);
         return NO;
     }
     
+    [_documentCache invalidateDocumentWithId:identifier solution:solution];
+    [_liveQueries didChangeDocumentsWithIds:@[identifier] solution:solution];
+    
     if (localError) {
         if (error) {
             *error = [AIQError errorWithCode:AIQErrorContainerFault message:[db lastError].localizedDescription];
@@ -950,12 +976,57 @@ NSString *const AIQAttachmentErrorNotification = @"AIQAttachmentErrorNotificatio
         return NO;
     }
     
-    [[self synchronizerForType:type] didUpdateDocument:identifier type:type solution:solution];
+    [self collectChange:@"update" ofDocumentWithId:identifier type:type solution:solution content:content];
     AIQLogCInfo(1, @"Did update document %@ (%@) in solution %@", identifier, type, solution);
     
     return YES;
 }
 
+- (void)collectChange:(NSString *)change
+     ofDocumentWithId:(NSString *)identifier
+                 type:(NSString *)type
+             solution:(NSString *)solution
+              content:(NSDictionary *)content {
+    id<AIQSynchronizer> synchronizer = [self synchronizerForType:type];
+    if (! [synchronizer respondsToSelector:@selector(didChangeDocuments:type:)]) {
+        if ([change isEqualToString:@"create"]) {
+            [synchronizer didCreateDocument:identifier type:type solution:solution];
+        } else if ([change isEqualToString:@"update"]) {
+            [synchronizer didUpdateDocument:identifier type:type solution:solution];
+        } else {
+            [synchronizer didDeleteDocument:identifier type:type solution:solution];
+        }
+        return;
+    }
+    
+    // synchronizers handling many documents of a type get them in one go once the pull has been processed
+    NSMutableDictionary *entry = [NSMutableDictionary dictionaryWithObjectsAndKeys:change, @"change", identifier, @"identifier", solution, @"solution", nil];
+    if (content) {
+        entry[@"content"] = content;
+    }
+    
+    @synchronized(_documentChanges) {
+        NSMutableArray *changes = _documentChanges[type];
+        if (! changes) {
+            changes = [NSMutableArray array];
+            _documentChanges[type] = changes;
+        }
+        [changes addObject:entry];
+    }
+}
+
+- (void)flushDocumentChanges {
+    NSDictionary *changes;
+    @synchronized(_documentChanges) {
+        changes = [_documentChanges copy];
+        [_documentChanges removeAllObjects];
+    }
+    
+    for (NSString *type in changes) {
+        [[self synchronizerForType:type] didChangeDocuments:changes[type] type:type];
+    }
+}
+
 - (NSDictionary *)documentWithId:(NSString *)identifier forSolution:(NSString *)solution inDatabase:(FMDatabase *)db error:(NSError *__autoreleasing *)error {
     FMResultSet *rs = [db executeQuery:@"SELECT type, status FROM documents WHERE solution = ? AND identifier = ?", solution, identifier];
     if (! rs) {
@@ -1004,6 +1075,8 @@ NSString *const AIQAttachmentErrorNotification = @"AIQAttachmentErrorNotificatio
         *error = localError;
         return NO;
     }
+    [_documentCache invalidateDocumentWithId:identifier solution:solution];
+    [_liveQueries didChangeDocumentsWithIds:@[identifier] solution:solution];
     
     if (! [db executeUpdate:@"DELETE FROM attachments WHERE solution = ? AND identifier = ?", solution, identifier]) {
         localError = [AIQError errorWithCode:AIQErrorContainerFault message:[db lastError].localizedDescription];
@@ -1021,7 +1094,7 @@ NSString *const AIQAttachmentErrorNotification = @"AIQAttachmentErrorNotificatio
         }
     }
     
-    [[self synchronizerForType:type] didDeleteDocument:identifier type:type solution:solution];
+    [self collectChange:@"delete" ofDocumentWithId:identifier type:type solution:solution content:nil];
     AIQLogCInfo(1, @"Did delete document %@ (%@) from solution %@", identifier, type, solution);
     
     return YES;
@@ -1055,64 +1128,140 @@ NSString *const AIQAttachmentErrorNotification = @"AIQAttachmentErrorNotificatio
 }
 
 - (BOOL)queueUnavailableAttachments:(NSError *__autoreleasing *)error {
+    return [self queueUnavailableAttachmentsOfDocuments:nil error:error];
+}
+
+- (BOOL)queueUnavailableAttachmentsOfDocuments:(NSArray *)documents error:(NSError *__autoreleasing *)error {
     __block NSError *localError = nil;
     
-    AIQLogCInfo(1, @"Queuing unavailable attachments");
+    if (documents) {
+        AIQLogCInfo(1, @"Queuing unavailable attachments of %lu documents", (unsigned long)documents.count);
+    } else {
+        AIQLogCInfo(1, @"Queuing unavailable attachments");
+    }
+    
+    // documents are given as solution and identifier pairs, without them all unavailable attachments are considered
+    NSString *query = @"SELECT d.identifier, d.type, a.name, d.solution, d.data, d.revision FROM attachments a, documents d "
+                       "WHERE a.solution = d.solution AND a.identifier = d.identifier AND a.state = ?";
+    NSMutableArray *lookups = [NSMutableArray arrayWithCapacity:documents ? documents.count : 1];
+    if (documents) {
+        query = [query stringByAppendingString:@" AND d.solution = ? AND d.identifier = ?"];
+        for (NSArray *document in documents) {
+            [lookups addObject:@[@(AIQAttachmentStateUnavailable), document[0], document[1]]];
+        }
+    } else {
+        [lookups addObject:@[@(AIQAttachmentStateUnavailable)]];
+    }
     
     [_downloadQueue setSuspended:YES];
     
+    NSMutableArray *admitted = [NSMutableArray array];
+    NSMutableDictionary *candidates = [NSMutableDictionary dictionary];
+    
     [_dbQueue inDatabase:^(FMDatabase *db) {
-        FMResultSet *rs = [db executeQuery:@"SELECT d.identifier, d.type, a.name, d.solution FROM attachments a, documents d "
-                           "WHERE a.solution = d.solution AND a.identifier = d.identifier AND a.state = ?",
-                           @(AIQAttachmentStateUnavailable)];
-        if (! rs) {
-            localError = [AIQError errorWithCode:AIQErrorContainerFault message:[db lastError].localizedDescription];
-            return;
-        }
-        
-        while ([rs next]) {
-            if (_shouldCancel) {
-                [rs close];
+        for (NSArray *arguments in lookups) {
+            FMResultSet *rs = [db executeQuery:query withArgumentsInArray:arguments];
+            if (! rs) {
+                localError = [AIQError errorWithCode:AIQErrorContainerFault message:[db lastError].localizedDescription];
                 return;
             }
             
-            NSString *identifier = [rs stringForColumnIndex:0];
-            NSString *type = [rs stringForColumnIndex:1];
-            
-            AIQOperation *operation = [DownloadOperation new];
-            operation.solution = [rs stringForColumnIndex:3];
-            operation.identifier = identifier;
-            operation.type = type;
-            operation.attachmentName = [rs stringForColumnIndex:2];
-            operation.synchronization = self;
-            operation.timeout = _attachmentTimeout;
-            if ([_downloadQueue.operations containsObject:operation]) {
-                AIQLogCInfo(1, @"Attachment %@ for document %@ already in queue %lu", operation.attachmentName, identifier, (unsigned long)_downloadQueue.operationCount);
-                continue;
-            }
-            if ([type isEqualToString:@"_launchable"]) {
-                operation.queuePriority = NSOperationQueuePriorityVeryHigh;
-            } else if ([type hasPrefix:@"_"]) {
-                operation.queuePriority = NSOperationQueuePriorityHigh;
-            } else {
-                operation.queuePriority = NSOperationQueuePriorityLow;
+            while ([rs next]) {
+                if (_shouldCancel) {
+                    [rs close];
+                    return;
+                }
+                
+                NSString *type = [rs stringForColumnIndex:1];
+                NSDictionary *attachment = @{@"identifier": [rs stringForColumnIndex:0],
+                                             @"type": type,
+                                             @"name": [rs stringForColumnIndex:2],
+                                             @"solution": [rs stringForColumnIndex:3]};
+                
+                // synchronizers with an admission policy get to look at the document before its attachments are downloaded
+                if (! [[self synchronizerForType:type] respondsToSelector:@selector(admitAttachments:type:)]) {
+                    [admitted addObject:attachment];
+                    continue;
+                }
+                
+                NSMutableDictionary *candidate = [attachment mutableCopy];
+                candidate[@"revision"] = [rs objectForColumnIndex:5];
+                NSDictionary *content = [DocumentCodec objectWithData:[rs dataForColumnIndex:4] mutable:NO];
+                if (content) {
+                    candidate[@"content"] = content;
+                }
+                if (! candidates[type]) {
+                    candidates[type] = [NSMutableArray array];
+                }
+                [candidates[type] addObject:candidate];
             }
-            operation.qualityOfService = NSQualityOfServiceBackground;
-            [_downloadQueue addOperation:operation];
+            [rs close];
         }
-        [rs close];
     }];
     
+    // policies may access the data store themselves, so they are asked outside of the database queue
+    for (NSString *type in candidates) {
+        NSArray *attachments = [[self synchronizerForType:type] admitAttachments:candidates[type] type:type];
+        AIQLogCInfo(1, @"Admitted %lu of %lu attachments of type %@", (unsigned long)attachments.count, (unsigned long)[candidates[type] count], type);
+        [admitted addObjectsFromArray:attachments];
+    }
+    
+    for (NSDictionary *attachment in admitted) {
+        if (_shouldCancel) {
+            break;
+        }
+        
+        NSString *identifier = attachment[@"identifier"];
+        NSString *type = attachment[@"type"];
+        
+        AIQOperation *operation = [DownloadOperation new];
+        operation.solution = attachment[@"solution"];
+        operation.identifier = identifier;
+        operation.type = type;
+        operation.attachmentName = attachment[@"name"];
+        operation.synchronization = self;
+        operation.timeout = _attachmentTimeout;
+        if ([_downloadQueue.operations containsObject:operation]) {
+            AIQLogCInfo(1, @"Attachment %@ for document %@ already in queue %lu", operation.attachmentName, identifier, (unsigned long)_downloadQueue.operationCount);
+            continue;
+        }
+        if ([type isEqualToString:@"_launchable"]) {
+            operation.queuePriority = NSOperationQueuePriorityVeryHigh;
+        } else if ([type hasPrefix:@"_"]) {
+            operation.queuePriority = NSOperationQueuePriorityHigh;
+        } else {
+            operation.queuePriority = NSOperationQueuePriorityLow;
+        }
+        operation.qualityOfService = NSQualityOfServiceBackground;
+        [_downloadQueue addOperation:operation];
+    }
+    
     [_downloadQueue setSuspended:NO];
     
     if (localError) {
-        *error = localError;
+        if (error) {
+            *error = localError;
+        }
         return NO;
     }
     
     return YES;
 }
 
+- (void)cancelDownloadsForDocumentWithId:(NSString *)identifier solution:(NSString *)solution {
+    for (NSOperation *operation in _downloadQueue.operations) {
+        if (! [operation isKindOfClass:[DownloadOperation class]]) {
+            continue;
+        }
+        
+        DownloadOperation *download = (DownloadOperation *)operation;
+        if ((! download.isFinished) && ([download.identifier isEqualToString:identifier]) && ([download.solution isEqualToString:solution])) {
+            AIQLogCInfo(1, @"Cancelling download of attachment %@ for document %@", download.attachmentName, identifier);
+            [download cancel];
+        }
+    }
+}
+
 - (void)queueUnsynchronizedAttachments {
     __block NSError *error = nil;
     
@@ -1196,6 +1345,8 @@ NSString *const AIQAttachmentErrorNotification = @"AIQAttachmentErrorNotificatio
             AIQLogCError(1, @"Failed to clean synchronized data: %@", [db lastError].localizedDescription);
             abort();
         }
+        [_documentCache purge];
+        [_liveQueries didChangeAllDocuments];
         if (! [db executeUpdate:@"UPDATE attachments SET link = NULL WHERE status = ?", @(AIQSynchronizationStatusSynchronized)]) {
             AIQLogCError(1, @"Failed to clean synchronized data: %@", [db lastError].localizedDescription);
             abort();
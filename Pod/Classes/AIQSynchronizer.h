@@ -29,6 +29,19 @@
 
 - (void)close;
 
+@optional
+
+// receives all changes of documents of given type processed in one pull instead of the individual did*Document:
+// calls. every change is a dictionary with "change" set to "create", "update" or "delete", the document "identifier"
+// and "solution", and the decoded document "content" unless it has been deleted.
+- (void)didChangeDocuments:(NSArray *)changes type:(NSString *)type;
+
+// decides which unavailable attachments of documents of given type are downloaded now. every attachment is a
+// dictionary with the attachment "name", the document "identifier", "solution" and "revision", and the decoded
+// document "content".
+// attachments left out stay unavailable and are considered again the next time downloads are queued.
+- (NSArray *)admitAttachments:(NSArray *)attachments type:(NSString *)type;
+
 @end
 
 
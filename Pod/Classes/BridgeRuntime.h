@@ -0,0 +1,8 @@
+#import <Foundation/Foundation.h>
+
+@interface BridgeRuntime : NSObject
+
++ (BOOL)getCordovaVersion:(NSString **)cordovaVersion apiLevel:(NSUInteger *)apiLevel;
++ (BOOL)linkIntoFolderAtPath:(NSString *)folder basePath:(NSString *)basePath error:(NSError **)error;
+
+@end
@@ -0,0 +1,155 @@
+#import "AIQError.h"
+#import "AIQLog.h"
+#import "BridgeRuntime.h"
+
+// bridge files are installed once per bridge version and hard linked into every launchable
+static NSString *const kRuntimeFolder = @".aiq_runtime";
+
+@implementation BridgeRuntime
+
++ (BOOL)getCordovaVersion:(NSString *__autoreleasing *)cordovaVersion apiLevel:(NSUInteger *)apiLevel {
+    // the bridge is an optional dependency, so it is only looked up at runtime
+    Class jsBridgeClass = NSClassFromString(@"AIQJSBridgeInternal");
+    if (! jsBridgeClass) {
+        return NO;
+    }
+    
+    SEL selector = NSSelectorFromString(@"cordovaVersion");
+    NSMethodSignature *signature = [jsBridgeClass methodSignatureForSelector:selector];
+    NSInvocation *invocation = [NSInvocation invocationWithMethodSignature:signature];
+    [invocation setSelector:selector];
+    [invocation setTarget:jsBridgeClass];
+    [invocation invoke];
+    void *tmp;
+    [invocation getReturnValue:&tmp];
+    *cordovaVersion = (__bridge NSString *)tmp;
+    
+    selector = NSSelectorFromString(@"apiLevel");
+    signature = [jsBridgeClass methodSignatureForSelector:selector];
+    invocation = [NSInvocation invocationWithMethodSignature:signature];
+    [invocation setSelector:selector];
+    [invocation setTarget:jsBridgeClass];
+    [invocation invoke];
+    [invocation getReturnValue:apiLevel];
+    
+    return YES;
+}
+
++ (BOOL)linkIntoFolderAtPath:(NSString *)folder basePath:(NSString *)basePath error:(NSError *__autoreleasing *)error {
+    if (error) {
+        *error = nil;
+    }
+    
+    NSString *runtimePath = [self installedRuntimeInPath:basePath error:error];
+    if (! runtimePath) {
+        return NO;
+    }
+    
+    NSFileManager *fileManager = [NSFileManager defaultManager];
+    NSError *localError = nil;
+    for (NSString *file in [self files]) {
+        NSString *source = [runtimePath stringByAppendingPathComponent:file];
+        NSString *target = [folder stringByAppendingPathComponent:file];
+        
+        if ([fileManager fileExistsAtPath:target]) {
+            if (! [fileManager removeItemAtPath:target error:&localError]) {
+                if (error) {
+                    *error = [AIQError errorWithCode:AIQErrorContainerFault message:localError.localizedDescription];
+                }
+                return NO;
+            }
+        } else if (! [fileManager createDirectoryAtPath:[target stringByDeletingLastPathComponent]
+                            withIntermediateDirectories:YES
+                                             attributes:nil
+                                                  error:&localError]) {
+            if (error) {
+                *error = [AIQError errorWithCode:AIQErrorContainerFault message:localError.localizedDescription];
+            }
+            return NO;
+        }
+        
+        if (! [fileManager linkItemAtPath:source toPath:target error:nil]) {
+            // a partially linked directory has to go before copying
+            [fileManager removeItemAtPath:target error:nil];
+            if (! [fileManager copyItemAtPath:source toPath:target error:&localError]) {
+                if (error) {
+                    *error = [AIQError errorWithCode:AIQErrorContainerFault message:localError.localizedDescription];
+                }
+                return NO;
+            }
+        }
+    }
+    
+    return YES;
+}
+
+#pragma mark - Private API
+
++ (NSDictionary *)sources {
+    return @{@"cordova.js": @"cordova.js",
+             @"cordova_plugins.js": @"cordova_plugins.js",
+             @"plugins": @"plugins",
+             @"aiq/aiq-api.js": @"cordova.js"};
+}
+
++ (NSArray *)files {
+    return [self sources].allKeys;
+}
+
++ (NSString *)version {
+    NSString *cordovaVersion;
+    NSUInteger apiLevel;
+    if (! [BridgeRuntime getCordovaVersion:&cordovaVersion apiLevel:&apiLevel]) {
+        return @"default";
+    }
+    
+    return [NSString stringWithFormat:@"%@-%lu", cordovaVersion, (unsigned long)apiLevel];
+}
+
++ (NSString *)installedRuntimeInPath:(NSString *)basePath error:(NSError *__autoreleasing *)error {
+    NSString *runtimesPath = [basePath stringByAppendingPathComponent:kRuntimeFolder];
+    NSString *runtimePath = [runtimesPath stringByAppendingPathComponent:[self version]];
+    NSFileManager *fileManager = [NSFileManager defaultManager];
+    
+    @synchronized(self) {
+        if ([fileManager fileExistsAtPath:runtimePath]) {
+            return runtimePath;
+        }
+        
+        AIQLogCInfo(1, @"Installing bridge runtime %@", runtimePath.lastPathComponent);
+        
+        // launchables keep their own links to the files, so runtimes of older bridge versions can simply go
+        [fileManager removeItemAtPath:runtimesPath error:nil];
+        
+        NSString *bundlePath = [[NSBundle mainBundle] pathForResource:@"AIQJSBridge" ofType:@"bundle"];
+        NSString *tmpPath = [runtimePath stringByAppendingPathExtension:@"tmp"];
+        NSDictionary *sources = [self sources];
+        NSError *localError = nil;
+        for (NSString *file in sources) {
+            NSString *target = [tmpPath stringByAppendingPathComponent:file];
+            if ((! [fileManager createDirectoryAtPath:[target stringByDeletingLastPathComponent]
+                          withIntermediateDirectories:YES
+                                           attributes:nil
+                                                error:&localError]) ||
+                (! [fileManager copyItemAtPath:[bundlePath stringByAppendingPathComponent:sources[file]] toPath:target error:&localError])) {
+                [fileManager removeItemAtPath:tmpPath error:nil];
+                if (error) {
+                    *error = [AIQError errorWithCode:AIQErrorContainerFault message:localError.localizedDescription];
+                }
+                return nil;
+            }
+        }
+        
+        if (! [fileManager moveItemAtPath:tmpPath toPath:runtimePath error:&localError]) {
+            [fileManager removeItemAtPath:tmpPath error:nil];
+            if (error) {
+                *error = [AIQError errorWithCode:AIQErrorContainerFault message:localError.localizedDescription];
+            }
+            return nil;
+        }
+        
+        return runtimePath;
+    }
+}
+
+@end
@@ -0,0 +1,13 @@
+#import <Foundation/Foundation.h>
+
+@interface DeadlineHeap : NSObject
+
+@property (nonatomic, readonly) NSUInteger count;
+@property (nonatomic, readonly) NSTimeInterval earliestDeadline;
+
+- (void)setDeadline:(NSTimeInterval)deadline forKey:(id<NSCopying>)key object:(id)object;
+- (void)removeDeadlineForKey:(id)key;
+- (void)removeAllDeadlines;
+- (NSArray *)popObjectsUntil:(NSTimeInterval)date;
+
+@end
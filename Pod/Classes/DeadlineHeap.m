@@ -0,0 +1,146 @@
+#import "DeadlineHeap.h"
+
+@interface DeadlineHeapEntry : NSObject
+
+@property (nonatomic, retain) id key;
+@property (nonatomic, retain) id object;
+@property (nonatomic, assign) NSTimeInterval deadline;
+// position in the heap, so that the deadline of a key is moved or removed without a scan
+@property (nonatomic, assign) NSUInteger index;
+
+@end
+
+@implementation DeadlineHeapEntry
+
+@end
+
+@interface DeadlineHeap () {
+    NSMutableArray *_entries;
+    NSMutableDictionary *_entriesByKey;
+}
+
+@end
+
+@implementation DeadlineHeap
+
+- (instancetype)init {
+    self = [super init];
+    if (self) {
+        _entries = [NSMutableArray array];
+        _entriesByKey = [NSMutableDictionary dictionary];
+    }
+    return self;
+}
+
+- (NSUInteger)count {
+    return _entries.count;
+}
+
+- (NSTimeInterval)earliestDeadline {
+    if (_entries.count == 0) {
+        return [[NSDate distantFuture] timeIntervalSince1970];
+    }
+    return ((DeadlineHeapEntry *)_entries[0]).deadline;
+}
+
+- (void)setDeadline:(NSTimeInterval)deadline forKey:(id<NSCopying>)key object:(id)object {
+    DeadlineHeapEntry *entry = _entriesByKey[key];
+    if (entry) {
+        NSTimeInterval previous = entry.deadline;
+        entry.deadline = deadline;
+        entry.object = object;
+        if (deadline < previous) {
+            [self siftUp:entry.index];
+        } else {
+            [self siftDown:entry.index];
+        }
+        return;
+    }
+
+    entry = [DeadlineHeapEntry new];
+    entry.key = key;
+    entry.object = object;
+    entry.deadline = deadline;
+    entry.index = _entries.count;
+    [_entries addObject:entry];
+    _entriesByKey[key] = entry;
+    [self siftUp:entry.index];
+}
+
+- (void)removeDeadlineForKey:(id)key {
+    DeadlineHeapEntry *entry = _entriesByKey[key];
+    if (! entry) {
+        return;
+    }
+
+    [_entriesByKey removeObjectForKey:key];
+    NSUInteger index = entry.index;
+    NSUInteger last = _entries.count - 1;
+    if (index != last) {
+        [self swap:index with:last];
+    }
+    [_entries removeLastObject];
+    if (index < _entries.count) {
+        [self siftUp:index];
+        [self siftDown:index];
+    }
+}
+
+- (void)removeAllDeadlines {
+    [_entries removeAllObjects];
+    [_entriesByKey removeAllObjects];
+}
+
+- (NSArray *)popObjectsUntil:(NSTimeInterval)date {
+    NSMutableArray *objects = [NSMutableArray array];
+    while ((_entries.count != 0) && (((DeadlineHeapEntry *)_entries[0]).deadline <= date)) {
+        DeadlineHeapEntry *entry = _entries[0];
+        [objects addObject:entry.object];
+        [self removeDeadlineForKey:entry.key];
+    }
+    return [objects copy];
+}
+
+#pragma mark - Private API
+
+- (void)siftUp:(NSUInteger)index {
+    while (index > 0) {
+        NSUInteger parent = (index - 1) / 2;
+        if (((DeadlineHeapEntry *)_entries[parent]).deadline <= ((DeadlineHeapEntry *)_entries[index]).deadline) {
+            return;
+        }
+        [self swap:index with:parent];
+        index = parent;
+    }
+}
+
+- (void)siftDown:(NSUInteger)index {
+    NSUInteger count = _entries.count;
+    while (YES) {
+        NSUInteger smallest = index;
+        NSUInteger left = 2 * index + 1;
+        NSUInteger right = left + 1;
+        if ((left < count) && (((DeadlineHeapEntry *)_entries[left]).deadline < ((DeadlineHeapEntry *)_entries[smallest]).deadline)) {
+            smallest = left;
+        }
+        if ((right < count) && (((DeadlineHeapEntry *)_entries[right]).deadline < ((DeadlineHeapEntry *)_entries[smallest]).deadline)) {
+            smallest = right;
+        }
+        if (smallest == index) {
+            return;
+        }
+        [self swap:index with:smallest];
+        index = smallest;
+    }
+}
+
+- (void)swap:(NSUInteger)first with:(NSUInteger)second {
+    DeadlineHeapEntry *a = _entries[first];
+    DeadlineHeapEntry *b = _entries[second];
+    _entries[first] = b;
+    _entries[second] = a;
+    a.index = second;
+    b.index = first;
+}
+
+@end
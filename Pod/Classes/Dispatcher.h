@@ -0,0 +1,12 @@
+#import <Foundation/Foundation.h>
+
+@interface Dispatcher : NSObject
+
+@property (nonatomic, retain) dispatch_queue_t callbackQueue;
+@property (nonatomic, assign) NSQualityOfService qualityOfService;
+
+- (void)read:(void (^)(void))block;
+- (void)write:(void (^)(void))block;
+- (void)complete:(void (^)(void))block;
+
+@end
@@ -0,0 +1,74 @@
+#import "Dispatcher.h"
+
+@interface Dispatcher () {
+    dispatch_queue_t _readQueue;
+    dispatch_queue_t _writeQueue;
+}
+
+@end
+
+@implementation Dispatcher
+
+- (instancetype)init {
+    self = [super init];
+    if (self) {
+        _readQueue = dispatch_queue_create("com.appearnetworks.aiq.read", DISPATCH_QUEUE_CONCURRENT);
+        _writeQueue = dispatch_queue_create("com.appearnetworks.aiq.write", DISPATCH_QUEUE_SERIAL);
+        _callbackQueue = dispatch_get_main_queue();
+        _qualityOfService = NSQualityOfServiceUserInitiated;
+    }
+    return self;
+}
+
+- (dispatch_queue_t)callbackQueue {
+    @synchronized(self) {
+        return _callbackQueue;
+    }
+}
+
+- (void)setCallbackQueue:(dispatch_queue_t)callbackQueue {
+    @synchronized(self) {
+        _callbackQueue = callbackQueue ?: dispatch_get_main_queue();
+    }
+}
+
+- (void)read:(void (^)(void))block {
+    dispatch_async(_readQueue, [self blockWithQualityOfService:block]);
+}
+
+- (void)write:(void (^)(void))block {
+    // writes are serialized here so that they queue up in the library rather than on the database pool
+    dispatch_async(_writeQueue, [self blockWithQualityOfService:block]);
+}
+
+- (void)complete:(void (^)(void))block {
+    if (block) {
+        dispatch_async(self.callbackQueue, block);
+    }
+}
+
+#pragma mark - Private API
+
+- (dispatch_block_t)blockWithQualityOfService:(void (^)(void))block {
+    qos_class_t qos;
+    switch (_qualityOfService) {
+        case NSQualityOfServiceUserInteractive:
+            qos = QOS_CLASS_USER_INTERACTIVE;
+            break;
+        case NSQualityOfServiceUserInitiated:
+            qos = QOS_CLASS_USER_INITIATED;
+            break;
+        case NSQualityOfServiceUtility:
+            qos = QOS_CLASS_UTILITY;
+            break;
+        case NSQualityOfServiceBackground:
+            qos = QOS_CLASS_BACKGROUND;
+            break;
+        default:
+            qos = QOS_CLASS_DEFAULT;
+            break;
+    }
+    return dispatch_block_create_with_qos_class(DISPATCH_BLOCK_ENFORCE_QOS_CLASS, qos, 0, block);
+}
+
+@end
@@ -0,0 +1,25 @@
+#import <Foundation/Foundation.h>
+
+@interface DocumentCache : NSObject
+
+@property (nonatomic, assign) NSUInteger capacity;
+@property (nonatomic, readonly) NSUInteger cost;
+@property (nonatomic, readonly) NSUInteger hits;
+@property (nonatomic, readonly) NSUInteger misses;
+
+// bumped by every invalidation, documents read across an invalidation are not stored
+@property (nonatomic, readonly) NSUInteger generation;
+
+- (NSDictionary *)documentForId:(NSString *)identifier solution:(NSString *)solution revision:(id)revision status:(id)status;
+- (void)storeDocument:(NSDictionary *)document
+                forId:(NSString *)identifier
+             solution:(NSString *)solution
+             revision:(id)revision
+               status:(id)status
+                 cost:(NSUInteger)cost
+           generation:(NSUInteger)generation;
+- (void)invalidateDocumentWithId:(NSString *)identifier solution:(NSString *)solution;
+- (void)invalidateSolution:(NSString *)solution;
+- (void)purge;
+
+@end
@@ -0,0 +1,207 @@
+#if TARGET_OS_IPHONE
+    #import <UIKit/UIKit.h>
+#endif
+
+#import "AIQLog.h"
+#import "DocumentCache.h"
+#import "common.h"
+
+@interface DocumentCacheEntry : NSObject
+
+@property (nonatomic, retain) NSArray *key;
+@property (nonatomic, retain) NSDictionary *document;
+@property (nonatomic, retain) id revision;
+@property (nonatomic, retain) id status;
+@property (nonatomic, assign) NSUInteger cost;
+@property (nonatomic, weak) DocumentCacheEntry *previous;
+@property (nonatomic, retain) DocumentCacheEntry *next;
+
+@end
+
+@implementation DocumentCacheEntry
+
+@end
+
+@interface DocumentCache () {
+    NSMutableDictionary *_entries;
+    DocumentCacheEntry *_head;
+    DocumentCacheEntry *_tail;
+    NSUInteger _generation;
+}
+
+@end
+
+@implementation DocumentCache
+
+- (instancetype)init {
+    self = [super init];
+    if (self) {
+        _entries = [NSMutableDictionary dictionary];
+#if TARGET_OS_IPHONE
+        LISTEN(self, @selector(didReceiveMemoryWarning:), UIApplicationDidReceiveMemoryWarningNotification);
+#endif
+    }
+    return self;
+}
+
+- (void)setCapacity:(NSUInteger)capacity {
+    @synchronized(self) {
+        _capacity = capacity;
+        [self trim];
+    }
+}
+
+- (NSUInteger)generation {
+    @synchronized(self) {
+        return _generation;
+    }
+}
+
+- (NSDictionary *)documentForId:(NSString *)identifier solution:(NSString *)solution revision:(id)revision status:(id)status {
+    @synchronized(self) {
+        if (_capacity == 0) {
+            return nil;
+        }
+
+        DocumentCacheEntry *entry = _entries[@[solution, identifier]];
+        if ((! entry) || (! [entry.revision isEqual:revision]) || (! [entry.status isEqual:status])) {
+            if (entry) {
+                [self removeEntry:entry];
+            }
+            _misses++;
+            return nil;
+        }
+
+        _hits++;
+        [self unlinkEntry:entry];
+        [self linkEntry:entry];
+        return entry.document;
+    }
+}
+
+- (void)storeDocument:(NSDictionary *)document
+                forId:(NSString *)identifier
+             solution:(NSString *)solution
+             revision:(id)revision
+               status:(id)status
+                 cost:(NSUInteger)cost
+           generation:(NSUInteger)generation {
+    @synchronized(self) {
+        // the document may have been written after the caller read it
+        if ((! document) || (cost > _capacity) || (generation != _generation)) {
+            return;
+        }
+
+        NSArray *key = @[solution, identifier];
+        DocumentCacheEntry *entry = _entries[key];
+        if (entry) {
+            [self removeEntry:entry];
+        }
+
+        entry = [DocumentCacheEntry new];
+        entry.key = key;
+        entry.document = [document copy];
+        entry.revision = revision;
+        entry.status = status;
+        entry.cost = cost;
+
+        _entries[key] = entry;
+        _cost += cost;
+        [self linkEntry:entry];
+        [self trim];
+    }
+}
+
+- (void)invalidateDocumentWithId:(NSString *)identifier solution:(NSString *)solution {
+    if ((! identifier) || (! solution)) {
+        return;
+    }
+
+    @synchronized(self) {
+        _generation++;
+        DocumentCacheEntry *entry = _entries[@[solution, identifier]];
+        if (entry) {
+            [self removeEntry:entry];
+        }
+    }
+}
+
+- (void)invalidateSolution:(NSString *)solution {
+    @synchronized(self) {
+        _generation++;
+        for (NSArray *key in [_entries allKeys]) {
+            if ([key[0] isEqualToString:solution]) {
+                [self removeEntry:_entries[key]];
+            }
+        }
+    }
+}
+
+- (void)purge {
+    @synchronized(self) {
+        if (_entries.count != 0) {
+            AIQLogCInfo(1, @"Purging %lu cached documents", (unsigned long)_entries.count);
+        }
+        _generation++;
+        [_entries removeAllObjects];
+        _head = nil;
+        _tail = nil;
+        _cost = 0;
+    }
+}
+
+- (void)dealloc {
+    [[NSNotificationCenter defaultCenter] removeObserver:self];
+}
+
+- (NSString *)description {
+    return [NSString stringWithFormat:@"<DocumentCache: %p (%lu/%lu bytes, %lu hits, %lu misses)>",
+            self, (unsigned long)_cost, (unsigned long)_capacity, (unsigned long)_hits, (unsigned long)_misses];
+}
+
+#pragma mark - Private API
+
+- (void)didReceiveMemoryWarning:(NSNotification *)notification {
+    [self purge];
+}
+
+- (void)trim {
+    while ((_tail) && (_cost > _capacity)) {
+        [self removeEntry:_tail];
+    }
+}
+
+- (void)linkEntry:(DocumentCacheEntry *)entry {
+    entry.previous = nil;
+    entry.next = _head;
+    if (_head) {
+        _head.previous = entry;
+    }
+    _head = entry;
+    if (! _tail) {
+        _tail = entry;
+    }
+}
+
+- (void)unlinkEntry:(DocumentCacheEntry *)entry {
+    if (entry.previous) {
+        entry.previous.next = entry.next;
+    } else {
+        _head = entry.next;
+    }
+    if (entry.next) {
+        entry.next.previous = entry.previous;
+    } else {
+        _tail = entry.previous;
+    }
+    entry.previous = nil;
+    entry.next = nil;
+}
+
+- (void)removeEntry:(DocumentCacheEntry *)entry {
+    [self unlinkEntry:entry];
+    [_entries removeObjectForKey:entry.key];
+    _cost -= entry.cost;
+}
+
+@end
@@ -0,0 +1,15 @@
+#import <Foundation/Foundation.h>
+
+@class FMDatabase;
+
+@interface DocumentCodec : NSObject
+
++ (BOOL)isEncodedData:(NSData *)data;
++ (NSData *)dataWithObject:(id)object;
++ (id)objectWithData:(NSData *)data mutable:(BOOL)mutable;
++ (id)valueForPath:(NSArray *)path inData:(NSData *)data;
++ (NSUInteger)costOfObject:(id)object;
++ (NSData *)JSONDataWithData:(NSData *)data;
++ (void)registerFunctionsInDatabase:(FMDatabase *)db;
+
+@end
@@ -0,0 +1,626 @@
+#import <FMDB/FMDB.h>
+#import <sqlite3.h>
+
+#import "AIQLog.h"
+#import "DocumentCodec.h"
+#import "GZIP.h"
+
+// no JSON text starts with the magic, so documents stored before the codec was introduced are still recognized
+static const uint8_t kDocumentCodecMagic[] = {0x00, 'A', 'Q'};
+static const uint8_t kDocumentCodecVersion = 1;
+static const NSUInteger kDocumentCodecHeaderLength = 5;
+static const NSUInteger kDocumentCodecCompressionThreshold = 1024;
+
+typedef NS_ENUM(uint8_t, DocumentCodecTag) {
+    DocumentCodecTagNull = 0,
+    DocumentCodecTagFalse,
+    DocumentCodecTagTrue,
+    DocumentCodecTagInt8,
+    DocumentCodecTagInt32,
+    DocumentCodecTagInt64,
+    DocumentCodecTagDouble,
+    DocumentCodecTagString,
+    DocumentCodecTagArray,
+    DocumentCodecTagObject,
+    DocumentCodecTagDeflatedString
+};
+
+typedef struct {
+    const uint8_t *bytes;
+    NSUInteger length;
+} DocumentCodecBuffer;
+
+#pragma mark - Encoding
+
+static BOOL IsBoolean(NSNumber *number) {
+    return CFGetTypeID((__bridge CFTypeRef)number) == CFBooleanGetTypeID();
+}
+
+static BOOL IsFloatingPoint(NSNumber *number) {
+    const char *type = number.objCType;
+    return (type[0] == 'f') || (type[0] == 'd') || ((type[0] == 'Q') && (number.unsignedLongLongValue > INT64_MAX));
+}
+
+static void AppendTag(NSMutableData *data, DocumentCodecTag tag) {
+    [data appendBytes:&tag length:sizeof(tag)];
+}
+
+static void AppendUInt32(NSMutableData *data, uint32_t value) {
+    value = CFSwapInt32HostToLittle(value);
+    [data appendBytes:&value length:sizeof(value)];
+}
+
+static void SetUInt32(NSMutableData *data, NSUInteger offset, uint32_t value) {
+    value = CFSwapInt32HostToLittle(value);
+    [data replaceBytesInRange:NSMakeRange(offset, sizeof(value)) withBytes:&value];
+}
+
+static void AppendString(NSMutableData *data, NSString *string) {
+    NSUInteger length = [string lengthOfBytesUsingEncoding:NSUTF8StringEncoding];
+    AppendUInt32(data, (uint32_t)length);
+
+    NSUInteger offset = data.length;
+    [data increaseLengthBy:length];
+    [string getBytes:(uint8_t *)data.mutableBytes + offset
+           maxLength:length
+          usedLength:NULL
+            encoding:NSUTF8StringEncoding
+             options:kNilOptions
+               range:NSMakeRange(0, string.length)
+      remainingRange:NULL];
+}
+
+static NSComparisonResult CompareBytes(const void *left, NSUInteger leftLength, const void *right, NSUInteger rightLength) {
+    int result = memcmp(left, right, MIN(leftLength, rightLength));
+    if (result == 0) {
+        return (leftLength == rightLength) ? NSOrderedSame : ((leftLength < rightLength) ? NSOrderedAscending : NSOrderedDescending);
+    }
+    return (result < 0) ? NSOrderedAscending : NSOrderedDescending;
+}
+
+static BOOL AppendValue(NSMutableData *data, id value) {
+    if (value == [NSNull null]) {
+        AppendTag(data, DocumentCodecTagNull);
+        return YES;
+    }
+
+    if ([value isKindOfClass:[NSString class]]) {
+        // a UTF-16 unit never takes more than three UTF-8 bytes, so short strings skip the copy
+        if ([value length] > kDocumentCodecCompressionThreshold / 3) {
+            NSData *bytes = [value dataUsingEncoding:NSUTF8StringEncoding];
+            if (bytes.length > kDocumentCodecCompressionThreshold) {
+                // favour speed over ratio, documents are compressed on every write
+                NSData *deflated = [bytes gzippedDataWithCompressionLevel:0.1f];
+                if ((deflated) && (deflated.length < bytes.length)) {
+                    AppendTag(data, DocumentCodecTagDeflatedString);
+                    AppendUInt32(data, (uint32_t)deflated.length);
+                    [data appendData:deflated];
+                    return YES;
+                }
+            }
+        }
+        AppendTag(data, DocumentCodecTagString);
+        AppendString(data, value);
+        return YES;
+    }
+
+    if ([value isKindOfClass:[NSNumber class]]) {
+        if (IsBoolean(value)) {
+            AppendTag(data, [value boolValue] ? DocumentCodecTagTrue : DocumentCodecTagFalse);
+        } else if (IsFloatingPoint(value)) {
+            uint64_t bits;
+            double number = [value doubleValue];
+            memcpy(&bits, &number, sizeof(bits));
+            bits = CFSwapInt64HostToLittle(bits);
+            AppendTag(data, DocumentCodecTagDouble);
+            [data appendBytes:&bits length:sizeof(bits)];
+        } else {
+            long long number = [value longLongValue];
+            if ((number >= INT8_MIN) && (number <= INT8_MAX)) {
+                int8_t small = (int8_t)number;
+                AppendTag(data, DocumentCodecTagInt8);
+                [data appendBytes:&small length:sizeof(small)];
+            } else if ((number >= INT32_MIN) && (number <= INT32_MAX)) {
+                AppendTag(data, DocumentCodecTagInt32);
+                AppendUInt32(data, (uint32_t)(int32_t)number);
+            } else {
+                uint64_t bits = CFSwapInt64HostToLittle((uint64_t)number);
+                AppendTag(data, DocumentCodecTagInt64);
+                [data appendBytes:&bits length:sizeof(bits)];
+            }
+        }
+        return YES;
+    }
+
+    if ([value isKindOfClass:[NSArray class]]) {
+        NSArray *array = value;
+        NSUInteger start = data.length;
+        AppendTag(data, DocumentCodecTagArray);
+        AppendUInt32(data, (uint32_t)array.count);
+
+        NSUInteger table = data.length;
+        [data increaseLengthBy:array.count * sizeof(uint32_t)];
+
+        NSUInteger index = 0;
+        for (id element in array) {
+            SetUInt32(data, table + index * sizeof(uint32_t), (uint32_t)(data.length - start));
+            if (! AppendValue(data, element)) {
+                return NO;
+            }
+            index++;
+        }
+        return YES;
+    }
+
+    if ([value isKindOfClass:[NSDictionary class]]) {
+        NSDictionary *dictionary = value;
+        NSMutableArray *keys = [NSMutableArray arrayWithCapacity:dictionary.count];
+        for (id key in dictionary) {
+            if (! [key isKindOfClass:[NSString class]]) {
+                return NO;
+            }
+            [keys addObject:@[[key dataUsingEncoding:NSUTF8StringEncoding], key]];
+        }
+        [keys sortUsingComparator:^NSComparisonResult(NSArray *left, NSArray *right) {
+            NSData *leftKey = left[0];
+            NSData *rightKey = right[0];
+            return CompareBytes(leftKey.bytes, leftKey.length, rightKey.bytes, rightKey.length);
+        }];
+
+        NSUInteger start = data.length;
+        AppendTag(data, DocumentCodecTagObject);
+        AppendUInt32(data, (uint32_t)keys.count);
+
+        NSUInteger table = data.length;
+        [data increaseLengthBy:keys.count * 2 * sizeof(uint32_t)];
+
+        NSUInteger index = 0;
+        for (NSArray *key in keys) {
+            NSData *bytes = key[0];
+            SetUInt32(data, table + index * 2 * sizeof(uint32_t), (uint32_t)(data.length - start));
+            AppendUInt32(data, (uint32_t)bytes.length);
+            [data appendData:bytes];
+
+            SetUInt32(data, table + (index * 2 + 1) * sizeof(uint32_t), (uint32_t)(data.length - start));
+            if (! AppendValue(data, dictionary[key[1]])) {
+                return NO;
+            }
+            index++;
+        }
+        return YES;
+    }
+
+    return NO;
+}
+
+#pragma mark - Decoding
+
+static BOOL ReadUInt32(DocumentCodecBuffer buffer, NSUInteger offset, uint32_t *value) {
+    if ((offset > buffer.length) || (buffer.length - offset < sizeof(uint32_t))) {
+        return NO;
+    }
+    memcpy(value, buffer.bytes + offset, sizeof(uint32_t));
+    *value = CFSwapInt32LittleToHost(*value);
+    return YES;
+}
+
+static BOOL ReadUInt64(DocumentCodecBuffer buffer, NSUInteger offset, uint64_t *value) {
+    if ((offset > buffer.length) || (buffer.length - offset < sizeof(uint64_t))) {
+        return NO;
+    }
+    memcpy(value, buffer.bytes + offset, sizeof(uint64_t));
+    *value = CFSwapInt64LittleToHost(*value);
+    return YES;
+}
+
+static BOOL ReadBytes(DocumentCodecBuffer buffer, NSUInteger offset, const uint8_t **bytes, uint32_t *length) {
+    if (! ReadUInt32(buffer, offset, length)) {
+        return NO;
+    }
+    if (buffer.length - offset - sizeof(uint32_t) < *length) {
+        return NO;
+    }
+    *bytes = buffer.bytes + offset + sizeof(uint32_t);
+    return YES;
+}
+
+static NSString *DecodeString(DocumentCodecBuffer buffer, NSUInteger offset) {
+    const uint8_t *bytes;
+    uint32_t length;
+    if (! ReadBytes(buffer, offset, &bytes, &length)) {
+        return nil;
+    }
+    return [[NSString alloc] initWithBytes:bytes length:length encoding:NSUTF8StringEncoding];
+}
+
+static NSString *DecodeDeflatedString(DocumentCodecBuffer buffer, NSUInteger offset) {
+    const uint8_t *bytes;
+    uint32_t length;
+    if (! ReadBytes(buffer, offset, &bytes, &length)) {
+        return nil;
+    }
+    NSData *inflated = [[NSData dataWithBytesNoCopy:(void *)bytes length:length freeWhenDone:NO] gunzippedData];
+    if (! inflated) {
+        AIQLogCError(1, @"Failed to decompress document value");
+        return nil;
+    }
+    return [[NSString alloc] initWithData:inflated encoding:NSUTF8StringEncoding];
+}
+
+static id DecodeValue(DocumentCodecBuffer buffer, NSUInteger offset, BOOL mutable) {
+    if (offset >= buffer.length) {
+        return nil;
+    }
+
+    switch (buffer.bytes[offset]) {
+        case DocumentCodecTagNull:
+            return [NSNull null];
+        case DocumentCodecTagFalse:
+            return @NO;
+        case DocumentCodecTagTrue:
+            return @YES;
+        case DocumentCodecTagInt8:
+            return (offset + 1 < buffer.length) ? @((int8_t)buffer.bytes[offset + 1]) : nil;
+        case DocumentCodecTagInt32: {
+            uint32_t value;
+            return ReadUInt32(buffer, offset + 1, &value) ? @((int32_t)value) : nil;
+        }
+        case DocumentCodecTagInt64: {
+            uint64_t value;
+            return ReadUInt64(buffer, offset + 1, &value) ? @((long long)value) : nil;
+        }
+        case DocumentCodecTagDouble: {
+            uint64_t bits;
+            double value;
+            if (! ReadUInt64(buffer, offset + 1, &bits)) {
+                return nil;
+            }
+            memcpy(&value, &bits, sizeof(value));
+            return @(value);
+        }
+        case DocumentCodecTagString:
+            return DecodeString(buffer, offset + 1);
+        case DocumentCodecTagDeflatedString:
+            return DecodeDeflatedString(buffer, offset + 1);
+        case DocumentCodecTagArray: {
+            uint32_t count;
+            if ((! ReadUInt32(buffer, offset + 1, &count)) || (count > (buffer.length - offset) / sizeof(uint32_t))) {
+                return nil;
+            }
+            NSMutableArray *array = [NSMutableArray arrayWithCapacity:count];
+            for (uint32_t i = 0; i < count; i++) {
+                uint32_t element;
+                if (! ReadUInt32(buffer, offset + 5 + i * sizeof(uint32_t), &element)) {
+                    return nil;
+                }
+                id value = DecodeValue(buffer, offset + element, mutable);
+                if (! value) {
+                    return nil;
+                }
+                [array addObject:value];
+            }
+            return mutable ? array : [array copy];
+        }
+        case DocumentCodecTagObject: {
+            uint32_t count;
+            if ((! ReadUInt32(buffer, offset + 1, &count)) || (count > (buffer.length - offset) / (2 * sizeof(uint32_t)))) {
+                return nil;
+            }
+            NSMutableDictionary *dictionary = [NSMutableDictionary dictionaryWithCapacity:count];
+            for (uint32_t i = 0; i < count; i++) {
+                uint32_t keyOffset;
+                uint32_t valueOffset;
+                if ((! ReadUInt32(buffer, offset + 5 + i * 2 * sizeof(uint32_t), &keyOffset)) ||
+                    (! ReadUInt32(buffer, offset + 5 + (i * 2 + 1) * sizeof(uint32_t), &valueOffset))) {
+                    return nil;
+                }
+                NSString *key = DecodeString(buffer, offset + keyOffset);
+                id value = DecodeValue(buffer, offset + valueOffset, mutable);
+                if ((! key) || (! value)) {
+                    return nil;
+                }
+                dictionary[key] = value;
+            }
+            return mutable ? dictionary : [dictionary copy];
+        }
+        default:
+            return nil;
+    }
+}
+
+static NSUInteger FindValue(DocumentCodecBuffer buffer, NSUInteger offset, NSArray *path) {
+    for (NSString *component in path) {
+        uint32_t count;
+        if ((offset >= buffer.length) ||
+            (buffer.bytes[offset] != DocumentCodecTagObject) ||
+            (! ReadUInt32(buffer, offset + 1, &count))) {
+            return NSNotFound;
+        }
+
+        NSData *key = [component dataUsingEncoding:NSUTF8StringEncoding];
+        NSUInteger low = 0;
+        NSUInteger high = count;
+        NSUInteger found = NSNotFound;
+        while (low < high) {
+            NSUInteger middle = low + (high - low) / 2;
+            uint32_t keyOffset;
+            uint32_t valueOffset;
+            const uint8_t *bytes;
+            uint32_t length;
+            if ((! ReadUInt32(buffer, offset + 5 + middle * 2 * sizeof(uint32_t), &keyOffset)) ||
+                (! ReadUInt32(buffer, offset + 5 + (middle * 2 + 1) * sizeof(uint32_t), &valueOffset)) ||
+                (! ReadBytes(buffer, offset + keyOffset, &bytes, &length))) {
+                return NSNotFound;
+            }
+
+            NSComparisonResult result = CompareBytes(bytes, length, key.bytes, key.length);
+            if (result == NSOrderedSame) {
+                found = offset + valueOffset;
+                break;
+            } else if (result == NSOrderedAscending) {
+                low = middle + 1;
+            } else {
+                high = middle;
+            }
+        }
+
+        if (found == NSNotFound) {
+            return NSNotFound;
+        }
+        offset = found;
+    }
+    return offset;
+}
+
+static BOOL IsSupportedVersion(NSData *data) {
+    const uint8_t *bytes = data.bytes;
+    if (bytes[3] != kDocumentCodecVersion) {
+        AIQLogCError(1, @"Unsupported document encoding version %d", bytes[3]);
+        return NO;
+    }
+    return YES;
+}
+
+static NSUInteger CostOfValue(id value) {
+    // rough footprint of the decoded objects, strings are counted as UTF-16 since that is how most of them end up
+    if ([value isKindOfClass:[NSString class]]) {
+        return 32 + [value length] * sizeof(unichar);
+    } else if ([value isKindOfClass:[NSArray class]]) {
+        NSUInteger cost = 32 + [value count] * sizeof(id);
+        for (id element in value) {
+            cost += CostOfValue(element);
+        }
+        return cost;
+    } else if ([value isKindOfClass:[NSDictionary class]]) {
+        NSUInteger cost = 48 + [value count] * 2 * sizeof(id);
+        for (id key in value) {
+            cost += CostOfValue(key) + CostOfValue(value[key]);
+        }
+        return cost;
+    }
+    return 16;
+}
+
+#pragma mark - SQL functions
+
+static NSArray *ComponentsForPath(NSString *path) {
+    if (! [path hasPrefix:@"$"]) {
+        return nil;
+    }
+
+    NSMutableArray *components = [NSMutableArray array];
+    NSScanner *scanner = [NSScanner scannerWithString:[path substringFromIndex:1]];
+    scanner.charactersToBeSkipped = nil;
+    while (! scanner.isAtEnd) {
+        NSString *component = nil;
+        if (! [scanner scanString:@"." intoString:NULL]) {
+            return nil;
+        }
+        if ([scanner scanString:@"\"" intoString:NULL]) {
+            if ((! [scanner scanUpToString:@"\"" intoString:&component]) || (! [scanner scanString:@"\"" intoString:NULL])) {
+                return nil;
+            }
+        } else if (! [scanner scanUpToString:@"." intoString:&component]) {
+            return nil;
+        }
+        [components addObject:component];
+    }
+    return components;
+}
+
+static void ReleaseAuxiliaryData(void *data) {
+    CFBridgingRelease(data);
+}
+
+static void ResultValue(sqlite3_context *context, id value) {
+    if ((! value) || (value == [NSNull null])) {
+        sqlite3_result_null(context);
+    } else if ([value isKindOfClass:[NSString class]]) {
+        sqlite3_result_text(context, [value UTF8String], -1, SQLITE_TRANSIENT);
+    } else if ([value isKindOfClass:[NSNumber class]]) {
+        if (IsBoolean(value)) {
+            sqlite3_result_int(context, [value boolValue] ? 1 : 0);
+        } else if (IsFloatingPoint(value)) {
+            sqlite3_result_double(context, [value doubleValue]);
+        } else {
+            sqlite3_result_int64(context, [value longLongValue]);
+        }
+    } else {
+        // containers are returned as JSON text, the same way json_extract does
+        NSData *json = [NSJSONSerialization dataWithJSONObject:value options:kNilOptions error:nil];
+        sqlite3_result_text(context, json.bytes, (int)json.length, SQLITE_TRANSIENT);
+    }
+}
+
+static void ExtractFunction(sqlite3_context *context, int argc, sqlite3_value **argv) {
+    @autoreleasepool {
+        if (sqlite3_value_type(argv[0]) == SQLITE_NULL) {
+            sqlite3_result_null(context);
+            return;
+        }
+
+        NSData *data = [NSData dataWithBytesNoCopy:(void *)sqlite3_value_blob(argv[0])
+                                            length:sqlite3_value_bytes(argv[0])
+                                      freeWhenDone:NO];
+        BOOL encoded = [DocumentCodec isEncodedData:data];
+
+        id root = encoded ? nil : [NSJSONSerialization JSONObjectWithData:data options:kNilOptions error:nil];
+        if (encoded ? (! IsSupportedVersion(data)) : (! root)) {
+            sqlite3_result_error(context, "malformed document", -1);
+            return;
+        }
+        DocumentCodecBuffer buffer = {data.bytes, data.length};
+
+        NSMutableArray *values = (argc > 2) ? [NSMutableArray arrayWithCapacity:argc - 1] : nil;
+        for (int i = 1; i < argc; i++) {
+            // paths are literals, so they are parsed once per statement rather than once per row
+            NSArray *path = (__bridge NSArray *)sqlite3_get_auxdata(context, i);
+            if (! path) {
+                const unsigned char *text = sqlite3_value_text(argv[i]);
+                path = text ? ComponentsForPath([NSString stringWithUTF8String:(const char *)text]) : nil;
+                if (! path) {
+                    sqlite3_result_error(context, "malformed path", -1);
+                    return;
+                }
+                sqlite3_set_auxdata(context, i, (void *)CFBridgingRetain(path), ReleaseAuxiliaryData);
+            }
+
+            id value;
+            if (encoded) {
+                NSUInteger offset = FindValue(buffer, kDocumentCodecHeaderLength, path);
+                value = (offset == NSNotFound) ? nil : DecodeValue(buffer, offset, NO);
+            } else {
+                value = root;
+                for (NSString *component in path) {
+                    value = [value isKindOfClass:[NSDictionary class]] ? value[component] : nil;
+                }
+            }
+
+            if (! values) {
+                ResultValue(context, value);
+                return;
+            }
+            [values addObject:value ?: [NSNull null]];
+        }
+
+        ResultValue(context, values);
+    }
+}
+
+static void EncodeFunction(sqlite3_context *context, int argc, sqlite3_value **argv) {
+    @autoreleasepool {
+        if (sqlite3_value_type(argv[0]) == SQLITE_NULL) {
+            sqlite3_result_null(context);
+            return;
+        }
+
+        NSData *data = [NSData dataWithBytesNoCopy:(void *)sqlite3_value_blob(argv[0])
+                                            length:sqlite3_value_bytes(argv[0])
+                                      freeWhenDone:NO];
+        if ([DocumentCodec isEncodedData:data]) {
+            sqlite3_result_value(context, argv[0]);
+            return;
+        }
+
+        NSData *encoded = [DocumentCodec dataWithObject:[DocumentCodec objectWithData:data mutable:NO]];
+        if (! encoded) {
+            sqlite3_result_error(context, "malformed document", -1);
+            return;
+        }
+        sqlite3_result_blob(context, encoded.bytes, (int)encoded.length, SQLITE_TRANSIENT);
+    }
+}
+
+@implementation DocumentCodec
+
++ (BOOL)isEncodedData:(NSData *)data {
+    return (data.length > kDocumentCodecHeaderLength) && (memcmp(data.bytes, kDocumentCodecMagic, sizeof(kDocumentCodecMagic)) == 0);
+}
+
++ (NSData *)dataWithObject:(id)object {
+    if (! object) {
+        return nil;
+    }
+
+    NSMutableData *data = [NSMutableData dataWithCapacity:256];
+    uint8_t header[] = {kDocumentCodecMagic[0], kDocumentCodecMagic[1], kDocumentCodecMagic[2], kDocumentCodecVersion, 0};
+    [data appendBytes:header length:sizeof(header)];
+
+    if (! AppendValue(data, object)) {
+        AIQLogCError(1, @"Failed to encode document: unsupported value");
+        return nil;
+    }
+
+    return data;
+}
+
++ (id)objectWithData:(NSData *)data mutable:(BOOL)mutable {
+    if (! data) {
+        return nil;
+    }
+
+    if (! [DocumentCodec isEncodedData:data]) {
+        NSJSONReadingOptions options = mutable ? NSJSONReadingMutableContainers : kNilOptions;
+        return [NSJSONSerialization JSONObjectWithData:data options:options error:nil];
+    }
+
+    if (! IsSupportedVersion(data)) {
+        return nil;
+    }
+    DocumentCodecBuffer buffer = {data.bytes, data.length};
+
+    id object = DecodeValue(buffer, kDocumentCodecHeaderLength, mutable);
+    if (! object) {
+        AIQLogCError(1, @"Failed to decode document: malformed data");
+    }
+    return object;
+}
+
++ (id)valueForPath:(NSArray *)path inData:(NSData *)data {
+    if (! data) {
+        return nil;
+    }
+
+    if (! [DocumentCodec isEncodedData:data]) {
+        id value = [NSJSONSerialization JSONObjectWithData:data options:kNilOptions error:nil];
+        for (NSString *component in path) {
+            value = [value isKindOfClass:[NSDictionary class]] ? value[component] : nil;
+        }
+        return value;
+    }
+
+    if (! IsSupportedVersion(data)) {
+        return nil;
+    }
+    DocumentCodecBuffer buffer = {data.bytes, data.length};
+
+    NSUInteger offset = FindValue(buffer, kDocumentCodecHeaderLength, path);
+    return (offset == NSNotFound) ? nil : DecodeValue(buffer, offset, NO);
+}
+
++ (NSUInteger)costOfObject:(id)object {
+    return object ? CostOfValue(object) : 0;
+}
+
++ (NSData *)JSONDataWithData:(NSData *)data {
+    if ((! data) || (! [DocumentCodec isEncodedData:data])) {
+        return data;
+    }
+
+    id object = [DocumentCodec objectWithData:data mutable:NO];
+    return object ? [NSJSONSerialization dataWithJSONObject:object options:kNilOptions error:nil] : nil;
+}
+
++ (void)registerFunctionsInDatabase:(FMDatabase *)db {
+    sqlite3 *handle = (sqlite3 *)[db sqliteHandle];
+
+    // both functions have to be deterministic to be usable in expression indexes
+    if (sqlite3_create_function_v2(handle, "aiq_extract", -1, SQLITE_UTF8 | SQLITE_DETERMINISTIC, NULL, ExtractFunction, NULL, NULL, NULL) != SQLITE_OK) {
+        AIQLogCError(1, @"Could not register aiq_extract: %@", [db lastErrorMessage]);
+    }
+    if (sqlite3_create_function_v2(handle, "aiq_encode", 1, SQLITE_UTF8 | SQLITE_DETERMINISTIC, NULL, EncodeFunction, NULL, NULL, NULL) != SQLITE_OK) {
+        AIQLogCError(1, @"Could not register aiq_encode: %@", [db lastErrorMessage]);
+    }
+}
+
+@end
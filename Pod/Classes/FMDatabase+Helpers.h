@@ -0,0 +1,13 @@
+#import <FMDB/FMDB.h>
+
+@interface FMDatabasePool (Helpers)
+
++ (instancetype)documentPoolWithPath:(NSString *)path;
+
+@end
+
+@interface FMDatabaseQueue (Helpers)
+
++ (instancetype)documentQueueWithPath:(NSString *)path;
+
+@end
@@ -0,0 +1,46 @@
+#import "DocumentCodec.h"
+#import "FMDatabase+Helpers.h"
+#import "SearchIndex.h"
+
+@interface DocumentPoolDelegate : NSObject
+
+@end
+
+@implementation DocumentPoolDelegate
+
+- (void)databasePool:(FMDatabasePool *)pool didAddDatabase:(FMDatabase *)database {
+    [DocumentCodec registerFunctionsInDatabase:database];
+    [SearchIndex registerFunctionsInDatabase:database];
+}
+
+@end
+
+@implementation FMDatabasePool (Helpers)
+
++ (instancetype)documentPoolWithPath:(NSString *)path {
+    static DocumentPoolDelegate *delegate = nil;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        // pools do not retain their delegates
+        delegate = [DocumentPoolDelegate new];
+    });
+    
+    FMDatabasePool *pool = [FMDatabasePool databasePoolWithPath:path];
+    pool.delegate = delegate;
+    return pool;
+}
+
+@end
+
+@implementation FMDatabaseQueue (Helpers)
+
++ (instancetype)documentQueueWithPath:(NSString *)path {
+    FMDatabaseQueue *queue = [FMDatabaseQueue databaseQueueWithPath:path];
+    [queue inDatabase:^(FMDatabase *db) {
+        [DocumentCodec registerFunctionsInDatabase:db];
+        [SearchIndex registerFunctionsInDatabase:db];
+    }];
+    return queue;
+}
+
+@end
@@ -0,0 +1,13 @@
+#import <Foundation/Foundation.h>
+
+@interface LaunchableArchive : NSObject
+
++ (NSDictionary *)manifestForArchiveAtPath:(NSString *)path;
++ (NSDictionary *)manifestForFolderAtPath:(NSString *)path;
++ (BOOL)writeManifest:(NSDictionary *)manifest toFolderAtPath:(NSString *)path;
++ (BOOL)updateFolderAtPath:(NSString *)folder
+         fromArchiveAtPath:(NSString *)path
+               stagingPath:(NSString *)stagingPath
+                     error:(NSError **)error;
+
+@end
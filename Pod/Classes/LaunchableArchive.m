@@ -0,0 +1,193 @@
+#import "AIQError.h"
+#import "AIQLog.h"
+#import "LaunchableArchive.h"
+#import "ZipArchive.h"
+
+// CRC32 and size of every entry a launchable was extracted from, so that an update only inflates changed entries
+static NSString *const kManifestFile = @".aiq_manifest";
+static size_t const kBufferSize = 16384;
+
+@implementation LaunchableArchive
+
++ (NSDictionary *)manifestForArchiveAtPath:(NSString *)path {
+    unzFile zip = unzOpen(path.fileSystemRepresentation);
+    if (! zip) {
+        return nil;
+    }
+
+    NSMutableDictionary *manifest = [NSMutableDictionary dictionary];
+    BOOL success = [self enumerateEntriesOfArchive:zip usingBlock:^BOOL(NSString *name, NSArray *signature) {
+        manifest[name] = signature;
+        return YES;
+    }];
+    unzClose(zip);
+
+    return success ? [manifest copy] : nil;
+}
+
++ (NSDictionary *)manifestForFolderAtPath:(NSString *)path {
+    return [NSDictionary dictionaryWithContentsOfFile:[path stringByAppendingPathComponent:kManifestFile]];
+}
+
++ (BOOL)writeManifest:(NSDictionary *)manifest toFolderAtPath:(NSString *)path {
+    return [manifest writeToFile:[path stringByAppendingPathComponent:kManifestFile] atomically:YES];
+}
+
++ (BOOL)updateFolderAtPath:(NSString *)folder
+         fromArchiveAtPath:(NSString *)path
+               stagingPath:(NSString *)stagingPath
+                     error:(NSError *__autoreleasing *)error {
+    if (error) {
+        *error = nil;
+    }
+
+    NSDictionary *installed = [self manifestForFolderAtPath:folder];
+    if (! installed) {
+        if (error) {
+            *error = [AIQError errorWithCode:AIQErrorResourceNotFound message:@"Manifest not found"];
+        }
+        return NO;
+    }
+
+    unzFile zip = unzOpen(path.fileSystemRepresentation);
+    if (! zip) {
+        if (error) {
+            *error = [AIQError errorWithCode:AIQErrorContainerFault message:@"Could not open zip file"];
+        }
+        return NO;
+    }
+
+    NSFileManager *fileManager = [NSFileManager defaultManager];
+    [fileManager removeItemAtPath:stagingPath error:nil];
+
+    NSMutableDictionary *manifest = [NSMutableDictionary dictionary];
+    NSMutableArray *changed = [NSMutableArray array];
+    BOOL success = [self enumerateEntriesOfArchive:zip usingBlock:^BOOL(NSString *name, NSArray *signature) {
+        manifest[name] = signature;
+        if ([installed[name] isEqual:signature]) {
+            return YES;
+        }
+        [changed addObject:name];
+        return [self extractCurrentEntryOfArchive:zip toPath:[stagingPath stringByAppendingPathComponent:name]];
+    }];
+    unzClose(zip);
+
+    if (! success) {
+        [fileManager removeItemAtPath:stagingPath error:nil];
+        if (error) {
+            *error = [AIQError errorWithCode:AIQErrorContainerFault message:@"Could not extract zip file"];
+        }
+        return NO;
+    }
+
+    // the installed folder has not been touched so far, each rename below replaces a single file atomically
+    for (NSString *name in changed) {
+        NSString *target = [folder stringByAppendingPathComponent:name];
+        NSError *localError = nil;
+        if (! [fileManager createDirectoryAtPath:[target stringByDeletingLastPathComponent]
+                     withIntermediateDirectories:YES
+                                      attributes:nil
+                                           error:&localError]) {
+            if (error) {
+                *error = [AIQError errorWithCode:AIQErrorContainerFault message:localError.localizedDescription];
+            }
+            return NO;
+        }
+        if (rename([stagingPath stringByAppendingPathComponent:name].fileSystemRepresentation, target.fileSystemRepresentation) != 0) {
+            if (error) {
+                *error = [AIQError errorWithCode:AIQErrorContainerFault message:[NSString stringWithUTF8String:strerror(errno)]];
+            }
+            return NO;
+        }
+    }
+
+    for (NSString *name in installed) {
+        if (! manifest[name]) {
+            [fileManager removeItemAtPath:[folder stringByAppendingPathComponent:name] error:nil];
+        }
+    }
+
+    [fileManager removeItemAtPath:stagingPath error:nil];
+
+    if (! [self writeManifest:manifest toFolderAtPath:folder]) {
+        if (error) {
+            *error = [AIQError errorWithCode:AIQErrorContainerFault message:@"Could not write manifest"];
+        }
+        return NO;
+    }
+
+    AIQLogCInfo(1, @"Updated %lu of %lu files in %@", (unsigned long)changed.count, (unsigned long)manifest.count, folder);
+
+    return YES;
+}
+
+#pragma mark - Private API
+
++ (BOOL)enumerateEntriesOfArchive:(unzFile)zip usingBlock:(BOOL (^)(NSString *name, NSArray *signature))block {
+    char filename[PATH_MAX];
+    int status = unzGoToFirstFile(zip);
+    while (status == UNZ_OK) {
+        unz_file_info info;
+        if (unzGetCurrentFileInfo(zip, &info, filename, sizeof(filename), NULL, 0, NULL, 0) != UNZ_OK) {
+            return NO;
+        }
+
+        NSString *name = [NSString stringWithUTF8String:filename];
+        if (! name) {
+            name = [NSString stringWithCString:filename encoding:NSISOLatin1StringEncoding];
+        }
+
+        // directories are implied by the files they contain, entries escaping the folder are ignored
+        if ((! [name hasSuffix:@"/"]) && (! [name.pathComponents containsObject:@".."])) {
+            if (! block(name, @[@(info.crc), @(info.uncompressed_size)])) {
+                return NO;
+            }
+        }
+
+        status = unzGoToNextFile(zip);
+    }
+
+    return (status == UNZ_END_OF_LIST_OF_FILE);
+}
+
++ (BOOL)extractCurrentEntryOfArchive:(unzFile)zip toPath:(NSString *)path {
+    if (! [[NSFileManager defaultManager] createDirectoryAtPath:[path stringByDeletingLastPathComponent]
+                                    withIntermediateDirectories:YES
+                                                     attributes:nil
+                                                          error:nil]) {
+        return NO;
+    }
+
+    if (unzOpenCurrentFile(zip) != UNZ_OK) {
+        return NO;
+    }
+
+    FILE *file = fopen(path.fileSystemRepresentation, "wb");
+    if (! file) {
+        unzCloseCurrentFile(zip);
+        return NO;
+    }
+
+    char buffer[kBufferSize];
+    BOOL success = YES;
+    int read;
+    while ((read = unzReadCurrentFile(zip, buffer, sizeof(buffer))) > 0) {
+        if (fwrite(buffer, 1, read, file) != (size_t)read) {
+            success = NO;
+            break;
+        }
+    }
+    if (read < 0) {
+        success = NO;
+    }
+    fclose(file);
+
+    // closing the entry verifies the CRC of what has been inflated
+    if (unzCloseCurrentFile(zip) != UNZ_OK) {
+        success = NO;
+    }
+
+    return success;
+}
+
+@end
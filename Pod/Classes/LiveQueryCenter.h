@@ -0,0 +1,13 @@
+#import <Foundation/Foundation.h>
+
+@class AIQLiveQuery;
+
+@interface LiveQueryCenter : NSObject
+
+- (void)addQuery:(AIQLiveQuery *)query;
+- (void)removeQuery:(AIQLiveQuery *)query;
+- (void)didChangeDocumentsWithIds:(NSArray *)identifiers solution:(NSString *)solution;
+- (void)didChangeAllDocuments;
+- (void)invalidateAll;
+
+@end
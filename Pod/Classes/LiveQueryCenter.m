@@ -0,0 +1,72 @@
+#import "AIQLiveQuery.h"
+#import "LiveQueryCenter.h"
+
+@interface AIQLiveQuery ()
+
+- (NSString *)solution;
+- (void)documentsDidChange:(NSArray *)identifiers;
+
+@end
+
+@interface LiveQueryCenter () {
+    NSMutableArray *_queries;
+}
+
+@end
+
+@implementation LiveQueryCenter
+
+- (instancetype)init {
+    self = [super init];
+    if (self) {
+        _queries = [NSMutableArray array];
+    }
+    return self;
+}
+
+- (void)addQuery:(AIQLiveQuery *)query {
+    @synchronized(self) {
+        [_queries addObject:query];
+    }
+}
+
+- (void)removeQuery:(AIQLiveQuery *)query {
+    @synchronized(self) {
+        [_queries removeObjectIdenticalTo:query];
+    }
+}
+
+- (void)didChangeDocumentsWithIds:(NSArray *)identifiers solution:(NSString *)solution {
+    if ((identifiers.count == 0) || (! solution)) {
+        return;
+    }
+    
+    for (AIQLiveQuery *query in [self queries]) {
+        if ([query.solution isEqualToString:solution]) {
+            [query documentsDidChange:identifiers];
+        }
+    }
+}
+
+- (void)didChangeAllDocuments {
+    for (AIQLiveQuery *query in [self queries]) {
+        // nil makes the query compare its whole result set
+        [query documentsDidChange:nil];
+    }
+}
+
+- (void)invalidateAll {
+    for (AIQLiveQuery *query in [self queries]) {
+        [query invalidate];
+    }
+}
+
+#pragma mark - Private API
+
+- (NSArray *)queries {
+    @synchronized(self) {
+        return [_queries copy];
+    }
+}
+
+@end
@@ -0,0 +1,37 @@
+#import "DocumentCodec.h"
+#import "FMDBMigrationManager.h"
+
+@interface Migration_20160516 : NSObject<FMDBMigrating>
+
+@end
+
+@implementation Migration_20160516
+
+- (NSString *)name {
+    return @"Encoding document data";
+}
+
+- (uint64_t)version {
+    return 20160516;
+}
+
+- (BOOL)migrateDatabase:(FMDatabase *)db error:(out NSError *__autoreleasing *)error {
+    [DocumentCodec registerFunctionsInDatabase:db];
+
+    NSArray *statements = @[@"UPDATE documents SET data = aiq_encode(data)",
+                            @"UPDATE localdocuments SET data = aiq_encode(data)",
+                            @"UPDATE comessages SET payload = aiq_encode(payload)"];
+
+    for (NSString *statement in statements) {
+        if (! [db executeUpdate:statement]) {
+            if (error) {
+                *error = [db lastError];
+            }
+            return NO;
+        }
+    }
+
+    return YES;
+}
+
+@end
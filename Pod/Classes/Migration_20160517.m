@@ -0,0 +1,47 @@
+#import "FMDBMigrationManager.h"
+
+@interface Migration_20160517 : NSObject<FMDBMigrating>
+
+@end
+
+@implementation Migration_20160517
+
+- (NSString *)name {
+    return @"Indexing message activation and expiry";
+}
+
+- (uint64_t)version {
+    return 20160517;
+}
+
+- (BOOL)migrateDatabase:(FMDatabase *)db error:(out NSError *__autoreleasing *)error {
+    // activeFrom is kept in milliseconds as received, activeAt and expiresAt are seconds since epoch
+    // so that message lookups and scheduling become range scans instead of evaluating every row
+    NSArray *statements = @[@"ALTER TABLE somessages ADD COLUMN activeAt INTEGER NOT NULL DEFAULT 0",
+                            @"ALTER TABLE somessages ADD COLUMN expiresAt INTEGER NOT NULL DEFAULT 0",
+                            @"UPDATE somessages SET activeAt = activeFrom / 1000, expiresAt = activeFrom / 1000 + timeToLive",
+                            @"CREATE TRIGGER somessages_insert_schedule AFTER INSERT ON somessages BEGIN "
+                            "UPDATE somessages SET activeAt = NEW.activeFrom / 1000, expiresAt = NEW.activeFrom / 1000 + NEW.timeToLive "
+                            "WHERE rowid = NEW.rowid; "
+                            "END",
+                            @"CREATE TRIGGER somessages_update_schedule AFTER UPDATE OF activeFrom, timeToLive ON somessages BEGIN "
+                            "UPDATE somessages SET activeAt = NEW.activeFrom / 1000, expiresAt = NEW.activeFrom / 1000 + NEW.timeToLive "
+                            "WHERE rowid = NEW.rowid; "
+                            "END",
+                            @"CREATE INDEX idx_somessages_solution_type_activeAt ON somessages (solution, type, activeAt)",
+                            @"CREATE INDEX idx_somessages_activeAt ON somessages (activeAt)",
+                            @"CREATE INDEX idx_somessages_expiresAt ON somessages (expiresAt)"];
+
+    for (NSString *statement in statements) {
+        if (! [db executeUpdate:statement]) {
+            if (error) {
+                *error = [db lastError];
+            }
+            return NO;
+        }
+    }
+
+    return YES;
+}
+
+@end
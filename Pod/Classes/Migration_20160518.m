@@ -0,0 +1,83 @@
+#import "FMDBMigrationManager.h"
+
+@interface Migration_20160518 : NSObject<FMDBMigrating>
+
+@end
+
+@implementation Migration_20160518
+
+- (NSString *)name {
+    return @"Counting messages";
+}
+
+- (uint64_t)version {
+    return 20160518;
+}
+
+- (BOOL)migrateDatabase:(FMDatabase *)db error:(out NSError *__autoreleasing *)error {
+    // the active flag follows activation and expiry, it is refreshed by the messaging synchronizer as time passes.
+    // counts are adjusted by triggers so that every writer of somessages keeps them consistent in its own transaction.
+    // scheduling and counting share a single trigger per event, so the result does not depend on the order in which
+    // SQLite runs triggers. the schedule update of the insert trigger moves the counts through the update trigger,
+    // which in turn is not fired again by its own schedule update and counts the row as it is afterwards.
+    // INSERT OR REPLACE does not fire delete triggers, the replaced row is taken out of the counts before inserting.
+    // its conflict clause also applies to statements inside the triggers, so they must never conflict themselves.
+    NSArray *statements = @[@"ALTER TABLE somessages ADD COLUMN active TINYINT NOT NULL DEFAULT 0",
+                            @"UPDATE somessages SET active = (activeAt <= CAST(strftime('%s', 'now') AS INTEGER) AND expiresAt >= CAST(strftime('%s', 'now') AS INTEGER))",
+                            @"DROP TRIGGER somessages_insert_schedule",
+                            @"DROP TRIGGER somessages_update_schedule",
+                            @"CREATE TABLE somessagecounts ("
+                            "solution TEXT    NOT NULL,"
+                            "type     TEXT    NOT NULL,"
+                            "total    INTEGER NOT NULL DEFAULT 0,"
+                            "active   INTEGER NOT NULL DEFAULT 0,"
+                            "unread   INTEGER NOT NULL DEFAULT 0,"
+                            "CONSTRAINT pk_solution_type PRIMARY KEY (solution, type))",
+                            @"INSERT INTO somessagecounts (solution, type, total, active, unread) "
+                            "SELECT solution, type, COUNT(*), SUM(active), SUM(active AND NOT read) FROM somessages GROUP BY solution, type",
+                            @"CREATE TRIGGER somessages_count_replace BEFORE INSERT ON somessages BEGIN "
+                            "UPDATE somessagecounts SET total = total - 1, "
+                            "active = active - (SELECT active FROM somessages WHERE identifier = NEW.identifier), "
+                            "unread = unread - (SELECT active AND NOT read FROM somessages WHERE identifier = NEW.identifier) "
+                            "WHERE EXISTS (SELECT 1 FROM somessages m WHERE m.identifier = NEW.identifier AND m.solution = somessagecounts.solution AND m.type = somessagecounts.type); "
+                            "END",
+                            @"CREATE TRIGGER somessages_insert AFTER INSERT ON somessages BEGIN "
+                            "INSERT INTO somessagecounts (solution, type) SELECT NEW.solution, NEW.type "
+                            "WHERE NOT EXISTS (SELECT 1 FROM somessagecounts WHERE solution = NEW.solution AND type = NEW.type); "
+                            "UPDATE somessagecounts SET total = total + 1, active = active + NEW.active, unread = unread + (NEW.active AND NOT NEW.read) "
+                            "WHERE solution = NEW.solution AND type = NEW.type; "
+                            "UPDATE somessages SET activeAt = NEW.activeFrom / 1000, expiresAt = NEW.activeFrom / 1000 + NEW.timeToLive, "
+                            "active = (NEW.activeFrom / 1000 <= CAST(strftime('%s', 'now') AS INTEGER) AND NEW.activeFrom / 1000 + NEW.timeToLive >= CAST(strftime('%s', 'now') AS INTEGER)) "
+                            "WHERE rowid = NEW.rowid; "
+                            "END",
+                            @"CREATE TRIGGER somessages_update AFTER UPDATE OF solution, type, activeFrom, timeToLive, active, read ON somessages BEGIN "
+                            "UPDATE somessages SET activeAt = NEW.activeFrom / 1000, expiresAt = NEW.activeFrom / 1000 + NEW.timeToLive, "
+                            "active = (NEW.activeFrom / 1000 <= CAST(strftime('%s', 'now') AS INTEGER) AND NEW.activeFrom / 1000 + NEW.timeToLive >= CAST(strftime('%s', 'now') AS INTEGER)) "
+                            "WHERE rowid = NEW.rowid AND (NEW.activeFrom <> OLD.activeFrom OR NEW.timeToLive <> OLD.timeToLive); "
+                            "UPDATE somessagecounts SET total = total - 1, active = active - OLD.active, unread = unread - (OLD.active AND NOT OLD.read) "
+                            "WHERE solution = OLD.solution AND type = OLD.type; "
+                            "INSERT INTO somessagecounts (solution, type) SELECT NEW.solution, NEW.type "
+                            "WHERE NOT EXISTS (SELECT 1 FROM somessagecounts WHERE solution = NEW.solution AND type = NEW.type); "
+                            "UPDATE somessagecounts SET total = total + 1, "
+                            "active = active + (SELECT active FROM somessages WHERE rowid = NEW.rowid), "
+                            "unread = unread + (SELECT active AND NOT read FROM somessages WHERE rowid = NEW.rowid) "
+                            "WHERE solution = NEW.solution AND type = NEW.type; "
+                            "END",
+                            @"CREATE TRIGGER somessages_count_delete AFTER DELETE ON somessages BEGIN "
+                            "UPDATE somessagecounts SET total = total - 1, active = active - OLD.active, unread = unread - (OLD.active AND NOT OLD.read) "
+                            "WHERE solution = OLD.solution AND type = OLD.type; "
+                            "END"];
+
+    for (NSString *statement in statements) {
+        if (! [db executeUpdate:statement]) {
+            if (error) {
+                *error = [db lastError];
+            }
+            return NO;
+        }
+    }
+
+    return YES;
+}
+
+@end
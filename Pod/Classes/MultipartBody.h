@@ -0,0 +1,13 @@
+#import <Foundation/Foundation.h>
+
+@interface MultipartBody : NSObject
+
+@property (nonatomic, readonly) NSString *contentType;
+@property (nonatomic, readonly) long long contentLength;
+@property (readonly) NSError *error;
+
+- (void)appendPartWithName:(NSString *)name contentType:(NSString *)contentType data:(NSData *)data;
+- (BOOL)appendPartWithName:(NSString *)name contentType:(NSString *)contentType URL:(NSURL *)url error:(NSError **)error;
+- (NSInputStream *)bodyStream;
+
+@end
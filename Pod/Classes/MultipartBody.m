@@ -0,0 +1,171 @@
+#import "AIQError.h"
+#import "AIQLog.h"
+#import "MultipartBody.h"
+
+static NSString *const kBoundary = @"b357b0und4ry3v3r";
+static NSUInteger const kBufferSize = 65536;
+
+@interface MultipartBody () {
+    NSMutableArray *_parts;
+    long long _contentLength;
+    NSError *_error;
+}
+
+@end
+
+@implementation MultipartBody
+
+- (instancetype)init {
+    self = [super init];
+    if (self) {
+        _parts = [NSMutableArray array];
+        _contentLength = 0;
+    }
+    return self;
+}
+
+- (NSString *)contentType {
+    return [NSString stringWithFormat:@"multipart/form-data; boundary=\"%@\"", kBoundary];
+}
+
+- (long long)contentLength {
+    if (_contentLength < 0) {
+        return -1;
+    }
+    return _contentLength + [self trailer].length;
+}
+
+- (NSError *)error {
+    @synchronized(self) {
+        return _error;
+    }
+}
+
+- (void)appendPartWithName:(NSString *)name contentType:(NSString *)contentType data:(NSData *)data {
+    [self appendHeaderWithName:name contentType:contentType];
+    [_parts addObject:data];
+    if (_contentLength >= 0) {
+        _contentLength += data.length;
+    }
+}
+
+- (BOOL)appendPartWithName:(NSString *)name contentType:(NSString *)contentType URL:(NSURL *)url error:(NSError *__autoreleasing *)error {
+    if (error) {
+        *error = nil;
+    }
+    
+    if ((url.isFileURL) && (! [[NSFileManager defaultManager] isReadableFileAtPath:url.path])) {
+        if (error) {
+            *error = [AIQError errorWithCode:AIQErrorResourceNotFound message:@"Attachment not readable"];
+        }
+        return NO;
+    }
+    
+    [self appendHeaderWithName:name contentType:contentType];
+    [_parts addObject:url];
+    if (_contentLength >= 0) {
+        NSNumber *size = nil;
+        if ((url.isFileURL) && ([url getResourceValue:&size forKey:NSURLFileSizeKey error:nil]) && (size)) {
+            _contentLength += size.longLongValue;
+        } else {
+            _contentLength = -1;
+        }
+    }
+    
+    return YES;
+}
+
+- (NSInputStream *)bodyStream {
+    CFReadStreamRef readStream;
+    CFWriteStreamRef writeStream;
+    // every write blocks until the connection has drained the pair, so at most one buffer of the body is in memory
+    CFStreamCreateBoundPair(NULL, &readStream, &writeStream, kBufferSize);
+    NSInputStream *input = CFBridgingRelease(readStream);
+    NSOutputStream *output = CFBridgingRelease(writeStream);
+    
+    NSArray *parts = [_parts arrayByAddingObject:[self trailer]];
+    dispatch_async(dispatch_get_global_queue(QOS_CLASS_UTILITY, 0), ^{
+        // writes fail as soon as the connection closes its end, which ends the writer as well
+        [output open];
+        for (id part in parts) {
+            BOOL success = [part isKindOfClass:[NSData class]] ? [self writeData:part to:output] : [self writeURL:part to:output];
+            if (! success) {
+                break;
+            }
+        }
+        [output close];
+    });
+    
+    return input;
+}
+
+#pragma mark - Private API
+
+- (NSData *)trailer {
+    return [[NSString stringWithFormat:@"\r\n--%@--\r\n", kBoundary] dataUsingEncoding:NSUTF8StringEncoding];
+}
+
+- (void)appendHeaderWithName:(NSString *)name contentType:(NSString *)contentType {
+    NSString *header = [NSString stringWithFormat:@"%@--%@\r\nContent-Disposition: form-data; name=\"%@\"\r\nContent-Type: %@\r\n\r\n",
+                        (_parts.count == 0) ? @"" : @"\r\n", kBoundary, name, contentType];
+    NSData *data = [header dataUsingEncoding:NSUTF8StringEncoding];
+    [_parts addObject:data];
+    if (_contentLength >= 0) {
+        _contentLength += data.length;
+    }
+}
+
+- (BOOL)writeData:(NSData *)data to:(NSOutputStream *)output {
+    const uint8_t *bytes = data.bytes;
+    NSUInteger offset = 0;
+    while (offset < data.length) {
+        NSInteger written = [output write:bytes + offset maxLength:MIN(data.length - offset, kBufferSize)];
+        if (written <= 0) {
+            return NO;
+        }
+        offset += written;
+    }
+    return YES;
+}
+
+- (BOOL)writeURL:(NSURL *)url to:(NSOutputStream *)output {
+    if (! url.isFileURL) {
+        // other URLs are served by URL protocols which cannot be streamed, they are loaded only once their turn comes
+        NSError *error = nil;
+        NSData *data = [NSData dataWithContentsOfURL:url options:NSDataReadingUncached error:&error];
+        if (! data) {
+            [self failWithError:error];
+            return NO;
+        }
+        return [self writeData:data to:output];
+    }
+    
+    NSInputStream *input = [NSInputStream inputStreamWithURL:url];
+    [input open];
+    uint8_t *buffer = malloc(kBufferSize);
+    BOOL success = YES;
+    NSInteger read;
+    while ((read = [input read:buffer maxLength:kBufferSize]) > 0) {
+        if (! [self writeData:[NSData dataWithBytesNoCopy:buffer length:read freeWhenDone:NO] to:output]) {
+            success = NO;
+            break;
+        }
+    }
+    if (read < 0) {
+        [self failWithError:input.streamError];
+        success = NO;
+    }
+    free(buffer);
+    [input close];
+    
+    return success;
+}
+
+- (void)failWithError:(NSError *)error {
+    AIQLogCWarn(1, @"Could not read message attachment: %@", error.localizedDescription);
+    @synchronized(self) {
+        _error = [AIQError errorWithCode:AIQErrorResourceNotFound message:error.localizedDescription ?: @"Attachment not readable"];
+    }
+}
+
+@end
@@ -0,0 +1,11 @@
+#import <Foundation/Foundation.h>
+
+@interface NSFileManager (Helpers)
+
+- (NSData *)mappedContentsAtPath:(NSString *)path error:(NSError **)error;
+- (BOOL)readContentsAtPath:(NSString *)path
+                 chunkSize:(NSUInteger)chunkSize
+                 processor:(void (^)(NSData *chunk, NSError **error))processor
+                     error:(NSError **)error;
+
+@end
@@ -0,0 +1,78 @@
+#import "AIQError.h"
+#import "NSFileManager+Helpers.h"
+
+@implementation NSFileManager (Helpers)
+
+- (NSData *)mappedContentsAtPath:(NSString *)path error:(NSError *__autoreleasing *)error {
+    if (error) {
+        *error = nil;
+    }
+    
+    NSError *localError = nil;
+    NSData *data = [NSData dataWithContentsOfFile:path options:NSDataReadingMappedIfSafe error:&localError];
+    if (! data) {
+        if (error) {
+            *error = [AIQError errorWithCode:AIQErrorResourceNotFound message:@"Resource not found"];
+        }
+        return nil;
+    }
+    
+    return data;
+}
+
+- (BOOL)readContentsAtPath:(NSString *)path
+                 chunkSize:(NSUInteger)chunkSize
+                 processor:(void (^)(NSData *, NSError *__autoreleasing *))processor
+                     error:(NSError *__autoreleasing *)error {
+    if (error) {
+        *error = nil;
+    }
+    
+    if (! processor) {
+        if (error) {
+            *error = [AIQError errorWithCode:AIQErrorInvalidArgument message:@"Processor not specified"];
+        }
+        return NO;
+    }
+    
+    if (chunkSize == 0) {
+        if (error) {
+            *error = [AIQError errorWithCode:AIQErrorInvalidArgument message:@"Chunk size not specified"];
+        }
+        return NO;
+    }
+    
+    NSFileHandle *handle = [NSFileHandle fileHandleForReadingAtPath:path];
+    if (! handle) {
+        if (error) {
+            *error = [AIQError errorWithCode:AIQErrorResourceNotFound message:@"Resource not found"];
+        }
+        return NO;
+    }
+    
+    BOOL result = YES;
+    BOOL finished = NO;
+    while (! finished) {
+        @autoreleasepool {
+            NSData *chunk = [handle readDataOfLength:chunkSize];
+            if (chunk.length == 0) {
+                finished = YES;
+            } else {
+                NSError *localError = nil;
+                processor(chunk, &localError);
+                if (localError) {
+                    result = NO;
+                    finished = YES;
+                    if (error) {
+                        *error = [AIQError errorWithCode:AIQErrorContainerFault message:localError.localizedDescription];
+                    }
+                }
+            }
+        }
+    }
+    [handle closeFile];
+    
+    return result;
+}
+
+@end
@@ -0,0 +1,13 @@
+#import <Foundation/Foundation.h>
+
+@interface RelevanceMatcher : NSObject
+
++ (instancetype)matcherForCondition:(NSDictionary *)condition
+                           solution:(NSString *)solution
+                         identifier:(NSString *)identifier
+                           revision:(id)revision;
+
+- (instancetype)initWithCondition:(NSDictionary *)condition;
+- (BOOL)matchesContext:(NSDictionary *)context error:(NSError **)error;
+
+@end
@@ -0,0 +1,196 @@
+#import <regex.h>
+
+#import "AIQError.h"
+#import "AIQJSON.h"
+#import "RelevanceMatcher.h"
+
+// matchers are cached per message revision, so conditions are only compiled once
+static NSUInteger const kCacheSize = 512;
+
+@interface RelevancePattern : NSObject {
+    id _pattern;
+    NSDictionary *_children;
+    NSArray *_elements;
+    BOOL _validRange;
+    regex_t _regex;
+    int _regexStatus;
+}
+
+- (instancetype)initWithPattern:(id)pattern;
+- (BOOL)matchesValue:(id)value error:(NSError **)error;
+
+@end
+
+@implementation RelevancePattern
+
+- (instancetype)initWithPattern:(id)pattern {
+    self = [super init];
+    if (self) {
+        _pattern = pattern;
+
+        if ([pattern isKindOfClass:[NSDictionary class]]) {
+            NSMutableDictionary *children = [NSMutableDictionary dictionaryWithCapacity:[pattern count]];
+            for (id key in pattern) {
+                children[key] = [[RelevancePattern alloc] initWithPattern:pattern[key]];
+            }
+            _children = [children copy];
+        } else if ([pattern isKindOfClass:[NSArray class]]) {
+            NSMutableArray *elements = [NSMutableArray arrayWithCapacity:[pattern count]];
+            for (id element in pattern) {
+                [elements addObject:[[RelevancePattern alloc] initWithPattern:element]];
+            }
+            _elements = [elements copy];
+
+            NSArray *array = (NSArray *)pattern;
+            _validRange = ((array.count == 2) &&
+                           ((array[0] == [NSNull null]) || ([array[0] isKindOfClass:[NSNumber class]])) &&
+                           ((array[1] == [NSNull null]) || ([array[1] isKindOfClass:[NSNumber class]])));
+        }
+
+        // any pattern is matched as a regular expression against values of a different kind
+        _regexStatus = regcomp(&_regex, [[pattern description] cStringUsingEncoding:NSUTF8StringEncoding], REG_EXTENDED);
+    }
+    return self;
+}
+
+- (void)dealloc {
+    if (_regexStatus == 0) {
+        regfree(&_regex);
+    }
+}
+
+- (BOOL)matchesValue:(id)value error:(NSError *__autoreleasing *)error {
+    if ((_children) && ([value isKindOfClass:[NSDictionary class]])) {
+        for (id key in _children) {
+            id child = value[key];
+            if ((! child) || (! [_children[key] matchesValue:child error:error])) {
+                return NO;
+            }
+        }
+        return YES;
+    }
+
+    if ((_elements) && ([value isKindOfClass:[NSArray class]])) {
+        if ([value count] != _elements.count) {
+            return NO;
+        }
+        BOOL result = YES;
+        for (NSUInteger i = 0; (i < _elements.count) && ((! error) || (! *error)); i++) {
+            result = [_elements[i] matchesValue:value[i] error:error];
+        }
+        return result;
+    }
+
+    if ((_elements) && ([value isKindOfClass:[NSNumber class]])) {
+        if (! _validRange) {
+            if (error) {
+                *error = [AIQError errorWithCode:AIQErrorInvalidArgument message:[NSString stringWithFormat:@"Invalid range: %@", [_pattern JSONString]]];
+            }
+            return NO;
+        }
+
+        NSArray *range = (NSArray *)_pattern;
+        if ((range[0] != [NSNull null]) && ([(NSNumber *)value compare:range[0]] == NSOrderedAscending)) {
+            return NO;
+        }
+        if ((range[1] != [NSNull null]) && ([(NSNumber *)value compare:range[1]] == NSOrderedDescending)) {
+            return NO;
+        }
+        return YES;
+    }
+
+    if (([_pattern isKindOfClass:[NSNumber class]]) && ([value isKindOfClass:[NSNumber class]])) {
+        return [(NSNumber *)value isEqualToNumber:_pattern];
+    }
+
+    if (_regexStatus != 0) {
+        if (error) {
+            *error = [AIQError errorWithCode:AIQErrorInvalidArgument message:[self messageForRegexError:_regexStatus]];
+        }
+        return NO;
+    }
+
+    int status = regexec(&_regex, [[value description] cStringUsingEncoding:NSUTF8StringEncoding], 0, NULL, 0);
+    if (status == 0) {
+        return YES;
+    }
+    if ((status != REG_NOMATCH) && (error)) {
+        *error = [AIQError errorWithCode:AIQErrorInvalidArgument message:[self messageForRegexError:status]];
+    }
+    return NO;
+}
+
+- (NSString *)messageForRegexError:(int)status {
+    char buffer[256];
+    regerror(status, &_regex, buffer, sizeof(buffer));
+    return @(buffer);
+}
+
+@end
+
+@interface RelevanceMatcher () {
+    NSDictionary *_patterns;
+}
+
+@end
+
+@implementation RelevanceMatcher
+
++ (instancetype)matcherForCondition:(NSDictionary *)condition
+                           solution:(NSString *)solution
+                         identifier:(NSString *)identifier
+                           revision:(id)revision {
+    static NSCache *cache;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        cache = [NSCache new];
+        cache.countLimit = kCacheSize;
+    });
+
+    if ((! solution) || (! identifier) || (! revision)) {
+        return [[RelevanceMatcher alloc] initWithCondition:condition];
+    }
+
+    NSArray *key = @[solution, identifier, revision];
+    RelevanceMatcher *matcher = [cache objectForKey:key];
+    if (! matcher) {
+        matcher = [[RelevanceMatcher alloc] initWithCondition:condition];
+        [cache setObject:matcher forKey:key];
+    }
+    return matcher;
+}
+
+- (instancetype)initWithCondition:(NSDictionary *)condition {
+    self = [super init];
+    if (self) {
+        NSMutableDictionary *patterns = [NSMutableDictionary dictionaryWithCapacity:condition.count];
+        for (NSString *name in condition) {
+            patterns[name] = [[RelevancePattern alloc] initWithPattern:condition[name]];
+        }
+        _patterns = [patterns copy];
+    }
+    return self;
+}
+
+- (BOOL)matchesContext:(NSDictionary *)context error:(NSError *__autoreleasing *)error {
+    if (error) {
+        *error = nil;
+    }
+
+    for (NSString *name in _patterns) {
+        id value = context[name];
+        if (! value) {
+            if (error) {
+                *error = [AIQError errorWithCode:AIQErrorInvalidArgument message:@"Context not found"];
+            }
+            return NO;
+        }
+        if (! [_patterns[name] matchesValue:value error:error]) {
+            return NO;
+        }
+    }
+
+    return YES;
+}
+
+@end
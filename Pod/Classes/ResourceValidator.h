@@ -0,0 +1,10 @@
+#import <Foundation/Foundation.h>
+
+@interface ResourceValidator : NSObject
+
++ (instancetype)sharedValidator;
+
+- (void)validateResources:(NSArray *)resources timeout:(NSTimeInterval)timeout completion:(void (^)(BOOL exist))completion;
+- (BOOL)resourcesExist:(NSArray *)resources timeout:(NSTimeInterval)timeout;
+
+@end
@@ -0,0 +1,183 @@
+#if TARGET_OS_IPHONE
+    #import <AssetsLibrary/AssetsLibrary.h>
+#endif
+
+#import "AIQLog.h"
+#import "ResourceValidator.h"
+
+// answers are remembered for a while, messages sent in a row with the same attachments do not check them again
+static NSTimeInterval const kCacheLifetime = 30.0;
+static NSUInteger const kCacheSize = 64;
+
+@interface ResourceValidator () {
+    NSMutableDictionary *_cache;
+    dispatch_queue_t _queue;
+}
+
+@end
+
+@implementation ResourceValidator
+
++ (instancetype)sharedValidator {
+    static ResourceValidator *validator;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        validator = [ResourceValidator new];
+    });
+    return validator;
+}
+
+- (instancetype)init {
+    self = [super init];
+    if (self) {
+        _cache = [NSMutableDictionary dictionary];
+        _queue = dispatch_queue_create("com.appearnetworks.aiq.ResourceValidator", DISPATCH_QUEUE_CONCURRENT);
+    }
+    return self;
+}
+
+- (void)validateResources:(NSArray *)resources timeout:(NSTimeInterval)timeout completion:(void (^)(BOOL))completion {
+    NSObject *lock = [NSObject new];
+    __block NSUInteger pending = resources.count;
+    __block BOOL finished = NO;
+    void (^finish)(BOOL) = ^(BOOL exist) {
+        @synchronized(lock) {
+            if (finished) {
+                return;
+            }
+            finished = YES;
+        }
+        completion(exist);
+    };
+    
+    if (pending == 0) {
+        dispatch_async(_queue, ^{
+            finish(YES);
+        });
+        return;
+    }
+    
+    for (NSString *resource in resources) {
+        [self checkResource:resource timeout:timeout completion:^(BOOL exists) {
+            BOOL done;
+            @synchronized(lock) {
+                pending--;
+                done = (pending == 0);
+            }
+            if (! exists) {
+                finish(NO);
+            } else if (done) {
+                finish(YES);
+            }
+        }];
+    }
+    
+    dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(timeout * NSEC_PER_SEC)), _queue, ^{
+        finish(NO);
+    });
+}
+
+- (BOOL)resourcesExist:(NSArray *)resources timeout:(NSTimeInterval)timeout {
+    dispatch_semaphore_t semaphore = dispatch_semaphore_create(0);
+    __block BOOL result = NO;
+    [self validateResources:resources timeout:timeout completion:^(BOOL exist) {
+        result = exist;
+        dispatch_semaphore_signal(semaphore);
+    }];
+    // the validation times out on its own, the wait never outlives it by much
+    dispatch_semaphore_wait(semaphore, dispatch_time(DISPATCH_TIME_NOW, (int64_t)((timeout + 1.0) * NSEC_PER_SEC)));
+    return result;
+}
+
+#pragma mark - Private API
+
+- (void)checkResource:(NSString *)resource timeout:(NSTimeInterval)timeout completion:(void (^)(BOOL exists))completion {
+    NSNumber *cached = [self cachedAnswerForResource:resource];
+    if (cached) {
+        dispatch_async(_queue, ^{
+            completion(cached.boolValue);
+        });
+        return;
+    }
+    
+    void (^answer)(BOOL) = ^(BOOL exists) {
+        [self cacheAnswer:exists forResource:resource];
+        completion(exists);
+    };
+    
+    NSURL *url;
+    if ([resource rangeOfString:@"://"].location == NSNotFound) {
+        // file URL
+        url = [NSURL fileURLWithPath:resource];
+    } else {
+        url = [NSURL URLWithString:resource];
+    }
+    
+    if ([url.scheme hasPrefix:@"aiq-"]) {
+        dispatch_async(_queue, ^{
+            completion(YES);
+        });
+    } else if (url.isFileURL) {
+        dispatch_async(_queue, ^{
+            NSDictionary *attributes = [[NSFileManager defaultManager] attributesOfItemAtPath:url.path error:nil];
+            answer((attributes) && ([attributes fileSize] > 0));
+        });
+    } else if ([url.scheme isEqualToString:@"assets-library"]) {
+#if TARGET_OS_IPHONE
+        // the library has to outlive the lookup, result blocks get a nil asset when it does not exist
+        ALAssetsLibrary *library = [ALAssetsLibrary new];
+        [library assetForURL:url resultBlock:^(ALAsset *asset) {
+            answer((library != nil) && (asset != nil));
+        } failureBlock:^(NSError *error) {
+            AIQLogCWarn(1, @"Could not access asset %@: %@", resource, error.localizedDescription);
+            answer(NO);
+        }];
+#else
+        dispatch_async(_queue, ^{
+            completion(NO);
+        });
+#endif
+    } else if (url) {
+        NSMutableURLRequest *request = [NSMutableURLRequest requestWithURL:url cachePolicy:NSURLRequestReloadIgnoringCacheData timeoutInterval:timeout];
+        request.HTTPMethod = @"HEAD";
+        [[[NSURLSession sharedSession] dataTaskWithRequest:request completionHandler:^(NSData *data, NSURLResponse *response, NSError *error) {
+            if (error) {
+                // failed requests are not remembered, the next message checks again
+                completion(NO);
+                return;
+            }
+            NSInteger statusCode = [response isKindOfClass:[NSHTTPURLResponse class]] ? ((NSHTTPURLResponse *)response).statusCode : 0;
+            answer((statusCode >= 200) && (statusCode < 300) && (response.expectedContentLength > 0));
+        }] resume];
+    } else {
+        dispatch_async(_queue, ^{
+            completion(NO);
+        });
+    }
+}
+
+- (NSNumber *)cachedAnswerForResource:(NSString *)resource {
+    @synchronized(_cache) {
+        NSArray *entry = _cache[resource];
+        if ((! entry) || ([entry[1] timeIntervalSinceNow] < -kCacheLifetime)) {
+            [_cache removeObjectForKey:resource];
+            return nil;
+        }
+        return entry[0];
+    }
+}
+
+- (void)cacheAnswer:(BOOL)exists forResource:(NSString *)resource {
+    @synchronized(_cache) {
+        if (_cache.count >= kCacheSize) {
+            for (NSString *key in _cache.allKeys) {
+                if ([_cache[key][1] timeIntervalSinceNow] < -kCacheLifetime) {
+                    [_cache removeObjectForKey:key];
+                }
+            }
+        }
+        _cache[resource] = @[@(exists), [NSDate date]];
+    }
+}
+
+@end
@@ -0,0 +1,29 @@
+#import <Foundation/Foundation.h>
+
+@class FMDatabase;
+
+@interface SearchIndex : NSObject
+
++ (void)registerFunctionsInDatabase:(FMDatabase *)db;
+
++ (BOOL)createIndexForFields:(NSArray *)fields
+                        type:(NSString *)type
+                    solution:(NSString *)solution
+                       table:(NSString *)table
+                  inDatabase:(FMDatabase *)db
+                       error:(NSError **)error;
++ (BOOL)dropIndexForType:(NSString *)type
+                solution:(NSString *)solution
+                   table:(NSString *)table
+              inDatabase:(FMDatabase *)db
+                   error:(NSError **)error;
++ (NSArray *)search:(NSString *)text
+               type:(NSString *)type
+           solution:(NSString *)solution
+              table:(NSString *)table
+          condition:(NSString *)condition
+              limit:(NSUInteger)limit
+         inDatabase:(FMDatabase *)db
+              error:(NSError **)error;
+
+@end
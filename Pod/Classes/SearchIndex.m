@@ -0,0 +1,252 @@
+#import <FMDB/FMDB.h>
+#import <sqlite3.h>
+
+#import "AIQDataStore.h"
+#import "AIQError.h"
+#import "AIQLog.h"
+#import "AIQPredicate.h"
+#import "SearchIndex.h"
+
+@interface AIQPredicate ()
+
++ (NSString *)expressionForField:(NSString *)field column:(NSString *)column error:(NSError **)error;
++ (NSString *)literalForString:(NSString *)string;
++ (NSString *)identifierForString:(NSString *)string;
+
+@end
+
+static void RankFunction(sqlite3_context *context, int argc, sqlite3_value **argv) {
+    // matchinfo 'pcx' holds the phrase and column counts followed by three counters per phrase and column
+    const uint32_t *info = sqlite3_value_blob(argv[0]);
+    NSUInteger length = sqlite3_value_bytes(argv[0]) / sizeof(uint32_t);
+    if ((! info) || (length < 2) || (length < 2 + 3 * (NSUInteger)info[0] * info[1])) {
+        sqlite3_result_error(context, "malformed match info", -1);
+        return;
+    }
+    
+    // every hit counts in proportion to how rare the phrase is in the column across all rows
+    double rank = 0.0;
+    for (uint32_t i = 0; i < info[0] * info[1]; i++) {
+        const uint32_t *hits = info + 2 + 3 * i;
+        if (hits[0] != 0) {
+            rank += (double)hits[0] / hits[1];
+        }
+    }
+    sqlite3_result_double(context, rank);
+}
+
+@implementation SearchIndex
+
++ (void)registerFunctionsInDatabase:(FMDatabase *)db {
+    sqlite3 *handle = (sqlite3 *)[db sqliteHandle];
+    if (sqlite3_create_function_v2(handle, "aiq_rank", 1, SQLITE_UTF8 | SQLITE_DETERMINISTIC, NULL, RankFunction, NULL, NULL, NULL) != SQLITE_OK) {
+        AIQLogCError(1, @"Could not register aiq_rank: %@", [db lastErrorMessage]);
+    }
+}
+
++ (BOOL)createIndexForFields:(NSArray *)fields
+                        type:(NSString *)type
+                    solution:(NSString *)solution
+                       table:(NSString *)table
+                  inDatabase:(FMDatabase *)db
+                       error:(NSError *__autoreleasing *)error {
+    if (error) {
+        *error = nil;
+    }
+    
+    if (fields.count == 0) {
+        if (error) {
+            *error = [AIQError errorWithCode:AIQErrorInvalidArgument message:@"Fields not specified"];
+        }
+        return NO;
+    }
+    
+    NSMutableArray *columns = [NSMutableArray arrayWithCapacity:fields.count];
+    NSMutableArray *values = [NSMutableArray arrayWithCapacity:fields.count];
+    NSMutableArray *initial = [NSMutableArray arrayWithCapacity:fields.count];
+    for (NSString *field in fields) {
+        NSString *value = [AIQPredicate expressionForField:field column:@"new.data" error:error];
+        if (! value) {
+            return NO;
+        }
+        [columns addObject:[AIQPredicate identifierForString:field]];
+        [values addObject:value];
+        [initial addObject:[AIQPredicate expressionForField:field column:@"data" error:nil]];
+    }
+    
+    NSString *name = [SearchIndex nameForType:type solution:solution table:table];
+    
+    NSArray *existing = [SearchIndex columnsOfIndex:name inDatabase:db];
+    if ([existing isEqualToArray:fields]) {
+        return YES;
+    }
+    
+    if ((existing) && (! [SearchIndex dropIndexForType:type solution:solution table:table inDatabase:db error:error])) {
+        return NO;
+    }
+    
+    NSString *index = [AIQPredicate identifierForString:name];
+    NSString *upsert = [NSString stringWithFormat:@"INSERT OR REPLACE INTO %@ (rowid, %@) VALUES (new.rowid, %@);",
+                        index, [columns componentsJoinedByString:@", "], [values componentsJoinedByString:@", "]];
+    
+    // FTS4 is the newest full-text module available on iOS 8, prefix indexes make search-as-you-type queries cheap.
+    // INSERT OR REPLACE removes the replaced row without firing delete triggers, its entry is removed up front instead.
+    NSArray *statements = @[[NSString stringWithFormat:@"CREATE VIRTUAL TABLE %@ USING fts4(%@, prefix=\"2,3\")",
+                             index, [columns componentsJoinedByString:@", "]],
+                            [NSString stringWithFormat:@"CREATE TRIGGER %@ BEFORE INSERT ON %@ WHEN new.solution = %@ BEGIN "
+                             "DELETE FROM %@ WHERE rowid IN (SELECT rowid FROM %@ WHERE solution = new.solution AND identifier = new.identifier AND %@); END",
+                             [AIQPredicate identifierForString:[name stringByAppendingString:@":replace"]], table,
+                             [AIQPredicate literalForString:solution], index, table,
+                             [SearchIndex filterForType:type solution:solution row:@""]],
+                            [NSString stringWithFormat:@"CREATE TRIGGER %@ AFTER INSERT ON %@ WHEN %@ BEGIN %@ END",
+                             [AIQPredicate identifierForString:[name stringByAppendingString:@":insert"]], table,
+                             [SearchIndex filterForType:type solution:solution row:@"new."], upsert],
+                            [NSString stringWithFormat:@"CREATE TRIGGER %@ AFTER UPDATE OF data ON %@ WHEN %@ BEGIN %@ END",
+                             [AIQPredicate identifierForString:[name stringByAppendingString:@":update"]], table,
+                             [SearchIndex filterForType:type solution:solution row:@"new."], upsert],
+                            [NSString stringWithFormat:@"CREATE TRIGGER %@ AFTER DELETE ON %@ WHEN %@ BEGIN DELETE FROM %@ WHERE rowid = old.rowid; END",
+                             [AIQPredicate identifierForString:[name stringByAppendingString:@":delete"]], table,
+                             [SearchIndex filterForType:type solution:solution row:@"old."], index],
+                            [NSString stringWithFormat:@"INSERT INTO %@ (rowid, %@) SELECT rowid, %@ FROM %@ WHERE %@",
+                             index, [columns componentsJoinedByString:@", "], [initial componentsJoinedByString:@", "], table,
+                             [SearchIndex filterForType:type solution:solution row:@""]]];
+    
+    for (NSString *statement in statements) {
+        if (! [db executeUpdate:statement]) {
+            if (error) {
+                *error = [AIQError errorWithCode:AIQErrorContainerFault message:[db lastError].localizedDescription];
+            }
+            return NO;
+        }
+    }
+    
+    return YES;
+}
+
++ (BOOL)dropIndexForType:(NSString *)type
+                solution:(NSString *)solution
+                   table:(NSString *)table
+              inDatabase:(FMDatabase *)db
+                   error:(NSError *__autoreleasing *)error {
+    if (error) {
+        *error = nil;
+    }
+    
+    NSString *name = [SearchIndex nameForType:type solution:solution table:table];
+    NSArray *statements = @[[NSString stringWithFormat:@"DROP TRIGGER IF EXISTS %@", [AIQPredicate identifierForString:[name stringByAppendingString:@":replace"]]],
+                            [NSString stringWithFormat:@"DROP TRIGGER IF EXISTS %@", [AIQPredicate identifierForString:[name stringByAppendingString:@":insert"]]],
+                            [NSString stringWithFormat:@"DROP TRIGGER IF EXISTS %@", [AIQPredicate identifierForString:[name stringByAppendingString:@":update"]]],
+                            [NSString stringWithFormat:@"DROP TRIGGER IF EXISTS %@", [AIQPredicate identifierForString:[name stringByAppendingString:@":delete"]]],
+                            [NSString stringWithFormat:@"DROP TABLE IF EXISTS %@", [AIQPredicate identifierForString:name]]];
+    
+    for (NSString *statement in statements) {
+        if (! [db executeUpdate:statement]) {
+            if (error) {
+                *error = [AIQError errorWithCode:AIQErrorContainerFault message:[db lastError].localizedDescription];
+            }
+            return NO;
+        }
+    }
+    
+    return YES;
+}
+
++ (NSArray *)search:(NSString *)text
+               type:(NSString *)type
+           solution:(NSString *)solution
+              table:(NSString *)table
+          condition:(NSString *)condition
+              limit:(NSUInteger)limit
+         inDatabase:(FMDatabase *)db
+              error:(NSError *__autoreleasing *)error {
+    if (error) {
+        *error = nil;
+    }
+    
+    NSString *name = [SearchIndex nameForType:type solution:solution table:table];
+    if (! [SearchIndex columnsOfIndex:name inDatabase:db]) {
+        if (error) {
+            *error = [AIQError errorWithCode:AIQErrorResourceNotFound message:@"Search index not found"];
+        }
+        return nil;
+    }
+    
+    NSString *match = [SearchIndex queryForText:text];
+    if (match.length == 0) {
+        return @[];
+    }
+    
+    // entries are joined with their documents by rowid, which applies the solution, type and caller conditions
+    NSString *fts = [AIQPredicate identifierForString:name];
+    NSString *query = [NSString stringWithFormat:@"SELECT d.identifier, aiq_rank(matchinfo(%@, 'pcx')) AS rank, snippet(%@, '<b>', '</b>', '…', -1, 16) "
+                       "FROM %@ JOIN %@ d ON d.rowid = %@.rowid "
+                       "WHERE %@ MATCH ? AND d.solution = ? AND d.type = ? AND (%@) "
+                       "ORDER BY rank DESC LIMIT ?",
+                       fts, fts, fts, table, fts, fts, condition ?: @"1"];
+    
+    FMResultSet *rs = [db executeQuery:query, match, solution, type, @(limit == 0 ? -1 : (long long)limit)];
+    if (! rs) {
+        if (error) {
+            *error = [AIQError errorWithCode:AIQErrorContainerFault message:[db lastError].localizedDescription];
+        }
+        return nil;
+    }
+    
+    NSMutableArray *result = [NSMutableArray array];
+    while ([rs next]) {
+        NSMutableDictionary *match = [NSMutableDictionary dictionaryWithCapacity:3];
+        match[kAIQDocumentId] = [rs stringForColumnIndex:0];
+        match[kAIQSearchResultRank] = @([rs doubleForColumnIndex:1]);
+        if (! [rs columnIndexIsNull:2]) {
+            match[kAIQSearchResultSnippet] = [rs stringForColumnIndex:2];
+        }
+        [result addObject:[match copy]];
+    }
+    [rs close];
+    
+    return [result copy];
+}
+
+#pragma mark - Private API
+
++ (NSString *)queryForText:(NSString *)text {
+    // every word becomes a quoted phrase so that user input never reaches the query syntax, phrases cannot escape
+    // quotes so those are dropped, a trailing asterisk is kept inside the phrase to request a prefix match
+    NSString *stripped = [text stringByReplacingOccurrencesOfString:@"\"" withString:@" "];
+    NSMutableArray *phrases = [NSMutableArray array];
+    for (NSString *word in [stripped componentsSeparatedByCharactersInSet:[NSCharacterSet whitespaceAndNewlineCharacterSet]]) {
+        NSString *token = [word stringByTrimmingCharactersInSet:[NSCharacterSet characterSetWithCharactersInString:@"*"]];
+        if ([token rangeOfCharacterFromSet:[NSCharacterSet alphanumericCharacterSet]].location == NSNotFound) {
+            // punctuation alone holds no tokens and would make the whole query match nothing
+            continue;
+        }
+        [phrases addObject:[NSString stringWithFormat:@"\"%@%@\"", token, [word hasSuffix:@"*"] ? @"*" : @""]];
+    }
+    return [phrases componentsJoinedByString:@" "];
+}
+
++ (NSString *)filterForType:(NSString *)type solution:(NSString *)solution row:(NSString *)row {
+    return [NSString stringWithFormat:@"%@solution = %@ AND %@type = %@",
+            row, [AIQPredicate literalForString:solution], row, [AIQPredicate literalForString:type]];
+}
+
++ (NSString *)nameForType:(NSString *)type solution:(NSString *)solution table:(NSString *)table {
+    return [NSString stringWithFormat:@"%@_fts:%@:%@", table, solution, type];
+}
+
++ (NSArray *)columnsOfIndex:(NSString *)name inDatabase:(FMDatabase *)db {
+    FMResultSet *rs = [db executeQuery:[NSString stringWithFormat:@"PRAGMA table_info(%@)", [AIQPredicate identifierForString:name]]];
+    if (! rs) {
+        return nil;
+    }
+    
+    NSMutableArray *columns = [NSMutableArray array];
+    while ([rs next]) {
+        [columns addObject:[rs stringForColumn:@"name"]];
+    }
+    [rs close];
+    
+    return (columns.count == 0) ? nil : [columns copy];
+}
+
+@end
@@ -0,0 +1,10 @@
+@class AIQMessagingSynchronizer;
+
+@interface SendMessageBatchOperation : NSOperation
+
+@property (nonatomic, retain) NSArray *messages;
+@property (nonatomic, assign) NSTimeInterval timeout;
+@property (nonatomic, retain) AIQMessagingSynchronizer *synchronizer;
+@property (nonatomic, retain) NSThread *thread;
+
+@end
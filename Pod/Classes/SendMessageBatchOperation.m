@@ -0,0 +1,265 @@
+#import <FMDB/FMDB.h>
+
+#import "AIQContext.h"
+#import "AIQDataStore.h"
+#import "AIQJSON.h"
+#import "AIQLog.h"
+#import "AIQMessaging.h"
+#import "AIQMessagingSynchronizer.h"
+#import "AIQSession.h"
+#import "AIQSynchronization.h"
+#import "DocumentCodec.h"
+#import "FMDatabase+Helpers.h"
+#import "SendMessageBatchOperation.h"
+#import "SendMessageOperation.h"
+#import "common.h"
+
+@interface AIQMessagingSynchronizer ()
+
+- (void)handleUnauthorized;
+- (void)scheduleNextNotification;
+- (void)batchingNotSupported;
+
+@end
+
+@interface SendMessageBatchOperation () <NSURLConnectionDataDelegate> {
+    NSURLConnection *_connection;
+    NSInteger _statusCode;
+    NSMutableData *_data;
+    NSDictionary *_sent;
+    BOOL _needsScheduling;
+    FMDatabaseQueue *_queue;
+}
+
+@property (nonatomic, assign) BOOL isFinished;
+@property (nonatomic, assign) BOOL isExecuting;
+@property (nonatomic, assign) BOOL isCancelled;
+
+@end
+
+@implementation SendMessageBatchOperation
+
+- (id)init {
+    self = [super init];
+    if (self) {
+        _thread = [NSThread currentThread];
+    }
+    return self;
+}
+
++ (BOOL)automaticallyNotifiesObserversForKey:(NSString *)key {
+    return YES;
+}
+
+- (BOOL)isConcurrent {
+    return YES;
+}
+
+- (void)start {
+    if (([self isCancelled]) || ([_thread isCancelled])) {
+        return;
+    }
+    
+    if (! [[NSThread currentThread] isEqual:_thread]) {
+        [self performSelector:@selector(start) onThread:_thread withObject:nil waitUntilDone:YES];
+        return;
+    }
+    
+    [self setIsExecuting:YES];
+    
+    AIQContext *context = [_synchronizer valueForKey:@"context"];
+    AIQSession *session = [_synchronizer valueForKey:@"session"];
+    
+    _queue = [FMDatabaseQueue documentQueueWithPath:[session valueForKey:@"dbPath"]];
+    
+    NSMutableArray *messages = [NSMutableArray arrayWithCapacity:_messages.count];
+    NSMutableDictionary *sent = [NSMutableDictionary dictionaryWithCapacity:_messages.count];
+    [_queue inDatabase:^(FMDatabase *db) {
+        for (NSArray *message in _messages) {
+            NSString *solution = message[0];
+            NSString *identifier = message[1];
+            FMResultSet *rs = [db executeQuery:@"SELECT destination, payload, created, launchable, expectResponse FROM comessages "
+                               "WHERE solution = ? AND identifier = ? AND state = ?",
+                               solution, identifier, @(AIQMessageStateQueued)];
+            if (! rs) {
+                AIQLogCError(1, @"Could not retrieve message %@: %@", identifier, [db lastError].localizedDescription);
+                continue;
+            }
+            
+            if (! [rs next]) {
+                [rs close];
+                continue;
+            }
+            
+            NSMutableDictionary *entry = [NSMutableDictionary dictionary];
+            entry[@"id"] = identifier;
+            entry[@"solution"] = solution;
+            entry[@"destination"] = [rs stringForColumnIndex:0];
+            entry[@"payload"] = [DocumentCodec objectWithData:[rs dataForColumnIndex:1] mutable:NO];
+            entry[@"created"] = [rs objectForColumnIndex:2];
+            if (! [rs columnIndexIsNull:3]) {
+                entry[@"launchable"] = [rs stringForColumnIndex:3];
+            }
+            entry[@"expectResponse"] = @([rs boolForColumnIndex:4]);
+            [rs close];
+            
+            [messages addObject:entry];
+            sent[identifier] = entry;
+        }
+    }];
+    
+    if (messages.count == 0) {
+        [self clean];
+        return;
+    }
+    
+    _sent = [sent copy];
+    
+    AIQLogCInfo(1, @"Sending %lu messages in one batch", (unsigned long)messages.count);
+    
+    // the context is the same for every message of the batch
+    NSMutableDictionary *contextData = [NSMutableDictionary dictionary];
+    id value = context ? [context valueForName:@"com.appearnetworks.aiq.location" error:nil] : nil;
+    contextData[@"com.appearnetworks.aiq.location"] = value ?: @{};
+    value = context ? [context valueForName:@"com.appearnetworks.aiq.apps" error:nil] : nil;
+    contextData[@"com.appearnetworks.aiq.apps"] = value ?: @{};
+    
+    NSMutableURLRequest *request = [NSMutableURLRequest requestWithURL:[NSURL URLWithString:[session propertyForName:@"comessagebatch"]]
+                                                           cachePolicy:NSURLRequestReloadIgnoringLocalAndRemoteCacheData
+                                                       timeoutInterval:_timeout];
+    request.HTTPMethod = @"POST";
+    request.HTTPBody = [@{@"messages": messages, @"context": contextData} JSONData];
+    [request setValue:@"application/json" forHTTPHeaderField:@"Content-Type"];
+    [request setValue:[NSString stringWithFormat:@"BEARER %@", [session propertyForName:@"accessToken"]] forHTTPHeaderField:@"Authorization"];
+    [request setValue:@"keep-alive" forHTTPHeaderField:@"Connection"];
+    
+    _data = [NSMutableData data];
+    _connection = [[NSURLConnection alloc] initWithRequest:request delegate:self startImmediately:NO];
+    [_connection scheduleInRunLoop:[NSRunLoop currentRunLoop] forMode:NSRunLoopCommonModes];
+    [_connection start];
+}
+
+- (void)cancel {
+    if ((! [[NSThread currentThread] isEqual:_thread]) && (! [_thread isCancelled])) {
+        [self performSelector:@selector(cancel) onThread:_thread withObject:nil waitUntilDone:YES];
+        return;
+    }
+    
+    AIQLogCInfo(1, @"Cancelling message batch");
+    
+    [self setIsCancelled:YES];
+    
+    if (_connection) {
+        [_connection cancel];
+    }
+    
+    [self clean];
+}
+
+#pragma mark - NSURLConnectionDataDelegate
+
+- (void)connection:(NSURLConnection *)connection didFailWithError:(NSError *)error {
+    AIQLogCWarn(1, @"Message batch failed: %@", error.localizedDescription);
+    [self clean];
+}
+
+- (void)connection:(NSURLConnection *)connection didReceiveResponse:(NSURLResponse *)response {
+    NSHTTPURLResponse *httpResponse = (NSHTTPURLResponse *)response;
+    _statusCode = httpResponse.statusCode;
+}
+
+- (void)connection:(NSURLConnection *)connection didReceiveData:(NSData *)data {
+    [_data appendData:data];
+}
+
+- (void)connectionDidFinishLoading:(NSURLConnection *)connection {
+    BOOL supported = YES;
+    if (_statusCode == 200) {
+        id json = [_data JSONObject];
+        NSArray *results = [json isKindOfClass:[NSDictionary class]] ? json[@"results"] : nil;
+        if (! [results isKindOfClass:[NSArray class]]) {
+            AIQLogCWarn(1, @"Invalid response to message batch");
+        } else {
+            NSMutableArray *notifications = [NSMutableArray arrayWithCapacity:results.count];
+            [_queue inTransaction:^(FMDatabase *db, BOOL *rollback) {
+                for (NSDictionary *result in results) {
+                    NSDictionary *message = _sent[result[@"id"]];
+                    if (message) {
+                        NSDictionary *notification = [self applyStatus:[result[@"status"] integerValue] toMessage:message inDatabase:db];
+                        if (notification) {
+                            [notifications addObject:notification];
+                        }
+                    }
+                }
+            }];
+            
+            if (_needsScheduling) {
+                [_synchronizer scheduleNextNotification];
+            }
+            
+            for (NSDictionary *notification in notifications) {
+                NOTIFY(notification[@"name"], _synchronizer, notification[@"userInfo"]);
+            }
+        }
+    } else if (_statusCode == 401) {
+        [connection cancel];
+        [connection unscheduleFromRunLoop:[NSRunLoop currentRunLoop] forMode:NSRunLoopCommonModes];
+        [_queue close];
+        [_synchronizer handleUnauthorized];
+    } else if ((_statusCode == 404) || (_statusCode == 405) || (_statusCode == 501)) {
+        AIQLogCWarn(1, @"Message batches are not supported by the mobility platform");
+        supported = NO;
+    } else {
+        AIQLogCWarn(1, @"Message batch failed with status %ld", (long)_statusCode);
+    }
+    
+    [self clean];
+    
+    if (! supported) {
+        // the messages of this batch are sent one by one from now on
+        [_synchronizer batchingNotSupported];
+    }
+}
+
+#pragma mark - Private API
+
+- (NSDictionary *)applyStatus:(NSInteger)status toMessage:(NSDictionary *)message inDatabase:(FMDatabase *)db {
+    BOOL expectResponse = [message[@"expectResponse"] boolValue];
+    NSString *name = [SendMessageOperation applyStatus:status
+                                       toMessageWithId:message[@"id"]
+                                              solution:message[@"solution"]
+                                        expectResponse:expectResponse
+                                            inDatabase:db];
+    if (! name) {
+        return nil;
+    }
+    
+    if (([name isEqualToString:AIQDidRejectMessageNotification]) && (! expectResponse)) {
+        _needsScheduling = YES;
+    }
+    
+    return @{@"name": name, @"userInfo": @{AIQDocumentIdUserInfoKey: message[@"id"],
+                                           AIQSolutionUserInfoKey: message[@"solution"],
+                                           AIQMessageDestinationUserInfoKey: message[@"destination"]}};
+}
+
+- (void)clean {
+    if (_connection) {
+        [_connection unscheduleFromRunLoop:[NSRunLoop currentRunLoop] forMode:NSRunLoopCommonModes];
+        _connection = nil;
+    }
+    
+    if (_queue) {
+        [_queue close];
+        _queue = nil;
+    }
+    
+    if (_isExecuting) {
+        [self setIsExecuting:NO];
+    }
+    if (! _isFinished) {
+        [self setIsFinished:YES];
+    }
+}
+
+@end
@@ -1,4 +1,5 @@
 @class AIQMessagingSynchronizer;
+@class FMDatabase;
 
 @interface SendMessageOperation : NSOperation
 
@@ -8,4 +9,10 @@
 @property (nonatomic, retain) AIQMessagingSynchronizer *synchronizer;
 @property (nonatomic, retain) NSThread *thread;
 
++ (NSString *)applyStatus:(NSInteger)status
+          toMessageWithId:(NSString *)identifier
+                 solution:(NSString *)solution
+           expectResponse:(BOOL)expectResponse
+               inDatabase:(FMDatabase *)db;
+
 @end
@@ -8,6 +8,9 @@
 #import "AIQMessagingSynchronizer.h"
 #import "AIQSession.h"
 #import "AIQSynchronization.h"
+#import "DocumentCodec.h"
+#import "FMDatabase+Helpers.h"
+#import "MultipartBody.h"
 #import "NSDictionary+Helpers.h"
 #import "NSURL+Helpers.h"
 #import "SendMessageOperation.h"
@@ -26,6 +29,7 @@
     BOOL _expectResponse;
     NSString *_destination;
     FMDatabaseQueue *_queue;
+    MultipartBody *_body;
 }
 
 @property (nonatomic, assign) BOOL isFinished;
@@ -53,12 +57,13 @@
 }
 
 - (void)start {
-    if (! [[NSThread currentThread] isEqual:_thread]) {
-        [self performSelector:@selector(start) onThread:_thread withObject:nil waitUntilDone:YES];
+    if (([self isCancelled]) || ([_thread isCancelled])) {
         return;
     }
     
-    if ([self isCancelled]) {
+    // everything, including the connection callbacks, happens on the networking thread of the synchronizer
+    if (! [[NSThread currentThread] isEqual:_thread]) {
+        [self performSelector:@selector(start) onThread:_thread withObject:nil waitUntilDone:YES];
         return;
     }
     
@@ -67,7 +72,7 @@
     AIQContext *context = [_synchronizer valueForKey:@"context"];
     AIQSession *session = [_synchronizer valueForKey:@"session"];
     
-    _queue = [FMDatabaseQueue databaseQueueWithPath:[session valueForKey:@"dbPath"]];
+    _queue = [FMDatabaseQueue documentQueueWithPath:[session valueForKey:@"dbPath"]];
     
     __block BOOL shouldClean = NO;
     
@@ -116,7 +121,6 @@
                                                                cachePolicy:NSURLRequestReloadIgnoringLocalAndRemoteCacheData
                                                            timeoutInterval:_timeout];
         request.HTTPMethod = @"POST";
-        [request setValue:@"multipart/form-data; boundary=\"b357b0und4ry3v3r\"" forHTTPHeaderField:@"Content-Type"];
         [request setValue:[NSString stringWithFormat:@"BEARER %@", [session propertyForName:@"accessToken"]] forHTTPHeaderField:@"Authorization"];
         [request setValue:_identifier forHTTPHeaderField:@"X-AIQ-MessageId"];
         [request setValue:[NSString stringWithFormat:@"%@", created] forHTTPHeaderField:@"X-AIQ-Created"];
@@ -126,14 +130,8 @@
         if (launchable) {
             [request setValue:launchable forHTTPHeaderField:@"X-AIQ-Launchable"];
         }
-        NSMutableData *body = [NSMutableData data];
-        [body appendData:[@"--b357b0und4ry3v3r\r\n" dataUsingEncoding:NSUTF8StringEncoding]];
-        [body appendData:[@"Content-Disposition: form-data; name=\"_payload\"\r\n" dataUsingEncoding:NSUTF8StringEncoding]];
-        [body appendData:[@"Content-Type: application/json\r\n\r\n" dataUsingEncoding:NSUTF8StringEncoding]];
-        [body appendData:payload];
-        [body appendData:[@"\r\n--b357b0und4ry3v3r\r\n" dataUsingEncoding:NSUTF8StringEncoding]];
-        [body appendData:[@"Content-Disposition: form-data; name=\"_context\"\r\n" dataUsingEncoding:NSUTF8StringEncoding]];
-        [body appendData:[@"Content-Type: application/json\r\n\r\n" dataUsingEncoding:NSUTF8StringEncoding]];
+        _body = [MultipartBody new];
+        [_body appendPartWithName:@"_payload" contentType:@"application/json" data:[DocumentCodec JSONDataWithData:payload]];
         
         NSMutableDictionary *contextData = [NSMutableDictionary dictionary];
         id value = context ? [context valueForName:@"com.appearnetworks.aiq.location" error:nil] : nil;
@@ -146,7 +144,7 @@
             value = @{};
         }
         [contextData setValue:value forKey:@"com.appearnetworks.aiq.apps"];
-        [body appendData:[contextData JSONData]];
+        [_body appendPartWithName:@"_context" contentType:@"application/json" data:[contextData JSONData]];
         
         rs = [db executeQuery:@"SELECT name, contentType, link FROM coattachments WHERE solution = ? AND identifier = ?",
               _solution, _identifier];
@@ -177,30 +175,24 @@
             }
             
             NSError *error = nil;
-            NSData *attachmentData = [NSData dataWithContentsOfURL:attachmentURL options:NSDataReadingUncached error:&error];
-            if (! attachmentData) {
-                if (! [db executeUpdate:@"UPDATE comessages SET state = ?, response = ?, responseId = ? WHERE solution = ? AND identifier = ?",
-                       @(AIQMessageStateRejected), error.localizedDescription, nil, _solution, _identifier]) {
-                    AIQLogCError(1, @"Could not update the state of message %@: %@", _identifier, [db lastError].localizedDescription);
-                }
-                NOTIFY(AIQDidRejectMessageNotification, _synchronizer, (@{AIQDocumentIdUserInfoKey: _identifier,
-                                                                          AIQSolutionUserInfoKey: _solution,
-                                                                          AIQMessageDestinationUserInfoKey: _destination}));
+            if (! [_body appendPartWithName:name contentType:contentType URL:attachmentURL error:&error]) {
+                [rs close];
+                AIQLogCWarn(1, @"Could not read attachment %@ of message %@: %@", name, _identifier, error.localizedDescription);
+                [self rejectWithCause:error.localizedDescription inDatabase:db];
                 shouldClean = YES;
                 return;
             }
-            [body appendData:[@"\r\n--b357b0und4ry3v3r\r\n" dataUsingEncoding:NSUTF8StringEncoding]];
-            [body appendData:[[NSString stringWithFormat:@"Content-Disposition: form-data; name=\"%@\"\r\n", name] dataUsingEncoding:NSUTF8StringEncoding]];
-            [body appendData:[[NSString stringWithFormat:@"Content-Type: %@\r\n\r\n", contentType] dataUsingEncoding:NSUTF8StringEncoding]];
-            [body appendData:attachmentData];
         }
         [rs close];
         
-        [body appendData:[@"\r\n--b357b0und4ry3v3r--\r\n" dataUsingEncoding:NSUTF8StringEncoding]];
-        request.HTTPBody = body;
+        [request setValue:_body.contentType forHTTPHeaderField:@"Content-Type"];
+        if (_body.contentLength >= 0) {
+            [request setValue:[NSString stringWithFormat:@"%lld", _body.contentLength] forHTTPHeaderField:@"Content-Length"];
+        }
+        request.HTTPBodyStream = [_body bodyStream];
         
         _connection = [[NSURLConnection alloc] initWithRequest:request delegate:self startImmediately:NO];
-        [_connection scheduleInRunLoop:[NSRunLoop mainRunLoop] forMode:NSRunLoopCommonModes];
+        [_connection scheduleInRunLoop:[NSRunLoop currentRunLoop] forMode:NSRunLoopCommonModes];
         [_connection start];
     }];
     
@@ -210,7 +202,7 @@
 }
 
 - (void)cancel {
-    if (! [[NSThread currentThread] isEqual:_thread]) {
+    if ((! [[NSThread currentThread] isEqual:_thread]) && (! [_thread isCancelled])) {
         [self performSelector:@selector(cancel) onThread:_thread withObject:nil waitUntilDone:YES];
         return;
     }
@@ -237,94 +229,150 @@
 
 - (void)connection:(NSURLConnection *)connection didFailWithError:(NSError *)error {
     AIQLogCWarn(1, @"Message %@ failed: %@", _identifier, error.localizedDescription);
+    
+    // an attachment which could not be read while sending would fail the message on every retry
+    NSError *bodyError = _body.error;
+    if (bodyError) {
+        [_queue inDatabase:^(FMDatabase *db) {
+            [self rejectWithCause:bodyError.localizedDescription inDatabase:db];
+        }];
+    }
+    
     [self clean];
 }
 
+- (NSInputStream *)connection:(NSURLConnection *)connection needNewBodyStream:(NSURLRequest *)request {
+    return [_body bodyStream];
+}
+
 - (void)connection:(NSURLConnection *)connection didReceiveResponse:(NSURLResponse *)response {
     NSHTTPURLResponse *httpResponse = (NSHTTPURLResponse *)response;
     _statusCode = httpResponse.statusCode;
 }
 
 - (void)connectionDidFinishLoading:(NSURLConnection *)connection {
-    if (_statusCode == 202) {
-        AIQLogCInfo(1, @"Message %@ has been accepted", _identifier);
+    // a body cut short by an unreadable attachment must never be taken as accepted
+    NSError *bodyError = _body.error;
+    if (bodyError) {
+        AIQLogCWarn(1, @"Message %@ was sent incomplete: %@", _identifier, bodyError.localizedDescription);
         [_queue inDatabase:^(FMDatabase *db) {
-            if (_expectResponse) {
-                AIQLogCInfo(1, @"Message %@ expects a response, keeping the status", _identifier);
-                if (! [db executeUpdate:@"UPDATE comessages SET state = ?, response = ?, responseId = ? WHERE solution = ? AND identifier = ?",
-                       @(AIQMessageStateAccepted), nil, nil, _solution, _identifier]) {
-                    AIQLogCError(1, @"Could not update the state of message %@: %@", _identifier, [db lastError].localizedDescription);
-                }
-            } else {
-                AIQLogCInfo(1, @"Message %@ does not expect a response, removing the status", _identifier);
-                
-                if (! [db executeUpdate:@"DELETE FROM comessages WHERE solution = ? AND identifier = ?", _solution, _identifier]) {
-                    AIQLogCError(1, @"Could not delete message %@: %@", _identifier, [db lastError].localizedDescription);
-                }
-            }
-            
-            if (! [db executeUpdate:@"DELETE FROM coattachments WHERE solution = ? AND identifier = ?", _solution, _identifier]) {
-                AIQLogCError(1, @"Could not delete attachments of message %@: %@", _identifier, [db lastError].localizedDescription);
-            }
-            
-            NOTIFY(AIQDidAcceptMessageNotification, _synchronizer, (@{AIQDocumentIdUserInfoKey: _identifier,
-                                                                      AIQSolutionUserInfoKey: _solution,
-                                                                      AIQMessageDestinationUserInfoKey: _destination}));
+            [self rejectWithCause:bodyError.localizedDescription inDatabase:db];
         }];
-    } else if (_statusCode == 401) {
+        [self clean];
+        return;
+    }
+    
+    if (_statusCode == 401) {
         [connection cancel];
-        [connection unscheduleFromRunLoop:[NSRunLoop mainRunLoop] forMode:NSRunLoopCommonModes];
+        [connection unscheduleFromRunLoop:[NSRunLoop currentRunLoop] forMode:NSRunLoopCommonModes];
         [_queue close];
         [_synchronizer handleUnauthorized];
-    } else if (_statusCode == 503) {
-        AIQLogCWarn(1, @"Mobility platform unavailable for message %@", _identifier);
     } else {
-        AIQLogCInfo(1, @"Message %@ has been rejected: %ld", _identifier, (long)_statusCode);
-        NSString *cause = nil;
-        if (_statusCode == 400) {
-            cause = @"Malformed message";
-        } else if (_statusCode == 403) {
-            cause = @"Permission denied";
-        } else if (_statusCode == 404) {
-            cause = @"Invalid destination";
-        } else if (_statusCode == 413) {
-            cause = @"Message too big";
+        __block NSString *notification = nil;
+        [_queue inDatabase:^(FMDatabase *db) {
+            notification = [SendMessageOperation applyStatus:_statusCode
+                                             toMessageWithId:_identifier
+                                                    solution:_solution
+                                              expectResponse:_expectResponse
+                                                  inDatabase:db];
+        }];
+        
+        if (([notification isEqualToString:AIQDidRejectMessageNotification]) && (! _expectResponse)) {
+            [_synchronizer scheduleNextNotification];
+        }
+        
+        if (notification) {
+            NOTIFY(notification, _synchronizer, (@{AIQDocumentIdUserInfoKey: _identifier,
+                                                   AIQSolutionUserInfoKey: _solution,
+                                                   AIQMessageDestinationUserInfoKey: _destination}));
         }
+    }
+    
+    [self clean];
+}
 
-        [_queue inDatabase:^(FMDatabase *db) {
++ (NSString *)applyStatus:(NSInteger)status
+          toMessageWithId:(NSString *)identifier
+                 solution:(NSString *)solution
+           expectResponse:(BOOL)expectResponse
+               inDatabase:(FMDatabase *)db {
+    if ((status == 0) || (status == 503)) {
+        // left queued for the next push
+        AIQLogCWarn(1, @"Message %@ left queued, mobility platform unavailable: %ld", identifier, (long)status);
+        return nil;
+    }
+    
+    if (status == 202) {
+        AIQLogCInfo(1, @"Message %@ has been accepted", identifier);
+        if (expectResponse) {
+            AIQLogCInfo(1, @"Message %@ expects a response, keeping the status", identifier);
             if (! [db executeUpdate:@"UPDATE comessages SET state = ?, response = ?, responseId = ? WHERE solution = ? AND identifier = ?",
-                   @(AIQMessageStateRejected), cause, nil, _solution, _identifier]) {
-                AIQLogCError(1, @"Could not update the state of message %@: %@", _identifier, [db lastError].localizedDescription);
+                   @(AIQMessageStateAccepted), nil, nil, solution, identifier]) {
+                AIQLogCError(1, @"Could not update the state of message %@: %@", identifier, [db lastError].localizedDescription);
             }
-            
-            if (! [db executeUpdate:@"DELETE FROM coattachments WHERE solution = ? AND identifier = ?", _solution, _identifier]) {
-                AIQLogCError(1, @"Could not delete attachments of message %@: %@", _identifier, [db lastError].localizedDescription);
-            }
-            
-            if (! _expectResponse) {
-                long long timestamp = (long long)([[NSDate date] timeIntervalSince1970] * 1000.0);
-                if (! [db executeUpdate:@"INSERT OR REPLACE INTO somessages (solution, identifier, type, revision, created, activeFrom, timeToLive, read)"
-                       "VALUES (?, ?, ?, ?, ?, ?, ?, COALESCE((SELECT read FROM somessages WHERE identifier = ?), 0))",
-                       _solution, _identifier, @"_comessageresponse", @(timestamp), @(timestamp), @3600, @NO]) {
-                    AIQLogCError(1, @"Could not create a stub response for message %@: %@", _identifier, [db lastError].localizedDescription);
-                }
-                [_synchronizer scheduleNextNotification];
+        } else {
+            AIQLogCInfo(1, @"Message %@ does not expect a response, removing the status", identifier);
+            if (! [db executeUpdate:@"DELETE FROM comessages WHERE solution = ? AND identifier = ?", solution, identifier]) {
+                AIQLogCError(1, @"Could not delete message %@: %@", identifier, [db lastError].localizedDescription);
             }
-        }];
+        }
+        
+        if (! [db executeUpdate:@"DELETE FROM coattachments WHERE solution = ? AND identifier = ?", solution, identifier]) {
+            AIQLogCError(1, @"Could not delete attachments of message %@: %@", identifier, [db lastError].localizedDescription);
+        }
         
-        NOTIFY(AIQDidRejectMessageNotification, _synchronizer, (@{AIQDocumentIdUserInfoKey: _identifier,
-                                                                  AIQSolutionUserInfoKey: _solution,
-                                                                  AIQMessageDestinationUserInfoKey: _destination}));
+        return AIQDidAcceptMessageNotification;
     }
     
-    [self clean];
+    AIQLogCInfo(1, @"Message %@ has been rejected: %ld", identifier, (long)status);
+    NSString *cause = nil;
+    if (status == 400) {
+        cause = @"Malformed message";
+    } else if (status == 403) {
+        cause = @"Permission denied";
+    } else if (status == 404) {
+        cause = @"Invalid destination";
+    } else if (status == 413) {
+        cause = @"Message too big";
+    }
+    
+    if (! [db executeUpdate:@"UPDATE comessages SET state = ?, response = ?, responseId = ? WHERE solution = ? AND identifier = ?",
+           @(AIQMessageStateRejected), cause, nil, solution, identifier]) {
+        AIQLogCError(1, @"Could not update the state of message %@: %@", identifier, [db lastError].localizedDescription);
+    }
+    
+    if (! [db executeUpdate:@"DELETE FROM coattachments WHERE solution = ? AND identifier = ?", solution, identifier]) {
+        AIQLogCError(1, @"Could not delete attachments of message %@: %@", identifier, [db lastError].localizedDescription);
+    }
+    
+    if (! expectResponse) {
+        // the stub response expires the rejected message after an hour
+        long long timestamp = (long long)([[NSDate date] timeIntervalSince1970] * 1000.0);
+        if (! [db executeUpdate:@"INSERT OR REPLACE INTO somessages (solution, identifier, type, revision, created, activeFrom, timeToLive, read) "
+               "VALUES (?, ?, ?, ?, ?, ?, ?, COALESCE((SELECT read FROM somessages WHERE identifier = ?), 0))",
+               solution, identifier, @"_comessageresponse", @(timestamp), @(timestamp), @(timestamp), @3600, identifier]) {
+            AIQLogCError(1, @"Could not create a stub response for message %@: %@", identifier, [db lastError].localizedDescription);
+        }
+    }
+    
+    return AIQDidRejectMessageNotification;
 }
 
 #pragma mark - Private API
 
+- (void)rejectWithCause:(NSString *)cause inDatabase:(FMDatabase *)db {
+    if (! [db executeUpdate:@"UPDATE comessages SET state = ?, response = ?, responseId = ? WHERE solution = ? AND identifier = ?",
+           @(AIQMessageStateRejected), cause, nil, _solution, _identifier]) {
+        AIQLogCError(1, @"Could not update the state of message %@: %@", _identifier, [db lastError].localizedDescription);
+    }
+    NOTIFY(AIQDidRejectMessageNotification, _synchronizer, (@{AIQDocumentIdUserInfoKey: _identifier,
+                                                              AIQSolutionUserInfoKey: _solution,
+                                                              AIQMessageDestinationUserInfoKey: _destination}));
+}
+
 - (void)clean {
     if (_connection) {
-        [_connection unscheduleFromRunLoop:[NSRunLoop mainRunLoop] forMode:NSRunLoopCommonModes];
+        [_connection unscheduleFromRunLoop:[NSRunLoop currentRunLoop] forMode:NSRunLoopCommonModes];
         _connection = nil;
     }
     